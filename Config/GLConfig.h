@@ -39,6 +39,12 @@
         #include <OpenGL/glext.h>
     #endif
 
+#elif defined(__linux__)
+    // Mesa headers, for headless builds with HL_GL_SHIM
+    #define GL_GLEXT_PROTOTYPES
+    #include <GL/gl.h>
+    #include <GL/glext.h>
+
 #else
     #error "Unsupported platform"
     // TODO: Android
@@ -124,13 +130,28 @@
     #define GL_MIN GL_MIN_EXT
     #define GL_MAX GL_MAX_EXT
 
-#else
+#elif defined(CL_OSX)
     #ifndef CL_USE_GL3
         #define glBindVertexArray glBindVertexArrayAPPLE
         #define glGenVertexArrays glGenVertexArraysAPPLE
         #define glGenerateMipmap glGenerateMipmapEXT
         #define glDeleteVertexArrays glDeleteVertexArraysAPPLE
+
+        #define glVertexAttribDivisor glVertexAttribDivisorARB
+        #define glDrawElementsInstanced glDrawElementsInstancedARB
     #endif
 #endif
 
+// Instanced drawing is core in GL 3.3, and available via ARB_instanced_arrays
+// on older desktop GL. GLES2 targets fall back to drawing instances one by one.
+#ifndef CL_GLES
+    #define CL_GL_INSTANCING
+#endif
+
+// HL_GL_SHIM sends HL's GL calls through a swappable table, so they can be
+// recorded rather than executed. See HLGLShim.h.
+#ifdef HL_GL_SHIM
+    #include <HLGLShim.h>
+#endif
+
 #endif
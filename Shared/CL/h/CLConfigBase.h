@@ -18,6 +18,7 @@
 //  CL_HAS_VSNPRINTF    - has the vsnprintf call
 //  CL_LITTLE_ENDIAN    - Define if on a little-endian machine (Intel).
 //  CL_BIG_ENDIAN       - Define if on a big-endian machine (PowerPC/Mips).
+//  CL_HASH_VERSION     - Selects the default string hash, see CLHash.h. Tag IDs always use FNV1a.
 //
 //  CL_IOS
 //  CL_OSX
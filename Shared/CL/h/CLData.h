@@ -177,7 +177,7 @@ namespace nCL
     { 
         if (mOffset == kNullDataOffset)
         {
-            mOffset = s->Allocate(sizeof(T), 0);
+            mOffset = s->Allocate(sizeof(T), alignof(T));
             new (s->Data(mOffset)) T(value);
         }
         else
@@ -214,14 +214,15 @@ namespace nCL
         }
         else if (numElts == mNumElts)
         {
-            T* data = s->Data(mOffset);
+            T* data = (T*) s->Data(mOffset);
             for (int i = 0; i < numElts; i++)
                 data[i] = elts[i];
         }
         else
         {
-            mOffset = s->Allocate(sizeof(T) * numElts, 0);
-            T* data = s->Data(mOffset);
+            mNumElts = numElts;
+            mOffset = s->Allocate(sizeof(T) * numElts, alignof(T));
+            T* data = (T*) s->Data(mOffset);
 
             for (int i = 0; i < numElts; i++)
                 new(data++) T(elts[i]);
@@ -1,7 +1,7 @@
 //
 //  File:       CLDispatch.h
 //
-//  Function:   Helpers for dispatch.h job API
+//  Function:   Work-stealing job system
 //
 //  Author(s):  Andrew Willmott
 //
@@ -11,13 +11,89 @@
 #ifndef CL_DISPATCH_H
 #define CL_DISPATCH_H
 
+#include <CLDefs.h>
+
+#include <atomic>
+
 namespace nCL
 {
+    class cIAllocator;
+
+    typedef void tJobFunc     (void* data, int index);              ///< Job entry point. 'index' is the job's index within an AddJobs() batch.
+    typedef void tJobRangeFunc(void* data, int begin, int end);     ///< ParallelFor entry point, called for [begin, end) ranges.
+
+    struct cJobCounter
+    /// Tracks completion of a set of jobs. Pass to AddJob()/AddJobs(), and then
+    /// call WaitForJobs() on it. Must outlive the jobs it is tracking.
+    {
+        std::atomic<int32_t> mCount;
+
+        cJobCounter() : mCount(0) {}
+
+        bool Done() const;      ///< Returns true if all jobs added against this counter have completed.
+    };
+
+    const int kMaxJobThreads = 32;
+
+    bool InitJobs(cIAllocator* alloc, int numThreads = -1);
+    ///< Start up the job system with the given number of threads, including the
+    ///< calling thread, which is considered the main thread. Pass -1 to use
+    ///< one thread per available core.
+    bool ShutdownJobs();
+    ///< Waits for outstanding jobs and stops all worker threads.
+
+    int  NumJobThreads();   ///< Returns number of threads running jobs, including the main thread. Returns 1 if the job system isn't running.
+    int  JobThreadIndex();  ///< Returns 0 for the main thread, [1, NumJobThreads()) for workers, and -1 for threads outside the job system.
+
+    void AddJob (tJobFunc* f, void* data, cJobCounter* counter = 0);
+    ///< Queue f(data, 0) to run on any job thread. Jobs added from threads
+    ///< outside the job system, or when the job system isn't running, are run immediately.
+    void AddJobs(int count, tJobFunc* f, void* data, cJobCounter* counter = 0);
+    ///< Queue f(data, i) for i in [0, count).
+    void WaitForJobs(cJobCounter* counter);
+    ///< Waits for all jobs against 'counter' to complete. The calling thread
+    ///< runs other pending jobs while waiting.
+
+    void AddMainThreadJob(tJobFunc* f, void* data, cJobCounter* counter = 0);
+    ///< Queue f(data, 0) to run on the main thread, the next time it calls RunMainThreadJobs().
+    ///< Can be called from any thread.
+    int  RunMainThreadJobs();
+    ///< Run all jobs queued via AddMainThreadJob. Returns the number run. Must be called from the main thread.
+
+    void ParallelFor(int count, int grain, tJobRangeFunc* f, void* data);
+    ///< Calls f(data, begin, end) over [0, count) in chunks of size 'grain',
+    ///< spread across job threads. Returns once all chunks have completed.
+    template<class T_F> void ParallelFor(int count, int grain, const T_F& f);
+    ///< Version of the above for lambdas/functors taking (int begin, int end).
+
+    struct cJobStats
+    {
+        int mJobsRun   [kMaxJobThreads];    ///< Jobs run on each thread since the last ResetJobStats()
+        int mJobsStolen[kMaxJobThreads];    ///< Of which, jobs stolen from other threads
+    };
+    void GetJobStats(cJobStats* stats);
+    void ResetJobStats();
+
 
+    // --- Inlines -------------------------------------------------------------
 
-    void DispatchTest();
-};
+    inline bool cJobCounter::Done() const
+    {
+        return mCount.load(std::memory_order_acquire) == 0;
+    }
 
+    template<class T_F> inline void ParallelFor(int count, int grain, const T_F& f)
+    {
+        struct cThunk
+        {
+            static void Run(void* data, int begin, int end)
+            {
+                (*(const T_F*) data)(begin, end);
+            }
+        };
 
+        ParallelFor(count, grain, cThunk::Run, (void*) &f);
+    }
+}
 
 #endif
@@ -1,7 +1,7 @@
 //
 //  File:       CLFIFO.h
 //
-//  Function:   Classic lockless FIFO for inter-thread communication
+//  Function:   Classic lockless FIFOs for inter-thread communication
 //
 //  Author(s):  Andrew Willmott
 //
@@ -14,13 +14,16 @@
 #include <CLBits.h>
 #include <CLMemory.h>
 
-#if defined(CL_IOS) || defined (CL_OSX)
-    #include <libKern/OSAtomic.h>
-#endif
+#include <atomic>
+#include <new>
 
 namespace nCL
 {
+    const int kFIFOCacheLineSize = 64;  ///< Alignment used to keep reader and writer state on separate cache lines
+
     template <class T> class cFIFO
+    /// Single-producer/single-consumer FIFO. One thread may write, and one
+    /// (other) thread may read, without locking.
     {
     public:
         cFIFO() = default;
@@ -34,6 +37,9 @@ namespace nCL
         bool Write(const T& item);  ///< Write the given item -- returns false if the fifo is full.
         bool Read (T* item);        ///< Read next available item into 'item', or returns false if none exists.
 
+        int  WriteN(int count, const T items[]);    ///< Write up to 'count' items, returns the number written.
+        int  ReadN (int count, T items[]);          ///< Read up to 'count' items, returns the number read.
+
         // Lower-level API
         T*       NextWriteItem();   ///< Returns a pointer to space to write the next item, or 0 if the fifo is full
         const T* NextReadItem();    ///< Returns a pointer to the next item available for reading, or 0 if none.
@@ -44,24 +50,75 @@ namespace nCL
     protected:
         T*                  mBuffer = 0;
         cIAllocator*        mAllocator = 0;
+        uint32_t            mMask = 0;
+
+        // Writer-owned. mReadCache is the writer's last view of mReadIndex, to avoid touching the reader's line
+        alignas(kFIFOCacheLineSize) std::atomic<uint32_t> mWriteIndex { 0 };
+        uint32_t            mReadCache = 0;
 
-        volatile int32_t    mReadIndex  = 0;
-        volatile int32_t    mWriteIndex = 0;
-        int32_t             mMask = 0;
+        // Reader-owned. Ditto.
+        alignas(kFIFOCacheLineSize) std::atomic<uint32_t> mReadIndex { 0 };
+        uint32_t            mWriteCache = 0;
     };
 
+    template <class T> class cMPMCFIFO
+    /// Bounded multi-producer/multi-consumer FIFO. Any number of threads may
+    /// read and write without locking. Each slot carries a sequence number
+    /// that says whether it's ready to be written or read for a given lap
+    /// around the ring, so producers and consumers only contend on their
+    /// respective index.
+    {
+    public:
+        cMPMCFIFO() = default;
+        cMPMCFIFO(uint32_t maxSize, nCL::cIAllocator* alloc);
+        ~cMPMCFIFO();
+
+        void Resize(uint32_t maxSize, nCL::cIAllocator* alloc);   ///< Do not call while fifo is in active use
+        void Clear();   ///< Do not call while fifo is in active use
+        int  Size();    ///< Approximate number of items in the queue -- may be out of date by the time it returns.
+
+        bool Write(const T& item);  ///< Write the given item -- returns false if the fifo is full.
+        bool Read (T* item);        ///< Read next available item into 'item', or returns false if none exists.
+
+        int  WriteN(int count, const T items[]);    ///< Write up to 'count' items as a contiguous block, returns the number written.
+        int  ReadN (int count, T items[]);          ///< Read up to 'count' items as a contiguous block, returns the number read.
+
+    protected:
+        struct cCell
+        {
+            std::atomic<uint32_t> mSequence;
+            T                     mItem;
+        };
+
+        void DestroyCells();
+
+        cCell*              mCells = 0;
+        cIAllocator*        mAllocator = 0;
+        uint32_t            mMask = 0;
+
+        alignas(kFIFOCacheLineSize) std::atomic<uint32_t> mWriteIndex { 0 };
+        alignas(kFIFOCacheLineSize) std::atomic<uint32_t> mReadIndex  { 0 };
+    };
+
+#ifndef CL_RELEASE
+    bool TestFIFOs();   ///< Multi-threaded stress test of cFIFO/cMPMCFIFO. Returns false on failure.
+    void BenchFIFOs();  ///< Prints throughput of cFIFO/cMPMCFIFO by thread count.
+#endif
 
 
     // --- Inlines -------------------------------------------------------------
 
+    // cFIFO
+
+    // Indices are kept in [0, size). The writer publishes with a release store
+    // of mWriteIndex, which the reader picks up with an acquire load before
+    // touching the item, and vice versa for freeing up space.
+
     template<class T> inline cFIFO<T>::cFIFO(uint32_t maxSize, nCL::cIAllocator* alloc)
     {
-        maxSize = CeilPow2(maxSize);
-
-        mBuffer = CreateArray<T>(alloc, maxSize);
-        mMask = maxSize - 1;
+        Resize(maxSize, alloc);
     }
-    
+
     template<class T> inline cFIFO<T>::~cFIFO()
     {
         Destroy(&mBuffer, mAllocator);
@@ -69,27 +126,30 @@ namespace nCL
 
     template<class T> inline void cFIFO<T>::Resize(uint32_t maxSize, nCL::cIAllocator* alloc)
     {
-        CL_ASSERT(mReadIndex == mWriteIndex);
+        CL_ASSERT(mReadIndex.load() == mWriteIndex.load());
 
         Destroy(&mBuffer, mAllocator);
 
         maxSize = CeilPow2(maxSize);
 
         mBuffer = CreateArray<T>(alloc, maxSize);
+        mAllocator = alloc;
         mMask = maxSize - 1;
-        mReadIndex = 0;
-        mWriteIndex = 0;
+
+        Clear();
     }
-    
+
     template<class T> inline void cFIFO<T>::Clear()
     {
-        mReadIndex = 0;
-        mWriteIndex = 0;
+        mReadIndex .store(0, std::memory_order_relaxed);
+        mWriteIndex.store(0, std::memory_order_relaxed);
+        mReadCache  = 0;
+        mWriteCache = 0;
     }
 
     template<class T> inline int cFIFO<T>::Size()
     {
-        return (mWriteIndex - mReadIndex) & mMask;
+        return (mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_acquire)) & mMask;
     }
 
     template<class T> inline bool cFIFO<T>::Write(const T& item)
@@ -120,44 +180,269 @@ namespace nCL
         return false;
     }
 
+    template<class T> int cFIFO<T>::WriteN(int count, const T items[])
+    {
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        uint32_t space = (mReadCache - writeIndex - 1) & mMask;
+
+        if (space < uint32_t(count))
+        {
+            mReadCache = mReadIndex.load(std::memory_order_acquire);
+            space = (mReadCache - writeIndex - 1) & mMask;
+        }
+
+        if (uint32_t(count) > space)
+            count = space;
+
+        for (int i = 0; i < count; i++)
+            mBuffer[(writeIndex + i) & mMask] = items[i];
+
+        mWriteIndex.store((writeIndex + count) & mMask, std::memory_order_release);
+
+        return count;
+    }
+
+    template<class T> int cFIFO<T>::ReadN(int count, T items[])
+    {
+        uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+        uint32_t avail = (mWriteCache - readIndex) & mMask;
+
+        if (avail < uint32_t(count))
+        {
+            mWriteCache = mWriteIndex.load(std::memory_order_acquire);
+            avail = (mWriteCache - readIndex) & mMask;
+        }
+
+        if (uint32_t(count) > avail)
+            count = avail;
+
+        for (int i = 0; i < count; i++)
+            items[i] = mBuffer[(readIndex + i) & mMask];
+
+        mReadIndex.store((readIndex + count) & mMask, std::memory_order_release);
+
+        return count;
+    }
+
     template<class T> inline T* cFIFO<T>::NextWriteItem()
     {
-        uint32_t nextWriteIndex = (mWriteIndex + 1) & mMask;
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        uint32_t nextWriteIndex = (writeIndex + 1) & mMask;
+
+        if (nextWriteIndex == mReadCache)
+        {
+            mReadCache = mReadIndex.load(std::memory_order_acquire);
 
-        if (nextWriteIndex == mReadIndex)
-            return 0;
+            if (nextWriteIndex == mReadCache)
+                return 0;
+        }
 
-        return mBuffer + mWriteIndex;
+        return mBuffer + writeIndex;
     }
-    
+
     template<class T> inline const T* cFIFO<T>::NextReadItem()
     {
-        if (mReadIndex == mWriteIndex)
-            return 0;
+        uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+
+        if (readIndex == mWriteCache)
+        {
+            mWriteCache = mWriteIndex.load(std::memory_order_acquire);
 
-        return mBuffer + mReadIndex;
+            if (readIndex == mWriteCache)
+                return 0;
+        }
+
+        return mBuffer + readIndex;
     }
-    
+
     template<class T> inline void cFIFO<T>::CommitWrite()
     {
-    #if defined(CL_IOS) || defined (CL_OSX)
-        // We're not doing a 'real' CAS here, rather this is to force a memory barrier in cross-CPU way
-        OSAtomicCompareAndSwap32(mWriteIndex, (mWriteIndex + 1) & mMask, &mWriteIndex);
-    #else
-        // Assume we're on strongly ordered CPU. (I.e., x86, *not* ARM or PPC.)
-        mWriteIndex = (mWriteIndex + 1) & mMask;
-    #endif
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        mWriteIndex.store((writeIndex + 1) & mMask, std::memory_order_release);
     }
 
     template<class T> inline void cFIFO<T>::CommitRead()
     {
-    #if defined(CL_IOS) || defined (CL_OSX)
-        // We're not doing a 'real' CAS here, rather this is to force a memory barrier in cross-CPU way
-        OSAtomicCompareAndSwap32(mReadIndex,  (mReadIndex  + 1) & mMask, &mReadIndex);
-    #else
-        // Assume we're on strongly ordered CPU. (I.e., x86, *not* ARM or PPC.)
-        mReadIndex = (mReadIndex + 1) & mMask;
-    #endif
+        uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+        mReadIndex.store((readIndex + 1) & mMask, std::memory_order_release);
+    }
+
+
+    // cMPMCFIFO
+
+    // Indices increase monotonically and wrap at 2^32, which is fine as the
+    // size is a power of two. Slot i is free for the write at index w when its
+    // sequence is w, and holds an item for the read at index r when its
+    // sequence is r + 1. Reading sets it to r + size, freeing it for the next lap.
+
+    template<class T> inline cMPMCFIFO<T>::cMPMCFIFO(uint32_t maxSize, nCL::cIAllocator* alloc)
+    {
+        Resize(maxSize, alloc);
+    }
+
+    template<class T> inline cMPMCFIFO<T>::~cMPMCFIFO()
+    {
+        DestroyCells();
+    }
+
+    template<class T> inline void cMPMCFIFO<T>::Resize(uint32_t maxSize, nCL::cIAllocator* alloc)
+    {
+        DestroyCells();
+
+        maxSize = CeilPow2(maxSize);
+
+        mCells = CreateArray<cCell>(alloc, maxSize);
+        mAllocator = alloc;
+        mMask = maxSize - 1;
+
+        for (uint32_t i = 0; i < maxSize; i++)
+        {
+            ::new(&mCells[i]) cCell;
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+        }
+
+        mWriteIndex.store(0, std::memory_order_relaxed);
+        mReadIndex .store(0, std::memory_order_relaxed);
+    }
+
+    template<class T> inline void cMPMCFIFO<T>::DestroyCells()
+    {
+        if (!mCells)
+            return;
+
+        for (uint32_t i = 0; i <= mMask; i++)
+            mCells[i].~cCell();
+
+        if (mAllocator)
+            mAllocator->Free(mCells);
+
+        mCells = 0;
+    }
+
+    template<class T> inline void cMPMCFIFO<T>::Clear()
+    {
+        if (!mCells)
+            return;
+
+        for (uint32_t i = 0; i <= mMask; i++)
+            mCells[i].mSequence.store(i, std::memory_order_relaxed);
+
+        mWriteIndex.store(0, std::memory_order_relaxed);
+        mReadIndex .store(0, std::memory_order_relaxed);
+    }
+
+    template<class T> inline int cMPMCFIFO<T>::Size()
+    {
+        int32_t size = int32_t(mWriteIndex.load(std::memory_order_relaxed) - mReadIndex.load(std::memory_order_relaxed));
+        return size < 0 ? 0 : size;
+    }
+
+    template<class T> inline bool cMPMCFIFO<T>::Write(const T& item)
+    {
+        return WriteN(1, &item) == 1;
+    }
+
+    template<class T> inline bool cMPMCFIFO<T>::Read(T* item)
+    {
+        return ReadN(1, item) == 1;
+    }
+
+    template<class T> int cMPMCFIFO<T>::WriteN(int count, const T items[])
+    {
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        int free;
+
+        for (;;)
+        {
+            // Count the run of free slots from writeIndex. Once we've claimed
+            // them via the CAS, no-one else can touch them until we publish.
+            free = 0;
+            bool retry = false;
+
+            while (free < count)
+            {
+                uint32_t seq = mCells[(writeIndex + free) & mMask].mSequence.load(std::memory_order_acquire);
+                int32_t diff = int32_t(seq - (writeIndex + free));
+
+                if (diff != 0)
+                {
+                    retry = (free == 0 && diff > 0);    // another writer got here first, catch up
+                    break;                              // otherwise full, or a reader hasn't finished with the slot yet
+                }
+
+                free++;
+            }
+
+            if (retry)
+            {
+                writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (free == 0)
+                return 0;
+
+            if (mWriteIndex.compare_exchange_weak(writeIndex, writeIndex + free, std::memory_order_relaxed))
+                break;
+        }
+
+        for (int i = 0; i < free; i++)
+        {
+            cCell* cell = mCells + ((writeIndex + i) & mMask);
+
+            cell->mItem = items[i];
+            cell->mSequence.store(writeIndex + i + 1, std::memory_order_release);
+        }
+
+        return free;
+    }
+
+    template<class T> int cMPMCFIFO<T>::ReadN(int count, T items[])
+    {
+        uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+        int avail;
+
+        for (;;)
+        {
+            avail = 0;
+            bool retry = false;
+
+            while (avail < count)
+            {
+                uint32_t seq = mCells[(readIndex + avail) & mMask].mSequence.load(std::memory_order_acquire);
+                int32_t diff = int32_t(seq - (readIndex + avail + 1));
+
+                if (diff != 0)
+                {
+                    retry = (avail == 0 && diff > 0);    // another reader got here first, catch up
+                    break;                              // otherwise empty, or a writer hasn't finished with the slot yet
+                }
+
+                avail++;
+            }
+
+            if (retry)
+            {
+                readIndex = mReadIndex.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (avail == 0)
+                return 0;
+
+            if (mReadIndex.compare_exchange_weak(readIndex, readIndex + avail, std::memory_order_relaxed))
+                break;
+        }
+
+        for (int i = 0; i < avail; i++)
+        {
+            cCell* cell = mCells + ((readIndex + i) & mMask);
+
+            items[i] = cell->mItem;
+            cell->mSequence.store(readIndex + i + mMask + 1, std::memory_order_release);
+        }
+
+        return avail;
     }
 }
 
@@ -12,9 +12,11 @@
 #define CL_FILE_WATCH_H
 
 #include <CLFileSpec.h>
+#include <CLHashMap.h>
 #include <CLSTL.h>
 #include <CLString.h>
 #include <CLTag.h>
+#include <CLTimer.h>
 
 namespace
 {
@@ -26,6 +28,9 @@ namespace nCL
     struct cFileSpec;
 
     struct cFileWatcher
+    /// Reports changes to watched files. Uses inotify on Linux and kqueue elsewhere.
+    /// Changes are held until none have arrived for the debounce time, so an editor
+    /// saving many files at once results in one batch.
     {
         cFileWatcher();
         ~cFileWatcher();
@@ -34,10 +39,10 @@ namespace nCL
         bool Shutdown();
 
         int  AddFile     (const char* filePath);    ///< Begins watching given file, returns handle to it.
-        int  AddDirectory(const char* dirPath);     ///< Begins watching given directory and all contained files.
+        int  AddDirectory(const char* dirPath);     ///< Begins watching given directory and all contained files and subdirectories.
 
         int  AddFileID     (tStringID filePath);    ///< Begins watching given file, returns handle to it.
-        int  AddDirectoryID(tStringID dirPath);     ///< Begins watching given directory and all contained files.
+        int  AddDirectoryID(tStringID dirPath);     ///< Begins watching given directory and all contained files and subdirectories.
 
         bool FilesChanged
         (
@@ -46,13 +51,26 @@ namespace nCL
             vector<int>* removedFiles  = 0
         );
         ///< Checks for changes since the last call, and optionally fills in details of which files/directories have changed.
+        ///< Each file is reported at most once per list.
+
+        void SetDebounceTime(float seconds);        ///< Sets how long changes must settle before being reported. Defaults to 0.1s.
 
         tStringID   PathIDForRef(int ref);
         const char* PathForRef(int ref);
 
 
     protected:
+        enum tPendingFlags : uint8_t
+        {
+            kPendingChanged = 1,
+            kPendingAdded   = 2,
+            kPendingRemoved = 4
+        };
+
         // Utils
+        bool ReadEvents();  ///< Gathers any outstanding events from the OS via AddPending(). Returns true if there were any.
+        void AddPending(int ref, tPendingFlags flag);
+
         bool CheckForDirectoryChanges
         (
             cDirectoryInfo* dirInfo,
@@ -63,12 +81,21 @@ namespace nCL
         // Data
         cFileWatchInternal* mInternal = 0;
 
-        map<int, tStringID> mRefToPath;
-        map<tStringID, int> mPathToRef;
+        hash_map<int, tStringID> mRefToPath;
+        tag_hash_map<int>        mPathToRef;
 
         map<int, cDirectoryInfo> mRefToDirectoryInfo;
+
+        hash_map<int, uint8_t>   mPending;          ///< tPendingFlags for each file changed in the current batch
+        bool                     mHavePending = false;
+        float                    mDebounceTime = 0.1f;
+        cWallClockTimer          mSinceLastEvent;
     };
 
+#ifndef CL_RELEASE
+    bool TestFileWatcher(int numFiles);
+    ///< Creates and modifies 'numFiles' files in a scratch directory, and checks each step is reported as a single batch. Returns false on failure.
+#endif
 
 
     // --- Inlines -------------------------------------------------------------
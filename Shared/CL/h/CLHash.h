@@ -13,6 +13,15 @@
 
 #include <CLDefs.h>
 #include <ctype.h>  // for tolower()
+#include <string.h>
+
+#ifndef CL_HASH_VERSION
+    #define CL_HASH_VERSION 1
+    // Selects the hash behind HashU32/StrHashU32 etc.
+    // 1: FNV-1a, one byte at a time.
+    // 2: WyHash, eight bytes at a time.
+    // Tag IDs are always FNV-1a, see NameToID(), as they can be stored in data.
+#endif
 
 namespace nCL
 {
@@ -21,21 +30,46 @@ namespace nCL
 
     uint32_t HashU32 (const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue = kFNVOffset32);
     ///< Hash byte-based data to a 32-bit value. 'hashValue' can be used to chain hashes: HashU32(data1, HashU32(data2)), etc.
-    ///< This is currently the FNV1a hash.
-    uint32_t IHashU32(const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue = kFNVOffset32);    ///< Case-insensitive version of HashU32
+    ///< This is WyHash or FNV1a, according to CL_HASH_VERSION.
+    uint32_t IHashU32(const char* data, const char* dataEnd, uint32_t hashValue = kFNVOffset32);  ///< Case-insensitive version of HashU32
 
     uint32_t StrHashU32 (const char* s, uint32_t hashValue = kFNVOffset32); ///< Basic string hash. 'hashValue' can be used to chain hashes.
     uint32_t StrIHashU32(const char* s, uint32_t hashValue = kFNVOffset32); ///< Case insensitive version of StrHashU32.
 
     uint64_t HashU64    (const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue = kFNVOffset64);
-    uint64_t IHashU64   (const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue = kFNVOffset64);
+    uint64_t IHashU64   (const char* data, const char* dataEnd, uint64_t hashValue = kFNVOffset64);
     uint64_t StrHashU64 (const char* s, uint64_t hashValue = kFNVOffset64);
     uint64_t StrIHashU64(const char* s, uint64_t hashValue = kFNVOffset64);
 
+    void StrHashU32s (int count, const char* const strings[], uint32_t hashes[], uint32_t hashValue = kFNVOffset32);
+    ///< Sets hashes[i] = StrHashU32(strings[i], hashValue), more cheaply than calling StrHashU32 'count' times.
+    void StrIHashU32s(int count, const char* const strings[], uint32_t hashes[], uint32_t hashValue = kFNVOffset32);
+    ///< Sets hashes[i] = StrIHashU32(strings[i], hashValue).
+
+    // Specific hashes, for when the result must not depend on CL_HASH_VERSION
+    uint32_t FNVHashU32    (const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue = kFNVOffset32);
+    uint32_t FNVIHashU32   (const char* data, const char* dataEnd, uint32_t hashValue = kFNVOffset32);
+    uint32_t StrFNVHashU32 (const char* s, uint32_t hashValue = kFNVOffset32);
+    uint32_t StrFNVIHashU32(const char* s, uint32_t hashValue = kFNVOffset32);
+
+    uint64_t FNVHashU64    (const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue = kFNVOffset64);
+    uint64_t FNVIHashU64   (const char* data, const char* dataEnd, uint64_t hashValue = kFNVOffset64);
+    uint64_t StrFNVHashU64 (const char* s, uint64_t hashValue = kFNVOffset64);
+    uint64_t StrFNVIHashU64(const char* s, uint64_t hashValue = kFNVOffset64);
+
+    uint64_t WyHashU64 (const uint8_t* data, size_t size, uint64_t seed = 0);
+    ///< WyHash (see https://github.com/wangyi-fudan/wyhash), which reads eight bytes at a time.
+    uint64_t WyIHashU64(const char* data, size_t size, uint64_t seed = 0);
+    ///< Case-insensitive version of WyHashU64. Only folds ASCII letters, like tolower() in the C locale.
+    uint32_t StrWyHashU32(const char* s, uint32_t hashValue = kFNVOffset32);
+    ///< WyHash of a C string, for hashes that are never stored, e.g., hash table and interning buckets.
+
 
     // CRC
     uint32_t CRC32      (const uint8_t* data, size_t size, uint32_t crc = 0);   ///< Standard CRC, matches gzip/crc32. 'crc' can be used for chaining.
     uint32_t CRC32Nibble(const uint8_t* data, size_t size, uint32_t crc = 0);   ///< Variant that puts less pressure on cache -- use in mixed data situations.
+    uint32_t CRC32C     (const uint8_t* data, size_t size, uint32_t crc = 0);
+    ///< Castagnoli CRC, as used by iSCSI/ext4. Not compatible with CRC32, but uses the SSE4.2 crc32 instruction where available, so is the better choice when the result stays internal.
 
     // MD5 (See http://www.ietf.org/rfc/rfc1321.txt)
     void MD5(const uint8_t* data, size_t size, uint8_t hash[16]);
@@ -45,6 +79,13 @@ namespace nCL
 
     uint32_t MurmurHash3(uint32_t);
 
+#ifndef CL_RELEASE
+    bool TestHashes();
+    ///< Checks the hash and CRC variants against each other and known values. Returns false on failure.
+    void BenchHashes(int count, const char* const strings[]);
+    ///< Reports throughput of the hash and CRC functions, and the number of tag ID collisions amongst the given strings under each hash.
+#endif
+
 
     // --- Inlines -------------------------------------------------------------
 
@@ -52,7 +93,7 @@ namespace nCL
 
     const uint32_t kFNVPrime32 = 0x01000193;    // 0x0100 0193
 
-    inline uint32_t HashU32(const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue)
+    inline uint32_t FNVHashU32(const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue)
     {
         for ( ; data < dataEnd; data++)
             hashValue = (hashValue ^ (*data)) * kFNVPrime32;
@@ -60,15 +101,15 @@ namespace nCL
         return hashValue;
     }
 
-    inline uint32_t IHashU32(const char* data, const char* dataEnd, uint32_t hashValue)
+    inline uint32_t FNVIHashU32(const char* data, const char* dataEnd, uint32_t hashValue)
     {
         for ( ; data < dataEnd; data++)
-            hashValue = (hashValue ^ tolower(*data)) * kFNVPrime32;
+            hashValue = (hashValue ^ tolower(uint8_t(*data))) * kFNVPrime32;
 
         return hashValue;
     }
 
-    inline uint32_t StrHashU32(const char* s, uint32_t hashValue)
+    inline uint32_t StrFNVHashU32(const char* s, uint32_t hashValue)
     {
         const uint8_t* data = (const uint8_t*) s;
         uint32_t c;
@@ -79,7 +120,7 @@ namespace nCL
         return hashValue;
     }
 
-    inline uint32_t StrIHashU32(const char* s, uint32_t hashValue)
+    inline uint32_t StrFNVIHashU32(const char* s, uint32_t hashValue)
     {
         const uint8_t* data = (const uint8_t*) s;
         uint32_t c;
@@ -92,7 +133,7 @@ namespace nCL
 
     const uint64_t kFNVPrime64 = 0x00000100000001B3;    // 0x0000 0100 0000 01B3
 
-    inline uint64_t HashU64(const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue)
+    inline uint64_t FNVHashU64(const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue)
     {
         for ( ; data < dataEnd; data++)
             hashValue = (hashValue ^ (*data)) * kFNVPrime64;
@@ -100,15 +141,15 @@ namespace nCL
         return hashValue;
     }
 
-    inline uint64_t IHashU64(const char* data, const char* dataEnd, uint64_t hashValue)
+    inline uint64_t FNVIHashU64(const char* data, const char* dataEnd, uint64_t hashValue)
     {
         for ( ; data < dataEnd; data++)
-            hashValue = (hashValue ^ tolower(*data)) * kFNVPrime64;
+            hashValue = (hashValue ^ tolower(uint8_t(*data))) * kFNVPrime64;
 
         return hashValue;
     }
 
-    inline uint64_t StrHashU64(const char* s, uint64_t hashValue)
+    inline uint64_t StrFNVHashU64(const char* s, uint64_t hashValue)
     {
         const uint8_t* data = (const uint8_t*) s;
         uint64_t c;
@@ -119,7 +160,7 @@ namespace nCL
         return hashValue;
     }
 
-    inline uint64_t StrIHashU64(const char* s, uint64_t hashValue)
+    inline uint64_t StrFNVIHashU64(const char* s, uint64_t hashValue)
     {
         const uint8_t* data = (const uint8_t*) s;
         uint64_t c;
@@ -130,6 +171,93 @@ namespace nCL
         return hashValue;
     }
 
+    inline uint32_t StrWyHashU32(const char* s, uint32_t hashValue)
+    {
+        return uint32_t(WyHashU64((const uint8_t*) s, strlen(s), hashValue));
+    }
+
+#if CL_HASH_VERSION >= 2
+    inline uint32_t HashU32(const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue)
+    {
+        return uint32_t(WyHashU64(data, dataEnd - data, hashValue));
+    }
+
+    inline uint32_t IHashU32(const char* data, const char* dataEnd, uint32_t hashValue)
+    {
+        return uint32_t(WyIHashU64(data, dataEnd - data, hashValue));
+    }
+
+    inline uint32_t StrHashU32(const char* s, uint32_t hashValue)
+    {
+        return uint32_t(WyHashU64((const uint8_t*) s, strlen(s), hashValue));
+    }
+
+    inline uint32_t StrIHashU32(const char* s, uint32_t hashValue)
+    {
+        return uint32_t(WyIHashU64(s, strlen(s), hashValue));
+    }
+
+    inline uint64_t HashU64(const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue)
+    {
+        return WyHashU64(data, dataEnd - data, hashValue);
+    }
+
+    inline uint64_t IHashU64(const char* data, const char* dataEnd, uint64_t hashValue)
+    {
+        return WyIHashU64(data, dataEnd - data, hashValue);
+    }
+
+    inline uint64_t StrHashU64(const char* s, uint64_t hashValue)
+    {
+        return WyHashU64((const uint8_t*) s, strlen(s), hashValue);
+    }
+
+    inline uint64_t StrIHashU64(const char* s, uint64_t hashValue)
+    {
+        return WyIHashU64(s, strlen(s), hashValue);
+    }
+#else
+    inline uint32_t HashU32(const uint8_t* data, const uint8_t* dataEnd, uint32_t hashValue)
+    {
+        return FNVHashU32(data, dataEnd, hashValue);
+    }
+
+    inline uint32_t IHashU32(const char* data, const char* dataEnd, uint32_t hashValue)
+    {
+        return FNVIHashU32(data, dataEnd, hashValue);
+    }
+
+    inline uint32_t StrHashU32(const char* s, uint32_t hashValue)
+    {
+        return StrFNVHashU32(s, hashValue);
+    }
+
+    inline uint32_t StrIHashU32(const char* s, uint32_t hashValue)
+    {
+        return StrFNVIHashU32(s, hashValue);
+    }
+
+    inline uint64_t HashU64(const uint8_t* data, const uint8_t* dataEnd, uint64_t hashValue)
+    {
+        return FNVHashU64(data, dataEnd, hashValue);
+    }
+
+    inline uint64_t IHashU64(const char* data, const char* dataEnd, uint64_t hashValue)
+    {
+        return FNVIHashU64(data, dataEnd, hashValue);
+    }
+
+    inline uint64_t StrHashU64(const char* s, uint64_t hashValue)
+    {
+        return StrFNVHashU64(s, hashValue);
+    }
+
+    inline uint64_t StrIHashU64(const char* s, uint64_t hashValue)
+    {
+        return StrFNVIHashU64(s, hashValue);
+    }
+#endif
+
     inline uint32_t MurmurHash3(uint32_t h)
     {
         h ^= h >> 16;
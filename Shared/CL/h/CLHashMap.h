@@ -0,0 +1,514 @@
+//
+//  File:       CLHashMap.h
+//
+//  Function:   Open-addressing hash map and set, for hot lookup tables
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#ifndef CL_HASH_MAP_H
+#define CL_HASH_MAP_H
+
+#include <CLHash.h>
+#include <CLMemory.h>
+#include <CLSTL.h>
+#include <CLTag.h>
+
+#include <new>
+#include <string.h>
+#include <utility>
+
+// hash_map and hash_set are drop-in replacements for map/set where ordered
+// iteration isn't needed. They use Robin Hood linear probing, so entries
+// live directly in one flat array, and lookups touch one or two cache lines.
+// Unlike map/set:
+//  - iteration order is arbitrary, and changes on insert.
+//  - insert and erase invalidate all iterators and entry pointers.
+//  - value_type is pair<K, V>, not pair<const K, V>. Don't modify keys in place.
+
+namespace nCL
+{
+    // --- Hash functions ------------------------------------------------------
+
+    inline uint32_t HashMix(uint64_t x)
+    ///< Scrambles all input bits into the low 32 bits. (MurmurHash3 fmix64)
+    {
+        x ^= x >> 33;
+        x *= UINT64_C(0xff51afd7ed558ccd);
+        x ^= x >> 33;
+        x *= UINT64_C(0xc4ceb9fe1a85ec53);
+        x ^= x >> 33;
+        return uint32_t(x);
+    }
+
+    template<class T> struct cHash
+    ///< Default hash: integer and enum keys, including release-build tags.
+    {
+        uint32_t operator()(const T& key) const { return HashMix(uint64_t(key)); }
+    };
+
+    template<class T> struct cHash<T*>
+    ///< Pointer identity hash, e.g., for developer-build tags and string IDs.
+    {
+        uint32_t operator()(T* key) const { return HashMix(uint64_t(uintptr_t(key))); }
+    };
+
+    template<class T> struct cEqual
+    {
+        bool operator()(const T& a, const T& b) const { return a == b; }
+    };
+
+    struct cStringHash
+    ///< Hash C strings by content
+    {
+        uint32_t operator()(const char* s) const { return HashMix(StrWyHashU32(s)); }
+    };
+
+    struct cStringEqual
+    {
+        bool operator()(const char* a, const char* b) const { return strcmp(a, b) == 0; }
+    };
+
+
+    // --- cHashTable ----------------------------------------------------------
+
+    template<class T_E, class T_K, class T_KEY_OF, class T_H, class T_EQ> class cHashTable
+    ///< Shared implementation of hash_map/hash_set. T_E is the stored entry type, and T_KEY_OF extracts its key.
+    {
+    public:
+        typedef T_K         key_type;
+        typedef T_E         value_type;
+        typedef size_t      size_type;
+
+        template<class T_T, class T_V> class tIterator
+        {
+        public:
+            tIterator() {}
+            tIterator(T_T* table, uint32_t i) : mTable(table), mIndex(i) {}
+            template<class T_T2, class T_V2> tIterator(const tIterator<T_T2, T_V2>& other) : mTable(other.mTable), mIndex(other.mIndex) {}
+
+            T_V& operator*() const  { return mTable->mEntries[mIndex]; }
+            T_V* operator->() const { return mTable->mEntries + mIndex; }
+
+            tIterator& operator++()     { mIndex = mTable->NextUsed(mIndex + 1); return *this; }
+            tIterator  operator++(int)  { tIterator result(*this); ++*this; return result; }
+
+            bool operator==(const tIterator& other) const { return mIndex == other.mIndex; }
+            bool operator!=(const tIterator& other) const { return mIndex != other.mIndex; }
+
+            T_T*     mTable = 0;
+            uint32_t mIndex = 0;
+        };
+
+        typedef tIterator<cHashTable, T_E>                  iterator;
+        typedef tIterator<const cHashTable, const T_E>      const_iterator;
+
+        cHashTable(cIAllocator* alloc = 0);     ///< If 'alloc' is 0, kDefaultAllocator is used. No memory is allocated until the first insert.
+        cHashTable(const cHashTable& other);
+        cHashTable(cHashTable&& other);
+        ~cHashTable();
+
+        cHashTable& operator=(const cHashTable& other);
+        cHashTable& operator=(cHashTable&& other);
+
+        size_type size() const      { return mSize; }
+        bool      empty() const     { return mSize == 0; }
+        size_type capacity() const  { return mMask ? mMask + 1 : 0; }
+
+        iterator       begin()          { return iterator      (this, NextUsed(0)); }
+        const_iterator begin() const    { return const_iterator(this, NextUsed(0)); }
+        iterator       end()            { return iterator      (this, EndIndex()); }
+        const_iterator end() const      { return const_iterator(this, EndIndex()); }
+
+        iterator       find(const T_K& key)         { return iterator      (this, FindIndex(key)); }
+        const_iterator find(const T_K& key) const   { return const_iterator(this, FindIndex(key)); }
+        size_type      count(const T_K& key) const  { return FindIndex(key) != EndIndex(); }
+
+        std::pair<iterator, bool> insert(const T_E& entry);     ///< Returns existing entry and false if the key is already present
+        size_type erase(const T_K& key);            ///< Returns number of entries removed
+        void      erase(const_iterator it);
+        void      clear();                          ///< Removes all entries, keeps storage
+        void      reserve(size_type n);             ///< Size the table to hold n entries without rehashing
+        void      shrink_to_fit();                  ///< Frees storage if empty, otherwise shrinks to fit the current size
+
+        cIAllocator* Allocator() const { return mAllocator; }
+
+    protected:
+        enum : uint32_t { kMaxDist = 255 };     // mDists[i] = probe distance + 1, 0 = empty
+
+        T_E*            mEntries    = 0;
+        uint8_t*        mDists      = 0;
+        uint32_t        mMask       = 0;
+        uint32_t        mSize       = 0;
+        uint32_t        mGrowSize   = 0;    ///< Rehash when mSize reaches this
+        cIAllocator*    mAllocator  = 0;
+
+        uint32_t EndIndex() const { return mMask ? mMask + 1 : 0; }
+        uint32_t NextUsed(uint32_t i) const;
+        uint32_t FindIndex(const T_K& key) const;
+        uint32_t InsertIndex(T_E&& entry);      ///< Inserts an entry known not to be present, returns its index.
+
+        void Rehash(uint32_t capacity);
+        void Release();
+    };
+
+
+    // --- hash_map ------------------------------------------------------------
+
+    template<class T_K, class T_V> struct cKeyOfPair
+    {
+        const T_K& operator()(const std::pair<T_K, T_V>& entry) const { return entry.first; }
+    };
+
+    template<class T_K> struct cKeyOfKey
+    {
+        const T_K& operator()(const T_K& entry) const { return entry; }
+    };
+
+    template<class T_K, class T_V, class T_H = cHash<T_K>, class T_EQ = cEqual<T_K>>
+    class hash_map : public cHashTable<std::pair<T_K, T_V>, T_K, cKeyOfPair<T_K, T_V>, T_H, T_EQ>
+    {
+    public:
+        typedef cHashTable<std::pair<T_K, T_V>, T_K, cKeyOfPair<T_K, T_V>, T_H, T_EQ> tBase;
+        typedef T_V mapped_type;
+
+        using tBase::tBase;
+
+        T_V& operator[](const T_K& key);
+        T_V& at(const T_K& key);                ///< Key must be present
+        const T_V& at(const T_K& key) const;    ///< Key must be present
+    };
+
+    template<class T_K, class T_H = cHash<T_K>, class T_EQ = cEqual<T_K>>
+    class hash_set : public cHashTable<T_K, T_K, cKeyOfKey<T_K>, T_H, T_EQ>
+    {
+    public:
+        typedef cHashTable<T_K, T_K, cKeyOfKey<T_K>, T_H, T_EQ> tBase;
+        using tBase::tBase;
+    };
+
+    // Keyed by tag or string ID. These hash by pointer in developer builds, and by ID otherwise.
+    template<class T_V> using tag_hash_map = hash_map<tTag, T_V>;
+    typedef hash_set<tTag> tag_hash_set;
+
+    // Keyed by C string contents. The map doesn't own the strings.
+    template<class T_V> using string_hash_map = hash_map<const char*, T_V, cStringHash, cStringEqual>;
+    typedef hash_set<const char*, cStringHash, cStringEqual> string_hash_set;
+
+#ifndef CL_RELEASE
+    bool TestHashMaps();    ///< Checks hash_map against map over random inserts/erases. Returns false on failure.
+    void BenchHashMaps();   ///< Prints insert/find timings for hash_map vs. map.
+#endif
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    #define CL_HT_TEMPLATE template<class T_E, class T_K, class T_KEY_OF, class T_H, class T_EQ>
+    #define CL_HT cHashTable<T_E, T_K, T_KEY_OF, T_H, T_EQ>
+
+    CL_HT_TEMPLATE inline CL_HT::cHashTable(cIAllocator* alloc) :
+        mAllocator(alloc)
+    {
+    }
+
+    CL_HT_TEMPLATE inline CL_HT::cHashTable(const cHashTable& other) :
+        mAllocator(other.mAllocator)
+    {
+        *this = other;
+    }
+
+    CL_HT_TEMPLATE inline CL_HT::cHashTable(cHashTable&& other) :
+        mAllocator(other.mAllocator)
+    {
+        *this = std::move(other);
+    }
+
+    CL_HT_TEMPLATE inline CL_HT::~cHashTable()
+    {
+        Release();
+    }
+
+    CL_HT_TEMPLATE CL_HT& CL_HT::operator=(const cHashTable& other)
+    {
+        if (this == &other)
+            return *this;
+
+        clear();
+        reserve(other.mSize);
+
+        for (uint32_t i = 0, n = other.EndIndex(); i < n; i++)
+            if (other.mDists[i])
+                InsertIndex(T_E(other.mEntries[i]));
+
+        return *this;
+    }
+
+    CL_HT_TEMPLATE CL_HT& CL_HT::operator=(cHashTable&& other)
+    {
+        if (this == &other)
+            return *this;
+
+        Release();
+
+        mEntries   = other.mEntries;
+        mDists     = other.mDists;
+        mMask      = other.mMask;
+        mSize      = other.mSize;
+        mGrowSize  = other.mGrowSize;
+        mAllocator = other.mAllocator;
+
+        other.mEntries  = 0;
+        other.mDists    = 0;
+        other.mMask     = 0;
+        other.mSize     = 0;
+        other.mGrowSize = 0;
+
+        return *this;
+    }
+
+    CL_HT_TEMPLATE inline uint32_t CL_HT::NextUsed(uint32_t i) const
+    {
+        uint32_t n = EndIndex();
+
+        while (i < n && mDists[i] == 0)
+            i++;
+
+        return i;
+    }
+
+    CL_HT_TEMPLATE inline uint32_t CL_HT::FindIndex(const T_K& key) const
+    {
+        if (mSize == 0)
+            return EndIndex();
+
+        uint32_t i = T_H()(key) & mMask;
+
+        // Robin Hood invariant: once we hit an entry closer to its home slot than
+        // we are to ours, the key can't be further on. An entry at the same distance
+        // has the same home slot, so only those need a key comparison.
+        for (uint32_t dist = 1; mDists[i] >= dist; dist++, i = (i + 1) & mMask)
+            if (mDists[i] == dist && T_EQ()(T_KEY_OF()(mEntries[i]), key))
+                return i;
+
+        return EndIndex();
+    }
+
+    CL_HT_TEMPLATE std::pair<typename CL_HT::iterator, bool> CL_HT::insert(const T_E& entry)
+    {
+        uint32_t i = FindIndex(T_KEY_OF()(entry));
+
+        if (i != EndIndex())
+            return { iterator(this, i), false };
+
+        return { iterator(this, InsertIndex(T_E(entry))), true };
+    }
+
+    CL_HT_TEMPLATE uint32_t CL_HT::InsertIndex(T_E&& entryIn)
+    {
+        if (mSize >= mGrowSize)
+            Rehash(mMask ? 2 * (mMask + 1) : 8);
+
+        T_E entry(std::move(entryIn));
+        T_K key(T_KEY_OF()(entry));
+
+        uint32_t i = T_H()(key) & mMask;
+        uint32_t dist = 1;
+        uint32_t result = EndIndex();
+
+        while (true)
+        {
+            if (mDists[i] == 0)
+            {
+                new(mEntries + i) T_E(std::move(entry));
+                mDists[i] = dist;
+                mSize++;
+
+                return result != EndIndex() ? result : i;
+            }
+
+            if (mDists[i] < dist)
+            {
+                // Steal from the rich: take this slot, and carry on placing the displaced entry.
+                std::swap(entry, mEntries[i]);
+
+                uint32_t d = mDists[i];
+                mDists[i] = dist;
+                dist = d;
+
+                if (result == EndIndex())
+                    result = i;
+            }
+
+            dist++;
+            i = (i + 1) & mMask;
+
+            if (dist == kMaxDist)
+            {
+                // Pathological clustering -- grow, then place whatever we're still carrying.
+                Rehash(2 * (mMask + 1));
+                InsertIndex(std::move(entry));
+                return FindIndex(key);
+            }
+        }
+    }
+
+    CL_HT_TEMPLATE typename CL_HT::size_type CL_HT::erase(const T_K& key)
+    {
+        uint32_t i = FindIndex(key);
+
+        if (i == EndIndex())
+            return 0;
+
+        erase(const_iterator(this, i));
+        return 1;
+    }
+
+    CL_HT_TEMPLATE void CL_HT::erase(const_iterator it)
+    {
+        uint32_t i = it.mIndex;
+        CL_ASSERT(i < EndIndex() && mDists[i] != 0);
+
+        mEntries[i].~T_E();
+        mSize--;
+
+        // Backward-shift deletion: pull following entries back a slot until we hit an
+        // empty slot or an entry already in its home slot. Avoids tombstones.
+        while (true)
+        {
+            uint32_t next = (i + 1) & mMask;
+
+            if (mDists[next] <= 1)
+            {
+                mDists[i] = 0;
+                return;
+            }
+
+            new(mEntries + i) T_E(std::move(mEntries[next]));
+            mEntries[next].~T_E();
+            mDists[i] = mDists[next] - 1;
+
+            i = next;
+        }
+    }
+
+    CL_HT_TEMPLATE void CL_HT::clear()
+    {
+        for (uint32_t i = 0, n = EndIndex(); i < n; i++)
+            if (mDists[i])
+            {
+                mEntries[i].~T_E();
+                mDists[i] = 0;
+            }
+
+        mSize = 0;
+    }
+
+    CL_HT_TEMPLATE void CL_HT::reserve(size_type n)
+    {
+        uint32_t capacity = 8;
+
+        while (capacity - capacity / 8 < n)
+            capacity *= 2;
+
+        if (capacity > EndIndex())
+            Rehash(capacity);
+    }
+
+    CL_HT_TEMPLATE void CL_HT::shrink_to_fit()
+    {
+        if (mSize == 0)
+        {
+            Release();
+            return;
+        }
+
+        uint32_t capacity = 8;
+
+        while (capacity - capacity / 8 <= mSize)
+            capacity *= 2;
+
+        if (capacity < EndIndex())
+            Rehash(capacity);
+    }
+
+    CL_HT_TEMPLATE void CL_HT::Rehash(uint32_t capacity)
+    {
+        CL_ASSERT((capacity & (capacity - 1)) == 0);
+
+        if (!mAllocator)
+            mAllocator = nCL::Allocator(kDefaultAllocator);
+
+        T_E*     oldEntries = mEntries;
+        uint8_t* oldDists   = mDists;
+        uint32_t oldEnd     = EndIndex();
+
+        // One block: entries, then distances.
+        size_t entriesSize = capacity * sizeof(T_E);
+        uint8_t* data = mAllocator->Alloc(entriesSize + capacity, alignof(T_E) > 4 ? alignof(T_E) : 4);
+
+        mEntries  = (T_E*) data;
+        mDists    = data + entriesSize;
+        mMask     = capacity - 1;
+        mSize     = 0;
+        mGrowSize = capacity - capacity / 8;    // max load factor of 7/8
+
+        memset(mDists, 0, capacity);
+
+        for (uint32_t i = 0; i < oldEnd; i++)
+            if (oldDists[i])
+            {
+                InsertIndex(std::move(oldEntries[i]));
+                oldEntries[i].~T_E();
+            }
+
+        if (oldEntries)
+            mAllocator->Free(oldEntries);
+    }
+
+    CL_HT_TEMPLATE void CL_HT::Release()
+    {
+        clear();
+
+        if (mEntries)
+            mAllocator->Free(mEntries);
+
+        mEntries  = 0;
+        mDists    = 0;
+        mMask     = 0;
+        mGrowSize = 0;
+    }
+
+    #undef CL_HT_TEMPLATE
+    #undef CL_HT
+
+    template<class T_K, class T_V, class T_H, class T_EQ>
+    inline T_V& hash_map<T_K, T_V, T_H, T_EQ>::operator[](const T_K& key)
+    {
+        uint32_t i = tBase::FindIndex(key);
+
+        if (i == tBase::EndIndex())
+            i = tBase::InsertIndex(std::pair<T_K, T_V>(key, T_V()));
+
+        return tBase::mEntries[i].second;
+    }
+
+    template<class T_K, class T_V, class T_H, class T_EQ>
+    inline T_V& hash_map<T_K, T_V, T_H, T_EQ>::at(const T_K& key)
+    {
+        uint32_t i = tBase::FindIndex(key);
+        CL_ASSERT(i != tBase::EndIndex());
+        return tBase::mEntries[i].second;
+    }
+
+    template<class T_K, class T_V, class T_H, class T_EQ>
+    inline const T_V& hash_map<T_K, T_V, T_H, T_EQ>::at(const T_K& key) const
+    {
+        uint32_t i = tBase::FindIndex(key);
+        CL_ASSERT(i != tBase::EndIndex());
+        return tBase::mEntries[i].second;
+    }
+}
+
+#endif
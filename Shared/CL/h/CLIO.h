@@ -179,7 +179,7 @@ namespace nCL
         mCursor = mBegin;
     };
 
-    tIOError cIOStream::Error() const
+    inline tIOError cIOStream::Error() const
     {
         return mError;
     }
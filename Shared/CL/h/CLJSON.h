@@ -29,6 +29,7 @@ namespace nCL
 
     bool ReadFromJSONFile(const cFileSpec& fileSpec, cValue* value, string* errorMessages = 0, int* firstErrorLine = 0);
     ///< Reads from fileSpec into 'value'. Returns false on failure, and any parse errors in errorMessages.
+    ///< If there is an up-to-date binary form of the file, that is read instead, see FindValueDataFile().
     bool ReadFromJSONFile(const cFileSpec& fileSpec, cObjectValue* value, string* errorMessages = 0, int* firstErrorLine = 0);
     ///< Version of ReadFromJSONFile that assumes the file describes an object. On success the object is tagged with kSourcePathTag.
 
@@ -49,6 +50,11 @@ namespace nCL
     void LogJSON(const char* group, const char* label, const cValue& v);
     ///< Logs the contents of the given value to the given group.
 
+#ifndef CL_RELEASE
+    void BenchJSONRead(const cFileSpec& fileSpec);
+    ///< Prints parse time and live value memory for the given file, with and without packed arrays.
+#endif
+
 
     // --- cJSONReader ---------------------------------------------------------
 
@@ -80,6 +86,9 @@ namespace nCL
         int GetFirstErrorLine() const;
         ///< Returns line number of the first error, or -1 if none.
 
+        void SetPackArrays(bool enabled);
+        ///< Controls whether numeric arrays are stored packed, see cValue::PackArray(). Defaults to true.
+
     protected:
         typedef const char* tLocation;
 
@@ -171,6 +180,7 @@ namespace nCL
         bool        mCollectComments;
         bool        mAllowUnquotedStrings;
         bool        mAllowTrailingCommas;
+        bool        mPackArrays;
     };
 
 
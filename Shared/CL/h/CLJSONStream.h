@@ -0,0 +1,146 @@
+//
+//  File:       CLJSONStream.h
+//
+//  Function:   Streaming JSON reader. Reports values via a handler interface
+//              rather than building a cValue tree, and scans strings, whitespace
+//              and comments 16 bytes at a time.
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#ifndef CL_JSON_STREAM_H
+#define CL_JSON_STREAM_H
+
+#include <CLValue.h>
+
+#include <ustl/string.h>
+#include <ustl/vector.h>
+
+namespace nCL
+{
+    class cFileSpec;
+
+    // --- cIJSONHandler -------------------------------------------------------
+
+    class cIJSONHandler
+    /// Receives the contents of a document from cJSONStreamReader, in document order.
+    /// Return false from any call to stop the read, which then fails.
+    {
+    public:
+        virtual bool Null() = 0;
+        virtual bool Bool  (bool value) = 0;
+        virtual bool Int   (int32_t value) = 0;
+        virtual bool UInt  (uint32_t value) = 0;
+        virtual bool Double(double value) = 0;
+        virtual bool String(const char* s, size_t length) = 0;  ///< 's' is 0-terminated, and only valid for the duration of the call.
+
+        virtual bool BeginObject() = 0;
+        virtual bool Key(const char* s, size_t length) = 0;     ///< Member name, followed by its value. 's' is not 0-terminated.
+        virtual bool EndObject() = 0;
+
+        virtual bool BeginArray() = 0;
+        virtual bool EndArray() = 0;
+
+        virtual bool Comment(const char* begin, const char* end, tCommentPlacement placement) { return true; }
+        ///< Only called if comments are being collected. The comment includes its delimiters. kCommentAfterOnSameLine
+        ///< comments apply to the previous value, and kCommentBefore comments to the next value, or the end of the
+        ///< document if there are no more values.
+    };
+
+
+    // --- cJSONStreamReader ---------------------------------------------------
+
+    class cJSONStreamReader
+    /// Alternative to cJSONReader that reports values to a handler, so callers can build whatever
+    /// they need directly. Accepts the same extensions: comments, unquoted strings, and trailing commas.
+    /// Numbers are parsed without sscanf in all but rare cases, and strings are decoded into a reused buffer.
+    /// Unlike cJSONReader, reading stops at the first error.
+    {
+    public:
+        bool Read(const char* beginDoc, const char* endDoc, cIJSONHandler* handler, bool collectComments = false);
+        ///< Reads the given UTF8 document range, returns false on error.
+
+        void GetFormattedErrorMessages(string* formattedMessage) const; ///< Returns a description of any error from the last Read().
+        int  GetFirstErrorLine() const;                                 ///< Returns line number of the error, or -1 if none.
+
+    protected:
+        bool ReadValue();
+        bool ReadObject();
+        bool ReadArray();
+        bool ReadString(bool isKey);
+        bool ReadUnquoted(bool isKey);
+        bool ReadNumber();
+
+        bool SkipSpaces();      ///< Skips whitespace and comments. Returns false on an unterminated comment.
+        bool ReadComment();
+
+        bool Error(const char* message, const char* location);
+
+        // Data
+        const char*     mBegin      = 0;
+        const char*     mEnd        = 0;
+        const char*     mCurrent    = 0;
+        cIJSONHandler*  mHandler    = 0;
+
+        bool            mCollectComments = false;
+        const char*     mLastValueEnd = 0;  ///< For placing comments
+
+        const char*     mErrorMessage  = 0;
+        const char*     mErrorLocation = 0;
+
+        string          mScratch;           ///< For 0-terminating and unescaping strings
+    };
+
+
+    // --- cJSONValueBuilder ---------------------------------------------------
+
+    class cJSONValueBuilder : public cIJSONHandler
+    /// Builds a cValue from cJSONStreamReader events. As with cJSONReader, nested objects are owned
+    /// by the top-level object, and numeric arrays are packed by default. Unlike cJSONReader,
+    /// existing objects in the destination are not preserved.
+    {
+    public:
+        cJSONValueBuilder(cValue* root, bool packArrays = true);
+
+        bool Null() override;
+        bool Bool  (bool value) override;
+        bool Int   (int32_t value) override;
+        bool UInt  (uint32_t value) override;
+        bool Double(double value) override;
+        bool String(const char* s, size_t length) override;
+
+        bool BeginObject() override;
+        bool Key(const char* s, size_t length) override;
+        bool EndObject() override;
+
+        bool BeginArray() override;
+        bool EndArray() override;
+
+        bool Comment(const char* begin, const char* end, tCommentPlacement placement) override;
+
+    protected:
+        cValue* NextValue();    ///< Returns the value to be filled in next
+
+        cValue*         mRoot;
+        bool            mPackArrays;
+        vector<cValue*> mNodes;             ///< Open arrays and objects
+        tTag            mKey = kNullTag;    ///< Pending member name
+        cValue*         mLastValue = 0;
+        string          mCommentsBefore;
+    };
+
+
+    // --- Utilities -----------------------------------------------------------
+
+    bool ReadFromJSONStream(const char* beginDoc, const char* endDoc, cValue* value, string* errorMessages = 0, int* firstErrorLine = 0);
+    ///< Convenience wrapper that uses cJSONStreamReader and cJSONValueBuilder to read into 'value'.
+
+#ifndef CL_RELEASE
+    void BenchJSONStreamRead(const cFileSpec& fileSpec);
+    ///< Prints throughput for the given file with cJSONReader and cJSONStreamReader, and checks their results match.
+#endif
+}
+
+#endif
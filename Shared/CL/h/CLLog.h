@@ -50,20 +50,32 @@ namespace nCL
     class cObjectValue;
 
     bool InitLogSystem(const char* tag = 0);
-    bool ShutdownLogSystem();
+    bool ShutdownLogSystem();   ///< Writes out any pending output first.
 
     void ConfigLogSystem(const nCL::cObjectValue* config); ///< Configure log system from the give value.
 
     bool OpenLogConsole();  ///< Bring up a window showing log output
 
+    // Output. Log calls only record their arguments, and output happens later on a
+    // background thread, so use FlushLog() if you need it to have appeared.
+    void FlushLog();                        ///< Waits until everything logged so far has been written out.
+    void SetLogToStdout(bool enabled);      ///< Controls whether output goes to stdout. Defaults to true.
+    bool SetLogFile(const char* path);      ///< Also write output to the given file, or stop if 0. Returns false if the file couldn't be opened.
+    void SetLogStream(cIOStream* stream);   ///< Also write output to the given stream, or stop if 0. LogData/LogImage data is written in raw form.
+
     // Internal log routines used by CL_LOG macros
     void Log       (const char* group, const char* format, ...);
+    ///< Only the format pointer is recorded, so it must outlive the call -- normally it's a string literal. %s arguments are copied.
     void LogData   (const char* group, size_t dataSize, const uint8_t* data);
     void LogImage8 (const char* group, int w, int h, const uint8_t* data);
     void LogImage32(const char* group, int w, int h, const uint8_t* data);
 
     cIOStream* LogStream(const char* group);
     ///< Returns output stream for the given log group.
+
+#ifndef CL_RELEASE
+    void BenchLog();    ///< Prints time taken by Log() calls on the calling thread.
+#endif
 }
 
 #endif
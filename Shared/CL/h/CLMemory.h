@@ -13,6 +13,10 @@
 
 #include <CLDefs.h>
 
+#include <string.h>
+
+#include <atomic>
+
 namespace nCL
 {
     class cIAllocator
@@ -20,6 +24,8 @@ namespace nCL
     public:
         virtual uint8_t* Alloc(size_t size, size_t align = 4) = 0;
         virtual void     Free (void* p) = 0;
+
+        uint8_t* AllocZeroed(size_t size, size_t align = 4);   ///< Alloc() followed by clearing to 0. Alloc() itself makes no guarantees about contents.
     };
     ///< Basic allocator interface
 
@@ -27,7 +33,7 @@ namespace nCL
     {
         kNullAllocator,     // Free() is a no-op, Alloc should never be called.
         kDefaultAllocator,  // Basic heap allocator
-        kLocalAllocator,    // Allocator meant for temporary allocations that don't outlive the local scope
+        kLocalAllocator,    // Allocator meant for temporary allocations that don't outlive the local scope. Each thread gets its own -- see LocalAllocator().
         kLoggingAllocator,  // Logs allocations/frees
         kDebugAllocator,    // Debug allocations
         kValueAllocator,    // Default allocator for cValues
@@ -63,10 +69,29 @@ namespace nCL
     bool ShutdownAllocators();
     ///< Shutdown allocator system.
 
+    struct cAllocatorStats
+    {
+        int64_t mNumAllocs      = 0;    ///< Allocations made so far
+        int64_t mNumFrees       = 0;    ///< Frees made so far
+        int64_t mBytesAllocated = 0;    ///< Total bytes allocated so far, including size-class rounding
+        int64_t mBytesFreed     = 0;    ///< Total bytes freed so far
+    };
+
+    bool GetAllocatorStats(tAllocatorKind kind, cAllocatorStats* stats);
+    ///< Fills in stats for the given kind, if it's using the built-in allocator, and returns true. Otherwise returns false.
+    bool IsThreadSafeAllocator(const cIAllocator* allocator);
+    ///< Returns true if the given allocator is one of the built-in heap allocators, which can be used from any thread.
+    void LogAllocatorStats();
+    ///< Log allocation counts and live bytes for each built-in allocator kind, followed by LogLocalAllocatorStats().
+
     size_t PageSize();                      ///< Returns size of a VM page in bytes
     void*  AllocPages(size_t numPages);     ///< Allocates and returns the given number of VM pages, cleared to 0.
     void   FreePages(void* p, size_t numPages); ///< Return given pages to memory
 
+    void*  ReservePages (size_t numPages);          ///< Reserves address space for the given number of pages, without backing it. Returns 0 on failure. Release with FreePages().
+    bool   CommitPages  (void* p, size_t numPages); ///< Makes the given reserved pages accessible. Newly committed pages are cleared to 0.
+    void   DecommitPages(void* p, size_t numPages); ///< Returns the memory behind the given pages to the system, but keeps the address range reserved.
+
     struct cMappedFileInfo
     {
         const uint8_t* mData;
@@ -114,6 +139,117 @@ namespace nCL
         uint8_t* mBlocks[kMaxBlocks] = { 0 };
     };
 
+    // --- cVMStackAllocator ---------------------------------------------------
+
+    // Stack allocator that reserves one contiguous address range up front, and
+    // commits pages as the stack grows into it. Unlike cStackAllocator there is
+    // no block limit, allocations are always contiguous, and marks are plain
+    // pointers. Address space is only reserved on first use.
+    // Note: not thread safe -- use LocalAllocator() for a per-thread instance.
+    class cVMStackAllocator : public cIAllocator
+    {
+    public:
+        cVMStackAllocator() = default;
+        cVMStackAllocator(size_t reserveSize) : mReserveSize(reserveSize) {}
+        ~cVMStackAllocator();
+
+        uint8_t* Alloc(size_t size, size_t align = 4) override;
+        void     Free (void* p) override;   ///< Frees p and everything allocated after it
+
+        // cVMStackAllocator
+        const void* PushMark();                 ///< Returns mark at current allocation point
+        void        PopMark(const void* mark);  ///< Frees all allocations that occurred after the given mark
+        void        Reset();                    ///< Frees all allocations. Committed pages are kept for reuse.
+        void        Trim();                     ///< Decommits pages beyond the current allocation point
+
+        void        SetResetPerFrame(bool enabled); ///< If enabled, EndFrame() frees all allocations
+        void        EndFrame();                 ///< Records the peak usage for the frame, and resets if requested
+
+        size_t      UsedSize() const;           ///< Bytes currently allocated
+        size_t      CommittedSize() const;      ///< Bytes currently backed by memory
+        size_t      ReservedSize() const;       ///< Maximum size of the stack
+        size_t      PeakSize() const;           ///< High-water mark since creation. Updated as memory is released or the frame ends, so is safe to read from other threads.
+        size_t      LastFramePeakSize() const;  ///< High-water mark over the last frame
+
+    protected:
+        uint8_t*    AllocSlow(size_t size, size_t align);
+        void        NotePeak();
+
+        size_t      mReserveSize = sizeof(void*) == 8 ? (size_t(256) << 20) : (size_t(32) << 20);
+
+        uint8_t*    mBase      = 0;
+        uint8_t*    mCurrent   = 0;
+        uint8_t*    mCommitEnd = 0;
+        uint8_t*    mFramePeak = 0;
+        size_t      mLastFramePeakSize = 0;
+        bool        mResetPerFrame = false;
+
+        std::atomic<size_t> mPeakSize      { 0 };
+        std::atomic<size_t> mCommittedSize { 0 };
+    };
+
+    cVMStackAllocator* LocalAllocator();
+    ///< Returns the calling thread's scratch allocator, creating it if necessary. Allocator(kLocalAllocator) forwards to this.
+    void LogLocalAllocatorStats();
+    ///< Log usage and high-water marks for all live per-thread local allocators.
+
+
+    // --- cPoolAllocator ------------------------------------------------------
+
+    const uint8_t kPoolPoison = 0xDD;   ///< Fill value for freed slots when poisoning is enabled
+
+    // Fixed-size allocator for objects of type T, for types that are created and
+    // destroyed frequently. Alloc/Free are O(1): freed slots are kept on an
+    // intrusive free list, and fresh slots are carved from page-backed chunks as
+    // needed. Slots leave room for the allocator pointer cAllocatable prepends,
+    // so 'new(pool) T' works as expected. Allocations that don't fit a slot fail.
+    // Note: not thread safe
+    template<class T> class cPoolAllocator : public cIAllocator
+    {
+    public:
+        static const size_t kSlotAlign = alignof(T) > sizeof(void*) ? alignof(T) : sizeof(void*);
+        static const size_t kSlotSize  = (sizeof(T) + sizeof(void*) + kSlotAlign - 1) & ~(kSlotAlign - 1);
+
+        cPoolAllocator() = default;
+        cPoolAllocator(int pagesPerChunk) : mPagesPerChunk(pagesPerChunk) {}
+        ~cPoolAllocator();
+
+        uint8_t* Alloc(size_t size, size_t align = 4) override;
+        void     Free (void* p) override;
+
+        // cPoolAllocator
+        void    SetPoison(bool enabled);    ///< If enabled, freed slots are filled with kPoolPoison, and checked for stray writes when reused.
+        bool    Clear();                    ///< Returns all chunks to the system. Fails if there are outstanding allocations.
+
+        int     NumAllocs() const;          ///< Number of live allocations
+        int     NumChunks() const;          ///< Number of chunks currently held
+        size_t  ChunkSize() const;          ///< Size of each chunk in bytes
+
+    protected:
+        struct cFreeSlot
+        {
+            cFreeSlot* mNext;
+        };
+        struct cChunk
+        {
+            cChunk*    mNext;
+            size_t     mNumPages;
+        };
+        static const size_t kChunkHeaderSize = (sizeof(cChunk) + kSlotAlign - 1) & ~(kSlotAlign - 1);
+
+        bool     AddChunk();
+        bool     PoisonIntact(const uint8_t* slot) const;
+
+        int         mPagesPerChunk = 16;
+        cChunk*     mChunks       = 0;
+        cFreeSlot*  mFreeList     = 0;
+        uint8_t*    mChunkCurrent = 0;  ///< Next never-used slot in the most recent chunk
+        uint8_t*    mChunkEnd     = 0;
+        int         mNumAllocs    = 0;
+        int         mNumChunks    = 0;
+        bool        mPoison       = false;
+    };
+
     // --- Allocations helpers -------------------------------------------------
 
     template<class T> T* Create     (nCL::cIAllocator* alloc);
@@ -202,6 +338,16 @@ void* operator new[]   (size_t size, nCL::cIAllocator*) throw();
 
 // --- Inlines -----------------------------------------------------------------
 
+inline uint8_t* nCL::cIAllocator::AllocZeroed(size_t size, size_t align)
+{
+    uint8_t* p = Alloc(size, align);
+
+    if (p)
+        memset(p, 0, size);
+
+    return p;
+}
+
 inline const void* nCL::cStackAllocator::PushMark()
 {
     return Alloc(0);
@@ -212,6 +358,66 @@ inline void nCL::cStackAllocator::PopMark(const void* mark)
     Free((void*) mark);
 }
 
+inline uint8_t* nCL::cVMStackAllocator::Alloc(size_t size, size_t align)
+{
+    uint8_t* p = (uint8_t*) ((uintptr_t(mCurrent) + align - 1) & ~uintptr_t(align - 1));
+    uint8_t* end = p + size;
+
+    if (end >= mCommitEnd)  // >= so the first Alloc(0) sets up the range, and marks are never 0
+        return AllocSlow(size, align);
+
+    mCurrent = end;
+    return p;
+}
+
+inline void nCL::cVMStackAllocator::Free(void* p)
+{
+    if (!p)
+        return;
+
+    CL_ASSERT_MSG((uint8_t*) p >= mBase && (uint8_t*) p <= mCurrent, "Invalid free\n");
+
+    if (mCurrent > mFramePeak)
+        NotePeak();
+
+    mCurrent = (uint8_t*) p;
+}
+
+inline const void* nCL::cVMStackAllocator::PushMark()
+{
+    return Alloc(0, 1);
+}
+
+inline void nCL::cVMStackAllocator::PopMark(const void* mark)
+{
+    Free((void*) mark);
+}
+
+inline size_t nCL::cVMStackAllocator::UsedSize() const
+{
+    return mCurrent - mBase;
+}
+
+inline size_t nCL::cVMStackAllocator::CommittedSize() const
+{
+    return mCommittedSize.load(std::memory_order_relaxed);
+}
+
+inline size_t nCL::cVMStackAllocator::ReservedSize() const
+{
+    return mReserveSize;
+}
+
+inline size_t nCL::cVMStackAllocator::PeakSize() const
+{
+    return mPeakSize.load(std::memory_order_relaxed);
+}
+
+inline size_t nCL::cVMStackAllocator::LastFramePeakSize() const
+{
+    return mLastFramePeakSize;
+}
+
 template<class T> inline nCL::cAllocPtr<T>::cAllocPtr(T* data) : mData(data)
 {}
 
@@ -233,6 +439,139 @@ template<class T> inline void nCL::cAllocPtr<T>::Release()
     Destroy(&mData, mAllocator);
 }
 
+template<class T> nCL::cPoolAllocator<T>::~cPoolAllocator()
+{
+    CL_ASSERT_MSG(mNumAllocs == 0, "Destroying pool with %d outstanding allocations\n", mNumAllocs);
+    mNumAllocs = 0;
+    Clear();
+}
+
+template<class T> inline uint8_t* nCL::cPoolAllocator<T>::Alloc(size_t size, size_t align)
+{
+    CL_ASSERT_MSG(size <= kSlotSize && align <= kSlotAlign, "Allocation of %zu bytes doesn't fit pool slot of %zu\n", size, kSlotSize);
+
+    if (size > kSlotSize || align > kSlotAlign)
+        return 0;
+
+    uint8_t* p;
+
+    if (mFreeList)
+    {
+        p = (uint8_t*) mFreeList;
+        mFreeList = mFreeList->mNext;
+
+        CL_ASSERT_MSG(!mPoison || PoisonIntact(p), "Pool slot %p was written to after being freed\n", p);
+    }
+    else
+    {
+        if (mChunkCurrent == mChunkEnd && !AddChunk())
+            return 0;
+
+        p = mChunkCurrent;
+        mChunkCurrent += kSlotSize;
+    }
+
+    mNumAllocs++;
+    return p;
+}
+
+template<class T> inline void nCL::cPoolAllocator<T>::Free(void* p)
+{
+    if (!p)
+        return;
+
+    CL_ASSERT(mNumAllocs > 0);
+
+    if (mPoison)
+        memset(p, kPoolPoison, kSlotSize);
+
+    cFreeSlot* slot = (cFreeSlot*) p;
+    slot->mNext = mFreeList;
+    mFreeList = slot;
+
+    mNumAllocs--;
+}
+
+template<class T> void nCL::cPoolAllocator<T>::SetPoison(bool enabled)
+{
+    if (enabled && !mPoison)
+        for (cFreeSlot* slot = mFreeList; slot; slot = slot->mNext)
+            memset(slot + 1, kPoolPoison, kSlotSize - sizeof(cFreeSlot));
+
+    mPoison = enabled;
+}
+
+template<class T> bool nCL::cPoolAllocator<T>::Clear()
+{
+    if (mNumAllocs > 0)
+        return false;
+
+    while (mChunks)
+    {
+        cChunk* chunk = mChunks;
+        mChunks = chunk->mNext;
+
+        FreePages(chunk, chunk->mNumPages);
+    }
+
+    mFreeList = 0;
+    mChunkCurrent = 0;
+    mChunkEnd = 0;
+    mNumChunks = 0;
+
+    return true;
+}
+
+template<class T> inline int nCL::cPoolAllocator<T>::NumAllocs() const
+{
+    return mNumAllocs;
+}
+
+template<class T> inline int nCL::cPoolAllocator<T>::NumChunks() const
+{
+    return mNumChunks;
+}
+
+template<class T> inline size_t nCL::cPoolAllocator<T>::ChunkSize() const
+{
+    size_t minSize = kChunkHeaderSize + 16 * kSlotSize;   // ensure large T still get a reasonable number of slots per chunk
+    size_t size = mPagesPerChunk * PageSize();
+
+    if (size < minSize)
+        size = (minSize + PageSize() - 1) & ~(PageSize() - 1);
+
+    return size;
+}
+
+template<class T> bool nCL::cPoolAllocator<T>::AddChunk()
+{
+    size_t chunkSize = ChunkSize();
+    cChunk* chunk = (cChunk*) AllocPages(chunkSize / PageSize());
+
+    if (!chunk)
+        return false;
+
+    chunk->mNext = mChunks;
+    chunk->mNumPages = chunkSize / PageSize();
+    mChunks = chunk;
+    mNumChunks++;
+
+    // Slots are handed out from here lazily, so a new chunk costs nothing up front.
+    mChunkCurrent = (uint8_t*) chunk + kChunkHeaderSize;
+    mChunkEnd = mChunkCurrent + (chunkSize - kChunkHeaderSize) / kSlotSize * kSlotSize;
+
+    return true;
+}
+
+template<class T> bool nCL::cPoolAllocator<T>::PoisonIntact(const uint8_t* slot) const
+{
+    for (size_t i = sizeof(cFreeSlot); i < kSlotSize; i++)
+        if (slot[i] != kPoolPoison)
+            return false;
+
+    return true;
+}
+
 template<class T> inline T* nCL::Create(nCL::cIAllocator* alloc)
 {
     void* p = alloc->Alloc(sizeof(T));
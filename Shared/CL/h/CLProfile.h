@@ -0,0 +1,83 @@
+//
+//  File:       CLProfile.h
+//
+//  Function:   Hierarchical CPU profiler with scoped markers
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#ifndef CL_PROFILE_H
+#define CL_PROFILE_H
+
+#include <CLDefs.h>
+
+// CL_PROFILE_SCOPE("name") times the enclosing scope. The name must be a
+// string literal, or otherwise outlive the profiler's use of it. Each thread
+// writes completed scopes to its own lock-free buffer, and EndProfileFrame()
+// gathers them up once per frame. Markers compile out in CL_RELEASE builds.
+
+#ifndef CL_PROFILE
+    #ifdef CL_RELEASE
+        #define CL_PROFILE 0
+    #else
+        #define CL_PROFILE 1
+    #endif
+#endif
+
+#if CL_PROFILE
+    #define CL_PROFILE_SCOPE(M_NAME) nCL::cProfileScope CL_PROFILE_VAR(__LINE__)(M_NAME)
+    #define CL_PROFILE_VAR(M_LINE)   CL_PROFILE_VAR2(M_LINE)
+    #define CL_PROFILE_VAR2(M_LINE)  profileScope_ ## M_LINE
+#else
+    #define CL_PROFILE_SCOPE(M_NAME)
+#endif
+
+namespace nCL
+{
+    struct cProfileStat
+    {
+        const char* mName;
+        int         mThread;        ///< Profile thread index, see ProfileThreadName()
+        int         mDepth;         ///< Nesting depth, 0 = top level
+        int         mParent;        ///< Index of enclosing stat, or -1
+        int         mCount;         ///< Number of times the scope was entered over the frame
+        uint64_t    mTicks;         ///< Total inclusive time over the frame, in AbsoluteTicks() units
+    };
+
+#if CL_PROFILE
+    void BeginProfileScope(const char* name);
+    void EndProfileScope();
+    ///< Use CL_PROFILE_SCOPE in preference to calling these directly
+
+    void SetProfileThreadName(const char* name);
+    ///< Set name used for the calling thread in stats and traces. Copied.
+    const char* ProfileThreadName(int thread);
+    ///< Returns name of the given profile thread index.
+
+    void EndProfileFrame();
+    ///< Call once per frame, from one thread only. Gathers scopes completed since the last call into the frame stats, and any active capture.
+
+    int                 NumProfileStats();
+    const cProfileStat* ProfileStats();     ///< Stats for the last frame, grouped by thread, with children following their parents
+    uint64_t            ProfileFrameTicks();///< Length of the last frame, in AbsoluteTicks() units
+    int                 ProfileDroppedScopes(); ///< Scopes lost over the last frame due to full thread buffers
+
+    bool StartProfileCapture(const char* path, int numFrames);
+    ///< Capture every scope for the next numFrames frames, and then write them to 'path' in Chrome trace_event JSON format, for viewing via chrome://tracing.
+    bool ProfileCaptureActive();
+
+    void BenchProfiler();
+    ///< Report per-marker overhead
+
+    class cProfileScope
+    {
+    public:
+        cProfileScope(const char* name) { BeginProfileScope(name); }
+        ~cProfileScope()                { EndProfileScope(); }
+    };
+#endif
+}
+
+#endif
@@ -52,6 +52,35 @@ namespace nCL
     float RandomRangeAbout(float a, float b, tSeed32* seed);
 
 
+    // --- Streams -------------------------------------------------------------
+
+    tSeed32 SeedFromKey(uint32_t key);                  ///< Returns a well-mixed starting seed for the given key, e.g., a tag.
+    tSeed32 SeedFromKey(uint32_t key1, uint32_t key2);  ///< Returns a starting seed for the given key pair, e.g., tag and slot. Use to give each owner its own independent stream.
+
+    // Per-owner streams make results independent of the order owners are updated
+    // in, e.g., by job threads. If key2 comes from a master seed, advance that only
+    // during serial creation, so an owner reusing a recycled slot still differs.
+
+    tSeed32 SkipSeed(tSeed32 seed, uint32_t n);         ///< Returns the result of applying NextSeed() n times, in O(log n).
+
+
+    // --- Batch generation ----------------------------------------------------
+    // These produce the same results as 'count' successive calls to the
+    // corresponding single-value functions above, and leave 'seed' in the same
+    // state, but generate four values at a time.
+
+    void RandomSeeds(int count, tSeed32 values[], tSeed32* seed);                   ///< values[i] = NextSeed(seed)
+
+    void RandomUInt32(int count, uint32_t a, uint32_t values[], tSeed32* seed);     ///< values[i] = RandomUInt32(a, seed)
+
+    void RandomUFloat(int count,          float values[], tSeed32* seed);           ///< values[i] = RandomUFloat(seed)
+    void RandomSFloat(int count,          float values[], tSeed32* seed);           ///< values[i] = RandomSFloat(seed)
+    void RandomSFloat(int count, float a, float values[], tSeed32* seed);           ///< values[i] = RandomSFloat(a, seed)
+
+    void RandomRange     (int count, float a, float b, float values[], tSeed32* seed);  ///< values[i] = RandomRange(a, b, seed)
+    void RandomRangeAbout(int count, float a, float b, float values[], tSeed32* seed);  ///< values[i] = RandomRangeAbout(a, b, seed)
+
+
     // --- cRandomMT -----------------------------------------------------------
 
     class cRandomMT
@@ -182,6 +211,41 @@ namespace nCL
     }
 
 
+    // Streams
+    inline tSeed32 SeedFromKey(uint32_t key)
+    {
+        // Murmur3 finaliser
+        key ^= key >> 16;
+        key *= 0x85ebca6b;
+        key ^= key >> 13;
+        key *= 0xc2b2ae35;
+        key ^= key >> 16;
+
+        return key;
+    }
+
+    inline tSeed32 SeedFromKey(uint32_t key1, uint32_t key2)
+    {
+        return SeedFromKey(SeedFromKey(key1) + 0x9e3779b9 + key2);
+    }
+
+    // Batch
+    inline void RandomUFloat(int count, float values[], tSeed32* seed)
+    {
+        RandomRange(count, 0.0f, 1.0f, values, seed);
+    }
+
+    inline void RandomSFloat(int count, float values[], tSeed32* seed)
+    {
+        RandomRangeAbout(count, 0.0f, 1.0f, values, seed);
+    }
+
+    inline void RandomSFloat(int count, float a, float values[], tSeed32* seed)
+    {
+        RandomRangeAbout(count, 0.0f, a, values, seed);
+    }
+
+
     // cRandomMT
     inline uint32_t cRandomMT::Random()
     {
@@ -34,6 +34,7 @@ namespace nCL
         int  NumSlots() const;
         int  NumSlotsInUse() const;
         void ClearSlots();
+        void ReserveSlots(int n);   ///< Reserve space for n slots, to avoid reallocation as slots are created
 
         cSlotRef CreateSlot();
         bool     DestroySlot(cSlotRef ref);         ///< Returns true if the slot still exists, and destroys it.
@@ -92,6 +93,11 @@ namespace nCL
         return mNumSlotsInUse;
     }
 
+    inline void cSlotArray::ReserveSlots(int n)
+    {
+        mStamps.reserve(n);
+    }
+
     inline bool cSlotArray::InUse(cSlotRef ref) const
     {
         CL_ASSERT(ref.mParentStamp == ~0 || ref.mParentStamp == mStamp);
@@ -169,14 +169,15 @@ namespace nCL
     inline bool eqi(tString lhs, tString rhs)
     { return strcasecmp(lhs.c_str(), rhs.c_str()) == 0; }
 
+    // Tag IDs can be stored in data, so these stay on FNV1a whatever CL_HASH_VERSION is.
     inline uint32_t NameToID(const char* s)
     {
-        return StrIHashU32(s, 0x811C9DC5) | 0x80000000;
+        return StrFNVIHashU32(s, kFNVOffset32) | 0x80000000;
     }
 
     inline uint32_t NameToID(const char* begin, const char* end)
     {
-        return IHashU32(begin, end, 0x811C9DC5) | 0x80000000;
+        return FNVIHashU32(begin, end, kFNVOffset32) | 0x80000000;
     }
 }
 
@@ -95,26 +95,37 @@ namespace nCL
     // Unlike tags, which are intended to be short and must always have a unique hash if
     // specified by string, string IDs can be used to reference any string.
     //
+    // All of the tag and string ID routines may be called from any thread.
+    //
 
     typedef tTag tStringID;
 
     tStringID   StringIDFromString(const char* s);      ///< Returns an ID that can be used to refer to the given string. Warning: this may not be the same as the tTagID.
     const char* StringFromStringID(tStringID id);       ///< Get back the string for the given string ID.
 
-    bool        ReleaseStringID(tStringID id);          ///< Call when a string ID is no longer needed
+    bool        ReleaseStringID(tStringID id);          ///< Call when a string ID is no longer needed. Returns true if its string was released.
     tStringID   CopyStringID(tStringID id);             ///< Increments any internal usage counter for the given string ID.
+    void        CollectStringIDs();
+    ///< Frees the storage of released string IDs. Call only when no other thread can be in a string ID call, e.g., between frames.
 
     tTagID IDFromStringID (tStringID id);               ///< Get hash ID for the given string ID.
     tTag   TagFromStringID(tStringID id);
 
     // System
-    bool InitTagSystem(cIAllocator* allocator = 0);
+    bool InitTagSystem(cIAllocator* allocator = 0, bool refCountStrings = false);
     ///< Call before any calls to the above routines. If allocator is specified,
-    ///< it will be used for all associated tag storage.
+    ///< it will be used for all associated tag storage. If refCountStrings is true,
+    ///< string IDs are reclaimed once every StringIDFromString()/CopyStringID()
+    ///< has been matched by ReleaseStringID(). Otherwise they persist until shutdown.
     bool ShutdownTagSystem();
     ///< Call after all calls to the above routines are done. After this, they
     ///< will return kNullTag.
 
+#if CL_TAG_DEBUG
+    void BenchTagInterning(int count, const char* const strings[]);
+    ///< Reports single- and multi-threaded intern timings for the given strings, vs. a plain locked set.
+#endif
+
 
     // --- Inlines -------------------------------------------------------------
 
@@ -153,17 +164,6 @@ namespace nCL
         return "<unknown>"; // TODO: should be storing here?
     }
 #endif
-
-    // Current implementation keeps all strings around.
-    inline tStringID CopyStringID(tStringID id)
-    {
-        return id;
-    }
-
-    inline bool ReleaseStringID(tStringID id)
-    {
-        return false;
-    }
 }
 
 
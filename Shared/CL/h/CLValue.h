@@ -12,6 +12,7 @@
 #define CL_VALUE_H
 
 #include <CLBounds.h>
+#include <CLHashMap.h>
 #include <CLLink.h>
 #include <CLMemory.h>
 #include <CLSTL.h>
@@ -79,6 +80,8 @@ namespace nCL
     /// - A null object will be returned for bogus queries. (Non-existent array value or object member.)
     /// - An array/object write will fail silently on the wrong kind of value.
     /// The idea is to avoid having to write a lot of error-checking code.
+    /// Values are 16 bytes: strings of up to 7 characters are stored inline, arrays of numbers
+    /// can be packed (see PackArray()), and comments live in a separate table.
     {
     public:
         static const cValue kNull;
@@ -111,7 +114,7 @@ namespace nCL
 
         tValueType Type() const;
 
-        const char*     AsString(const char* defaultValue = 0    ) const;
+        const char*     AsString(const char* defaultValue = 0    ) const;   ///< Short strings are stored in the value itself, so the result is only valid until the value is modified or moved.
         tTag            AsTag   (tTag        defaultValue = kNullTag) const;
         uint32_t        AsID    (uint32_t    defaultValue = 0    ) const;
         int32_t         AsInt   (int32_t     defaultValue = 0    ) const;
@@ -151,6 +154,17 @@ namespace nCL
 
         void Append(const cValue& value);    ///< Append value to array at the end.
 
+        int32_t  EltAsInt  (uint32_t index, int32_t  defaultValue = 0   ) const;  ///< Same as Elt(index).AsInt(), but avoids creating element values for packed arrays
+        uint32_t EltAsUInt (uint32_t index, uint32_t defaultValue = 0   ) const;
+        float    EltAsFloat(uint32_t index, float    defaultValue = 0.0f) const;
+
+        void PackArray();                   ///< If this is an array of ints and/or doubles without comments, switch it to compact storage. Writing via operator[], Append() or resize() switches it back.
+        bool IsPackedArray() const;
+
+        const void* PackedArrayData(uint32_t* size, tValueType* eltType, bool* intMask) const;    ///< Returns the raw contents of a packed array, for serialisation, or 0 if this isn't one. See PackedArrayDataSize().
+        void        SetPackedArray (uint32_t  size, tValueType  eltType, bool  intMask, const void* data);   ///< Set to a packed array with a copy of 'data', in the form returned by PackedArrayData().
+        static size_t PackedArrayDataSize(uint32_t size, tValueType eltType, bool intMask);
+
         // Object API
         const cValue& operator[](tTag tag) const;    ///< Access an object value by name, returns null if there is no member with that name.
         // We purposefully have no non-const operator [], as this will get called when we have non-const access to a cValue,
@@ -190,6 +204,9 @@ namespace nCL
 
         int Compare(const cValue& other);               ///< Trivalue comparison -- returns -1, 0, or 1
 
+        // Diagnostics
+        size_t MemoryUsed() const;  ///< Approximate heap bytes used by this value and its children, not including shared strings
+
         // Low-level type management
         void MakeNull();    // Clears value back to null
         bool MakeArray();   // If value is null, converts to an array. Returns true in this case or if already an array.
@@ -197,17 +214,20 @@ namespace nCL
 
     protected:
         typedef vector<cValue> tArrayValues;
+        struct cPackedArray;
 
-        struct cCommentInfo
+        enum tStorage : uint8_t
         {
-            cCommentInfo();
-            ~cCommentInfo();
-
-            void SetComment(const char* text);
-
-            tStringID mComment;
+            kStorageDefault,    ///< mValue holds the value, or a pointer to it
+            kStorageInline,     ///< string held directly in mValue.mChars
+            kStoragePacked      ///< homogeneous numeric array held in mValue.mPacked
         };
 
+        void          SetString(const char* s);
+        const char*   StringValue() const;          ///< Returns string contents, assumes mType == kValueString
+        tArrayValues* Unpack();                     ///< Converts a packed array to generic storage, returns its elements
+        cValue        PackedElt(uint32_t index) const;
+
         union tValueHolder
         {
             int32_t         mInt;
@@ -215,23 +235,16 @@ namespace nCL
             double          mDouble;
             bool            mBool;
             tStringID       mString;
+            char            mChars[8];
             tArrayValues*   mArray;
+            cPackedArray*   mPacked;
             cObjectValue*   mObject;
         };
 
         tValueHolder    mValue = { 0 };
         tValueType      mType = kValueNull;
-
-        cCommentInfo* mComments = 0;
-    };
-
-
-
-    // --- cArrayValue --------------------------------------------------------
-
-    class cArrayValue
-    {
-        nCL::vector<cValue> mElts;
+        tStorage        mStorage = kStorageDefault;
+        uint32_t        mComments = 0;      ///< Index of our comments in the comment table, or 0 if none
     };
 
     // --- cObjectValue --------------------------------------------------------
@@ -244,6 +257,7 @@ namespace nCL
         const cValue& operator[](tTag key) const;
 
         const cValue& Member      (tTag tag) const;              ///< Return member for the given key if it exists, kNull otherwise.
+        const cValue& TagMember   (tTag tag) const;              ///< Same as Member(), but for a tag that's already resolved, e.g., from CL_TAG(). Doesn't handle dotted paths.
         const cValue& LocalMember (tTag tag) const;              ///< Same as Member() but looks at local members only.
         void          SetMember   (tTag tag, const cValue& v);   ///< Set given member
         cValue&       InsertMember(tTag tag);                    ///< Add given member if it doesn't exist already, returns for writing.
@@ -264,8 +278,9 @@ namespace nCL
         cValue&       MemberValue(int i);         ///< Returns i'th member value
         void          RemoveMembers();            ///< Remove all members
 
-        uint32_t      ModCount() const;
+        uint32_t      ModCount() const;                 ///< Incremented when our members or parents change. Update() also increments it on the ancestors of any change, so it then covers the whole subtree.
         void          IncModCount();
+        static uint32_t Generation();                   ///< Incremented whenever any object's members or parents change. Can be used to invalidate cached lookups.
 
         int                 NumParents() const;
         const cObjectValue* Parent(int i) const;              ///< i'th parent object
@@ -279,16 +294,37 @@ namespace nCL
         void          SetOwner(cObjectValue* owner);    ///< Set owner for this
 
         void          Swap(cObjectValue* other);
+        bool          Update(cObjectValue* source);
+        ///< Makes our contents match 'source', e.g., a freshly re-read config file, while keeping existing child
+        ///< objects and patching them in place. Only objects that actually differ, and their ancestors, have their
+        ///< ModCount bumped. Returns true if anything changed. 'source' is left with the replaced values.
 
         bool operator ==(const cObjectValue& other) const;
 
     protected:
+        bool Update(cObjectValue* source, const cObjectValue* sourceOwner, cObjectValue* owner);
         void AddChildren(tObjectChildren* children) const;
+        void AddFlatMembers(tag_hash_map<const cValue*>* members) const;
+        bool FlatMembersReady() const;
 
         // Data decls
         typedef map<tTag, cValue> tMap;
         typedef vector<cLink<const cObjectValue>> tParents;
 
+        struct cFlatMembers
+        /// Flattened view of all members, including inherited ones. Not copied along with the object.
+        {
+            tag_hash_map<const cValue*> mMembers;
+            uint32_t                    mGeneration = 0;
+            uint32_t                    mLookups = 0;   ///< Lookups since the last change, we only flatten after a few
+
+            cFlatMembers() = default;
+            cFlatMembers(const cFlatMembers&) {}
+            cFlatMembers& operator=(const cFlatMembers&) { mMembers.clear(); mGeneration = 0; return *this; }
+        };
+
+        static std::atomic<uint32_t> sGeneration;
+
         // Data
         tMap            mMap;
         tParents        mParents;     ///< If non-null, inherit from this object.
@@ -298,12 +334,70 @@ namespace nCL
         // Cache for full children list
         mutable tObjectChildren mChildren;
         mutable uint32_t        mChildrenModCount = ~0;
+
+        // Cache for inherited member lookups
+        mutable cFlatMembers    mFlatMembers;
+    };
+
+
+    // --- cConfigPath ---------------------------------------------------------
+
+    class cConfigPath
+    /// Precompiled member path, e.g., "render.showBounds", for lookups made every frame.
+    /// The path's tags are resolved on first use, and the result of the last lookup is
+    /// kept until any object is changed, so repeated lookups on the same object just
+    /// cost a couple of compares.
+    /// Like cObjectValue's other caches, this is not thread safe.
+    {
+    public:
+        explicit cConfigPath(const char* path);     ///< 'path' must persist, e.g., be a string literal.
+
+        const cValue& Find(const cObjectValue* object) const;  ///< Returns value at the path from 'object', or kNull if there is none.
+        const cValue& Find(const cValue& value) const;
+
+        const char* Path() const;
+
+    protected:
+        void Resolve() const;
+
+        enum { kMaxTags = 8 };
+
+        const char*                 mPath;
+        mutable tTag                mTags[kMaxTags];
+        mutable int                 mNumTags = -1;      ///< -1 until resolved
+
+        mutable const cObjectValue* mLastObject = 0;
+        mutable const cValue*       mLastValue = 0;
+        mutable uint32_t            mLastGeneration = 0;
     };
 
     typedef cLink<cObjectValue>       tObjectLink;
     typedef cLink<const cObjectValue> tConstObjectLink;
 
 
+    // --- cConfigChangeTracker ------------------------------------------------
+
+    class cConfigChangeTracker
+    /// Remembers the ModCount() of each config object a system has loaded from, e.g., each
+    /// material in "materials", so that on a config reload it can skip those that haven't
+    /// changed. As cObjectValue::Update() bumps the ancestors of any change, this covers
+    /// everything below each object.
+    {
+    public:
+        bool Changed(const cObjectValue* object);   ///< Returns true if 'object' is new or has been modified since the last call for it, and records its current state.
+        void Reset();                               ///< Forget all objects, so they'll be reported as changed again.
+
+    protected:
+        struct cEntry
+        {
+            tConstObjectLink mObject;       ///< Keeps the object alive, so its address can't be reused by a new one
+            uint32_t         mModCount = 0;
+        };
+
+        map<const cObjectValue*, cEntry> mEntries;
+    };
+
+
     // --- Helpers -------------------------------------------------------------
 
     bool MemberExists(const cObjectValue* config, tTag key, const cValue** vOut);
@@ -366,6 +460,11 @@ namespace nCL
     void DumpHierarchy(const char* label, int indent, const cObjectValue* root, const cObjectValue* owner = 0);
     ///< Debug dump hierarchy
 
+#ifndef CL_RELEASE
+    void BenchConfigLookup();
+    ///< Prints member lookup timings for inheritance chains of various depths.
+#endif
+
     // --- Inlines -------------------------------------------------------------
 
     inline cValue::cValue()
@@ -387,9 +486,9 @@ namespace nCL
     {
         mValue.mDouble = value;
     }
-    inline cValue::cValue(const char* value) : mType(kValueString)
+    inline cValue::cValue(const char* value)
     {
-        mValue.mString = StringIDFromString(value);
+        SetString(value);
     }
     inline cValue::cValue(cObjectValue* object) : mType(kValueObject)
     {
@@ -424,8 +523,7 @@ namespace nCL
     inline void cValue::operator=(const char* value)
     {
         MakeNull();
-        mType = kValueString;
-        mValue.mString = StringIDFromString(value);
+        SetString(value);
     }
 
     inline void cValue::operator=(cObjectValue* object)
@@ -538,7 +636,7 @@ namespace nCL
     inline int cValue::NumElts() const
     {
         if (mType == kValueArray)
-            return mValue.mArray->size();
+            return size();
 
         return 0;
     }
@@ -550,7 +648,12 @@ namespace nCL
     inline void cValue::resize(uint32_t newSize)
     {
         if (MakeArray())
-            mValue.mArray->resize(newSize);
+            Unpack()->resize(newSize);
+    }
+
+    inline bool cValue::IsPackedArray() const
+    {
+        return mStorage == kStoragePacked;
     }
 
     inline const cValue& cValue::operator[](tTag key) const
@@ -694,7 +797,7 @@ namespace nCL
 
     inline void cObjectValue::RemoveMembers()
     {
-        mModCount++;
+        IncModCount();
         mMap.clear();
     }
 
@@ -711,6 +814,12 @@ namespace nCL
     inline void cObjectValue::IncModCount()
     {
         mModCount++;
+        sGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline uint32_t cObjectValue::Generation()
+    {
+        return sGeneration.load(std::memory_order_relaxed);
     }
 
     inline int cObjectValue::NumParents() const
@@ -729,11 +838,13 @@ namespace nCL
         CL_ASSERT(parent != this);
 
         mParents.push_back(parent);
+        IncModCount();
     }
 
     inline void cObjectValue::RemoveParents()
     {
         mParents.clear();
+        IncModCount();
     }
 
     inline cObjectValue* cObjectValue::Owner() const
@@ -749,7 +860,59 @@ namespace nCL
 
     inline bool cObjectValue::operator == (const cObjectValue& other) const
     {
-        return mMap == other.mMap;
+        // Compare by member, as map == compares bytes
+        if (mMap.size() != other.mMap.size())
+            return false;
+
+        for (int i = 0, n = mMap.size(); i < n; i++)
+            if (mMap.at(i).first != other.mMap.at(i).first || mMap.at(i).second != other.mMap.at(i).second)
+                return false;
+
+        return true;
+    }
+
+
+    // --- cConfigPath ---------------------------------------------------------
+
+    inline cConfigPath::cConfigPath(const char* path) :
+        mPath(path)
+    {
+    }
+
+    inline const cValue& cConfigPath::Find(const cObjectValue* object) const
+    {
+        if (object && object == mLastObject && mLastGeneration == cObjectValue::Generation())
+            return *mLastValue;
+
+        if (!object)
+            return cValue::kNull;
+
+        if (mNumTags < 0)
+            Resolve();
+
+        const cValue* value = &object->TagMember(mTags[0]);
+
+        for (int i = 1; i < mNumTags; i++)
+        {
+            const cObjectValue* child = value->AsObject();
+            value = child ? &child->TagMember(mTags[i]) : &cValue::kNull;
+        }
+
+        mLastObject = object;
+        mLastValue = value;
+        mLastGeneration = cObjectValue::Generation();
+
+        return *value;
+    }
+
+    inline const cValue& cConfigPath::Find(const cValue& value) const
+    {
+        return Find(value.AsObject());
+    }
+
+    inline const char* cConfigPath::Path() const
+    {
+        return mPath;
     }
 
 
@@ -772,7 +935,7 @@ namespace nCL
         int n = min(value.size(), nv);
 
         for (int i = 0; i < n; i++)
-            v[i] = value[i].AsInt();
+            v[i] = value.EltAsInt(i);
 
         return n;
     }
@@ -782,7 +945,7 @@ namespace nCL
         int n = min(value.size(), nv);
 
         for (int i = 0; i < n; i++)
-            v[i] = value[i].AsUInt();
+            v[i] = value.EltAsUInt(i);
 
         return n;
     }
@@ -792,7 +955,7 @@ namespace nCL
         int n = min(value.size(), nv);
 
         for (int i = 0; i < n; i++)
-            v[i] = value[i].AsFloat();
+            v[i] = value.EltAsFloat(i);
 
         return n;
     }
@@ -807,7 +970,7 @@ namespace nCL
         float* v = &bbox->mMin[0];
         
         for (int i = 0; i < n; i++)
-            v[i] = value[i].AsFloat();
+            v[i] = value.EltAsFloat(i);
         
         return true;
     }
@@ -821,7 +984,7 @@ namespace nCL
         float* v = &bbox->mMin[0];
 
         for (int i = 0; i < n; i++)
-            v[i] = value[i].AsFloat();
+            v[i] = value.EltAsFloat(i);
 
         return n;
     }
@@ -830,7 +993,7 @@ namespace nCL
         int n = min(2, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsInt();
+            (*v)[i] = value.EltAsInt(i);
         
         return n;
     }
@@ -839,7 +1002,7 @@ namespace nCL
         int n = min(3, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsInt();
+            (*v)[i] = value.EltAsInt(i);
         
         return n;
     }
@@ -848,7 +1011,7 @@ namespace nCL
         int n = min(4, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsInt();
+            (*v)[i] = value.EltAsInt(i);
         
         return n;
     }
@@ -857,7 +1020,7 @@ namespace nCL
         int n = min(2, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsFloat();
+            (*v)[i] = value.EltAsFloat(i);
 
         return n;
     }
@@ -866,7 +1029,7 @@ namespace nCL
         int n = min(3, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsFloat();
+            (*v)[i] = value.EltAsFloat(i);
 
         return n;
     }
@@ -875,7 +1038,7 @@ namespace nCL
         int n = min(4, value.size());
         
         for (int i = 0; i < n; i++)
-            (*v)[i] = value[i].AsFloat();
+            (*v)[i] = value.EltAsFloat(i);
 
         return n;
     }
@@ -0,0 +1,50 @@
+//
+//  File:       CLValueData.h
+//
+//  Function:   Binary form of cValue trees, for fast loading of config data
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#ifndef CL_VALUE_DATA_H
+#define CL_VALUE_DATA_H
+
+#include <CLValue.h>
+
+namespace nCL
+{
+    class cFileSpec;
+
+    // The binary form is written via a cWriteableDataStore, so it contains
+    // only offsets, and can be mapped in and walked as is. Tag names are
+    // stored once, in a table that members refer to by index, and numeric
+    // arrays are stored in the same form as packed cValue arrays. Comments
+    // are not stored.
+
+    extern const char* const kValueDataExtension;   ///< Extension added to a json file's name to give its binary form, e.g., config.json.bin
+
+    bool WriteValueData    (const cValue& value, vector<uint8_t>* data);   ///< Convert 'value' to binary form
+    bool WriteValueDataFile(const cValue& value, const cFileSpec& spec);   ///< Write 'value' in binary form to the given file
+
+    bool ReadValueData    (size_t size, const uint8_t* data, cValue* value);
+    ///< Read value from binary form. Returns false if the data is not in the current format.
+    ///< As with cJSONReader, any existing cObjectValues in 'value' are preserved.
+    bool ReadValueDataFile(const cFileSpec& spec, cValue* value);
+    ///< Maps in the given file and reads it via ReadValueData().
+
+    bool FindValueDataFile(const cFileSpec& jsonSpec, cFileSpec* dataSpec);
+    ///< Returns true if jsonSpec has a binary form that is at least as new as it, or jsonSpec itself is missing, and sets dataSpec to it.
+
+    void SetValueDataFilesEnabled(bool enabled);
+    ///< Controls whether ReadFromJSONFile() will use an up-to-date binary form when available. Defaults to true.
+    bool ValueDataFilesEnabled();
+
+#ifndef CL_RELEASE
+    void BenchValueDataRead(const cFileSpec& jsonSpec);
+    ///< Prints load time for the given file as json and in binary form, and checks they give the same result.
+#endif
+}
+
+#endif
@@ -121,6 +121,13 @@ namespace nCL
     Vec3f RandomEllipsoid(const cBounds3& bounds, tSeed32* seed);   ///< Generalised version of RandomSphere, handles any axis-aligned ellipsoid with the given bounds
     Vec3f RandomTorus    (const cBounds3& bounds, float r, tSeed32* seed);  ///< Returns random point from a torus with the given radius and bounds
 
+    // Batch versions of the above: these match 'count' successive single calls, but use the four-wide generators from CLRandom.h.
+    void RandomRange    (int count, Vec2f range,              float values[], tSeed32* seed);
+    void RandomRange    (int count, const cBounds3& bounds,   Vec3f values[], tSeed32* seed);
+    void RandomSphere3f (int count,                           Vec3f values[], tSeed32* seed);
+    void RandomEllipsoid(int count, const cBounds3& bounds,   Vec3f values[], tSeed32* seed);
+    void RandomTorus    (int count, const cBounds3& bounds, float r, Vec3f values[], tSeed32* seed);
+
     bool Refract
     (
         float          fromIndex,
@@ -403,6 +410,11 @@ namespace nCL
         return range[0] + (range[1] - range[0]) * UFloatFromSeed(NextSeed(seed));
     }
 
+    inline void RandomRange(int count, Vec2f range, float values[], tSeed32* seed)
+    {
+        RandomRange(count, range[0], range[1], values, seed);
+    }
+
     inline Vec2f RandomSquare2f(tSeed32* seed)
     {
         Vec2f result;
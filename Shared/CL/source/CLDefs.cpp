@@ -33,6 +33,7 @@ void CLDefaultError(const char* errorMessage)
 {
 #ifdef CL_LOG_H
     CL_LOG("Debug", "*** %s\n", errorMessage);
+    nCL::FlushLog();    // Log output is asynchronous, so make sure it's out before we stop
 #else
     fprintf(stderr, "*** %s\n", errorMessage);
 #endif
@@ -93,6 +94,7 @@ void nCL::Trace(const char* desc, const char* file, int line, const char* messag
 
 #ifdef CL_LOG_H
    CL_LOG("Debug", "%s", buffer);
+   nCL::FlushLog();
 #else
    fprintf(stderr, "%s", buffer);
 #endif
@@ -1,7 +1,7 @@
 //
 //  File:       CLDispatch.cpp
 //
-//  Function:   <Description>
+//  Function:   Work-stealing job system
 //
 //  Author(s):  Andrew Willmott
 //
@@ -10,89 +10,558 @@
 
 #include <CLDispatch.h>
 
-#include <dispatch/dispatch.h>
-#include <stdio.h>
-#include <fcntl.h>
+#include <CLLog.h>
+#include <CLMemory.h>
+#include <CLProfile.h>
+#include <CLSTL.h>
+#include <CLTimer.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+using namespace nCL;
 
 namespace
 {
+    struct cJob
+    {
+        tJobFunc*       mFunc;
+        void*           mData;
+        int             mIndex;
+        cJobCounter*    mCounter;
+    };
 
-}
+    const int kJobQueueSize = 4096;     // must be a power of two
+    const int kSpinCount    = 64;       // number of failed steal rounds before a worker sleeps
 
+    class cJobQueue
+    /// Chase-Lev work-stealing deque. Push/Pop may only be called by the owning
+    /// thread, Steal may be called from any thread.
+    {
+    public:
+        bool Push (const cJob& job);
+        bool Pop  (cJob* job);
+        bool Steal(cJob* job);
 
+        cJob*               mJobs = 0;
 
+        alignas(64) std::atomic<int32_t> mTop;
+        alignas(64) std::atomic<int32_t> mBottom;
+    };
 
+    bool cJobQueue::Push(const cJob& job)
+    {
+        int32_t b = mBottom.load(std::memory_order_relaxed);
+        int32_t t = mTop   .load(std::memory_order_acquire);
 
+        if (b - t >= kJobQueueSize)
+            return false;
 
-void DoJob(void* data, size_t index)
-{
-    printf("callback job %lu\n", index);
+        mJobs[b & (kJobQueueSize - 1)] = job;
+
+        std::atomic_thread_fence(std::memory_order_release);
+        mBottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool cJobQueue::Pop(cJob* job)
+    {
+        int32_t b = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(b, std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        int32_t t = mTop.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            mBottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        *job = mJobs[b & (kJobQueueSize - 1)];
+
+        if (t != b)
+            return true;
+
+        // Last item -- race any thieves for it
+        bool won = mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        mBottom.store(b + 1, std::memory_order_relaxed);
+
+        return won;
+    }
+
+    bool cJobQueue::Steal(cJob* job)
+    {
+        int32_t t = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int32_t b = mBottom.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        *job = mJobs[t & (kJobQueueSize - 1)];
+
+        return mTop.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    struct cJobThread
+    {
+        cJobQueue   mQueue;
+        pthread_t   mThread;
+        uint32_t    mSeed = 0;
+
+        int         mJobsRun = 0;
+        int         mJobsStolen = 0;
+    };
+
+    cIAllocator*        sJobAllocator = 0;
+    int                 sNumThreads = 0;
+    cJobThread*         sThreads = 0;
+
+    std::atomic<int32_t> sPendingJobs(0);   // jobs currently sitting in a queue
+    std::atomic<int32_t> sNumSleeping(0);
+    std::atomic<bool>    sQuit(false);
+
+    pthread_mutex_t     sSleepMutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t      sSleepCond  = PTHREAD_COND_INITIALIZER;
+
+    pthread_mutex_t     sMainJobsMutex = PTHREAD_MUTEX_INITIALIZER;
+    vector<cJob>        sMainJobs;
+
+    __thread int        tThreadIndex = -1;
+
+    inline void RunJob(const cJob& job)
+    {
+        {
+            CL_PROFILE_SCOPE("Job");
+            job.mFunc(job.mData, job.mIndex);
+        }
+
+        if (job.mCounter)
+            job.mCounter->mCount.fetch_sub(1, std::memory_order_release);
+    }
+
+    void WakeWorkers()
+    {
+        if (sNumSleeping.load() > 0)
+        {
+            pthread_mutex_lock(&sSleepMutex);
+            pthread_cond_broadcast(&sSleepCond);
+            pthread_mutex_unlock(&sSleepMutex);
+        }
+    }
+
+    bool FindJob(int threadIndex, cJob* job)
+    {
+        cJobThread& self = sThreads[threadIndex];
+
+        if (self.mQueue.Pop(job))
+        {
+            sPendingJobs.fetch_sub(1);
+            return true;
+        }
+
+        if (sPendingJobs.load(std::memory_order_relaxed) <= 0)
+            return false;
+
+        // Start at a random victim to avoid everyone hammering the same queue.
+        self.mSeed = self.mSeed * 1664525 + 1013904223;
+        int start = (self.mSeed >> 16) % sNumThreads;
+
+        for (int i = 0; i < sNumThreads; i++)
+        {
+            int victim = start + i;
+            if (victim >= sNumThreads)
+                victim -= sNumThreads;
+
+            if (victim != threadIndex && sThreads[victim].mQueue.Steal(job))
+            {
+                sPendingJobs.fetch_sub(1);
+                self.mJobsStolen++;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void* WorkerMain(void* data)
+    {
+        int threadIndex = int(intptr_t(data));
+        tThreadIndex = threadIndex;
+
+    #if CL_PROFILE
+        char threadName[16];
+        snprintf(threadName, sizeof(threadName), "Job %d", threadIndex);
+        SetProfileThreadName(threadName);
+    #endif
+
+        cJobThread& self = sThreads[threadIndex];
+        int spins = 0;
+        cJob job;
+
+        while (!sQuit.load(std::memory_order_relaxed))
+        {
+            if (FindJob(threadIndex, &job))
+            {
+                RunJob(job);
+                self.mJobsRun++;
+                spins = 0;
+                continue;
+            }
+
+            if (++spins < kSpinCount)
+            {
+                sched_yield();
+                continue;
+            }
+
+            pthread_mutex_lock(&sSleepMutex);
+            sNumSleeping++;
+
+            while (sPendingJobs.load() <= 0 && !sQuit.load())
+                pthread_cond_wait(&sSleepCond, &sSleepMutex);
+
+            sNumSleeping--;
+            pthread_mutex_unlock(&sSleepMutex);
+            spins = 0;
+        }
+
+        return 0;
+    }
+
+    struct cRangeInfo
+    {
+        tJobRangeFunc*  mFunc;
+        void*           mData;
+        int             mCount;
+        int             mGrain;
+    };
+
+    void RangeJob(void* data, int index)
+    {
+        const cRangeInfo* info = (const cRangeInfo*) data;
+
+        int begin = index * info->mGrain;
+        int end   = begin + info->mGrain;
+
+        if (end > info->mCount)
+            end = info->mCount;
+
+        info->mFunc(info->mData, begin, end);
+    }
 }
 
-void DoAsyncJob(void* data)
+bool nCL::InitJobs(cIAllocator* alloc, int numThreads)
 {
-    printf("async job\n");
+    CL_ASSERT(sNumThreads == 0);
+
+    if (numThreads < 0)
+        numThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+
+    if (numThreads < 1)
+        numThreads = 1;
+    if (numThreads > kMaxJobThreads)
+        numThreads = kMaxJobThreads;
+
+    sJobAllocator = alloc;
+    sQuit = false;
+    sPendingJobs = 0;
+    sNumSleeping = 0;
+
+    sThreads = (cJobThread*) alloc->Alloc(sizeof(cJobThread) * numThreads, CL_ALIGNOF(cJobThread));
+
+    for (int i = 0; i < numThreads; i++)
+    {
+        cJobThread* thread = new(sThreads + i) cJobThread;
+
+        thread->mQueue.mJobs = CreateArray<cJob>(alloc, kJobQueueSize);
+        thread->mQueue.mTop = 0;
+        thread->mQueue.mBottom = 0;
+        thread->mSeed = i;
+    }
+
+    sNumThreads = numThreads;
+    tThreadIndex = 0;
+
+    for (int i = 1; i < numThreads; i++)
+    {
+        if (pthread_create(&sThreads[i].mThread, 0, WorkerMain, (void*) intptr_t(i)) != 0)
+        {
+            CL_LOG_E("Jobs", "Failed to create worker thread %d\n", i);
+            sNumThreads = i;
+            break;
+        }
+    }
+
+    CL_LOG_I("Jobs", "Started job system with %d threads\n", sNumThreads);
+
+    return true;
 }
 
+bool nCL::ShutdownJobs()
+{
+    if (sNumThreads == 0)
+        return false;
+
+    // Drain anything left on the main thread's queue
+    cJob job;
+    while (FindJob(0, &job))
+        RunJob(job);
 
-const dispatch_source_vnode_flags_t kAllVNodeFlags =
-  DISPATCH_VNODE_DELETE
-| DISPATCH_VNODE_WRITE
-| DISPATCH_VNODE_EXTEND
-| DISPATCH_VNODE_ATTRIB
-| DISPATCH_VNODE_LINK
-| DISPATCH_VNODE_RENAME
-| DISPATCH_VNODE_REVOKE;
+    pthread_mutex_lock(&sSleepMutex);
+    sQuit = true;
+    pthread_cond_broadcast(&sSleepCond);
+    pthread_mutex_unlock(&sSleepMutex);
 
-void SourceCallback(dispatch_source_t source, void* context)
+    for (int i = 1; i < sNumThreads; i++)
+        pthread_join(sThreads[i].mThread, 0);
+
+    for (int i = 0; i < sNumThreads; i++)
+        Destroy(&sThreads[i].mQueue.mJobs, sJobAllocator);
+
+    sJobAllocator->Free(sThreads);
+    sThreads = 0;
+
+    sNumThreads = 0;
+    sJobAllocator = 0;
+    tThreadIndex = -1;
+
+    return true;
+}
+
+int nCL::NumJobThreads()
 {
-    dispatch_source_vnode_flags_t flags = dispatch_source_get_data(source);
-    printf("Source callback (%s), flags = 0x%08lx\n", context ? context : "", flags);
+    return sNumThreads > 0 ? sNumThreads : 1;
 }
 
+int nCL::JobThreadIndex()
+{
+    return tThreadIndex;
+}
 
-void SubmitJob()
+void nCL::AddJob(tJobFunc* f, void* data, cJobCounter* counter)
 {
-    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0);
-//    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
-    // or _HIGH/_LOW/_BACKGROUND
-    // or, dispatch_get_main_queue(), and call dispatch_main() periodically
+    AddJobs(1, f, data, counter);
+}
 
+void nCL::AddJobs(int count, tJobFunc* f, void* data, cJobCounter* counter)
+{
+    int threadIndex = tThreadIndex;
 
-    dispatch_group_t group = dispatch_group_create();
-    dispatch_object_t object = 0;
+    if (sNumThreads <= 1 || threadIndex < 0)
+    {
+        for (int i = 0; i < count; i++)
+            f(data, i);
 
+        return;
+    }
 
-    dispatch_async_f(queue, 0, DoAsyncJob);
-    int count = 16;
+    if (counter)
+        counter->mCount.fetch_add(count, std::memory_order_relaxed);
 
-    dispatch_group_enter(group);
-    dispatch_apply_f(count, queue, 0, DoJob);
-    dispatch_group_leave(group);
+    cJobQueue& queue = sThreads[threadIndex].mQueue;
+    cJob job = { f, data, 0, counter };
 
-    dispatch_apply(count, queue,
-        ^(size_t index)
+    for (int i = 0; i < count; i++)
+    {
+        job.mIndex = i;
+
+        sPendingJobs.fetch_add(1);
+
+        if (!queue.Push(job))
         {
-            printf("block job %lu / %d\n", index, count);
+            // Queue is full, run it ourselves
+            sPendingJobs.fetch_sub(1);
+            RunJob(job);
         }
-    );
+    }
 
-    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
-    printf("All done.\n");
+    WakeWorkers();
+}
+
+void nCL::WaitForJobs(cJobCounter* counter)
+{
+    int threadIndex = tThreadIndex;
 
+    if (threadIndex < 0)
+    {
+        while (!counter->Done())
+            sched_yield();
 
-    // Experiment with sources...
-    int watchFD = open("/tmp/a.txt", O_EVTONLY);
-    dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, watchFD, kAllVNodeFlags, queue);
-    dispatch_source_set_event_handler(source,
-        ^{ SourceCallback(source, dispatch_get_context(source)); }
-    );
-    dispatch_set_context(source, (void*) "context message");
-    dispatch_resume(source);
+        return;
+    }
 
+    cJob job;
+
+    while (!counter->Done())
+    {
+        if (FindJob(threadIndex, &job))
+        {
+            RunJob(job);
+            sThreads[threadIndex].mJobsRun++;
+        }
+        else if (threadIndex == 0 && RunMainThreadJobs() > 0)
+            ;   // avoid deadlock if we're waiting on a job that's waiting on the main thread
+        else
+            sched_yield();
+    }
 }
 
-void nCL::DispatchTest()
+void nCL::AddMainThreadJob(tJobFunc* f, void* data, cJobCounter* counter)
 {
-    SubmitJob();
+    cJob job = { f, data, 0, counter };
+
+    if (sNumThreads == 0)
+    {
+        f(data, 0);
+        return;
+    }
+
+    if (counter)
+        counter->mCount.fetch_add(1, std::memory_order_relaxed);
+
+    pthread_mutex_lock(&sMainJobsMutex);
+    sMainJobs.push_back(job);
+    pthread_mutex_unlock(&sMainJobsMutex);
+}
+
+int nCL::RunMainThreadJobs()
+{
+    CL_ASSERT(tThreadIndex <= 0);
+
+    // Local, as a job waiting on a counter re-enters via WaitForJobs
+    vector<cJob> jobs;
+
+    pthread_mutex_lock(&sMainJobsMutex);
+    jobs.swap(sMainJobs);
+    pthread_mutex_unlock(&sMainJobsMutex);
+
+    int numJobs = jobs.size();
+
+    for (int i = 0; i < numJobs; i++)
+        RunJob(jobs[i]);
+
+    return numJobs;
 }
+
+void nCL::ParallelFor(int count, int grain, tJobRangeFunc* f, void* data)
+{
+    if (grain < 1)
+        grain = 1;
+
+    if (count <= grain || sNumThreads <= 1 || tThreadIndex < 0)
+    {
+        if (count > 0)
+            f(data, 0, count);
+        return;
+    }
+
+    cRangeInfo info = { f, data, count, grain };
+    cJobCounter counter;
+
+    AddJobs((count + grain - 1) / grain, RangeJob, &info, &counter);
+    WaitForJobs(&counter);
+}
+
+void nCL::GetJobStats(cJobStats* stats)
+{
+    for (int i = 0; i < kMaxJobThreads; i++)
+    {
+        stats->mJobsRun   [i] = i < sNumThreads ? sThreads[i].mJobsRun    : 0;
+        stats->mJobsStolen[i] = i < sNumThreads ? sThreads[i].mJobsStolen : 0;
+    }
+}
+
+void nCL::ResetJobStats()
+{
+    for (int i = 0; i < sNumThreads; i++)
+    {
+        sThreads[i].mJobsRun = 0;
+        sThreads[i].mJobsStolen = 0;
+    }
+}
+
+
+#ifndef CL_RELEASE
+
+namespace
+{
+    void BenchWork(void* data, int begin, int end)
+    {
+        float* values = (float*) data;
+
+        for (int i = begin; i < end; i++)
+        {
+            float x = values[i];
+
+            for (int j = 0; j < 32; j++)
+                x = sqrtf(x * x + 1.0f) * 0.5f;
+
+            values[i] = x;
+        }
+    }
+
+    void BenchEmptyJob(void* data, int index)
+    {
+    }
+}
+
+namespace nCL
+{
+    void BenchJobs()
+    {
+        cIAllocator* alloc = Allocator(kDefaultAllocator);
+        bool wasRunning = sNumThreads > 0;
+
+        if (wasRunning)
+            ShutdownJobs();
+
+        const int kNumValues = 1 << 20;
+        const int kGrain = 1024;
+        const int kJobBatch = 1024;
+        const int kNumSmallJobs = 100 * kJobBatch;
+
+        float* values = CreateArray<float>(alloc, kNumValues);
+        int maxThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+        double baseTime = 0.0;
+
+        printf("Threads  ParallelFor (ms)  Speedup  Empty jobs (ns/job)\n");
+
+        for (int numThreads = 1; numThreads <= maxThreads && numThreads <= kMaxJobThreads; numThreads++)
+        {
+            InitJobs(alloc, numThreads);
+
+            for (int i = 0; i < kNumValues; i++)
+                values[i] = float(i);
+
+            uint64_t t0 = AbsoluteTicks();
+            ParallelFor(kNumValues, kGrain, BenchWork, values);
+            uint64_t t1 = AbsoluteTicks();
+
+            cJobCounter counter;
+            for (int i = 0; i < kNumSmallJobs; i += kJobBatch)
+                AddJobs(kJobBatch, BenchEmptyJob, 0, &counter);
+            WaitForJobs(&counter);
+            uint64_t t2 = AbsoluteTicks();
+
+            double parallelTime = (t1 - t0) * 1e-6;
+
+            if (numThreads == 1)
+                baseTime = parallelTime;
+
+            printf("%7d  %16.2f  %7.2f  %19.1f\n", numThreads, parallelTime, baseTime / parallelTime, double(t2 - t1) / kNumSmallJobs);
+
+            ShutdownJobs();
+        }
+
+        alloc->Free(values);
+
+        if (wasRunning)
+            InitJobs(alloc);
+    }
+}
+
+#endif
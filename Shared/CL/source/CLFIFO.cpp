@@ -0,0 +1,299 @@
+//
+//  File:       CLFIFO.cpp
+//
+//  Function:   Stress test and benchmark for the lockless FIFOs
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <CLFIFO.h>
+
+#include <CLSTL.h>
+#include <CLTimer.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace nCL;
+
+#ifndef CL_RELEASE
+
+namespace
+{
+    const int kMaxFIFOThreads = 16;     // max producers, and max consumers
+    const int kBatchSize = 16;          // used for WriteN/ReadN
+
+    struct cFIFOTest
+    /// Shared state for a set of producer and consumer threads. Producers
+    /// write (producer << 24 | i) for i in [0, mCount). Consumers check that
+    /// items from each producer arrive in order, and keep a checksum.
+    {
+        cFIFO<uint32_t>*        mSPSC = 0;
+        cMPMCFIFO<uint32_t>*    mMPMC = 0;
+        bool                    mBatched = false;
+
+        int                     mProducers = 0;
+        int                     mCount = 0;
+
+        std::atomic<int>        mItemsRead  { 0 };
+        std::atomic<uint64_t>   mChecksum   { 0 };
+        std::atomic<bool>       mFailed     { false };
+
+        int Write(int count, const uint32_t items[])
+        {
+            if (mSPSC)
+                return mBatched ? mSPSC->WriteN(count, items) : mSPSC->Write(items[0]);
+
+            return mBatched ? mMPMC->WriteN(count, items) : mMPMC->Write(items[0]);
+        }
+
+        int Read(int count, uint32_t items[])
+        {
+            if (mSPSC)
+                return mBatched ? mSPSC->ReadN(count, items) : mSPSC->Read(items);
+
+            return mBatched ? mMPMC->ReadN(count, items) : mMPMC->Read(items);
+        }
+    };
+
+    struct cFIFOThread
+    {
+        cFIFOTest*  mTest;
+        int         mIndex;
+        pthread_t   mThread;
+    };
+
+    void* ProducerMain(void* data)
+    {
+        cFIFOThread* thread = (cFIFOThread*) data;
+        cFIFOTest* test = thread->mTest;
+        uint32_t tag = uint32_t(thread->mIndex) << 24;
+        uint32_t items[kBatchSize];
+
+        for (int i = 0, n = test->mCount; i < n; )
+        {
+            int count = test->mBatched ? min(kBatchSize, n - i) : 1;
+
+            for (int j = 0; j < count; j++)
+                items[j] = tag | (i + j);
+
+            int written = test->Write(count, items);
+
+            if (written == 0)
+                sched_yield();
+
+            i += written;   // on a partial write, the rest of the batch is regenerated next time around
+        }
+
+        return 0;
+    }
+
+    void* ConsumerMain(void* data)
+    {
+        cFIFOThread* thread = (cFIFOThread*) data;
+        cFIFOTest* test = thread->mTest;
+        int total = test->mProducers * test->mCount;
+
+        int32_t  lastSeen[kMaxFIFOThreads];
+        uint64_t checksum = 0;
+        uint32_t items[kBatchSize];
+
+        for (int i = 0; i < kMaxFIFOThreads; i++)
+            lastSeen[i] = -1;
+
+        while (test->mItemsRead.load(std::memory_order_relaxed) < total)
+        {
+            int count = test->Read(test->mBatched ? kBatchSize : 1, items);
+
+            if (count == 0)
+            {
+                sched_yield();
+                continue;
+            }
+
+            for (int i = 0; i < count; i++)
+            {
+                uint32_t producer = items[i] >> 24;
+                int32_t  value    = items[i] & 0xFFFFFF;
+
+                if (producer >= uint32_t(test->mProducers) || value <= lastSeen[producer])
+                    test->mFailed = true;
+
+                lastSeen[producer] = value;
+                checksum += items[i];
+            }
+
+            test->mItemsRead.fetch_add(count, std::memory_order_relaxed);
+        }
+
+        test->mChecksum.fetch_add(checksum);
+        return 0;
+    }
+
+    double RunFIFOTest(cFIFOTest* test, int producers, int consumers, int count)
+    /// Returns time taken in seconds
+    {
+        cFIFOThread threads[2 * kMaxFIFOThreads];
+        int numThreads = producers + consumers;
+
+        test->mProducers = producers;
+        test->mCount = count;
+        test->mItemsRead = 0;
+        test->mChecksum = 0;
+        test->mFailed = false;
+
+        for (int i = 0; i < numThreads; i++)
+        {
+            threads[i].mTest = test;
+            threads[i].mIndex = i < producers ? i : i - producers;
+        }
+
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int i = 0; i < numThreads; i++)
+            pthread_create(&threads[i].mThread, 0, i < producers ? ProducerMain : ConsumerMain, threads + i);
+
+        for (int i = 0; i < numThreads; i++)
+            pthread_join(threads[i].mThread, 0);
+
+        uint64_t t1 = AbsoluteTicks();
+
+        uint64_t expected = 0;
+
+        for (int p = 0; p < producers; p++)
+            expected += uint64_t(p << 24) * count + uint64_t(count) * (count - 1) / 2;
+
+        if (test->mChecksum != expected || test->mItemsRead != producers * count)
+            test->mFailed = true;
+
+        return (t1 - t0) * 1e-9;
+    }
+}
+
+bool nCL::TestFIFOs()
+{
+    cIAllocator* alloc = Allocator(kDefaultAllocator);
+
+    const int kCount = 200000;
+    bool success = true;
+
+    cFIFO<uint32_t>     spsc(64, alloc);
+    cMPMCFIFO<uint32_t> mpmc(64, alloc);
+
+    for (int batched = 0; batched < 2; batched++)
+    {
+        cFIFOTest test;
+        test.mSPSC = &spsc;
+        test.mBatched = batched != 0;
+
+        RunFIFOTest(&test, 1, 1, kCount);
+
+        if (test.mFailed)
+        {
+            printf("cFIFO%s failed\n", batched ? " batched" : "");
+            success = false;
+        }
+
+        const int kConfigs[][2] = { { 1, 1 }, { 4, 1 }, { 1, 4 }, { 4, 4 } };
+
+        for (auto config : kConfigs)
+        {
+            cFIFOTest test;
+            test.mMPMC = &mpmc;
+            test.mBatched = batched != 0;
+
+            RunFIFOTest(&test, config[0], config[1], kCount / config[0]);
+
+            if (test.mFailed)
+            {
+                printf("cMPMCFIFO%s failed with %d producers, %d consumers\n", batched ? " batched" : "", config[0], config[1]);
+                success = false;
+            }
+        }
+    }
+
+    // Items with constructors and destructors, around the buffer a few times
+    {
+        cMPMCFIFO<string> strings(8, alloc);
+        string item;
+
+        for (int i = 0; i < 40; i++)
+        {
+            string written(i % 3 ? "short" : "a string long enough to need its own allocation");
+            written += char('a' + i % 26);
+
+            if (!strings.Write(written) || !strings.Read(&item) || item != written)
+            {
+                printf("cMPMCFIFO<string> failed at item %d\n", i);
+                success = false;
+                break;
+            }
+        }
+
+        strings.Write(item);    // leave one behind for the destructor
+    }
+
+    // Unsized queues must be safe to clear, as with cFIFO
+    {
+        cMPMCFIFO<uint32_t> unsized;
+        unsized.Clear();
+
+        if (unsized.Size() != 0)
+        {
+            printf("cMPMCFIFO Clear() before Resize() failed\n");
+            success = false;
+        }
+    }
+
+    printf("FIFO test %s\n", success ? "passed" : "FAILED");
+
+    return success;
+}
+
+void nCL::BenchFIFOs()
+{
+    cIAllocator* alloc = Allocator(kDefaultAllocator);
+
+    const int kCount = 1 << 21;
+    int maxThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+
+    cFIFO<uint32_t>     spsc(1024, alloc);
+    cMPMCFIFO<uint32_t> mpmc(1024, alloc);
+
+    printf("Type        Threads    Mops/s (single)  Mops/s (batched)  Per thread (batched)\n");
+
+    for (int numThreads = 2; numThreads <= maxThreads || numThreads == 2; numThreads += 2)
+    {
+        int pairs = min(numThreads / 2, kMaxFIFOThreads);
+        double rates[2];
+
+        for (int spscOnly = 1; spscOnly >= 0; spscOnly--)
+        {
+            if (spscOnly && pairs > 1)
+                continue;
+
+            for (int batched = 0; batched < 2; batched++)
+            {
+                cFIFOTest test;
+                test.mSPSC = spscOnly ? &spsc : 0;
+                test.mMPMC = spscOnly ? 0 : &mpmc;
+                test.mBatched = batched != 0;
+
+                double t = RunFIFOTest(&test, pairs, pairs, kCount / pairs);
+
+                rates[batched] = kCount / t * 1e-6;
+
+                if (test.mFailed)
+                    printf("FAILED: ");
+            }
+
+            printf("%-10s  %7d  %16.2f  %16.2f  %20.2f\n", spscOnly ? "cFIFO" : "cMPMCFIFO", 2 * pairs, rates[0], rates[1], rates[1] / (2 * pairs));
+        }
+    }
+}
+
+#endif
@@ -533,6 +533,19 @@ void nCL::GetTempPath(tString* tempPath)
 // --- cDirectoryInfo ----------------------------------------------------------
 
 #include <dirent.h>
+#include <string.h>
+
+namespace
+{
+    inline size_t NameLength(const dirent* entry)
+    {
+    #ifdef __linux__
+        return strlen(entry->d_name);   // no d_namlen
+    #else
+        return entry->d_namlen;
+    #endif
+    }
+}
 
 nCL::cDirectoryInfo::cDirectoryInfo() :
     mPath(),
@@ -567,19 +580,19 @@ bool nCL::cDirectoryInfo::ReadAgain()
     {
         if (entry->d_type == DT_DIR)
         {
-            if (entry->d_namlen > 0 && entry->d_name[0] == '.')
+            if (NameLength(entry) > 0 && entry->d_name[0] == '.')
             {
-                if (entry->d_namlen == 1 || (entry->d_name[1] == '.' && entry->d_namlen == 2))
+                if (NameLength(entry) == 1 || (entry->d_name[1] == '.' && NameLength(entry) == 2))
                     continue;
             }
 
             mDirectories.push_back();
-            mDirectories.back().mName.assign(entry->d_name, entry->d_namlen);
+            mDirectories.back().mName.assign(entry->d_name, NameLength(entry));
         }
         else
         {
             mFiles.push_back();
-            mFiles.back().mName.assign(entry->d_name, entry->d_namlen);
+            mFiles.back().mName.assign(entry->d_name, NameLength(entry));
         }
     }
 
@@ -614,23 +627,23 @@ bool nCL::cFullDirectoryInfo::Read(tStrConst path)
         {
             if (entry->d_type == DT_DIR)
             {
-                if (entry->d_namlen > 0 && entry->d_name[0] == '.')
+                if (NameLength(entry) > 0 && entry->d_name[0] == '.')
                 {
-                    if (entry->d_namlen == 1 || (entry->d_name[1] == '.' && entry->d_namlen == 2))
+                    if (NameLength(entry) == 1 || (entry->d_name[1] == '.' && NameLength(entry) == 2))
                         continue;
                 }
 
                 mDirectories.push_back();
                 mDirectories.back().mName = subPath;
                 mDirectories.back().mName += kDirectorySeparator;
-                mDirectories.back().mName.append(entry->d_name, entry->d_namlen);
+                mDirectories.back().mName.append(entry->d_name, NameLength(entry));
             }
             else
             {
                 mFiles.push_back();
                 mFiles.back().mName = subPath;
                 mFiles.back().mName += kDirectorySeparator;
-                mFiles.back().mName.append(entry->d_name, entry->d_namlen);
+                mFiles.back().mName.append(entry->d_name, NameLength(entry));
             }
         }
 
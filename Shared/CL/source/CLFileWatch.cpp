@@ -1,7 +1,7 @@
 //
 //  File:       CLFileWatch.cpp
 //
-//  Function:   <Description>
+//  Function:   Notifies when files/directories modified
 //
 //  Author(s):  Andrew Willmott
 //
@@ -15,22 +15,473 @@
 #include <CLString.h>
 #include <CLTag.h>
 
-// This is an implementation based on kevents, supported on OSX and iOS. TODO: does this exist on Android?
-// Update -- seems like it does, see https://github.com/plattypus/Android-4.0.1_r1.0/blob/master/external/dbus/bus/dir-watch-kqueue.c FI.
+// On Linux (and Android) this is based on inotify, which watches directories and
+// names the files within them that changed, so we only need one watch per directory.
+// Elsewhere it's based on kevents, supported on OSX and iOS, which need an fd per file.
 
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/types.h>
-#include <sys/event.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <string.h>
 #include <inttypes.h>
 
+#if defined(__linux__)
+    #include <sys/inotify.h>
+#else
+    #include <sys/event.h>
+#endif
+
 using namespace nCL;
 
+
+// --- Common ------------------------------------------------------------------
+
+int cFileWatcher::AddFile(const char* filePath)
+{
+    tStringID pathID = StringIDFromString(filePath);
+    return AddFileID(pathID);
+}
+
+int cFileWatcher::AddDirectory(const char* dirPath)
+{
+    tStringID pathID = StringIDFromString(dirPath);
+
+    return AddDirectoryID(pathID);
+}
+
+bool cFileWatcher::FilesChanged
+(
+    vector<int>* changedFiles,
+    vector<int>* addedFiles,
+    vector<int>* removedFiles
+)
+{
+    if (ReadEvents())
+    {
+        mHavePending = true;
+        mSinceLastEvent.Start();
+    }
+
+    if (!mHavePending)
+        return false;
+
+    float settleTime = mSinceLastEvent.GetTime();
+
+    if (settleTime >= 0.0f && settleTime < mDebounceTime)  // negative if the clock wrapped
+        return false;
+
+    size_t changedStart = changedFiles ? changedFiles->size() : 0;
+    size_t addedStart   = addedFiles   ? addedFiles  ->size() : 0;
+    size_t removedStart = removedFiles ? removedFiles->size() : 0;
+
+    for (auto& p : mPending)
+    {
+        if (removedFiles && (p.second & kPendingRemoved))
+            removedFiles->push_back(p.first);
+        if (addedFiles   && (p.second & kPendingAdded))
+            addedFiles->push_back(p.first);
+        if (changedFiles && (p.second & kPendingChanged))
+            changedFiles->push_back(p.first);
+    }
+
+    // Keep results in a stable order
+    if (changedFiles)
+        sort(changedFiles->begin() + changedStart, changedFiles->end());
+    if (addedFiles)
+        sort(addedFiles->begin() + addedStart, addedFiles->end());
+    if (removedFiles)
+        sort(removedFiles->begin() + removedStart, removedFiles->end());
+
+    mPending.clear();
+    mHavePending = false;
+
+    return true;
+}
+
+void cFileWatcher::SetDebounceTime(float seconds)
+{
+    mDebounceTime = seconds;
+}
+
+void cFileWatcher::AddPending(int ref, tPendingFlags flag)
+{
+    uint8_t& flags = mPending[ref];
+
+    switch (flag)
+    {
+    case kPendingRemoved:
+        if (flags & kPendingAdded)
+            mPending.erase(ref);    // came and went within the batch
+        else
+            flags = kPendingRemoved;
+        break;
+
+    case kPendingAdded:
+        if (flags & kPendingRemoved)
+            flags = kPendingChanged;    // replaced, e.g., by an editor's save
+        else
+            flags |= kPendingAdded;
+        break;
+
+    case kPendingChanged:
+        flags = (flags & ~kPendingRemoved) | kPendingChanged;
+        break;
+    }
+}
+
+
+#if defined(__linux__)
+
+// --- inotify -----------------------------------------------------------------
+
+namespace
+{
+    // We don't use IN_MODIFY, as it fires for every write.
+    const uint32_t kWatchEvents =
+          IN_CLOSE_WRITE
+        | IN_CREATE
+        | IN_DELETE
+        | IN_MOVED_FROM
+        | IN_MOVED_TO
+        | IN_DELETE_SELF
+        | IN_MOVE_SELF
+        | IN_ONLYDIR;
+
+    struct cWatchedDirectory
+    {
+        tStringID mPath = tStringID(0);
+        int       mRef  = -1;   ///< Ref if added via AddDirectory(), in which case new files are picked up, otherwise -1
+    };
+
+    struct cFileWatchInternal
+    {
+        int mNotifyFD = -1;
+        int mNextRef  = 0;
+
+        hash_map<int, cWatchedDirectory> mWatchToDirectory;     ///< Keyed by inotify watch descriptor
+        tag_hash_map<int>                mDirectoryToWatch;
+    };
+
+    int WatchDirectory(cFileWatchInternal* internal, tStringID pathID, int ref)
+    /// Ensures there's a watch on the given directory, and returns its descriptor, or -1 on failure
+    {
+        auto it = internal->mDirectoryToWatch.find(pathID);
+
+        if (it != internal->mDirectoryToWatch.end())
+        {
+            if (ref >= 0)
+                internal->mWatchToDirectory[it->second].mRef = ref;
+
+            return it->second;
+        }
+
+        const char* dirPath = StringFromStringID(pathID);
+        int wd = inotify_add_watch(internal->mNotifyFD, dirPath, kWatchEvents);
+
+        if (wd < 0)
+        {
+            CL_LOG("FileWatch", "error watching %s: %s\n", dirPath, strerror(errno));
+            return -1;
+        }
+
+        internal->mDirectoryToWatch[pathID] = wd;
+
+        cWatchedDirectory& dir = internal->mWatchToDirectory[wd];   // may already exist if we reached it by another path
+
+        if (dir.mPath == tStringID(0))
+            dir.mPath = pathID;
+        if (ref >= 0)
+            dir.mRef = ref;
+
+        return wd;
+    }
+}
+
+cFileWatcher::cFileWatcher() :
+    mInternal(new cFileWatchInternal)
+{
+}
+
+cFileWatcher::~cFileWatcher()
+{
+    Shutdown();
+
+    delete mInternal;
+    mInternal = 0;
+}
+
+bool cFileWatcher::Init()
+{
+    CL_ASSERT(mInternal->mNotifyFD < 0);
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0)
+    {
+        CL_LOG_D("FileWatch", "Could not initialise inotify.  Error was %s.\n", strerror(errno));
+        return false;
+    }
+
+    mInternal->mNotifyFD = fd;
+
+    return true;
+}
+
+bool cFileWatcher::Shutdown()
+{
+    if (mInternal->mNotifyFD < 0)
+        return false;
+
+    // Closing the inotify fd removes all its watches.
+    close(mInternal->mNotifyFD);
+    mInternal->mNotifyFD = -1;
+
+    mInternal->mWatchToDirectory.clear();
+    mInternal->mDirectoryToWatch.clear();
+
+    mRefToPath.clear();
+    mPathToRef.clear();
+    mRefToDirectoryInfo.clear();
+
+    mPending.clear();
+    mHavePending = false;
+
+    return true;
+}
+
+int cFileWatcher::AddFileID(tStringID pathID)
+{
+    auto it = mPathToRef.find(pathID);
+    if (it != mPathToRef.end())
+        return it->second;
+
+    if (mInternal->mNotifyFD < 0)
+        return -1;
+
+    const char* filePath = StringFromStringID(pathID);
+    cFileSpec fileSpec(filePath);
+
+    // Watching the parent directory rather than the file itself means we also see the file
+    // being replaced, as editors often do on save, or reappearing after being deleted.
+    if (WatchDirectory(mInternal, StringIDFromString(fileSpec.Directory()), -1) < 0)
+        return -1;
+
+    int ref = mInternal->mNextRef++;
+
+    CL_LOG_D("FileWatch", "now watching file %s as %d\n", filePath, ref);
+    mPathToRef[pathID] = ref;
+    mRefToPath[ref] = pathID;
+
+    return ref;
+}
+
+int cFileWatcher::AddDirectoryID(tStringID pathID)
+{
+    auto it = mPathToRef.find(pathID);
+    if (it != mPathToRef.end())
+        return it->second;
+
+    if (mInternal->mNotifyFD < 0)
+        return -1;
+
+    const char* dirPath = StringFromStringID(pathID);
+
+    cDirectoryInfo dirInfo;
+    dirInfo.Read(dirPath);
+
+    // Use the path without any trailing separator, to match the directories of our files.
+    int ref = mInternal->mNextRef++;
+
+    if (WatchDirectory(mInternal, StringIDFromString(dirInfo.mPath.c_str()), ref) < 0)
+        return -1;
+
+    CL_LOG_D("FileWatch", "now watching directory %s\n", dirPath);
+
+    mPathToRef[pathID] = ref;
+    mRefToPath[ref] = pathID;
+
+    cFileSpec fileSpec;
+    fileSpec.SetDirectory(dirInfo.mPath.c_str());
+
+    for (int i = 0, n = dirInfo.mFiles.size(); i < n; i++)
+    {
+        fileSpec.SetNameAndExtension(dirInfo.mFiles[i].mName);
+
+        AddFile(fileSpec.Path());
+    }
+
+    for (int i = 0, n = dirInfo.mDirectories.size(); i < n; i++)
+    {
+        fileSpec.SetNameAndExtension(dirInfo.mDirectories[i].mName);
+
+        AddDirectory(fileSpec.Path());
+    }
+
+    mRefToDirectoryInfo[ref] = dirInfo;  // for rescanning if the event queue overflows
+
+    return ref;
+}
+
+bool cFileWatcher::ReadEvents()
+{
+    if (mInternal->mNotifyFD < 0)
+        return false;
+
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    bool events = false;
+    bool overflowed = false;
+
+    cFileSpec fileSpec;
+
+    while (true)
+    {
+        ssize_t size = read(mInternal->mNotifyFD, buffer, sizeof(buffer));
+
+        if (size <= 0)
+        {
+            if (size < 0 && errno != EAGAIN && errno != EINTR)
+                CL_LOG_D("FileWatch", "inotify read error: %s.\n", strerror(errno));
+
+            break;
+        }
+
+        for (const char* p = buffer, *pEnd = buffer + size; p < pEnd; )
+        {
+            const inotify_event* event = (const inotify_event*) p;
+            p += sizeof(inotify_event) + event->len;
+
+            events = true;
+
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                overflowed = true;
+                continue;
+            }
+
+            auto itDir = mInternal->mWatchToDirectory.find(event->wd);
+
+            if (itDir == mInternal->mWatchToDirectory.end())
+                continue;
+
+            cWatchedDirectory dir = itDir->second;  // copy, as adding files below can invalidate itDir
+
+            if (event->mask & IN_IGNORED)   // watch has gone, e.g., directory was deleted
+            {
+                mInternal->mDirectoryToWatch.erase(dir.mPath);
+                mInternal->mWatchToDirectory.erase(event->wd);
+                continue;
+            }
+
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+            {
+                if (dir.mRef >= 0)
+                    AddPending(dir.mRef, kPendingRemoved);
+                continue;
+            }
+
+            if (event->len == 0)
+                continue;
+
+            fileSpec.SetDirectory(StringFromStringID(dir.mPath));
+            fileSpec.SetNameAndExtension(event->name);
+
+            tStringID pathID = StringIDFromString(fileSpec.Path());
+
+            auto itRef = mPathToRef.find(pathID);
+            int ref = itRef != mPathToRef.end() ? itRef->second : -1;
+
+            if (event->mask & IN_ISDIR)
+            {
+                if (ref < 0 && dir.mRef >= 0 && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                {
+                    // Files may have been written before we started watching, so report everything inside as added.
+                    int firstRef = mInternal->mNextRef;
+
+                    AddDirectoryID(pathID);
+
+                    for (int newRef = firstRef; newRef < mInternal->mNextRef; newRef++)
+                        if (mRefToPath.count(newRef))
+                            AddPending(newRef, kPendingAdded);
+
+                    continue;
+                }
+
+                // Removed directories get IN_DELETE_SELF/IN_MOVE_SELF from their own watch.
+                ReleaseStringID(pathID);
+                continue;
+            }
+
+            if (ref < 0)
+            {
+                if (dir.mRef < 0 || (event->mask & (IN_DELETE | IN_MOVED_FROM)))
+                {
+                    ReleaseStringID(pathID);    // not one of ours
+                    continue;
+                }
+
+                ref = AddFileID(pathID);
+
+                if (ref < 0)
+                    continue;
+
+                AddPending(ref, kPendingAdded);
+
+                if (event->mask & IN_CLOSE_WRITE)
+                    AddPending(ref, kPendingChanged);
+
+                continue;
+            }
+
+            ReleaseStringID(pathID);    // mPathToRef has its own
+
+            if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+                AddPending(ref, kPendingRemoved);
+            else if (event->mask & IN_CREATE)
+                AddPending(ref, kPendingAdded);
+            else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                AddPending(ref, kPendingChanged);
+        }
+    }
+
+    if (overflowed)
+    {
+        // We've lost events, so conservatively treat everything as changed, and look for new files.
+        CL_LOG("FileWatch", "Event queue overflowed, rescanning\n");
+
+        for (auto& rp : mRefToPath)
+        {
+            if (mRefToDirectoryInfo.find(rp.first) != mRefToDirectoryInfo.end())
+                continue;
+
+            if (access(StringFromStringID(rp.second), F_OK) == 0)
+                AddPending(rp.first, kPendingChanged);
+            else
+                AddPending(rp.first, kPendingRemoved);
+        }
+
+        vector<int> addedFiles;
+
+        for (auto& rd : mRefToDirectoryInfo)
+            CheckForDirectoryChanges(&rd.second, &addedFiles, 0);
+
+        for (int ref : addedFiles)
+            AddPending(ref, kPendingAdded);
+    }
+
+    return events;
+}
+
+#else
+
+// --- kqueue ------------------------------------------------------------------
+
+// Update -- seems like this exists on Android, see https://github.com/plattypus/Android-4.0.1_r1.0/blob/master/external/dbus/bus/dir-watch-kqueue.c FI.
+
 namespace
 {
     const unsigned int kNodeAllEvents =
@@ -70,7 +521,7 @@ namespace
 
 /*
     Sketch:
-    
+
     - if a file is added, we need to add it as a FD to watch
     - if a FD vnode is deleted, we need to remove it.
     - if a new file is added, we should check it's not one of our existing ones renamed.
@@ -94,7 +545,7 @@ bool cFileWatcher::Init()
     CL_ASSERT(mInternal->mKernelQueue < 0);
 
     int kq = kqueue();
-    
+
     if (kq < 0)
     {
         CL_LOG_D("FileWatch", "Could not open kernel queue.  Error was %s.\n", strerror(errno));
@@ -123,19 +574,15 @@ bool cFileWatcher::Shutdown()
     mPathToRef.clear();
     mRefToDirectoryInfo.clear();
 
+    mPending.clear();
+    mHavePending = false;
+
     close(mInternal->mKernelQueue);
-    mInternal->mKernelQueue = 0;
+    mInternal->mKernelQueue = -1;
 
     return true;
 }
 
-
-int cFileWatcher::AddFile(const char* filePath)
-{
-    tStringID pathID = StringIDFromString(filePath);
-    return AddFileID(pathID);
-}
-
 int cFileWatcher::AddFileID(tStringID pathID)
 {
     auto it = mPathToRef.find(pathID);
@@ -174,13 +621,6 @@ int cFileWatcher::AddFileID(tStringID pathID)
     return fd;
 }
 
-int cFileWatcher::AddDirectory(const char* dirPath)
-{
-    tStringID pathID = StringIDFromString(dirPath);
-
-    return AddDirectoryID(pathID);
-}
-
 int cFileWatcher::AddDirectoryID(tStringID pathID)
 {
     auto it = mPathToRef.find(pathID);
@@ -212,16 +652,16 @@ int cFileWatcher::AddDirectoryID(tStringID pathID)
         return -1;
     }
 
-    CL_LOG_D("FileWatch", "now watching directory %s\n", dirPath); 
+    CL_LOG_D("FileWatch", "now watching directory %s\n", dirPath);
 
     mPathToRef[pathID] = fd;
     mRefToPath[fd] = pathID;
 
-    cDirectoryInfo& dirInfo = mRefToDirectoryInfo[fd];
+    cDirectoryInfo dirInfo;
     dirInfo.Read(dirPath);
 
     cFileSpec fileSpec;
-    fileSpec.SetDirectory(dirPath);
+    fileSpec.SetDirectory(dirInfo.mPath.c_str());
 
     for (int i = 0, n = dirInfo.mFiles.size(); i < n; i++)
     {
@@ -230,15 +670,19 @@ int cFileWatcher::AddDirectoryID(tStringID pathID)
         AddFile(fileSpec.Path());
     }
 
-    return true;
+    for (int i = 0, n = dirInfo.mDirectories.size(); i < n; i++)
+    {
+        fileSpec.SetNameAndExtension(dirInfo.mDirectories[i].mName);
+
+        AddDirectory(fileSpec.Path());
+    }
+
+    mRefToDirectoryInfo[fd] = dirInfo;
+
+    return fd;
 }
 
-bool cFileWatcher::FilesChanged
-(
-    vector<int>* changedFiles,
-    vector<int>* addedFiles,
-    vector<int>* removedFiles
-)
+bool cFileWatcher::ReadEvents()
 {
     if (mInternal->mKernelQueue < 0)
         return false;
@@ -275,10 +719,15 @@ bool cFileWatcher::FilesChanged
             int fd = eventData[i].ident;
 
             auto it = mRefToDirectoryInfo.find(fd);
-            
+
             if (it != mRefToDirectoryInfo.end())
             {
-                CheckForDirectoryChanges(&it->second, addedFiles, removedFiles);
+                vector<int> addedFiles;
+                CheckForDirectoryChanges(&it->second, &addedFiles, 0);
+
+                for (int ref : addedFiles)
+                    AddPending(ref, kPendingAdded);
+
                 changes = true;
             }
             else
@@ -287,8 +736,7 @@ bool cFileWatcher::FilesChanged
 
                 if (eventData[i].fflags & NOTE_DELETE)
                 {
-                    if (removedFiles)
-                        removedFiles->push_back(fd);
+                    AddPending(fd, kPendingRemoved);
 
                     auto it1 = mRefToPath.find(fd);
                     tStringID pathID = it1->second;
@@ -305,8 +753,8 @@ bool cFileWatcher::FilesChanged
                     // perhaps we need to signal to directory info that rename rather than add/delete took place?
                 }
 
-                if (changedFiles && (eventData[i].fflags & (NOTE_WRITE | NOTE_EXTEND)))
-                    changedFiles->push_back(fd);
+                if (eventData[i].fflags & (NOTE_WRITE | NOTE_EXTEND))
+                    AddPending(fd, kPendingChanged);
             }
 
         #ifdef CL_DEBUG_LOCAL
@@ -329,6 +777,8 @@ bool cFileWatcher::FilesChanged
     return changes;
 }
 
+#endif
+
 // Internal
 
 bool cFileWatcher::CheckForDirectoryChanges
@@ -398,3 +848,231 @@ bool cFileWatcher::CheckForDirectoryChanges
 
     return true;
 }
+
+
+#ifndef CL_RELEASE
+
+// --- Test --------------------------------------------------------------------
+
+#include <sys/stat.h>
+
+namespace
+{
+    bool WriteTestFile(const char* path, const char* contents)
+    {
+        FILE* file = fopen(path, "w");
+
+        if (!file)
+            return false;
+
+        fputs(contents, file);
+        fclose(file);
+        return true;
+    }
+
+    bool WaitForBatch(cFileWatcher* watcher, vector<int>* changed, vector<int>* added, vector<int>* removed, float timeout)
+    /// Polls for the next batch, as a game loop would
+    {
+        changed->clear();
+        added->clear();
+        removed->clear();
+
+        cWallClockTimer timer;
+        timer.Start();
+
+        while (timer.GetTime() < timeout)
+        {
+            if (watcher->FilesChanged(changed, added, removed))
+                return true;
+
+            usleep(5000);
+        }
+
+        return false;
+    }
+
+    bool SameRefs(vector<int> a, vector<int> b)
+    {
+        sort(a.begin(), a.end());
+        sort(b.begin(), b.end());
+
+        return a.size() == b.size() && equal(a.begin(), a.end(), b.begin());
+    }
+}
+
+bool nCL::TestFileWatcher(int numFiles)
+{
+    const int   kNumSubDirs   = 8;
+    const float kDebounceTime = 0.05f;
+    const float kTimeout      = 5.0f;
+
+    tString tempPath;
+    GetTempPath(&tempPath);
+    tempPath += "/filewatch-XXXXXX";
+
+    if (!mkdtemp(&tempPath[0]))
+    {
+        printf("FileWatch test: couldn't create scratch directory %s\n", tempPath.c_str());
+        return false;
+    }
+
+    vector<tString> dirPaths;
+    vector<tString> filePaths;
+    char name[64];
+
+    for (int i = 0; i < kNumSubDirs; i++)
+    {
+        snprintf(name, sizeof(name), "/dir%d", i);
+        dirPaths.push_back(tempPath + name);
+        mkdir(dirPaths.back().c_str(), 0755);
+    }
+
+    for (int i = 0; i < numFiles; i++)
+    {
+        snprintf(name, sizeof(name), "/file%d.json", i);
+        filePaths.push_back(dirPaths[i % kNumSubDirs] + name);
+        WriteTestFile(filePaths.back().c_str(), "{}");
+    }
+
+    bool success = true;
+
+    cFileWatcher watcher;
+    watcher.Init();
+    watcher.SetDebounceTime(kDebounceTime);
+
+    cWallClockTimer timer;
+    timer.Start();
+
+    int rootRef = watcher.AddDirectory(tempPath.c_str());
+
+    printf("Watching %d files in %.2f ms\n", numFiles, timer.GetTime() * 1000.0f);
+
+    vector<int> fileRefs;
+
+    for (const tString& path : filePaths)
+        fileRefs.push_back(watcher.AddFile(path.c_str()));    // returns existing refs
+
+    vector<int> changed, added, removed;
+
+    if (rootRef < 0 || find(fileRefs.begin(), fileRefs.end(), -1) != fileRefs.end())
+    {
+        printf("FileWatch test: failed to add files\n");
+        success = false;
+    }
+    else if (WaitForBatch(&watcher, &changed, &added, &removed, 4 * kDebounceTime))
+    {
+        printf("FileWatch test: spurious batch before any changes\n");
+        success = false;
+    }
+
+    // Modify everything in one burst, which should arrive as one batch.
+    if (success)
+    {
+        for (const tString& path : filePaths)
+            WriteTestFile(path.c_str(), "{ \"modified\": true }");
+
+        timer.Start();
+
+        if (!WaitForBatch(&watcher, &changed, &added, &removed, kTimeout))
+        {
+            printf("FileWatch test: no batch for modified files\n");
+            success = false;
+        }
+        else if (!SameRefs(changed, fileRefs) || !added.empty() || !removed.empty())
+        {
+            printf("FileWatch test: modify batch had %d changed, %d added, %d removed, expected %d changed\n",
+                int(changed.size()), int(added.size()), int(removed.size()), numFiles);
+            success = false;
+        }
+        else
+            printf("Modified %d files, batch arrived after %.2f ms\n", numFiles, timer.GetTime() * 1000.0f);
+
+        if (success && WaitForBatch(&watcher, &changed, &added, &removed, 4 * kDebounceTime))
+        {
+            printf("FileWatch test: modifications split across batches\n");
+            success = false;
+        }
+    }
+
+    // New files, and a new subdirectory with files in it.
+    if (success)
+    {
+        vector<tString> newPaths;
+
+        dirPaths.push_back(tempPath + "/newdir");
+        mkdir(dirPaths.back().c_str(), 0755);
+        newPaths.push_back(dirPaths.back());
+
+        for (int i = 0; i < numFiles / 10 + 1; i++)
+        {
+            snprintf(name, sizeof(name), "/new%d.json", i);
+            newPaths.push_back(dirPaths[i % dirPaths.size()] + name);
+            WriteTestFile(newPaths.back().c_str(), "{}");
+        }
+
+        filePaths.insert(filePaths.end(), newPaths.begin() + 1, newPaths.end());
+
+        vector<int> newRefs;
+
+        if (WaitForBatch(&watcher, &changed, &added, &removed, kTimeout))
+            for (const tString& path : newPaths)
+                newRefs.push_back(watcher.AddFile(path.c_str()));
+
+        if (newRefs.empty() || !SameRefs(added, newRefs) || !removed.empty())
+        {
+            printf("FileWatch test: add batch had %d added, %d removed, expected %d added\n",
+                int(added.size()), int(removed.size()), int(newPaths.size()));
+            success = false;
+        }
+    }
+
+    // Save via a temporary file renamed over the original, as many editors do.
+    if (success)
+    {
+        tString savePath = filePaths[0] + ".tmp";
+
+        WriteTestFile(savePath.c_str(), "{ \"saved\": true }");
+        rename(savePath.c_str(), filePaths[0].c_str());
+
+        if (!WaitForBatch(&watcher, &changed, &added, &removed, kTimeout)
+            || changed.size() != 1 || changed[0] != fileRefs[0] || !added.empty() || !removed.empty())
+        {
+            printf("FileWatch test: replaced file not reported as a single change\n");
+            success = false;
+        }
+    }
+
+    // Remove files.
+    if (success)
+    {
+        vector<int> removedRefs;
+
+        for (int i = 0; i < numFiles; i += 10)
+        {
+            unlink(filePaths[i].c_str());
+            removedRefs.push_back(fileRefs[i]);
+        }
+
+        if (!WaitForBatch(&watcher, &changed, &added, &removed, kTimeout)
+            || !SameRefs(removed, removedRefs) || !changed.empty() || !added.empty())
+        {
+            printf("FileWatch test: remove batch had %d removed, expected %d\n", int(removed.size()), int(removedRefs.size()));
+            success = false;
+        }
+    }
+
+    watcher.Shutdown();
+
+    for (const tString& path : filePaths)
+        unlink(path.c_str());
+    for (const tString& path : dirPaths)
+        rmdir(path.c_str());
+
+    rmdir(tempPath.c_str());
+
+    printf("FileWatch test %s\n", success ? "passed" : "FAILED");
+
+    return success;
+}
+
+#endif
@@ -10,6 +10,22 @@
 
 #include <CLHash.h>
 
+#ifndef CL_RELEASE
+    #include <CLSTL.h>
+    #include <CLString.h>
+    #include <CLTimer.h>
+    #include <stdio.h>
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+    #include <arm_acle.h>
+#elif defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    #include <nmmintrin.h>
+    #define CL_CRC32C_SSE42
+#endif
+
+using namespace nCL;
+
 //#include <Kernel/libkern/crypto/md5.h>
 //#include <openssl/md5.h>
 
@@ -54,28 +70,209 @@ namespace
     };
 }
 
-uint32_t nCL::CRC32(const uint8_t* data, size_t size, uint32_t crc)
+namespace
 {
-    crc = ~crc;
+    uint32_t CRC32Bytes(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        crc = ~crc;
+
+        while (size >= 8)
+        {
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+            size -= 8;
+        }
+
+        while (size--)
+            crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+        return ~crc;
+    }
 
-    while (size >= 8)
+    // Slicing-by-8: table k holds the CRC of a byte followed by k zero bytes,
+    // which lets us fold in eight bytes with eight independent lookups.
+    // See Kounavis & Berry, "A Systematic Approach to Building High Performance
+    // Software-based CRC Generators".
+
+    struct cCRCSliceTables
     {
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+        uint32_t mTable[8][256];
+
+        cCRCSliceTables(uint32_t poly)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                uint32_t crc = i;
+
+                for (int j = 0; j < 8; j++)
+                    crc = (crc >> 1) ^ (poly & (0 - (crc & 1)));
 
-        size -= 8;
+                mTable[0][i] = crc;
+            }
+
+            for (int i = 0; i < 256; i++)
+                for (int k = 1; k < 8; k++)
+                    mTable[k][i] = (mTable[k - 1][i] >> 8) ^ mTable[0][mTable[k - 1][i] & 0xFF];
+        }
+    };
+
+    const uint32_t kCRC32Poly  = 0xEDB88320;    // reversed 0x04C11DB7
+    const uint32_t kCRC32CPoly = 0x82F63B78;    // reversed 0x1EDC6F41
+
+    const cCRCSliceTables& CRC32Tables()
+    {
+        static const cCRCSliceTables sTables(kCRC32Poly);
+        return sTables;
     }
 
-    while (size--)
-        crc = kCRC32Table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    const cCRCSliceTables& CRC32CTables()
+    {
+        static const cCRCSliceTables sTables(kCRC32CPoly);
+        return sTables;
+    }
 
-    return ~crc;
+    uint32_t CRCSliceBy8(const cCRCSliceTables& tables, const uint8_t* data, size_t size, uint32_t crc)
+    {
+        const uint32_t (*t)[256] = tables.mTable;
+
+        crc = ~crc;
+
+        if (size >= 16)
+        {
+            while (uintptr_t(data) & 7)
+            {
+                crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+                size--;
+            }
+
+            while (size >= 8)
+            {
+                uint32_t w0;
+                uint32_t w1;
+                memcpy(&w0, data,     4);
+                memcpy(&w1, data + 4, 4);
+            #ifdef CL_BIG_ENDIAN
+                w0 = __builtin_bswap32(w0);
+                w1 = __builtin_bswap32(w1);
+            #endif
+                w0 ^= crc;
+
+                crc = t[7][w0 & 0xFF] ^ t[6][(w0 >> 8) & 0xFF] ^ t[5][(w0 >> 16) & 0xFF] ^ t[4][w0 >> 24]
+                    ^ t[3][w1 & 0xFF] ^ t[2][(w1 >> 8) & 0xFF] ^ t[1][(w1 >> 16) & 0xFF] ^ t[0][w1 >> 24];
+
+                data += 8;
+                size -= 8;
+            }
+        }
+
+        while (size--)
+            crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+        return ~crc;
+    }
+
+    // Hardware paths. The SSE4.2 crc32 instruction only implements the Castagnoli
+    // polynomial, so only CRC32C benefits on x86. ARMv8 has both.
+
+#if defined(__ARM_FEATURE_CRC32)
+    uint32_t CRC32ARM(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        crc = ~crc;
+
+        for ( ; size >= 8; data += 8, size -= 8)
+        {
+            uint64_t w;
+            memcpy(&w, data, 8);
+            crc = __crc32d(crc, w);
+        }
+
+        while (size--)
+            crc = __crc32b(crc, *data++);
+
+        return ~crc;
+    }
+
+    uint32_t CRC32CARM(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        crc = ~crc;
+
+        for ( ; size >= 8; data += 8, size -= 8)
+        {
+            uint64_t w;
+            memcpy(&w, data, 8);
+            crc = __crc32cd(crc, w);
+        }
+
+        while (size--)
+            crc = __crc32cb(crc, *data++);
+
+        return ~crc;
+    }
+#endif
+
+#ifdef CL_CRC32C_SSE42
+    __attribute__((target("sse4.2")))
+    uint32_t CRC32CSSE42(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        uint64_t crc64 = ~crc;
+
+        for ( ; size >= 8; data += 8, size -= 8)
+        {
+            uint64_t w;
+            memcpy(&w, data, 8);
+            crc64 = _mm_crc32_u64(crc64, w);
+        }
+
+        crc = uint32_t(crc64);
+
+        while (size--)
+            crc = _mm_crc32_u8(crc, *data++);
+
+        return ~crc;
+    }
+#endif
+
+    uint32_t CRC32CSoftware(const uint8_t* data, size_t size, uint32_t crc)
+    {
+        return CRCSliceBy8(CRC32CTables(), data, size, crc);
+    }
+
+    typedef uint32_t tCRCFunction(const uint8_t* data, size_t size, uint32_t crc);
+
+    tCRCFunction* FindCRC32CFunction()
+    {
+    #if defined(__ARM_FEATURE_CRC32)
+        return CRC32CARM;
+    #elif defined(CL_CRC32C_SSE42)
+        if (__builtin_cpu_supports("sse4.2"))
+            return CRC32CSSE42;
+    #endif
+
+        return CRC32CSoftware;
+    }
+}
+
+uint32_t nCL::CRC32(const uint8_t* data, size_t size, uint32_t crc)
+{
+#if defined(__ARM_FEATURE_CRC32)
+    return CRC32ARM(data, size, crc);
+#else
+    return CRCSliceBy8(CRC32Tables(), data, size, crc);
+#endif
+}
+
+uint32_t nCL::CRC32C(const uint8_t* data, size_t size, uint32_t crc)
+{
+    static tCRCFunction* const sCRC32C = FindCRC32CFunction();
+
+    return sCRC32C(data, size, crc);
 }
 
 namespace
@@ -223,3 +420,445 @@ void nCL::SipHash(const uint8_t* in, size_t inlen, const uint8_t* k, uint8_t* ou
     b = v0 ^ v1 ^ v2  ^ v3;
     U64TO8_LE( out, b );
 }
+
+
+
+// WyHash, see https://github.com/wangyi-fudan/wyhash (public domain.)
+// This follows the 'final 4' version with the default secret.
+
+namespace
+{
+    const uint64_t kWyP0 = UINT64_C(0xa0761d6478bd642f);
+    const uint64_t kWyP1 = UINT64_C(0xe7037ed1a0b428db);
+    const uint64_t kWyP2 = UINT64_C(0x8ebc6af09c88c6e3);
+    const uint64_t kWyP3 = UINT64_C(0x589965cc75374cc3);
+
+    inline void WyMum(uint64_t* a, uint64_t* b)
+    {
+    #ifdef __SIZEOF_INT128__
+        __uint128_t r = *a;
+        r *= *b;
+        *a = uint64_t(r);
+        *b = uint64_t(r >> 64);
+    #else
+        uint64_t ha = *a >> 32, la = uint32_t(*a);
+        uint64_t hb = *b >> 32, lb = uint32_t(*b);
+
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+        uint64_t t  = rl + (rm0 << 32);
+        uint64_t c  = t < rl;
+        uint64_t lo = t + (rm1 << 32);
+        c += lo < t;
+
+        *a = lo;
+        *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    #endif
+    }
+
+    inline uint64_t WyMix(uint64_t a, uint64_t b)
+    {
+        WyMum(&a, &b);
+        return a ^ b;
+    }
+
+    inline uint64_t WySeed(uint64_t seed)
+    {
+        return seed ^ WyMix(seed ^ kWyP0, kWyP1);
+    }
+
+    inline uint64_t FoldCase(uint64_t w)
+    /// Converts any ASCII capitals in 'w' to lower case, eight bytes at a time
+    {
+        const uint64_t kOnes = UINT64_C(0x0101010101010101);
+
+        uint64_t low7    = w & (0x7F * kOnes);
+        uint64_t aboveA  = low7 + (0x3F * kOnes);   // top bit set where byte >= 'A'
+        uint64_t aboveZ  = low7 + (0x25 * kOnes);   // top bit set where byte >  'Z'
+        uint64_t capital = aboveA & ~aboveZ & ~w & (0x80 * kOnes);
+
+        return w | (capital >> 2);
+    }
+
+    inline uint64_t FoldCase(uint8_t c)
+    {
+        return c | ((uint8_t(c - 'A') < 26) << 5);
+    }
+
+    template<bool kFold> inline uint64_t WyRead8(const uint8_t* p)
+    {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        return kFold ? FoldCase(w) : w;
+    }
+
+    template<bool kFold> inline uint64_t WyRead4(const uint8_t* p)
+    {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        return kFold ? FoldCase(uint64_t(w)) : w;
+    }
+
+    template<bool kFold> inline uint64_t WyRead3(const uint8_t* p, size_t k)
+    {
+        if (kFold)
+            return (FoldCase(p[0]) << 16) | (FoldCase(p[k >> 1]) << 8) | FoldCase(p[k - 1]);
+
+        return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+    }
+
+    template<bool kFold> uint64_t WyHashSeeded(const uint8_t* p, size_t len, uint64_t seed)
+    /// WyHash proper, minus the seed setup, so batches can do that once.
+    {
+        uint64_t a, b;
+
+        if (len <= 16)
+        {
+            if (len >= 4)
+            {
+                size_t mid = (len >> 3) << 2;
+
+                a = (WyRead4<kFold>(p) << 32)           | WyRead4<kFold>(p + mid);
+                b = (WyRead4<kFold>(p + len - 4) << 32) | WyRead4<kFold>(p + len - 4 - mid);
+            }
+            else if (len > 0)
+            {
+                a = WyRead3<kFold>(p, len);
+                b = 0;
+            }
+            else
+                a = b = 0;
+        }
+        else
+        {
+            size_t i = len;
+
+            if (i > 48)
+            {
+                uint64_t seed1 = seed;
+                uint64_t seed2 = seed;
+
+                do
+                {
+                    seed  = WyMix(WyRead8<kFold>(p     ) ^ kWyP1, WyRead8<kFold>(p +  8) ^ seed);
+                    seed1 = WyMix(WyRead8<kFold>(p + 16) ^ kWyP2, WyRead8<kFold>(p + 24) ^ seed1);
+                    seed2 = WyMix(WyRead8<kFold>(p + 32) ^ kWyP3, WyRead8<kFold>(p + 40) ^ seed2);
+                    p += 48;
+                    i -= 48;
+                }
+                while (i > 48);
+
+                seed ^= seed1 ^ seed2;
+            }
+
+            while (i > 16)
+            {
+                seed = WyMix(WyRead8<kFold>(p) ^ kWyP1, WyRead8<kFold>(p + 8) ^ seed);
+                i -= 16;
+                p += 16;
+            }
+
+            a = WyRead8<kFold>(p + i - 16);
+            b = WyRead8<kFold>(p + i - 8);
+        }
+
+        a ^= kWyP1;
+        b ^= seed;
+        WyMum(&a, &b);
+
+        return WyMix(a ^ kWyP0 ^ len, b ^ kWyP1);
+    }
+}
+
+uint64_t nCL::WyHashU64(const uint8_t* data, size_t size, uint64_t seed)
+{
+    return WyHashSeeded<false>(data, size, WySeed(seed));
+}
+
+uint64_t nCL::WyIHashU64(const char* data, size_t size, uint64_t seed)
+{
+    return WyHashSeeded<true>((const uint8_t*) data, size, WySeed(seed));
+}
+
+void nCL::StrHashU32s(int count, const char* const strings[], uint32_t hashes[], uint32_t hashValue)
+{
+#if CL_HASH_VERSION >= 2
+    uint64_t seed = WySeed(hashValue);
+
+    for (int i = 0; i < count; i++)
+        hashes[i] = uint32_t(WyHashSeeded<false>((const uint8_t*) strings[i], strlen(strings[i]), seed));
+#else
+    for (int i = 0; i < count; i++)
+        hashes[i] = StrFNVHashU32(strings[i], hashValue);
+#endif
+}
+
+void nCL::StrIHashU32s(int count, const char* const strings[], uint32_t hashes[], uint32_t hashValue)
+{
+#if CL_HASH_VERSION >= 2
+    uint64_t seed = WySeed(hashValue);
+
+    for (int i = 0; i < count; i++)
+        hashes[i] = uint32_t(WyHashSeeded<true>((const uint8_t*) strings[i], strlen(strings[i]), seed));
+#else
+    for (int i = 0; i < count; i++)
+        hashes[i] = StrFNVIHashU32(strings[i], hashValue);
+#endif
+}
+
+
+
+#ifndef CL_RELEASE
+
+namespace
+{
+    struct cHashTestRNG
+    {
+        uint32_t mState = 0x12345678;
+
+        uint32_t Next()
+        {
+            mState ^= mState << 13;
+            mState ^= mState >> 17;
+            mState ^= mState << 5;
+            return mState;
+        }
+    };
+
+    bool CheckHash(bool ok, const char* what, int detail = 0)
+    {
+        if (!ok)
+            printf("FAILED: %s (%d)\n", what, detail);
+
+        return ok;
+    }
+
+    uint32_t NameToIDFNV(const char* s)
+    {
+        return StrFNVIHashU32(s, kFNVOffset32) | 0x80000000;
+    }
+
+    uint32_t NameToIDWy(const char* s)
+    {
+        return uint32_t(WyIHashU64(s, strlen(s), kFNVOffset32)) | 0x80000000;
+    }
+
+    int CountCollisions(const vector<const char*>& names, uint32_t (*nameToID)(const char*))
+    {
+        vector<uint32_t> ids(names.size());
+
+        for (size_t i = 0, n = names.size(); i < n; i++)
+            ids[i] = nameToID(names[i]);
+
+        sort(ids.begin(), ids.end());
+
+        int collisions = 0;
+
+        for (size_t i = 1, n = ids.size(); i < n; i++)
+            if (ids[i] == ids[i - 1])
+                collisions++;
+
+        return collisions;
+    }
+
+    template<class T> double TimeBytes(T hashFunc, const uint8_t* data, size_t size, int rounds, uint32_t* result)
+    /// Returns GB/s
+    {
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int r = 0; r < rounds; r++)
+            *result += hashFunc(data, size, *result);
+
+        uint64_t t1 = AbsoluteTicks();
+
+        return double(size) * rounds / double(t1 - t0);
+    }
+}
+
+bool nCL::TestHashes()
+{
+    bool ok = true;
+
+    // Known values
+    const uint8_t* check = (const uint8_t*) "123456789";
+
+    ok &= CheckHash(CRC32      (check, 9) == 0xCBF43926, "CRC32 check value");
+    ok &= CheckHash(CRC32Nibble(check, 9) == 0xCBF43926, "CRC32Nibble check value");
+    ok &= CheckHash(CRC32C     (check, 9) == 0xE3069283, "CRC32C check value");
+    ok &= CheckHash(StrFNVHashU32("a") == 0xE40C292C, "FNV1a check value");
+    ok &= CheckHash(NameToID("a") == 0xE40C292C, "NameToID check value");  // tag IDs must not change
+
+    const char* const kWyStrings[] = { "", "a", "abc", "message digest", "abcdefghijklmnopqrstuvwxyz" };
+    const uint64_t kWyValues[] =
+    {
+        UINT64_C(0x0409638ee2bde459), UINT64_C(0xa8412d091b5fe0a9), UINT64_C(0x32dd92e4b2915153),
+        UINT64_C(0x8619124089a3a16b), UINT64_C(0x7a43afb61d7f5f40)
+    };
+
+    for (int i = 0; i < int(CL_SIZE(kWyStrings)); i++)
+        ok &= CheckHash(WyHashU64((const uint8_t*) kWyStrings[i], strlen(kWyStrings[i]), i) == kWyValues[i], "WyHash check value", i);
+
+    // Implementations should agree at all lengths and alignments
+    cHashTestRNG rng;
+    vector<uint8_t> buffer(1024 + 8);
+
+    for (uint8_t& b : buffer)
+        b = rng.Next();
+
+    const cCRCSliceTables& crc32Tables = CRC32Tables();
+
+    for (int i = 0; i < 256; i++)
+        ok &= CheckHash(crc32Tables.mTable[0][i] == kCRC32Table[i], "CRC32 table", i);
+
+    for (int offset = 0; offset < 8; offset++)
+        for (int size = 0; size <= 1024; size += 1 + size / 16)
+        {
+            const uint8_t* data = buffer.data() + offset;
+            uint32_t crc = CRC32Bytes(data, size, 0);
+
+            ok &= CheckHash(CRC32      (data, size) == crc, "CRC32 vs bytewise", size);
+            ok &= CheckHash(CRC32Nibble(data, size) == crc, "CRC32Nibble vs bytewise", size);
+            ok &= CheckHash(CRC32C(data, size) == CRC32CSoftware(data, size, 0), "CRC32C vs software", size);
+
+            // chaining
+            int split = size / 3;
+            ok &= CheckHash(CRC32 (data + split, size - split, CRC32 (data, split)) == crc, "CRC32 chaining", size);
+            ok &= CheckHash(CRC32C(data + split, size - split, CRC32C(data, split)) == CRC32C(data, size), "CRC32C chaining", size);
+        }
+
+    // Case-insensitive hashes should match hashing the lower-cased string, including non-ASCII bytes
+    char mixed[200];
+    char lower[200];
+
+    for (int size = 0; size < 200; size++)
+    {
+        for (int i = 0; i < size; i++)
+        {
+            uint32_t r = rng.Next();
+            char c = (r & 0x300) ? "aAzZ@[`{09_"[r % 11] : char(1 + r % 255);
+
+            mixed[i] = c;
+            lower[i] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+        }
+
+        mixed[size] = 0;
+        lower[size] = 0;
+
+        ok &= CheckHash(WyIHashU64(mixed, size, 7) == WyHashU64((const uint8_t*) lower, size, 7), "WyIHashU64 vs WyHashU64", size);
+        ok &= CheckHash(StrIHashU32(mixed) == StrHashU32(lower), "StrIHashU32 vs StrHashU32", size);
+        ok &= CheckHash(IHashU32(mixed, mixed + size) == StrIHashU32(mixed), "IHashU32 vs StrIHashU32", size);
+        ok &= CheckHash(HashU32((const uint8_t*) lower, (const uint8_t*) lower + size) == StrHashU32(lower), "HashU32 vs StrHashU32", size);
+        ok &= CheckHash(StrWyHashU32(lower) == uint32_t(WyHashU64((const uint8_t*) lower, size, kFNVOffset32)), "StrWyHashU32 vs WyHashU64", size);
+        ok &= CheckHash(NameToID(mixed, mixed + size) == NameToID(lower), "NameToID", size);
+    }
+
+    // Batches should match single calls
+    const char* const kNames[] = { "", "a", "Position", "position", "diffuseTexture", "A_much_longer_name_that_spans_several_words_of_input" };
+    const int kNumNames = CL_SIZE(kNames);
+    uint32_t hashes[kNumNames];
+
+    StrHashU32s(kNumNames, kNames, hashes, 123);
+
+    for (int i = 0; i < kNumNames; i++)
+        ok &= CheckHash(hashes[i] == StrHashU32(kNames[i], 123), "StrHashU32s", i);
+
+    StrIHashU32s(kNumNames, kNames, hashes);
+
+    for (int i = 0; i < kNumNames; i++)
+        ok &= CheckHash(hashes[i] == StrIHashU32(kNames[i]), "StrIHashU32s", i);
+
+    printf("Hash tests %s\n", ok ? "passed" : "FAILED");
+
+    return ok;
+}
+
+void nCL::BenchHashes(int count, const char* const strings[])
+{
+    // Throughput on bulk data
+    const size_t kBufferSize = 64 * 1024;
+    const int kRounds = 2000;
+
+    vector<uint8_t> buffer(kBufferSize);
+    cHashTestRNG rng;
+
+    for (uint8_t& b : buffer)
+        b = rng.Next();
+
+    const uint8_t* data = buffer.data();
+    uint32_t result = 0;
+
+    printf("Throughput on %d KB (GB/s):\n", int(kBufferSize / 1024));
+    printf("  FNV1a             %6.2f\n", TimeBytes([](const uint8_t* d, size_t s, uint32_t h) { return FNVHashU32(d, d + s, h); }, data, kBufferSize, kRounds / 8, &result));
+    printf("  WyHash            %6.2f\n", TimeBytes([](const uint8_t* d, size_t s, uint32_t h) { return uint32_t(WyHashU64(d, s, h)); }, data, kBufferSize, kRounds, &result));
+    printf("  CRC32 bytewise    %6.2f\n", TimeBytes(CRC32Bytes, data, kBufferSize, kRounds / 8, &result));
+    printf("  CRC32 nibble      %6.2f\n", TimeBytes(CRC32Nibble, data, kBufferSize, kRounds / 8, &result));
+    printf("  CRC32             %6.2f\n", TimeBytes(CRC32, data, kBufferSize, kRounds, &result));
+    printf("  CRC32C software   %6.2f\n", TimeBytes(CRC32CSoftware, data, kBufferSize, kRounds, &result));
+    printf("  CRC32C            %6.2f\n", TimeBytes(CRC32C, data, kBufferSize, kRounds, &result));
+
+    if (count == 0)
+        return;
+
+    // Per-string cost on the given names
+    const int kStringRounds = max(1, 2000000 / count);
+    double scale = 1.0 / (double(kStringRounds) * count);
+    size_t totalLength = 0;
+
+    for (int i = 0; i < count; i++)
+        totalLength += strlen(strings[i]);
+
+    vector<uint32_t> hashes(count);
+
+    uint64_t t0 = AbsoluteTicks();
+    for (int r = 0; r < kStringRounds; r++)
+        for (int i = 0; i < count; i++)
+            result += StrFNVIHashU32(strings[i]);
+    uint64_t t1 = AbsoluteTicks();
+    for (int r = 0; r < kStringRounds; r++)
+        for (int i = 0; i < count; i++)
+            result += uint32_t(WyIHashU64(strings[i], strlen(strings[i]), kFNVOffset32));
+    uint64_t t2 = AbsoluteTicks();
+    for (int r = 0; r < kStringRounds; r++)
+    {
+        StrIHashU32s(count, strings, hashes.data());
+        result += hashes[r % count];
+    }
+    uint64_t t3 = AbsoluteTicks();
+
+    printf("\n%d strings, average length %.1f (ns/string):\n", count, double(totalLength) / count);
+    printf("  FNV1a             %6.1f\n", (t1 - t0) * scale);
+    printf("  WyHash            %6.1f\n", (t2 - t1) * scale);
+    printf("  StrIHashU32s      %6.1f\n", (t3 - t2) * scale);
+
+    // Collisions amongst the distinct names, as NameToID() sees them
+    vector<string> lowerNames;
+
+    for (int i = 0; i < count; i++)
+    {
+        string name(strings[i]);
+
+        for (char& c : name)
+            c = tolower(c);
+
+        lowerNames.push_back(name);
+    }
+
+    sort(lowerNames.begin(), lowerNames.end());
+    lowerNames.erase(unique(lowerNames.begin(), lowerNames.end()), lowerNames.end());
+
+    vector<const char*> names;
+
+    for (const string& name : lowerNames)
+        names.push_back(name.c_str());
+
+    // Expected collisions for n random 31-bit IDs is about n^2 / 2^32
+    double expected = double(names.size()) * names.size() / 4294967296.0;
+
+    printf("\nTag ID collisions over %d distinct names (%.3f expected):\n", int(names.size()), expected);
+    printf("  FNV1a             %6d\n", CountCollisions(names, NameToIDFNV));
+    printf("  WyHash            %6d\n", CountCollisions(names, NameToIDWy));
+
+    if (result == 0x7fffffff)    // keep the hashes from being optimised away
+        printf("\n");
+}
+
+#endif
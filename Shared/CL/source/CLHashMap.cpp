@@ -0,0 +1,219 @@
+//
+//  File:       CLHashMap.cpp
+//
+//  Function:   Tests and benchmarks for hash_map/hash_set
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <CLHashMap.h>
+
+#include <CLTimer.h>
+
+#include <stdio.h>
+
+using namespace nCL;
+
+#ifndef CL_RELEASE
+
+namespace
+{
+    struct cTestRNG
+    {
+        uint32_t mState = 0x12345678;
+
+        uint32_t Next()
+        {
+            mState ^= mState << 13;
+            mState ^= mState >> 17;
+            mState ^= mState << 5;
+            return mState;
+        }
+    };
+
+    template<class T_MAP> bool SameContents(const T_MAP& ref, const hash_map<uint32_t, int>& test)
+    {
+        if (ref.size() != test.size())
+            return false;
+
+        for (const auto& entry : ref)
+        {
+            auto it = test.find(entry.first);
+
+            if (it == test.end() || it->second != entry.second)
+                return false;
+        }
+
+        size_t visited = 0;
+
+        for (const auto& entry : test)
+        {
+            auto it = ref.find(entry.first);
+
+            if (it == ref.end() || it->second != entry.second)
+                return false;
+
+            visited++;
+        }
+
+        return visited == ref.size();
+    }
+
+    template<class T_MAP> void InsertKeys(T_MAP* m, int n, const uint32_t keys[])
+    {
+        for (int i = 0; i < n; i++)
+            (*m)[keys[i]] = i;
+    }
+
+    template<class T_MAP> int FindKeys(const T_MAP& m, int n, const uint32_t keys[])
+    {
+        int found = 0;
+
+        for (int i = 0; i < n; i++)
+        {
+            auto it = m.find(keys[i]);
+
+            if (it != m.end())
+                found += it->second;
+        }
+
+        return found;
+    }
+}
+
+bool nCL::TestHashMaps()
+{
+    bool success = true;
+    cTestRNG rng;
+
+    // Small key range so we get plenty of duplicate inserts, erases of existing keys, and clustering
+    for (uint32_t keyRange : { 16u, 1000u, 100000u })
+    {
+        map<uint32_t, int>      ref;
+        hash_map<uint32_t, int> test;
+
+        for (int i = 0; i < 200000; i++)
+        {
+            uint32_t key = rng.Next() % keyRange;
+            uint32_t op  = rng.Next() % 8;
+
+            if (op < 5)
+            {
+                ref [key] = i;
+                test[key] = i;
+            }
+            else if (op < 7)
+            {
+                size_t refErased = ref.find(key) != ref.end();
+                ref.erase(key);
+
+                if (test.erase(key) != refErased)
+                    success = false;
+            }
+            else if ((ref.find(key) != ref.end()) != (test.find(key) != test.end()))
+                success = false;
+        }
+
+        if (!SameContents(ref, test))
+            success = false;
+
+        hash_map<uint32_t, int> copy(test);
+
+        if (!SameContents(ref, copy))
+            success = false;
+
+        test.clear();
+
+        if (!test.empty() || test.begin() != test.end())
+            success = false;
+
+        if (!success)
+        {
+            printf("hash_map failed with key range %u\n", keyRange);
+            break;
+        }
+    }
+
+    // String keys compare by content, not pointer
+    string_hash_set strings;
+    static char sStrings[1000][8];
+    char buffer[8];
+
+    for (int i = 0; i < 1000; i++)
+    {
+        snprintf(sStrings[i], sizeof(sStrings[i]), "s%d", i);
+        strings.insert(sStrings[i]);
+    }
+
+    snprintf(buffer, sizeof(buffer), "s%d", 500);
+
+    if (strings.size() != 1000 || strings.find(buffer) == strings.end() || strings.find("s1000") != strings.end())
+    {
+        printf("string_hash_set failed\n");
+        success = false;
+    }
+
+    printf("hash_map test %s\n", success ? "passed" : "FAILED");
+
+    return success;
+}
+
+void nCL::BenchHashMaps()
+{
+    const int kTotalOps = 1000000;
+
+    printf("Entries    map insert  hash insert   map find  hash find   (ns/op)\n");
+
+    for (int n : { 10, 1000, 100000 })
+    {
+        vector<uint32_t> keys(n);
+        cTestRNG rng;
+
+        for (int i = 0; i < n; i++)
+            keys[i] = rng.Next();
+
+        int rounds = max(kTotalOps / n, 1);
+        double scale = 1.0 / (double(rounds) * n);
+        int found = 0;
+
+        double mapInsertNS = 0.0, mapFindNS = 0.0;
+        double hashInsertNS = 0.0, hashFindNS = 0.0;
+
+        for (int r = 0; r < rounds; r++)
+        {
+            map<uint32_t, int> m;
+
+            uint64_t t0 = AbsoluteTicks();
+            InsertKeys(&m, n, keys.begin());
+            uint64_t t1 = AbsoluteTicks();
+            found += FindKeys(m, n, keys.begin());
+            uint64_t t2 = AbsoluteTicks();
+
+            mapInsertNS += (t1 - t0) * scale;
+            mapFindNS   += (t2 - t1) * scale;
+        }
+
+        for (int r = 0; r < rounds; r++)
+        {
+            hash_map<uint32_t, int> m;
+
+            uint64_t t0 = AbsoluteTicks();
+            InsertKeys(&m, n, keys.begin());
+            uint64_t t1 = AbsoluteTicks();
+            found += FindKeys(m, n, keys.begin());
+            uint64_t t2 = AbsoluteTicks();
+
+            hashInsertNS += (t1 - t0) * scale;
+            hashFindNS   += (t2 - t1) * scale;
+        }
+
+        printf("%7d  %11.1f  %11.1f  %9.1f  %9.1f\n", n, mapInsertNS, hashInsertNS, mapFindNS, hashFindNS);
+
+        if (found == 0x7fffffff)    // keep the finds from being optimised away
+            printf("\n");
+    }
+}
+
+#endif
@@ -13,6 +13,7 @@
 #include <CLFileSpec.h>
 #include <CLLog.h>
 #include <CLMemory.h>
+#include <CLValueData.h>
 
 #include <ctype.h>
 
@@ -76,7 +77,8 @@ cJSONReader::cJSONReader() :
     mCommentsBefore(),
     mCollectComments(false),
     mAllowUnquotedStrings(true),
-    mAllowTrailingCommas(true)
+    mAllowTrailingCommas(true),
+    mPackArrays(true)
 {
 }
 
@@ -538,7 +540,6 @@ bool cJSONReader::ReadObject(cToken& tokenStart)
 bool cJSONReader::ReadArray(cToken& tokenStart)
 {
     *mNodes.back() = cValue(kValueArray);
-// TODO    cArrayValue& array = mNodes.back()->AsArray();
     cValue& array = *mNodes.back();
 
     int index = 0;
@@ -574,7 +575,10 @@ bool cJSONReader::ReadArray(cToken& tokenStart)
         if (token.mType == kTokenArrayEnd)
             break;
     }
-    
+
+    if (mPackArrays)
+        array.PackArray();
+
     return true;
 }
 
@@ -896,6 +900,11 @@ int cJSONReader::GetFirstErrorLine() const
     return -1;
 }
 
+void cJSONReader::SetPackArrays(bool enabled)
+{
+    mPackArrays = enabled;
+}
+
 
 
 
@@ -1545,6 +1554,16 @@ bool cJSONStyledWriter::HasCommentForValue(const cValue& value)
 
 bool nCL::ReadFromJSONFile(const cFileSpec& fileSpec, cValue* value, string* errorMessages, int* firstErrorLine)
 {
+    cFileSpec dataSpec;
+
+    if (ValueDataFilesEnabled() && FindValueDataFile(fileSpec, &dataSpec) && ReadValueDataFile(dataSpec, value))
+    {
+        if (firstErrorLine)
+            *firstErrorLine = -1;
+
+        return true;
+    }
+
     cMappedFileInfo mapInfo = MapFile(fileSpec.Path());
 
     if (!mapInfo.mData)
@@ -1850,3 +1869,57 @@ cIConfigSource* nCL::CreateDefaultConfigSource(cIAllocator* alloc)
 {
     return new(alloc) cConfigSource(alloc);
 }
+
+
+#ifndef CL_RELEASE
+
+#include <CLTimer.h>
+
+void nCL::BenchJSONRead(const cFileSpec& spec)
+{
+    cMappedFileInfo mapInfo = MapFile(spec.Path());
+
+    if (!mapInfo.mData)
+    {
+        printf("Couldn't read %s\n", spec.Path());
+        return;
+    }
+
+    const char* begin = (const char*) mapInfo.mData;
+    const char* end   = begin + mapInfo.mSize;
+    const int kRounds = 200;
+
+    printf("%s: %d bytes, sizeof(cValue) = %d\n", spec.Path(), int(mapInfo.mSize), int(sizeof(cValue)));
+    printf("Packed  Parse (us)  Value bytes\n");
+
+    for (int pack = 0; pack < 2; pack++)
+    {
+        cJSONReader reader;
+        reader.SetPackArrays(pack != 0);
+
+        size_t valueBytes = 0;
+
+        {
+            cValue value;
+            reader.Read(begin, end, &value);
+
+            valueBytes = value.MemoryUsed();
+        }
+
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int r = 0; r < kRounds; r++)
+        {
+            cValue value;
+            reader.Read(begin, end, &value);
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        printf("%-6s  %10.2f  %11d\n", pack ? "yes" : "no", (t1 - t0) * 1e-3 / kRounds, int(valueBytes));
+    }
+
+    UnmapFile(mapInfo);
+}
+
+#endif
@@ -0,0 +1,1051 @@
+//
+//  File:       CLJSONStream.cpp
+//
+//  Function:   Streaming JSON reader
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <CLJSONStream.h>
+
+#include <CLJSON.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+using namespace nCL;
+
+namespace
+{
+    // Character classes. These match cJSONReader's, so the same
+    // unquoted strings are accepted.
+    inline bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    inline bool IsStartTokenChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '@';
+    }
+
+    inline bool IsTokenChar(char c)
+    {
+        return IsStartTokenChar(c) || IsDigit(c) || c == '.' || c == '-' || c == '+' || c == '=';
+    }
+
+    inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    bool ContainsNewLine(const char* begin, const char* end)
+    {
+        for (; begin < end; ++begin)
+            if (*begin == '\n' || *begin == '\r')
+                return true;
+
+        return false;
+    }
+
+    // Bulk scanning: each routine below checks 16 characters at a time for
+    // the ones it's looking for, via a compare and a mask of the results,
+    // and finishes off any remainder one character at a time. We never read
+    // past 'end', as documents are often mapped files.
+#if defined(__SSE2__)
+    typedef __m128i  tChars16;
+    typedef uint32_t tMask16;
+
+    inline tChars16 Load16 (const char* p)             { return _mm_loadu_si128((const __m128i*) p); }
+    inline tChars16 Match16(tChars16 v, char c)        { return _mm_cmpeq_epi8(v, _mm_set1_epi8(c)); }
+    inline tChars16 Or16   (tChars16 a, tChars16 b)    { return _mm_or_si128(a, b); }
+    inline tMask16  Mask16 (tChars16 m)                { return _mm_movemask_epi8(m); }
+    inline tMask16  NotMask16(tChars16 m)              { return _mm_movemask_epi8(m) ^ 0xFFFF; }
+    inline int      FirstIndex16(tMask16 mask)         { return __builtin_ctz(mask); }
+
+    #define CL_JSON_SCAN_16 1
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    // No movemask, so narrow each 8-bit lane result to 4 bits, giving a 64-bit mask
+    typedef uint8x16_t tChars16;
+    typedef uint64_t   tMask16;
+
+    inline tChars16 Load16 (const char* p)             { return vld1q_u8((const uint8_t*) p); }
+    inline tChars16 Match16(tChars16 v, char c)        { return vceqq_u8(v, vdupq_n_u8(uint8_t(c))); }
+    inline tChars16 Or16   (tChars16 a, tChars16 b)    { return vorrq_u8(a, b); }
+    inline tMask16  Mask16 (tChars16 m)                { return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0); }
+    inline tMask16  NotMask16(tChars16 m)              { return Mask16(vmvnq_u8(m)); }
+    inline int      FirstIndex16(tMask16 mask)         { return __builtin_ctzll(mask) >> 2; }
+
+    #define CL_JSON_SCAN_16 1
+#endif
+
+    const char* FindQuoteOrEscape(const char* p, const char* end)
+    /// Returns the first '"' or '\' in [p, end), or end.
+    {
+    #ifdef CL_JSON_SCAN_16
+        for (; end - p >= 16; p += 16)
+        {
+            tChars16 v = Load16(p);
+            tMask16 mask = Mask16(Or16(Match16(v, '"'), Match16(v, '\\')));
+
+            if (mask)
+                return p + FirstIndex16(mask);
+        }
+    #endif
+
+        for (; p < end; p++)
+            if (*p == '"' || *p == '\\')
+                return p;
+
+        return end;
+    }
+
+    const char* FindLineEnd(const char* p, const char* end)
+    /// Returns the first '\n' or '\r' in [p, end), or end.
+    {
+    #ifdef CL_JSON_SCAN_16
+        for (; end - p >= 16; p += 16)
+        {
+            tChars16 v = Load16(p);
+            tMask16 mask = Mask16(Or16(Match16(v, '\n'), Match16(v, '\r')));
+
+            if (mask)
+                return p + FirstIndex16(mask);
+        }
+    #endif
+
+        for (; p < end; p++)
+            if (*p == '\n' || *p == '\r')
+                return p;
+
+        return end;
+    }
+
+    const char* FindChar(const char* p, const char* end, char c)
+    /// Returns the first 'c' in [p, end), or end.
+    {
+    #ifdef CL_JSON_SCAN_16
+        for (; end - p >= 16; p += 16)
+        {
+            tMask16 mask = Mask16(Match16(Load16(p), c));
+
+            if (mask)
+                return p + FirstIndex16(mask);
+        }
+    #endif
+
+        for (; p < end; p++)
+            if (*p == c)
+                return p;
+
+        return end;
+    }
+
+    const char* SkipWhitespace(const char* p, const char* end)
+    /// Returns the first non-whitespace character in [p, end), or end.
+    {
+        // Most runs are a single space or none, so check that before going wide
+        if (p == end || !IsSpace(*p))
+            return p;
+
+        p++;
+
+    #ifdef CL_JSON_SCAN_16
+        for (; end - p >= 16; p += 16)
+        {
+            tChars16 v = Load16(p);
+            tMask16 mask = NotMask16(Or16(Or16(Match16(v, ' '), Match16(v, '\t')), Or16(Match16(v, '\n'), Match16(v, '\r'))));
+
+            if (mask)
+                return p + FirstIndex16(mask);
+        }
+    #endif
+
+        for (; p < end; p++)
+            if (!IsSpace(*p))
+                return p;
+
+        return end;
+    }
+
+    // Numbers
+    const double kPowersOf10[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const int      kMaxExactPower10   = 22;                 // largest power of 10 exactly representable as a double
+    const uint64_t kMaxExactMantissa  = uint64_t(1) << 53;
+    const int      kMaxMantissaDigits = 19;                 // so the mantissa fits in 64 bits
+
+    void AppendUTF8(uint32_t c, string* s)
+    {
+        if (c < 0x80)
+            *s += char(c);
+        else if (c < 0x800)
+        {
+            *s += char(0xC0 | (c >> 6));
+            *s += char(0x80 | (c & 0x3F));
+        }
+        else if (c < 0x10000)
+        {
+            *s += char(0xE0 | (c >> 12));
+            *s += char(0x80 | ((c >> 6) & 0x3F));
+            *s += char(0x80 | (c & 0x3F));
+        }
+        else
+        {
+            *s += char(0xF0 | (c >> 18));
+            *s += char(0x80 | ((c >> 12) & 0x3F));
+            *s += char(0x80 | ((c >> 6) & 0x3F));
+            *s += char(0x80 | (c & 0x3F));
+        }
+    }
+
+    bool ReadHex4(const char* p, const char* end, uint32_t* result)
+    {
+        if (end - p < 4)
+            return false;
+
+        uint32_t value = 0;
+
+        for (int i = 0; i < 4; i++)
+        {
+            char c = p[i];
+
+            value <<= 4;
+
+            if (c >= '0' && c <= '9')
+                value += c - '0';
+            else if (c >= 'a' && c <= 'f')
+                value += c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                value += c - 'A' + 10;
+            else
+                return false;
+        }
+
+        *result = value;
+        return true;
+    }
+
+    void GetLineAndColumn(const char* begin, const char* end, const char* location, int* line, int* column)
+    {
+        const char* lastLineStart = begin;
+
+        *line = 1;
+
+        for (const char* p = begin; p < location && p < end; p++)
+        {
+            if (*p == '\n' || (*p == '\r' && (p + 1 == end || p[1] != '\n')))
+            {
+                lastLineStart = p + 1;
+                ++*line;
+            }
+        }
+
+        *column = int(location - lastLineStart) + 1;
+    }
+}
+
+
+// --- cJSONStreamReader -------------------------------------------------------
+
+bool cJSONStreamReader::Read(const char* beginDoc, const char* endDoc, cIJSONHandler* handler, bool collectComments)
+{
+    mBegin   = beginDoc;
+    mEnd     = endDoc;
+    mCurrent = beginDoc;
+    mHandler = handler;
+
+    mCollectComments = collectComments;
+    mLastValueEnd = 0;
+
+    mErrorMessage  = 0;
+    mErrorLocation = 0;
+
+    if (!ReadValue() || !SkipSpaces())
+        return false;
+
+    if (mCurrent != mEnd)
+        return Error("trailing garbage", mCurrent);
+
+    return true;
+}
+
+void cJSONStreamReader::GetFormattedErrorMessages(string* formattedMessage) const
+{
+    formattedMessage->clear();
+
+    if (!mErrorMessage)
+        return;
+
+    int line, column;
+    GetLineAndColumn(mBegin, mEnd, mErrorLocation, &line, &column);
+
+    char buffer[18 + 16 + 16 + 1];
+    snprintf(buffer, sizeof(buffer), "Line %d, Column %d", line, column);
+
+    *formattedMessage += "* ";
+    *formattedMessage += buffer;
+    *formattedMessage += "\n  ";
+    *formattedMessage += mErrorMessage;
+    *formattedMessage += "\n";
+}
+
+int cJSONStreamReader::GetFirstErrorLine() const
+{
+    if (!mErrorMessage)
+        return -1;
+
+    int line, column;
+    GetLineAndColumn(mBegin, mEnd, mErrorLocation, &line, &column);
+
+    return line;
+}
+
+bool cJSONStreamReader::ReadValue()
+{
+    if (!SkipSpaces())
+        return false;
+
+    if (mCurrent == mEnd)
+        return Error("Syntax error: value, object or array expected.", mCurrent);
+
+    bool ok;
+    char c = *mCurrent;
+
+    switch (c)
+    {
+    case '{':
+        ok = ReadObject();
+        break;
+    case '[':
+        ok = ReadArray();
+        break;
+    case '"':
+        ok = ReadString(false);
+        break;
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        ok = ReadNumber();
+        break;
+    default:
+        if (!IsStartTokenChar(c))
+            return Error("Syntax error: value, object or array expected.", mCurrent);
+
+        ok = ReadUnquoted(false);
+    }
+
+    mLastValueEnd = mCurrent;
+
+    return ok;
+}
+
+bool cJSONStreamReader::ReadObject()
+{
+    const char* start = mCurrent++;
+
+    if (!mHandler->BeginObject())
+        return Error("Read stopped by handler", start);
+
+    while (true)
+    {
+        if (!SkipSpaces())
+            return false;
+
+        if (mCurrent == mEnd)
+            return Error("Missing '}' at end of object", start);
+
+        char c = *mCurrent;
+
+        if (c == '}')   // empty object, or trailing comma
+            break;
+
+        bool ok;
+
+        if (c == '"')
+            ok = ReadString(true);
+        else if (IsStartTokenChar(c))
+            ok = ReadUnquoted(true);
+        else
+            return Error("Object member name isn't a string", mCurrent);
+
+        if (!ok || !SkipSpaces())
+            return false;
+
+        if (mCurrent == mEnd || *mCurrent != ':')
+            return Error("Missing ':' after object member name", mCurrent);
+
+        mCurrent++;
+
+        if (!ReadValue() || !SkipSpaces())
+            return false;
+
+        if (mCurrent == mEnd)
+            return Error("Missing '}' at end of object", start);
+
+        c = *mCurrent;
+
+        if (c == '}')
+            break;
+
+        if (c != ',')
+            return Error("Missing ',' or '}' in object declaration", mCurrent);
+
+        mCurrent++;
+    }
+
+    mCurrent++;
+
+    if (!mHandler->EndObject())
+        return Error("Read stopped by handler", mCurrent - 1);
+
+    return true;
+}
+
+bool cJSONStreamReader::ReadArray()
+{
+    const char* start = mCurrent++;
+
+    if (!mHandler->BeginArray())
+        return Error("Read stopped by handler", start);
+
+    while (true)
+    {
+        if (!SkipSpaces())
+            return false;
+
+        if (mCurrent == mEnd)
+            return Error("Missing ']' at end of array", start);
+
+        if (*mCurrent == ']')   // empty array, or trailing comma
+            break;
+
+        if (!ReadValue() || !SkipSpaces())
+            return false;
+
+        if (mCurrent == mEnd)
+            return Error("Missing ']' at end of array", start);
+
+        char c = *mCurrent;
+
+        if (c == ']')
+            break;
+
+        if (c != ',')
+            return Error("Expecting ',' in array declaration", mCurrent);
+
+        mCurrent++;
+    }
+
+    mCurrent++;
+
+    if (!mHandler->EndArray())
+        return Error("Read stopped by handler", mCurrent - 1);
+
+    return true;
+}
+
+bool cJSONStreamReader::ReadString(bool isKey)
+{
+    const char* start = ++mCurrent;
+    const char* p = FindQuoteOrEscape(start, mEnd);
+
+    if (p == mEnd)
+        return Error("Missing '\"' at end of string", start - 1);
+
+    if (*p == '"')
+    {
+        // No escapes, which is the common case
+        mCurrent = p + 1;
+
+        if (isKey)
+            return mHandler->Key(start, p - start) || Error("Read stopped by handler", start);
+
+        mScratch.assign(start, p - start);
+        return mHandler->String(mScratch.c_str(), mScratch.size()) || Error("Read stopped by handler", start);
+    }
+
+    mScratch.clear();
+
+    while (true)
+    {
+        mScratch.append(start, p - start);
+
+        if (*p == '"')
+            break;
+
+        // Escape sequence
+        if (++p == mEnd)
+            return Error("Empty escape sequence in string", p - 1);
+
+        switch (*p++)
+        {
+        case '"':  mScratch += '"';  break;
+        case '/':  mScratch += '/';  break;
+        case '\\': mScratch += '\\'; break;
+        case 'b':  mScratch += '\b'; break;
+        case 'f':  mScratch += '\f'; break;
+        case 'n':  mScratch += '\n'; break;
+        case 'r':  mScratch += '\r'; break;
+        case 't':  mScratch += '\t'; break;
+        case 'u':
+            {
+                uint32_t c;
+
+                if (!ReadHex4(p, mEnd, &c))
+                    return Error("Bad unicode escape sequence in string: four hex digits expected.", p);
+
+                p += 4;
+
+                // Combine surrogate pairs
+                uint32_t c2;
+
+                if (c >= 0xD800 && c < 0xDC00 && mEnd - p >= 6 && p[0] == '\\' && p[1] == 'u' && ReadHex4(p + 2, mEnd, &c2) && c2 >= 0xDC00 && c2 < 0xE000)
+                {
+                    c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+                    p += 6;
+                }
+
+                AppendUTF8(c, &mScratch);
+            }
+            break;
+        default:
+            return Error("Bad escape sequence in string", p - 1);
+        }
+
+        start = p;
+        p = FindQuoteOrEscape(start, mEnd);
+
+        if (p == mEnd)
+            return Error("Missing '\"' at end of string", start);
+    }
+
+    mCurrent = p + 1;
+
+    if (isKey)
+        return mHandler->Key(mScratch.c_str(), mScratch.size()) || Error("Read stopped by handler", start);
+
+    return mHandler->String(mScratch.c_str(), mScratch.size()) || Error("Read stopped by handler", start);
+}
+
+bool cJSONStreamReader::ReadUnquoted(bool isKey)
+{
+    const char* start = mCurrent;
+    const char* p = start + 1;
+
+    while (p < mEnd && IsTokenChar(*p))
+        p++;
+
+    mCurrent = p;
+    size_t length = p - start;
+    bool ok;
+
+    if (isKey)
+        ok = mHandler->Key(start, length);
+    else if (length == 4 && memcmp(start, "true", 4) == 0)
+        ok = mHandler->Bool(true);
+    else if (length == 5 && memcmp(start, "false", 5) == 0)
+        ok = mHandler->Bool(false);
+    else if (length == 4 && memcmp(start, "null", 4) == 0)
+        ok = mHandler->Null();
+    else
+    {
+        mScratch.assign(start, length);
+        ok = mHandler->String(mScratch.c_str(), length);
+    }
+
+    return ok || Error("Read stopped by handler", start);
+}
+
+bool cJSONStreamReader::ReadNumber()
+{
+    const char* start = mCurrent;
+    const char* p = start;
+
+    bool isNegative = *p == '-';
+
+    if (isNegative)
+        p++;
+
+    if (p == mEnd || !IsDigit(*p))
+        return Error("Number expected after '-'", start);
+
+    // Accumulate up to kMaxMantissaDigits significant digits, with the
+    // decimal exponent needed to scale them back.
+    uint64_t mantissa = 0;
+    int      numDigits = 0;
+    int      exponent = 0;
+    bool     truncated = false;
+    bool     isDouble = false;
+
+    for (; p < mEnd && IsDigit(*p); p++)
+    {
+        if (numDigits < kMaxMantissaDigits)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            numDigits += mantissa != 0;
+        }
+        else
+        {
+            exponent++;
+            truncated |= *p != '0';
+        }
+    }
+
+    if (p < mEnd && *p == '.')
+    {
+        isDouble = true;
+
+        for (p++; p < mEnd && IsDigit(*p); p++)
+        {
+            if (numDigits < kMaxMantissaDigits)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                numDigits += mantissa != 0;
+                exponent--;
+            }
+            else
+                truncated |= *p != '0';
+        }
+    }
+
+    if (p < mEnd && (*p == 'e' || *p == 'E'))
+    {
+        isDouble = true;
+        p++;
+
+        bool expNegative = false;
+
+        if (p < mEnd && (*p == '+' || *p == '-'))
+            expNegative = *p++ == '-';
+
+        if (p == mEnd || !IsDigit(*p))
+            return Error("Missing exponent digits in number", start);
+
+        int expValue = 0;
+
+        for (; p < mEnd && IsDigit(*p); p++)
+            if (expValue < 10000)
+                expValue = expValue * 10 + (*p - '0');
+
+        exponent += expNegative ? -expValue : expValue;
+    }
+
+    mCurrent = p;
+    bool ok;
+
+    if (!isDouble && !truncated && exponent == 0)
+    {
+        if (isNegative && mantissa <= uint64_t(INT32_MAX) + 1)
+            return mHandler->Int(int32_t(-int64_t(mantissa))) || Error("Read stopped by handler", start);
+
+        if (!isNegative && mantissa <= uint64_t(INT32_MAX))
+            return mHandler->Int(int32_t(mantissa)) || Error("Read stopped by handler", start);
+
+        if (!isNegative && mantissa <= uint64_t(UINT32_MAX))
+            return mHandler->UInt(uint32_t(mantissa)) || Error("Read stopped by handler", start);
+    }
+
+    if (!truncated && mantissa <= kMaxExactMantissa && exponent >= -kMaxExactPower10 && exponent <= kMaxExactPower10)
+    {
+        // Both the mantissa and power of ten are exact, so a single multiply or divide gives the correctly rounded result
+        double value = double(mantissa);
+
+        if (exponent < 0)
+            value /= kPowersOf10[-exponent];
+        else
+            value *= kPowersOf10[exponent];
+
+        ok = mHandler->Double(isNegative ? -value : value);
+    }
+    else
+    {
+        // Rare, so just fall back to strtod
+        mScratch.assign(start, p - start);
+        ok = mHandler->Double(strtod(mScratch.c_str(), 0));
+    }
+
+    return ok || Error("Read stopped by handler", start);
+}
+
+bool cJSONStreamReader::SkipSpaces()
+{
+    while (true)
+    {
+        mCurrent = SkipWhitespace(mCurrent, mEnd);
+
+        if (mCurrent == mEnd || *mCurrent != '/')
+            return true;
+
+        if (!ReadComment())
+            return false;
+    }
+}
+
+bool cJSONStreamReader::ReadComment()
+{
+    const char* begin = mCurrent;
+
+    if (mEnd - begin < 2)
+        return Error("Syntax error: '/' at end of document", begin);
+
+    char c = begin[1];
+
+    if (c == '/')
+    {
+        const char* p = FindLineEnd(begin + 2, mEnd);
+
+        mCurrent = p < mEnd ? p + 1 : p;   // include the newline, as cJSONReader does
+    }
+    else if (c == '*')
+    {
+        const char* p = begin + 2;
+
+        while (true)
+        {
+            p = FindChar(p, mEnd, '*');
+
+            if (mEnd - p < 2)
+                return Error("Missing '*/' at end of comment", begin);
+
+            if (p[1] == '/')
+                break;
+
+            p++;
+        }
+
+        mCurrent = p + 2;
+    }
+    else
+        return Error("Syntax error: '/' is not the start of a comment", begin);
+
+    if (mCollectComments)
+    {
+        tCommentPlacement placement = kCommentBefore;
+
+        if (mLastValueEnd && !ContainsNewLine(mLastValueEnd, begin))
+        {
+            if (c != '*' || !ContainsNewLine(begin, mCurrent))
+                placement = kCommentAfterOnSameLine;
+        }
+
+        if (!mHandler->Comment(begin, mCurrent, placement))
+            return Error("Read stopped by handler", begin);
+    }
+
+    return true;
+}
+
+bool cJSONStreamReader::Error(const char* message, const char* location)
+{
+    if (!mErrorMessage)     // keep the first, innermost error
+    {
+        mErrorMessage = message;
+        mErrorLocation = location;
+    }
+
+    return false;
+}
+
+
+// --- cJSONValueBuilder -------------------------------------------------------
+
+cJSONValueBuilder::cJSONValueBuilder(cValue* root, bool packArrays) :
+    mRoot(root),
+    mPackArrays(packArrays)
+{
+}
+
+cValue* cJSONValueBuilder::NextValue()
+{
+    cValue* value;
+
+    if (mNodes.empty())
+        value = mRoot;
+    else
+    {
+        cValue* parent = mNodes.back();
+
+        if (parent->Type() == kValueArray)
+        {
+            parent->Append(cValue::kNull);
+            value = &(*parent)[parent->NumElts() - 1];
+        }
+        else
+            value = &parent->AsObject()->InsertMember(mKey);
+    }
+
+    if (!mCommentsBefore.empty())
+    {
+        value->SetComment(mCommentsBefore, kCommentBefore);
+        mCommentsBefore.clear();
+    }
+
+    mLastValue = value;
+
+    return value;
+}
+
+bool cJSONValueBuilder::Null()
+{
+    NextValue()->MakeNull();
+    return true;
+}
+
+bool cJSONValueBuilder::Bool(bool value)
+{
+    *NextValue() = value;
+    return true;
+}
+
+bool cJSONValueBuilder::Int(int32_t value)
+{
+    *NextValue() = value;
+    return true;
+}
+
+bool cJSONValueBuilder::UInt(uint32_t value)
+{
+    *NextValue() = value;
+    return true;
+}
+
+bool cJSONValueBuilder::Double(double value)
+{
+    *NextValue() = value;
+    return true;
+}
+
+bool cJSONValueBuilder::String(const char* s, size_t length)
+{
+    *NextValue() = s;
+    return true;
+}
+
+bool cJSONValueBuilder::BeginObject()
+{
+    cValue* value = NextValue();
+    cObjectValue* object = value->AsObject();
+
+    if (value == mRoot && object)
+    {
+        // Keep the top-level object, as callers often hold onto it
+        object->RemoveMembers();
+        object->RemoveParents();
+    }
+    else
+    {
+        value->MakeNull();
+        value->MakeObject();
+
+        object = value->AsObject();
+
+        if (value != mRoot)
+            object->SetOwner(mRoot->AsObject());
+    }
+
+    mNodes.push_back(value);
+    return true;
+}
+
+bool cJSONValueBuilder::Key(const char* s, size_t length)
+{
+    mKey = TagFromString(s, s + length);
+    return true;
+}
+
+bool cJSONValueBuilder::EndObject()
+{
+    mLastValue = mNodes.back();
+    mLastValue->AsObject()->IncModCount();
+
+    mNodes.pop_back();
+    return true;
+}
+
+bool cJSONValueBuilder::BeginArray()
+{
+    cValue* value = NextValue();
+    *value = cValue(kValueArray);
+
+    mNodes.push_back(value);
+    return true;
+}
+
+bool cJSONValueBuilder::EndArray()
+{
+    mLastValue = mNodes.back();
+
+    if (mPackArrays)
+        mLastValue->PackArray();
+
+    mNodes.pop_back();
+    return true;
+}
+
+bool cJSONValueBuilder::Comment(const char* begin, const char* end, tCommentPlacement placement)
+{
+    if (placement == kCommentAfterOnSameLine && mLastValue)
+    {
+        mLastValue->SetComment(string(begin, end), placement);
+        return true;
+    }
+
+    if (!mCommentsBefore.empty())
+        mCommentsBefore += "\n";
+
+    mCommentsBefore.append(begin, end - begin);
+
+    // Once the top-level value is complete, remaining comments trail the document
+    if (mNodes.empty() && mLastValue)
+        mRoot->SetComment(mCommentsBefore, kCommentAfter);
+
+    return true;
+}
+
+
+// --- Utilities ---------------------------------------------------------------
+
+bool nCL::ReadFromJSONStream(const char* beginDoc, const char* endDoc, cValue* value, string* errorMessages, int* firstErrorLine)
+{
+    cJSONStreamReader reader;
+    cJSONValueBuilder builder(value);
+
+    bool success = reader.Read(beginDoc, endDoc, &builder);
+
+    if (!success && errorMessages)
+        reader.GetFormattedErrorMessages(errorMessages);
+
+    if (firstErrorLine)
+        *firstErrorLine = reader.GetFirstErrorLine();
+
+    return success;
+}
+
+
+#ifndef CL_RELEASE
+
+#include <CLFileSpec.h>
+#include <CLMemory.h>
+#include <CLTimer.h>
+
+namespace
+{
+    struct cCountingHandler : public cIJSONHandler
+    /// Does the minimum with each event, to measure the cost of the reader itself
+    {
+        size_t mCount = 0;
+
+        bool Null()                             override { mCount++; return true; }
+        bool Bool  (bool)                       override { mCount++; return true; }
+        bool Int   (int32_t)                    override { mCount++; return true; }
+        bool UInt  (uint32_t)                   override { mCount++; return true; }
+        bool Double(double)                     override { mCount++; return true; }
+        bool String(const char*, size_t length) override { mCount += length; return true; }
+        bool BeginObject()                      override { mCount++; return true; }
+        bool Key(const char*, size_t length)    override { mCount += length; return true; }
+        bool EndObject()                        override { mCount++; return true; }
+        bool BeginArray()                       override { mCount++; return true; }
+        bool EndArray()                         override { mCount++; return true; }
+    };
+}
+
+void nCL::BenchJSONStreamRead(const cFileSpec& spec)
+{
+    cMappedFileInfo mapInfo = MapFile(spec.Path());
+
+    if (!mapInfo.mData)
+    {
+        printf("Couldn't read %s\n", spec.Path());
+        return;
+    }
+
+    const char* begin = (const char*) mapInfo.mData;
+    const char* end   = begin + mapInfo.mSize;
+
+    // Check both readers agree, including comments
+    string results[2];
+
+    for (int stream = 0; stream < 2; stream++)
+    {
+        cValue value;
+
+        if (stream)
+        {
+            cJSONStreamReader reader;
+            cJSONValueBuilder builder(&value);
+            reader.Read(begin, end, &builder, true);
+        }
+        else
+        {
+            cJSONReader reader;
+            reader.Read(begin, end, &value, true);
+        }
+
+        cJSONStyledWriter writer;
+        writer.Write(value, &results[stream]);
+    }
+
+    printf("%s: %d bytes, results %s\n", spec.Path(), int(mapInfo.mSize), results[0] == results[1] ? "match" : "DIFFER");
+
+    const int kRounds = max(int((16 << 20) / max(mapInfo.mSize, size_t(1))), 10);
+    double megabytes = double(mapInfo.mSize) * kRounds / (1 << 20);
+
+    printf("Reader              MB/s\n");
+
+    for (int test = 0; test < 3; test++)
+    {
+        const char* names[] = { "cJSONReader", "stream -> cValue", "stream only" };
+        cJSONReader jsonReader;
+        cJSONStreamReader streamReader;
+        cCountingHandler counter;
+
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int r = 0; r < kRounds; r++)
+        {
+            if (test == 0)
+            {
+                cValue value;
+                jsonReader.Read(begin, end, &value);
+            }
+            else if (test == 1)
+            {
+                cValue value;
+                cJSONValueBuilder builder(&value);
+                streamReader.Read(begin, end, &builder);
+            }
+            else
+                streamReader.Read(begin, end, &counter);
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        printf("%-16s  %8.1f\n", names[test], megabytes / ((t1 - t0) * 1e-9));
+    }
+
+    UnmapFile(mapInfo);
+}
+
+#endif
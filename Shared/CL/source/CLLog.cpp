@@ -1,7 +1,9 @@
 //
 //  File:       CLLog.cpp
 //
-//  Function:   <Description>
+//  Function:   Asynchronous implementation of CLLog. Log calls record their format
+//              and raw arguments into a per-thread ring buffer, and a background
+//              thread does the formatting and output.
 //
 //  Author(s):  Andrew Willmott
 //
@@ -10,70 +12,1063 @@
 
 #include <CLLog.h>
 
+#include <CLIO.h>
+#include <CLSTL.h>
 #include <CLString.h>
+#include <CLTag.h>
+#include <CLTimer.h>
 #include <CLValue.h>
 
-#include <syslog.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <new>
+
+using namespace nCL;
 
 namespace
 {
-    struct cLogGroupInfo
+    const int      kMaxLogGroups   = 256;           ///< Groups past this share the last slot, which is always active
+    const int      kGroupCacheSize = 64;            ///< Per-thread cache of group name pointer -> index
+    const uint32_t kLogBufferSize  = 256 * 1024;    ///< Per thread, must be a power of two
+    const uint32_t kMaxRecordSize  = kLogBufferSize / 2;
+    const int      kMaxLogArgs     = 32;            ///< Formats using more arguments are formatted on the calling thread
+    const int      kMaxSpecLength  = 32;            ///< Ditto for overly long conversion specs
+    const int      kMaxTextLength  = 16 * 1024;     ///< Text formatted on the calling thread is truncated to this
+    const int      kMaxDumpBytes   = 64;            ///< Bytes of LogData() shown in text output
+    const int      kLogWakeMS      = 5;             ///< How often the log thread checks for output
+
+    // --- Records -------------------------------------------------------------
+
+    enum tLogRecordType : uint16_t
+    {
+        kRecordPadding,     ///< Skip to the start of the buffer
+        kRecordFormat,      ///< Format pointer, followed by a word per argument, with %s strings inline
+        kRecordText,        ///< Length, followed by already-formatted text
+        kRecordData,        ///< Length, zero, data
+        kRecordImage8,      ///< Length, width/height, pixels
+        kRecordImage32
+    };
+
+    struct cLogRecord
+    {
+        uint32_t    mSize;      ///< Including this header, always a multiple of 8
+        uint16_t    mType;      ///< tLogRecordType
+        uint16_t    mGroup;
+    };
+
+    inline uint32_t RoundUp8(size_t size)
+    {
+        return uint32_t((size + 7) & ~size_t(7));
+    }
+
+    struct cLogBuffer
+    /// Single-producer/single-consumer ring of variable-sized records. As with cFIFO,
+    /// the writer keeps a cached copy of the reader's index to avoid touching its cache
+    /// line. Indices increase monotonically and are masked on use, and records never
+    /// straddle the end of the buffer.
+    {
+        uint8_t*            mData = 0;
+        cLogBuffer*         mNext = 0;
+
+        std::atomic<int>    mDropped { 0 };
+        std::atomic<bool>   mExited  { false };
+
+        // Writer-owned
+        alignas(64) std::atomic<uint32_t> mWriteIndex { 0 };
+        uint32_t            mReadCache = 0;
+        uint32_t            mReserved  = 0;     ///< Bytes taken by the last Reserve(), including any padding
+
+        // Reader-owned
+        alignas(64) std::atomic<uint32_t> mReadIndex { 0 };
+
+        uint8_t* Reserve(uint32_t size);    ///< Returns space for a record of the given size, or 0 if the buffer is full.
+        void     Commit();                  ///< Makes the reserved record available to the reader.
+    };
+
+    uint8_t* cLogBuffer::Reserve(uint32_t size)
+    {
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        uint32_t offset     = writeIndex & (kLogBufferSize - 1);
+        uint32_t padding    = offset + size > kLogBufferSize ? kLogBufferSize - offset : 0;
+        uint32_t needed     = padding + size;
+
+        if (writeIndex + needed - mReadCache > kLogBufferSize)
+        {
+            mReadCache = mReadIndex.load(std::memory_order_acquire);
+
+            if (writeIndex + needed - mReadCache > kLogBufferSize)
+                return 0;
+        }
+
+        if (padding)
+        {
+            cLogRecord* pad = (cLogRecord*) (mData + offset);
+
+            pad->mSize  = padding;
+            pad->mType  = kRecordPadding;
+            pad->mGroup = 0;
+
+            offset = 0;
+        }
+
+        mReserved = needed;
+
+        return mData + offset;
+    }
+
+    inline void cLogBuffer::Commit()
+    {
+        uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+        mWriteIndex.store(writeIndex + mReserved, std::memory_order_release);
+    }
+
+
+    // --- Format parsing ------------------------------------------------------
+
+    struct cFormatSpec
+    {
+        const char* mStart;         ///< The '%'
+        const char* mLength;        ///< Start of any length modifier
+        const char* mEnd;           ///< Just past the conversion character
+        char        mConversion;    ///< 0 if the format ended early
+        char        mLengthType;    ///< 0, or 'H' (hh), 'h', 'l', 'q' (ll), 'j', 'z', 't', 'L'
+        bool        mStarWidth;
+        bool        mStarPrecision;
+        int         mPrecision;     ///< Literal precision, or -1
+    };
+
+    const char* ParseSpec(const char* s, cFormatSpec* spec)
+    /// Parses the conversion spec starting at the '%' at 's', and returns a pointer to what follows.
+    {
+        spec->mStart         = s++;
+        spec->mLengthType    = 0;
+        spec->mStarWidth     = false;
+        spec->mStarPrecision = false;
+        spec->mPrecision     = -1;
+
+        while (*s && strchr("-+ #0'", *s))
+            s++;
+
+        if (*s == '*')
+        {
+            spec->mStarWidth = true;
+            s++;
+        }
+        else
+            while (isdigit(*s))
+                s++;
+
+        if (*s == '.')
+        {
+            s++;
+
+            if (*s == '*')
+            {
+                spec->mStarPrecision = true;
+                s++;
+            }
+            else
+            {
+                spec->mPrecision = 0;
+
+                while (isdigit(*s))
+                    spec->mPrecision = spec->mPrecision * 10 + *s++ - '0';
+            }
+        }
+
+        spec->mLength = s;
+
+        switch (*s)
+        {
+        case 'h':
+            s++;
+            spec->mLengthType = 'h';
+
+            if (*s == 'h')
+            {
+                s++;
+                spec->mLengthType = 'H';
+            }
+            break;
+
+        case 'l':
+            s++;
+            spec->mLengthType = 'l';
+
+            if (*s == 'l')
+            {
+                s++;
+                spec->mLengthType = 'q';
+            }
+            break;
+
+        case 'q':
+        case 'j':
+        case 'z':
+        case 't':
+        case 'L':
+            spec->mLengthType = *s++;
+            break;
+        }
+
+        spec->mConversion = *s;
+
+        if (*s)
+            s++;
+
+        spec->mEnd = s;
+
+        return s;
+    }
+
+    inline bool IsIntConversion(char c)
+    {
+        return c == 'd' || c == 'i' || c == 'o' || c == 'u' || c == 'x' || c == 'X';
+    }
+
+    inline bool IsFloatConversion(char c)
+    {
+        return c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G' || c == 'a' || c == 'A';
+    }
+
+
+    // --- Groups --------------------------------------------------------------
+
+    struct cLogGroupConfig
     {
         bool mActive = true;
+
+        void Config(const cValue& config)
+        {
+            mActive = config[CL_TAG("active")].AsBool(mActive);
+        }
     };
 
-    nCL::map<const char*, cLogGroupInfo> sLogGroupInfoMap;
+    struct cGroupCacheEntry
+    {
+        const char* mName;
+        int         mIndex;
+    };
 
-    bool sLogActive = false;
-}
+    pthread_mutex_t sLogMutex = PTHREAD_MUTEX_INITIALIZER;  ///< Protects the group tables and the buffer list
 
-// syslog-based implementation for now.
+    map<string, int>             sGroupIndices;     ///< Lower-case group name -> index
+    vector<string>               sGroupNames;
+    map<string, cLogGroupConfig> sGroupConfigs;
+    cLogGroupConfig              sDefaultGroupConfig;
 
-bool nCL::InitLogSystem(const char* tag)
-{
-    if (!sLogActive)
+    std::atomic<uint64_t>        sActiveGroups[kMaxLogGroups / 64];
+
+    __thread cGroupCacheEntry    tGroupCache[kGroupCacheSize];
+
+    bool ConfiguredActive(const string& group)
+    /// sLogMutex must be held. As with the NSLogger version, "Group_Debug" etc. fall back to "Group".
+    {
+        auto it = sGroupConfigs.find(group);
+
+        if (it != sGroupConfigs.end())
+            return it->second.mActive;
+
+        const char* qualifier = strrchr(group.c_str(), '_');
+
+        if (qualifier)
+        {
+            it = sGroupConfigs.find(string(group.c_str(), qualifier));
+
+            if (it != sGroupConfigs.end())
+                return it->second.mActive;
+        }
+
+        return sDefaultGroupConfig.mActive;
+    }
+
+    void UpdateActiveGroups()
+    /// sLogMutex must be held
+    {
+        uint64_t active[kMaxLogGroups / 64] = { 0 };
+
+        for (int i = 0, n = sGroupNames.size(); i < n; i++)
+            if (ConfiguredActive(sGroupNames[i]))
+                active[i >> 6] |= uint64_t(1) << (i & 63);
+
+        active[(kMaxLogGroups - 1) >> 6] |= uint64_t(1) << ((kMaxLogGroups - 1) & 63);
+
+        for (int i = 0; i < kMaxLogGroups / 64; i++)
+            sActiveGroups[i].store(active[i], std::memory_order_relaxed);
+    }
+
+    int RegisterGroup(const char* group)
+    {
+        string name(group);
+        MakeLower(&name);
+
+        pthread_mutex_lock(&sLogMutex);
+
+        int index;
+        auto it = sGroupIndices.find(name);
+
+        if (it != sGroupIndices.end())
+            index = it->second;
+        else
+        {
+            index = kMaxLogGroups - 1;
+
+            if (sGroupNames.size() < kMaxLogGroups - 1)
+            {
+                index = sGroupNames.size();
+                sGroupNames.push_back(name);
+            }
+
+            sGroupIndices[name] = index;
+            UpdateActiveGroups();
+        }
+
+        pthread_mutex_unlock(&sLogMutex);
+
+        return index;
+    }
+
+    inline int GroupIndex(const char* group)
+    /// Group names come from the CL_LOG macros, so are string literals, and we can cache on their address.
+    {
+        cGroupCacheEntry& entry = tGroupCache[(uintptr_t(group) >> 3) & (kGroupCacheSize - 1)];
+
+        if (entry.mName != group)
+        {
+            entry.mIndex = RegisterGroup(group);
+            entry.mName  = group;
+        }
+
+        return entry.mIndex;
+    }
+
+    inline bool GroupActive(int index)
+    {
+        return (sActiveGroups[index >> 6].load(std::memory_order_relaxed) >> (index & 63)) & 1;
+    }
+
+
+    // --- Log thread ----------------------------------------------------------
+
+    pthread_once_t      sLogOnce = PTHREAD_ONCE_INIT;
+    pthread_key_t       sLogThreadKey;
+    cLogBuffer*         sLogBuffers = 0;
+    __thread cLogBuffer* tLogBuffer = 0;
+
+    pthread_t           sLogThread;
+    pthread_mutex_t     sLogWakeMutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t      sLogWakeCond  = PTHREAD_COND_INITIALIZER;
+
+    std::atomic<bool>   sLogActive       { false };
+    std::atomic<bool>   sLogThreadActive { false };
+    std::atomic<bool>   sLogThreadQuit   { false };
+    std::atomic<int>    sLogPasses       { 0 };
+
+    // Sinks
+    pthread_mutex_t     sSinkMutex = PTHREAD_MUTEX_INITIALIZER;
+    bool                sToStdout = true;
+    FILE*               sLogFile = 0;
+    cIOStream*          sLogStream = 0;
+
+    // Log thread only
+    vector<cLogBuffer*> sDrainBuffers;
+    vector<cLogBuffer*> sExitedBuffers;
+    vector<char>        sTextOutput;
+    vector<char>        sStreamOutput;
+
+    void ReleaseLogBuffer(void* data)
+    /// Called on thread exit -- the log thread frees the buffer once it has drained it.
+    {
+        cLogBuffer* buffer = (cLogBuffer*) data;
+        buffer->mExited.store(true, std::memory_order_release);
+    }
+
+    void InitLogThreadKey()
+    {
+        pthread_key_create(&sLogThreadKey, ReleaseLogBuffer);
+    }
+
+    cLogBuffer* CreateLogBuffer()
+    {
+        pthread_once(&sLogOnce, InitLogThreadKey);
+
+        // We use malloc as logging may happen before the allocators are set up
+        void* mem = 0;
+
+        if (posix_memalign(&mem, 64, sizeof(cLogBuffer)) != 0)
+            return 0;
+
+        cLogBuffer* buffer = new(mem) cLogBuffer;
+        buffer->mData = (uint8_t*) malloc(kLogBufferSize);
+
+        pthread_mutex_lock(&sLogMutex);
+        buffer->mNext = sLogBuffers;
+        sLogBuffers = buffer;
+        pthread_mutex_unlock(&sLogMutex);
+
+        pthread_setspecific(sLogThreadKey, buffer);
+        tLogBuffer = buffer;
+
+        return buffer;
+    }
+
+    void WakeLogThread()
+    {
+        pthread_cond_signal(&sLogWakeCond);
+    }
+
+    uint8_t* ReserveRecord(uint32_t size, cLogBuffer** bufferOut)
+    /// Returns space for a record on this thread's buffer, waiting for the log thread if it's full
+    {
+        cLogBuffer* buffer = tLogBuffer;
+
+        if (!buffer && !(buffer = CreateLogBuffer()))
+            return 0;
+
+        *bufferOut = buffer;
+
+        uint8_t* record = buffer->Reserve(size);
+
+        if (record)
+            return record;
+
+        if (size > kMaxRecordSize)
+        {
+            buffer->mDropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+
+        // Better to stall than to lose output
+        while (!(record = buffer->Reserve(size)))
+        {
+            if (!sLogThreadActive.load(std::memory_order_acquire))
+            {
+                buffer->mDropped.fetch_add(1, std::memory_order_relaxed);
+                return 0;
+            }
+
+            WakeLogThread();
+            usleep(100);
+        }
+
+        return record;
+    }
+
+    inline void InitRecord(uint8_t* record, uint32_t size, tLogRecordType type, int group)
+    {
+        cLogRecord* header = (cLogRecord*) record;
+
+        header->mSize  = size;
+        header->mType  = type;
+        header->mGroup = group;
+    }
+
+    void LogText(int group, const char* format, va_list args)
+    /// Fallback for formats we can't record
+    {
+        char text[kMaxTextLength];
+        int length = vsnprintf(text, sizeof(text), format, args);
+
+        if (length < 0)
+            return;
+        if (length >= kMaxTextLength)
+            length = kMaxTextLength - 1;
+
+        uint32_t size = sizeof(cLogRecord) + sizeof(uint64_t) + RoundUp8(length);
+
+        cLogBuffer* buffer;
+        uint8_t* record = ReserveRecord(size, &buffer);
+
+        if (!record)
+            return;
+
+        InitRecord(record, size, kRecordText, group);
+
+        uint64_t* words = (uint64_t*) (record + sizeof(cLogRecord));
+        words[0] = length;
+        memcpy(words + 1, text, length);
+
+        buffer->Commit();
+    }
+
+    void LogArgs(int group, const char* format, va_list args)
+    /// Records 'format' and the arguments it refers to. Strings are copied, as they may not outlive the call.
+    {
+        struct cArg
+        {
+            uint64_t    mWord;
+            const char* mString;    ///< If set, mWord is its length
+        };
+
+        cArg argList[kMaxLogArgs];
+        int  numArgs = 0;
+
+        uint32_t size = sizeof(cLogRecord) + sizeof(uint64_t);
+
+        va_list argsCopy;
+        va_copy(argsCopy, args);
+
+        bool supported = true;
+        const char* s = format;
+
+        while ((s = strchr(s, '%')))
+        {
+            cFormatSpec spec;
+            s = ParseSpec(s, &spec);
+
+            char c = spec.mConversion;
+
+            if (c == '%')
+                continue;
+
+            if (numArgs + 3 > kMaxLogArgs
+             || spec.mEnd - spec.mStart > kMaxSpecLength
+             || spec.mLengthType == 'L'
+             || (spec.mLengthType == 'l' && (c == 'c' || c == 's'))
+             || !(IsIntConversion(c) || IsFloatConversion(c) || c == 'c' || c == 's' || c == 'p')
+            )
+            {
+                supported = false;  // e.g., %n, %ls, long doubles
+                break;
+            }
+
+            int precision = spec.mPrecision;
+
+            if (spec.mStarWidth)
+            {
+                argList[numArgs++] = { uint64_t(int64_t(va_arg(args, int))), 0 };
+                size += sizeof(uint64_t);
+            }
+
+            if (spec.mStarPrecision)
+            {
+                precision = va_arg(args, int);
+                argList[numArgs++] = { uint64_t(int64_t(precision)), 0 };
+                size += sizeof(uint64_t);
+            }
+
+            cArg& arg = argList[numArgs++];
+            arg.mString = 0;
+
+            if (c == 'd' || c == 'i')
+            {
+                int64_t value;
+
+                switch (spec.mLengthType)
+                {
+                case 'l': value = va_arg(args, long);       break;
+                case 'q': value = va_arg(args, long long);  break;
+                case 'j': value = va_arg(args, intmax_t);   break;
+                case 'z': value = va_arg(args, ssize_t);    break;
+                case 't': value = va_arg(args, ptrdiff_t);  break;
+                case 'H': value = (signed char) va_arg(args, int); break;
+                case 'h': value = (short)       va_arg(args, int); break;
+                default:  value = va_arg(args, int);
+                }
+
+                arg.mWord = value;
+            }
+            else if (IsIntConversion(c))
+            {
+                uint64_t value;
+
+                switch (spec.mLengthType)
+                {
+                case 'l': value = va_arg(args, unsigned long);      break;
+                case 'q': value = va_arg(args, unsigned long long); break;
+                case 'j': value = va_arg(args, uintmax_t);          break;
+                case 'z': value = va_arg(args, size_t);             break;
+                case 't': value = va_arg(args, ptrdiff_t);          break;
+                case 'H': value = (unsigned char)  va_arg(args, unsigned int); break;
+                case 'h': value = (unsigned short) va_arg(args, unsigned int); break;
+                default:  value = va_arg(args, unsigned int);
+                }
+
+                arg.mWord = value;
+            }
+            else if (IsFloatConversion(c))
+            {
+                double value = va_arg(args, double);
+                memcpy(&arg.mWord, &value, sizeof(value));
+            }
+            else if (c == 'c')
+                arg.mWord = va_arg(args, int);
+            else if (c == 'p')
+                arg.mWord = uintptr_t(va_arg(args, void*));
+            else if (c == 's')
+            {
+                const char* str = va_arg(args, const char*);
+
+                if (!str)
+                    str = "(null)";
+
+                size_t length = precision >= 0 ? strnlen(str, precision) : strlen(str);
+
+                arg.mWord   = length;
+                arg.mString = str;
+
+                size += RoundUp8(length + 1);
+            }
+
+            size += sizeof(uint64_t);
+        }
+
+        if (!supported || size > kMaxRecordSize)
+        {
+            LogText(group, format, argsCopy);
+            va_end(argsCopy);
+            return;
+        }
+
+        va_end(argsCopy);
+
+        cLogBuffer* buffer;
+        uint8_t* record = ReserveRecord(size, &buffer);
+
+        if (!record)
+            return;
+
+        InitRecord(record, size, kRecordFormat, group);
+
+        uint64_t* words = (uint64_t*) (record + sizeof(cLogRecord));
+        *words++ = uintptr_t(format);
+
+        for (int i = 0; i < numArgs; i++)
+        {
+            *words++ = argList[i].mWord;
+
+            if (argList[i].mString)
+            {
+                size_t length = argList[i].mWord;
+                char* str = (char*) words;
+
+                memcpy(str, argList[i].mString, length);
+                str[length] = 0;
+
+                words += RoundUp8(length + 1) / sizeof(uint64_t);
+            }
+        }
+
+        buffer->Commit();
+    }
+
+    void LogBinary(const char* group, tLogRecordType type, int w, int h, size_t dataSize, const uint8_t* data)
+    {
+        int groupIndex = GroupIndex(group);
+
+        if (!GroupActive(groupIndex) || !sLogActive.load(std::memory_order_relaxed))
+            return;
+
+        size_t size = sizeof(cLogRecord) + 2 * sizeof(uint64_t) + RoundUp8(dataSize);
+
+        if (size > kMaxRecordSize)
+        {
+            if (tLogBuffer)
+                tLogBuffer->mDropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        cLogBuffer* buffer;
+        uint8_t* record = ReserveRecord(size, &buffer);
+
+        if (!record)
+            return;
+
+        InitRecord(record, size, type, groupIndex);
+
+        uint64_t* words = (uint64_t*) (record + sizeof(cLogRecord));
+        words[0] = dataSize;
+        words[1] = (uint64_t(uint32_t(w)) << 32) | uint32_t(h);
+        memcpy(words + 2, data, dataSize);
+
+        buffer->Commit();
+    }
+
+
+    // --- Output --------------------------------------------------------------
+
+    void Append(vector<char>* output, const char* s, size_t length)
     {
-        if (!tag)
-            tag = "CL";
+        output->insert(output->end(), s, s + length);
+    }
+
+    template<class T> void AppendFormatted(vector<char>* output, const char* spec, T value)
+    {
+        const int kGuess = 64;
 
-//        openlog(tag, LOG_CONS | LOG_PERROR, LOG_USER);
+        size_t start = output->size();
+        output->resize(start + kGuess);
 
-        sLogActive = true;
-        return true;
+        int length = snprintf(output->data() + start, kGuess, spec, value);
+
+        if (length >= kGuess)
+        {
+            output->resize(start + length + 1);
+            snprintf(output->data() + start, length + 1, spec, value);
+        }
+
+        output->resize(start + (length > 0 ? length : 0));
     }
 
-    return false;
+    const uint64_t* FormatArg(const cFormatSpec& spec, const uint64_t* words, vector<char>* output)
+    /// Formats the argument(s) for 'spec' starting at 'words', and returns the words that follow.
+    {
+        // Rebuild the spec with any '*'s filled in. Integers were widened to 64 bits when recorded.
+        char specStr[2 * kMaxSpecLength];
+        char* p = specStr;
+
+        for (const char* s = spec.mStart; s < spec.mLength; s++)
+            if (*s == '*')
+                p += snprintf(p, 12, "%d", int(int64_t(*words++)));
+            else
+                *p++ = *s;
+
+        char c = spec.mConversion;
+
+        if (IsIntConversion(c))
+        {
+            *p++ = 'l';
+            *p++ = 'l';
+        }
+
+        *p++ = c;
+        *p = 0;
+
+        if (c == 'd' || c == 'i')
+            AppendFormatted(output, specStr, (long long) *words++);
+        else if (IsIntConversion(c))
+            AppendFormatted(output, specStr, (unsigned long long) *words++);
+        else if (IsFloatConversion(c))
+        {
+            double value;
+            memcpy(&value, words++, sizeof(value));
+            AppendFormatted(output, specStr, value);
+        }
+        else if (c == 'c')
+            AppendFormatted(output, specStr, int(*words++));
+        else if (c == 'p')
+            AppendFormatted(output, specStr, (void*) uintptr_t(*words++));
+        else if (c == 's')
+        {
+            size_t length = *words++;
+            AppendFormatted(output, specStr, (const char*) words);
+            words += RoundUp8(length + 1) / sizeof(uint64_t);
+        }
+
+        return words;
+    }
+
+    void FormatRecord(const cLogRecord* record, bool toStream)
+    {
+        const uint64_t* words = (const uint64_t*) (record + 1);
+
+        switch (record->mType)
+        {
+        case kRecordFormat:
+            {
+                const char* s = (const char*) uintptr_t(*words++);
+
+                while (const char* percent = strchr(s, '%'))
+                {
+                    Append(&sTextOutput, s, percent - s);
+
+                    cFormatSpec spec;
+                    s = ParseSpec(percent, &spec);
+
+                    if (spec.mConversion == '%')
+                        sTextOutput.push_back('%');
+                    else
+                        words = FormatArg(spec, words, &sTextOutput);
+                }
+
+                Append(&sTextOutput, s, strlen(s));
+            }
+            break;
+
+        case kRecordText:
+            Append(&sTextOutput, (const char*) (words + 1), words[0]);
+            break;
+
+        case kRecordData:
+        case kRecordImage8:
+        case kRecordImage32:
+            {
+                size_t         dataSize = words[0];
+                int            w        = int(words[1] >> 32);
+                int            h        = int(uint32_t(words[1]));
+                const uint8_t* data     = (const uint8_t*) (words + 2);
+
+                pthread_mutex_lock(&sLogMutex);
+                string group(record->mGroup < sGroupNames.size() ? sGroupNames[record->mGroup].c_str() : "log");
+                pthread_mutex_unlock(&sLogMutex);
+
+                char line[256];
+                int length;
+
+                if (record->mType == kRecordData)
+                    length = snprintf(line, sizeof(line), "[%s] %zu bytes of data\n", group.c_str(), dataSize);
+                else
+                    length = snprintf(line, sizeof(line), "[%s] %d x %d %s image\n", group.c_str(), w, h, record->mType == kRecordImage8 ? "8-bit" : "32-bit");
+
+                Append(&sTextOutput, line, length);
+
+                if (toStream)
+                {
+                    // Raw data follows the header line
+                    Append(&sStreamOutput, sTextOutput.end() - length, length);
+                    Append(&sStreamOutput, (const char*) data, dataSize);
+                }
+
+                if (record->mType == kRecordData && dataSize > 0)
+                {
+                    for (size_t i = 0; i < dataSize && i < kMaxDumpBytes; i++)
+                    {
+                        length = snprintf(line, sizeof(line), (i % 16 == 15 || i + 1 == dataSize) ? "%02x\n" : "%02x ", data[i]);
+                        Append(&sTextOutput, line, length);
+                    }
+
+                    if (dataSize > kMaxDumpBytes)
+                        Append(&sTextOutput, "...\n", 4);
+                }
+            }
+            return;
+        }
+    }
+
+    void WriteLogOutput()
+    /// Formats everything outstanding on each thread's buffer, and writes it to the sinks.
+    {
+        // Buffers are only freed here, so once we have the list we can drop the lock.
+        pthread_mutex_lock(&sLogMutex);
+
+        sDrainBuffers.clear();
+
+        for (cLogBuffer* buffer = sLogBuffers; buffer; buffer = buffer->mNext)
+            sDrainBuffers.push_back(buffer);
+
+        pthread_mutex_unlock(&sLogMutex);
+
+        sExitedBuffers.clear();
+
+        for (cLogBuffer* buffer : sDrainBuffers)
+        {
+            // Check before draining, so we don't lose anything written just before exit.
+            bool exited = buffer->mExited.load(std::memory_order_acquire);
+
+            uint32_t readIndex = buffer->mReadIndex.load(std::memory_order_relaxed);
+            uint32_t endIndex  = buffer->mWriteIndex.load(std::memory_order_acquire);
+            int      dropped   = buffer->mDropped.exchange(0, std::memory_order_relaxed);
+
+            if (readIndex != endIndex || dropped)
+            {
+                pthread_mutex_lock(&sSinkMutex);
+
+                bool toStream = sLogStream != 0;
+
+                sTextOutput.clear();
+                sStreamOutput.clear();
+
+                while (readIndex != endIndex)
+                {
+                    const cLogRecord* record = (const cLogRecord*) (buffer->mData + (readIndex & (kLogBufferSize - 1)));
+
+                    if (record->mType != kRecordPadding)
+                    {
+                        size_t textStart = sTextOutput.size();
+                        FormatRecord(record, toStream);
+
+                        if (toStream && record->mType < kRecordData)
+                            Append(&sStreamOutput, sTextOutput.begin() + textStart, sTextOutput.size() - textStart);
+                    }
+
+                    readIndex += record->mSize;
+                }
+
+                if (dropped)
+                {
+                    char line[64];
+                    int length = snprintf(line, sizeof(line), "[Log] %d messages dropped\n", dropped);
+
+                    Append(&sTextOutput, line, length);
+                    if (toStream)
+                        Append(&sStreamOutput, line, length);
+                }
+
+                if (sToStdout)
+                {
+                    fwrite(sTextOutput.data(), 1, sTextOutput.size(), stdout);
+                    fflush(stdout);
+                }
+
+                if (sLogFile)
+                {
+                    fwrite(sTextOutput.data(), 1, sTextOutput.size(), sLogFile);
+                    fflush(sLogFile);
+                }
+
+                if (toStream)
+                {
+                    Write(sLogStream, sStreamOutput.size(), sStreamOutput.data());
+                    sLogStream->Flush();
+                }
+
+                pthread_mutex_unlock(&sSinkMutex);
+
+                buffer->mReadIndex.store(endIndex, std::memory_order_release);
+            }
+
+            if (exited)
+                sExitedBuffers.push_back(buffer);
+        }
+
+        if (!sExitedBuffers.empty())
+        {
+            pthread_mutex_lock(&sLogMutex);
+
+            for (cLogBuffer* buffer : sExitedBuffers)
+            {
+                cLogBuffer** link = &sLogBuffers;
+
+                while (*link != buffer)
+                    link = &(*link)->mNext;
+
+                *link = buffer->mNext;
+
+                free(buffer->mData);
+                buffer->~cLogBuffer();
+                free(buffer);
+            }
+
+            pthread_mutex_unlock(&sLogMutex);
+        }
+
+        sLogPasses.fetch_add(1, std::memory_order_release);
+    }
+
+    void* LogThreadMain(void*)
+    {
+        while (!sLogThreadQuit.load(std::memory_order_acquire))
+        {
+            WriteLogOutput();
+
+            timeval now;
+            gettimeofday(&now, 0);
+
+            int64_t wakeUS = now.tv_usec + kLogWakeMS * 1000;
+
+            timespec wakeTime;
+            wakeTime.tv_sec  = now.tv_sec + wakeUS / 1000000;
+            wakeTime.tv_nsec = (wakeUS % 1000000) * 1000;
+
+            pthread_mutex_lock(&sLogWakeMutex);
+            pthread_cond_timedwait(&sLogWakeCond, &sLogWakeMutex, &wakeTime);
+            pthread_mutex_unlock(&sLogWakeMutex);
+        }
+
+        WriteLogOutput();
+
+        return 0;
+    }
 }
 
-bool nCL::ShutdownLogSystem()
+bool nCL::InitLogSystem(const char* tag)
 {
     if (sLogActive)
-    {
-//        closelog();
-        sLogGroupInfoMap.clear();
-        sLogActive = false;
-        return true;
-    }
+        return false;
+
+    sLogThreadQuit.store(false);
 
-    return false;
+    if (pthread_create(&sLogThread, 0, LogThreadMain, 0) != 0)
+        return false;
+
+    sLogThreadActive.store(true, std::memory_order_release);
+    sLogActive.store(true, std::memory_order_release);
+
+    return true;
+}
+
+bool nCL::ShutdownLogSystem()
+{
+    if (!sLogActive)
+        return false;
+
+    // Anything logged from here on is written directly.
+    sLogActive.store(false, std::memory_order_release);
+
+    sLogThreadQuit.store(true, std::memory_order_release);
+    WakeLogThread();
+    pthread_join(sLogThread, 0);
+
+    sLogThreadActive.store(false, std::memory_order_release);
+
+    SetLogFile(0);
+    SetLogStream(0);
+
+    pthread_mutex_lock(&sLogMutex);
+    sGroupConfigs.clear();
+    sDefaultGroupConfig = cLogGroupConfig();
+    UpdateActiveGroups();
+    pthread_mutex_unlock(&sLogMutex);
+
+    return true;
 }
 
 void nCL::ConfigLogSystem(const nCL::cObjectValue* config)
 {
-    sLogGroupInfoMap.clear();
+    const cObjectValue* groupsConfig = config ? config->Member(CL_TAG("groups")).AsObject() : 0;
+
+    pthread_mutex_lock(&sLogMutex);
+
+    if (!config || groupsConfig)
+    {
+        sGroupConfigs.clear();
+        sDefaultGroupConfig = cLogGroupConfig();
+    }
 
-    for (auto c : config->Children())
+    if (groupsConfig)
     {
-        const char*   name = config.MemberName(i);
-        const cValue& info = config.MemberValue(i);
+        sDefaultGroupConfig.Config(groupsConfig->Member(CL_TAG("default")));
+
+        for (auto c : groupsConfig->Children())
+        {
+            string name(c.Name());
+
+            if (eqi(name, "default"))
+                continue;
 
-        if (!info.IsObject())
-            continue;
+            MakeLower(&name);
 
-        cLogGroupInfo& groupInfo = sLogGroupInfoMap[name];
+            cLogGroupConfig& groupConfig = sGroupConfigs[name];
 
-        groupInfo.mActive = info["active"].AsBool();
+            groupConfig = sDefaultGroupConfig;
+            groupConfig.Config(c.Value());
+        }
     }
+
+    UpdateActiveGroups();
+
+    pthread_mutex_unlock(&sLogMutex);
+
+    if (!config)
+        return;
+
+    const cValue& stdoutConfig = config->Member(CL_TAG("stdout"));
+
+    if (!stdoutConfig.IsNull())
+        SetLogToStdout(stdoutConfig.AsBool(true));
+
+    const char* logPath = config->Member(CL_TAG("file")).AsString();
+
+    if (logPath)
+        SetLogFile(logPath);
 }
 
 bool nCL::OpenLogConsole()
@@ -82,30 +1077,213 @@ bool nCL::OpenLogConsole()
     return true;
 }
 
+void nCL::FlushLog()
+{
+    // Can't wait on ourselves, e.g., if an assert fires while writing output.
+    if (!sLogThreadActive.load(std::memory_order_acquire) || pthread_equal(pthread_self(), sLogThread))
+    {
+        fflush(stdout);
+        return;
+    }
+
+    // The pass in progress may have started before our call, but the one after it can't have.
+    int target = sLogPasses.load(std::memory_order_acquire) + 2;
+
+    while (sLogPasses.load(std::memory_order_acquire) - target < 0)
+    {
+        WakeLogThread();
+        usleep(100);
+    }
+}
+
+void nCL::SetLogToStdout(bool enabled)
+{
+    pthread_mutex_lock(&sSinkMutex);
+    sToStdout = enabled;
+    pthread_mutex_unlock(&sSinkMutex);
+}
+
+bool nCL::SetLogFile(const char* path)
+{
+    FILE* file = 0;
+
+    if (path && !(file = fopen(path, "w")))
+        return false;
+
+    pthread_mutex_lock(&sSinkMutex);
+    FILE* oldFile = sLogFile;
+    sLogFile = file;
+    pthread_mutex_unlock(&sSinkMutex);
+
+    if (oldFile)
+        fclose(oldFile);
+
+    return true;
+}
+
+void nCL::SetLogStream(cIOStream* stream)
+{
+    pthread_mutex_lock(&sSinkMutex);
+    sLogStream = stream;
+    pthread_mutex_unlock(&sSinkMutex);
+}
+
 void nCL::Log(const char* group, const char* format, ...)
 {
-    auto it = sLogGroupInfoMap.find(group);
+    int groupIndex = GroupIndex(group);
 
-    if (it != sLogGroupInfoMap.end() && !it->second.mActive)
+    if (!GroupActive(groupIndex))
         return;
 
     va_list args;
     va_start(args, format);
 
-    vsyslog(LOG_ERR, format, args);
-    vprintf(format, args);      // TODO: if debugger attached
+    if (sLogActive.load(std::memory_order_relaxed))
+        LogArgs(groupIndex, format, args);
+    else
+        vprintf(format, args);
 
     va_end(args);
 }
 
 void nCL::LogData(const char* group, size_t dataSize, const uint8_t* data)
 {
+    LogBinary(group, kRecordData, 0, 0, dataSize, data);
 }
 
 void nCL::LogImage8 (const char* group, int w, int h, const uint8_t* data)
 {
+    LogBinary(group, kRecordImage8, w, h, size_t(w) * h, data);
 }
 
 void nCL::LogImage32(const char* group, int w, int h, const uint8_t* data)
 {
+    LogBinary(group, kRecordImage32, w, h, size_t(w) * h * 4, data);
+}
+
+
+#ifndef CL_RELEASE
+
+namespace
+{
+    void PrintLatencies(const char* label, vector<uint64_t>* ticks, uint64_t overhead)
+    {
+        sort(ticks->begin(), ticks->end());
+
+        size_t n = ticks->size();
+
+        auto Adjusted = [overhead](uint64_t t) { return t > overhead ? t - overhead : 0; };
+
+        printf("%-28s %8llu %8llu %8llu %10llu\n", label,
+            (unsigned long long) Adjusted((*ticks)[n / 2]),
+            (unsigned long long) Adjusted((*ticks)[n * 99 / 100]),
+            (unsigned long long) Adjusted((*ticks)[n * 999 / 1000]),
+            (unsigned long long) Adjusted((*ticks)[n - 1])
+        );
+    }
+}
+
+void nCL::BenchLog()
+{
+    const int kBatchSize  = 1000;   // stays well inside the thread buffer
+    const int kNumBatches = 100;
+    const int kNumCalls   = kBatchSize * kNumBatches;
+
+    bool active = sLogActive.load();
+
+    if (!active)
+        InitLogSystem();
+
+    FlushLog();
+
+    pthread_mutex_lock(&sSinkMutex);
+    bool toStdout = sToStdout;
+    sToStdout = false;
+    pthread_mutex_unlock(&sSinkMutex);
+
+    pthread_mutex_lock(&sLogMutex);
+    sGroupConfigs["benchlogoff"].mActive = false;
+    UpdateActiveGroups();
+    pthread_mutex_unlock(&sLogMutex);
+
+    FILE* nullFile = fopen("/dev/null", "w");
+
+    vector<uint64_t> ticks;
+    ticks.reserve(kNumCalls);
+
+    // Cost of timing itself
+    for (int i = 0; i < kNumCalls; i++)
+    {
+        uint64_t t0 = AbsoluteTicks();
+        ticks.push_back(AbsoluteTicks() - t0);
+    }
+
+    sort(ticks.begin(), ticks.end());
+    uint64_t overhead = ticks[ticks.size() / 2];
+
+    printf("Log call latency on the calling thread, in ns, with the timer overhead of %llu ns removed\n", (unsigned long long) overhead);
+    printf("%-28s %8s %8s %8s %10s\n", "", "median", "99%", "99.9%", "max");
+
+    for (int test = 0; test < 5; test++)
+    {
+        ticks.clear();
+
+        for (int batch = 0; batch < kNumBatches; batch++)
+        {
+            for (int i = 0; i < kBatchSize; i++)
+            {
+                uint64_t t0 = AbsoluteTicks();
+
+                switch (test)
+                {
+                case 0:
+                    Log("BenchLogOff", "Disabled %d %f\n", i, 1.0f);
+                    break;
+                case 1:
+                    Log("BenchLog", "No arguments\n");
+                    break;
+                case 2:
+                    Log("BenchLog", "Loaded %d effects in %.2f ms\n", i, i * 0.01f);
+                    break;
+                case 3:
+                    Log("BenchLog", "%s: reload material %d (%s / %s)\n", "Renderer", i, "shaders/default.vsh", "shaders/default.fsh");
+                    break;
+                case 4:
+                    fprintf(nullFile, "%s: reload material %d (%s / %s)\n", "Renderer", i, "shaders/default.vsh", "shaders/default.fsh");
+                    break;
+                }
+
+                ticks.push_back(AbsoluteTicks() - t0);
+            }
+
+            FlushLog();     // measure the caller, not how long until the buffer fills
+        }
+
+        const char* kLabels[] =
+        {
+            "Log, disabled group",
+            "Log, no arguments",
+            "Log, int + float",
+            "Log, int + 3 strings",
+            "fprintf, int + 3 strings"
+        };
+
+        PrintLatencies(kLabels[test], &ticks, overhead);
+    }
+
+    fclose(nullFile);
+
+    pthread_mutex_lock(&sLogMutex);
+    sGroupConfigs.erase(string("benchlogoff"));
+    UpdateActiveGroups();
+    pthread_mutex_unlock(&sLogMutex);
+
+    pthread_mutex_lock(&sSinkMutex);
+    sToStdout = toStdout;
+    pthread_mutex_unlock(&sSinkMutex);
+
+    if (!active)
+        ShutdownLogSystem();
 }
+
+#endif
@@ -11,6 +11,7 @@
 #include <CLLog.h>
 
 #include <CLString.h>
+#include <CLTimer.h>
 #include <CLValue.h>
 
 #include "Apple/LoggerClient.h"
@@ -50,6 +51,7 @@ namespace
     cLogGroupInfo sDefaultGroupInfo;
 
     bool sLogActive = false;
+    bool sToStdout  = true;
 
     inline const cLogGroupInfo* GroupInfo(const char* groupIn)
     {
@@ -140,7 +142,7 @@ void nCL::Log(const char* group, const char* format, ...)
         CFRelease(apiForcingACopyOfFormat);
     }
 
-    if (groupInfo->mToDebugger)
+    if (groupInfo->mToDebugger && sToStdout)
         vprintf(format, args);
 
 #ifdef HL_USE_TEST_FLIGHT
@@ -341,3 +343,46 @@ bool nCL::OpenLogConsole()
 #endif
     return true;
 }
+
+void nCL::FlushLog()
+{
+    if (sLogActive)
+        LoggerFlush(nullptr, NO);
+
+    fflush(stdout);
+}
+
+void nCL::SetLogToStdout(bool enabled)
+{
+    sToStdout = enabled;
+}
+
+bool nCL::SetLogFile(const char* path)
+{
+    return path == 0;   // Not supported -- use the NSLogger viewer
+}
+
+void nCL::SetLogStream(cIOStream* stream)
+{
+}
+
+#ifndef CL_RELEASE
+void nCL::BenchLog()
+{
+    const int kNumCalls = 100000;
+
+    bool toStdout = sToStdout;
+    sToStdout = false;
+
+    uint64_t t0 = AbsoluteTicks();
+
+    for (int i = 0; i < kNumCalls; i++)
+        Log("BenchLog", "Loaded %d effects in %.2f ms\n", i, i * 0.01f);
+
+    uint64_t t1 = AbsoluteTicks();
+
+    sToStdout = toStdout;
+
+    printf("Log, int + float: %6.1f ns per call\n", double(t1 - t0) / kNumCalls);
+}
+#endif
@@ -10,8 +10,10 @@
 
 #include <CLMemory.h>
 
+#include <CLBits.h>
 #include <CLLog.h>
 #include <CLSTL.h>
+#include <CLTimer.h>
 
 #include <stdlib.h>
 
@@ -30,18 +32,9 @@
     #endif
 #endif
 
-#if CL_MEM_TRACK
-    #include <pthread.h>
-#endif
+#include <pthread.h>
 
-#define CL_ASSERT_MONO_THREAD \
-    { \
-        static pthread_t sSingleThread = 0; \
-        if (sSingleThread) \
-            CL_ASSERT(sSingleThread == pthread_self()); \
-        else \
-            sSingleThread == pthread_self(); \
-    }
+#include <atomic>
 
 using namespace nCL;
 
@@ -62,53 +55,616 @@ namespace
         }
     };
 
-    class cBasicHeapAllocator : public cIAllocator
+
+    // --- Pooled heap ---------------------------------------------------------
+
+    // Small allocations are served from size-class spans carved out of a single
+    // reserved address range, so Free() can tell pool memory from large
+    // allocations with a range check, and find the size class from a per-page
+    // table. Each thread keeps its own free lists per size class, and only
+    // takes a lock when moving a batch of objects to or from the central list.
+    // Span memory is never returned to the OS, but is reused by its size class.
+    // Larger allocations go to malloc, with a header for alignment.
+
+    const int    kPoolPageShift     = 16;
+    const size_t kPoolPageSize      = size_t(1) << kPoolPageShift;     ///< Granularity of spans
+    const size_t kPoolRegionSize    = sizeof(void*) == 8 ? (size_t(1) << 30) : (size_t(1) << 28);  ///< Address space reserved for spans
+    const int    kNumPoolPages      = int(kPoolRegionSize >> kPoolPageShift);
+
+    const size_t kMaxSmallSize      = 32768;
+    const int    kNumSizeClasses    = 40;   ///< 16-byte steps up to 128, then four classes per power of two
+    const int    kMinSpanObjects    = 8;
+    const size_t kMinAlign          = 16;
+
+    const uint8_t kNoSizeClass      = 0xFF;
+    const int    kNumStatsKinds     = kUserAllocator1;
+
+    struct cFreeObject
+    {
+        cFreeObject* mNext;
+    };
+
+    struct cCentralList
+    {
+        pthread_mutex_t mMutex;
+        cFreeObject*    mFree;
+        int             mFreeCount;
+
+        uint8_t*        mSpanCurrent;   ///< Remainder of the most recent span, not yet handed out
+        uint8_t*        mSpanEnd;
+    };
+
+    struct cAllocCounters
+    {
+        std::atomic<int64_t> mNumAllocs;
+        std::atomic<int64_t> mNumFrees;
+        std::atomic<int64_t> mBytesAllocated;
+        std::atomic<int64_t> mBytesFreed;
+    };
+
+    struct cThreadCache
+    {
+        cFreeObject*    mFree     [kNumSizeClasses];
+        int             mFreeCount[kNumSizeClasses];
+
+        cAllocCounters  mCounters [kNumStatsKinds];     ///< Only written by the owning thread
+
+        cThreadCache*   mPrev;
+        cThreadCache*   mNext;
+    };
+
+    inline void AddCount(std::atomic<int64_t>& counter, int64_t n)
+    {
+        // Single writer, so no need for an atomic add. The atomic just lets stats be read from other threads.
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint8_t*        sPoolRegion = 0;
+    size_t          sPoolRegionUsed = 0;
+    pthread_mutex_t sPoolRegionMutex = PTHREAD_MUTEX_INITIALIZER;
+    uint8_t         sPoolPageClass[kNumPoolPages];
+
+    uint32_t        sClassSize     [kNumSizeClasses];
+    int             sClassBatch    [kNumSizeClasses];  ///< Number of objects moved between thread and central lists at a time
+    size_t          sClassSpanSize [kNumSizeClasses];
+    cCentralList    sCentral       [kNumSizeClasses];
+    uint8_t         sSizeClassLookup[(kMaxSmallSize >> 4) + 1];    ///< Size class by size in 16-byte units, rounded up. Class sizes are all multiples of 16.
+
+    pthread_once_t  sPoolOnce = PTHREAD_ONCE_INIT;
+    pthread_key_t   sThreadCacheKey;
+    pthread_mutex_t sThreadCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+    cThreadCache*   sThreadCaches = 0;                  ///< List of live thread caches, for stats
+    cAllocCounters  sRetiredCounters[kNumStatsKinds];   ///< Counts from threads that have exited, protected by sThreadCacheMutex
+
+    __thread cThreadCache* tThreadCache = 0;
+
+    inline int SizeClass(size_t size)
+    {
+        if (size <= 128)
+            return size ? int((size - 1) >> 4) : 0;
+
+        int b = Log2Int(uint32_t(size - 1));
+        return 8 + (b - 7) * 4 + int((size - 1) >> (b - 2)) - 4;
+    }
+
+    void ReleaseThreadCache(void* data);
+
+    void InitPool()
+    {
+        for (int i = 0; i < kNumSizeClasses; i++)
+        {
+            if (i < 8)
+                sClassSize[i] = 16 * (i + 1);
+            else
+            {
+                uint32_t base = 128 << ((i - 8) / 4);
+                sClassSize[i] = base + (base / 4) * ((i - 8) % 4 + 1);
+            }
+
+            CL_ASSERT(SizeClass(sClassSize[i]) == i);
+
+            int batch = int(kPoolPageSize / sClassSize[i]);
+            sClassBatch[i] = batch < 4 ? 4 : batch > 128 ? 128 : batch;
+
+            size_t spanSize = (kMinSpanObjects * sClassSize[i] + kPoolPageSize - 1) & ~(kPoolPageSize - 1);
+            sClassSpanSize[i] = spanSize;
+
+            pthread_mutex_init(&sCentral[i].mMutex, 0);
+        }
+
+        for (int i = 0; i <= int(kMaxSmallSize >> 4); i++)
+            sSizeClassLookup[i] = uint8_t(SizeClass(size_t(i) << 4));
+
+        memset(sPoolPageClass, kNoSizeClass, sizeof(sPoolPageClass));
+
+        // Reserve address space only -- pages are made accessible as spans are needed.
+        void* region = mmap(0, kPoolRegionSize + kPoolPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+        if (region != MAP_FAILED)
+            sPoolRegion = (uint8_t*) ((uintptr_t(region) + kPoolPageSize - 1) & ~uintptr_t(kPoolPageSize - 1));
+        else
+            CL_LOG_E("Memory", "Couldn't reserve pool address space, using system heap\n");
+
+        pthread_key_create(&sThreadCacheKey, ReleaseThreadCache);
+    }
+
+    inline bool IsPoolPointer(const void* p)
+    {
+        return sPoolRegion && size_t((const uint8_t*) p - sPoolRegion) < kPoolRegionSize;
+    }
+
+    uint8_t* AllocSpan(int sizeClass)
+    {
+        size_t spanSize = sClassSpanSize[sizeClass];
+        uint8_t* span = 0;
+
+        pthread_mutex_lock(&sPoolRegionMutex);
+
+        if (sPoolRegion && sPoolRegionUsed + spanSize <= kPoolRegionSize)
+        {
+            span = sPoolRegion + sPoolRegionUsed;
+
+            if (mprotect(span, spanSize, PROT_READ | PROT_WRITE) == 0)
+            {
+                size_t page = sPoolRegionUsed >> kPoolPageShift;
+                memset(sPoolPageClass + page, sizeClass, spanSize >> kPoolPageShift);
+
+                sPoolRegionUsed += spanSize;
+            }
+            else
+                span = 0;
+        }
+
+        pthread_mutex_unlock(&sPoolRegionMutex);
+
+        return span;
+    }
+
+    void FetchBatch(cThreadCache* cache, int sizeClass)
+    /// Refill the thread's list for sizeClass from the central list, carving out new objects as necessary.
+    {
+        cCentralList& central = sCentral[sizeClass];
+        int batch = sClassBatch[sizeClass];
+        size_t objectSize = sClassSize[sizeClass];
+
+        cFreeObject* list = 0;
+        int count = 0;
+
+        pthread_mutex_lock(&central.mMutex);
+
+        while (count < batch && central.mFree)
+        {
+            cFreeObject* object = central.mFree;
+            central.mFree = object->mNext;
+
+            object->mNext = list;
+            list = object;
+            count++;
+        }
+
+        central.mFreeCount -= count;
+
+        while (count < batch)
+        {
+            if (central.mSpanCurrent + objectSize > central.mSpanEnd)
+            {
+                uint8_t* span = AllocSpan(sizeClass);
+
+                if (!span)
+                    break;
+
+                central.mSpanCurrent = span;
+                central.mSpanEnd     = span + sClassSpanSize[sizeClass];
+            }
+
+            cFreeObject* object = (cFreeObject*) central.mSpanCurrent;
+            central.mSpanCurrent += objectSize;
+
+            object->mNext = list;
+            list = object;
+            count++;
+        }
+
+        pthread_mutex_unlock(&central.mMutex);
+
+        cache->mFree     [sizeClass] = list;
+        cache->mFreeCount[sizeClass] = count;
+    }
+
+    void ReleaseBatch(cThreadCache* cache, int sizeClass, int count)
+    /// Move 'count' objects from the thread's list for sizeClass back to the central list.
+    {
+        cFreeObject* head = cache->mFree[sizeClass];
+        cFreeObject* tail = head;
+
+        for (int i = 1; i < count; i++)
+            tail = tail->mNext;
+
+        cache->mFree     [sizeClass] = tail->mNext;
+        cache->mFreeCount[sizeClass] -= count;
+
+        cCentralList& central = sCentral[sizeClass];
+
+        pthread_mutex_lock(&central.mMutex);
+
+        tail->mNext = central.mFree;
+        central.mFree = head;
+        central.mFreeCount += count;
+
+        pthread_mutex_unlock(&central.mMutex);
+    }
+
+    cThreadCache* CreateThreadCache()
+    {
+        pthread_once(&sPoolOnce, InitPool);
+
+        // Comes from the system heap, as it's needed to use the pool in the first place.
+        cThreadCache* cache = (cThreadCache*) calloc(1, sizeof(cThreadCache));
+
+        if (!cache)
+            return 0;
+
+        pthread_mutex_lock(&sThreadCacheMutex);
+
+        cache->mNext = sThreadCaches;
+        if (sThreadCaches)
+            sThreadCaches->mPrev = cache;
+        sThreadCaches = cache;
+
+        pthread_mutex_unlock(&sThreadCacheMutex);
+
+        pthread_setspecific(sThreadCacheKey, cache);
+        tThreadCache = cache;
+
+        return cache;
+    }
+
+    void ReleaseThreadCache(void* data)
+    /// Called on thread exit -- return all cached objects to the central lists, and fold in stats.
+    {
+        cThreadCache* cache = (cThreadCache*) data;
+
+        for (int i = 0; i < kNumSizeClasses; i++)
+            if (cache->mFreeCount[i] > 0)
+                ReleaseBatch(cache, i, cache->mFreeCount[i]);
+
+        pthread_mutex_lock(&sThreadCacheMutex);
+
+        for (int i = 0; i < kNumStatsKinds; i++)
+        {
+            AddCount(sRetiredCounters[i].mNumAllocs,      cache->mCounters[i].mNumAllocs);
+            AddCount(sRetiredCounters[i].mNumFrees,       cache->mCounters[i].mNumFrees);
+            AddCount(sRetiredCounters[i].mBytesAllocated, cache->mCounters[i].mBytesAllocated);
+            AddCount(sRetiredCounters[i].mBytesFreed,     cache->mCounters[i].mBytesFreed);
+        }
+
+        if (cache->mPrev)
+            cache->mPrev->mNext = cache->mNext;
+        else
+            sThreadCaches = cache->mNext;
+
+        if (cache->mNext)
+            cache->mNext->mPrev = cache->mPrev;
+
+        pthread_mutex_unlock(&sThreadCacheMutex);
+
+        if (tThreadCache == cache)
+            tThreadCache = 0;
+
+        free(cache);
+    }
+
+    struct cLargeHeader
+    {
+        void*   mBase;  ///< What malloc returned
+        size_t  mSize;
+    };
+
+    uint8_t* AllocLarge(size_t size, size_t align)
+    {
+        if (align < kMinAlign)
+            align = kMinAlign;
+
+        uint8_t* base = (uint8_t*) malloc(size + sizeof(cLargeHeader) + align - 1);
+
+        if (!base)
+            return 0;
+
+        uint8_t* p = (uint8_t*) ((uintptr_t(base) + sizeof(cLargeHeader) + align - 1) & ~uintptr_t(align - 1));
+
+        cLargeHeader* header = (cLargeHeader*) p - 1;
+        header->mBase = base;
+        header->mSize = size;
+
+        return p;
+    }
+
+    size_t FreeLarge(void* p)
+    {
+        cLargeHeader* header = (cLargeHeader*) p - 1;
+        size_t size = header->mSize;
+
+        free(header->mBase);
+
+        return size;
+    }
+
+    class cHeapAllocator : public cIAllocator
+    /// Front end to the pooled heap. There's one of these per built-in
+    /// allocator kind, purely so stats can be tracked by kind.
     {
     public:
-        uint8_t* Alloc(size_t size, size_t align = 4)
+        uint8_t* Alloc(size_t size, size_t align = 4) override
         {
-            mNumAllocs++;
+            if (align > kMinAlign && align <= kMaxSmallSize && size <= kMaxSmallSize)
+            {
+                // Power-of-two size classes are aligned to their size, as spans are page aligned
+                if (size < align)
+                    size = align;
+
+                size = CeilPow2(uint32_t(size));
+            }
+
+            cThreadCache* cache = tThreadCache;
 
-            uint8_t* result = (uint8_t*) calloc(size, 1);
+            // Fast path: pop from this thread's list
+            if (cache && size <= kMaxSmallSize && align <= kMaxSmallSize)
+            {
+                int sizeClass = sSizeClassLookup[(size + 15) >> 4];
+                cFreeObject* object = cache->mFree[sizeClass];
 
-        #if CL_MEM_TRACK
-            CL_ASSERT_MONO_THREAD;
+                if (object)
+                {
+                    cache->mFree[sizeClass] = object->mNext;
+                    cache->mFreeCount[sizeClass]--;
 
-            mCurrentAllocs.insert(result);
-        #endif
+                    AddCount(cache->mCounters[mKind].mNumAllocs, 1);
+                    AddCount(cache->mCounters[mKind].mBytesAllocated, sClassSize[sizeClass]);
 
-            return result;
+                    return (uint8_t*) object;
+                }
+            }
+
+            return AllocSlow(size, align);
         }
 
-        void Free(void* p)
+        void Free(void* p) override
         {
             CL_ASSERT(p);
-            CL_ASSERT(mNumAllocs > 0);
-            mNumAllocs--;
 
-        #if CL_MEM_TRACK
-            CL_ASSERT_MONO_THREAD;
+            cThreadCache* cache = tThreadCache;
+
+            // Fast path: push onto this thread's list
+            if (cache && IsPoolPointer(p))
+            {
+                int sizeClass = sPoolPageClass[((uint8_t*) p - sPoolRegion) >> kPoolPageShift];
+                CL_ASSERT(sizeClass != kNoSizeClass);
 
-            auto it = mCurrentAllocs.find(p);
-            CL_ASSERT(it != mCurrentAllocs.end());
-            mCurrentAllocs.erase(it);
-        #endif
+                cFreeObject* object = (cFreeObject*) p;
 
-            free(p);
+                object->mNext = cache->mFree[sizeClass];
+                cache->mFree[sizeClass] = object;
+
+                if (++cache->mFreeCount[sizeClass] > 2 * sClassBatch[sizeClass])
+                    ReleaseBatch(cache, sizeClass, sClassBatch[sizeClass]);
+
+                AddCount(cache->mCounters[mKind].mNumFrees, 1);
+                AddCount(cache->mCounters[mKind].mBytesFreed, sClassSize[sizeClass]);
+
+                return;
+            }
+
+            FreeSlow(p);
         }
 
-        int mNumAllocs = 0;
-    #if CL_MEM_TRACK
-        nCL::set<void*> mCurrentAllocs;
-    #endif
+        uint8_t* AllocSlow(size_t size, size_t align);
+        void     FreeSlow(void* p);
+
+        int mKind = kDefaultAllocator;
+    };
+
+    uint8_t* cHeapAllocator::AllocSlow(size_t size, size_t align)
+    /// Handles thread setup, refilling the thread's list, and large allocations.
+    {
+        cThreadCache* cache = tThreadCache;
+
+        if (!cache)
+            cache = CreateThreadCache();
+
+        uint8_t* result = 0;
+
+        if (cache && size <= kMaxSmallSize && align <= kMaxSmallSize)
+        {
+            int sizeClass = sSizeClassLookup[(size + 15) >> 4];
+
+            if (!cache->mFree[sizeClass])
+                FetchBatch(cache, sizeClass);
+
+            cFreeObject* object = cache->mFree[sizeClass];
+
+            if (object)
+            {
+                cache->mFree[sizeClass] = object->mNext;
+                cache->mFreeCount[sizeClass]--;
+
+                size = sClassSize[sizeClass];
+                result = (uint8_t*) object;
+            }
+        }
+
+        if (!result)
+            result = AllocLarge(size, align);
+
+        if (cache && result)
+        {
+            AddCount(cache->mCounters[mKind].mNumAllocs, 1);
+            AddCount(cache->mCounters[mKind].mBytesAllocated, size);
+        }
+
+        return result;
+    }
+
+    void cHeapAllocator::FreeSlow(void* p)
+    /// Handles thread setup and large allocations.
+    {
+        cThreadCache* cache = tThreadCache;
+
+        if (!cache)
+            cache = CreateThreadCache();
+
+        size_t size;
+
+        if (IsPoolPointer(p))
+        {
+            int sizeClass = sPoolPageClass[((uint8_t*) p - sPoolRegion) >> kPoolPageShift];
+            CL_ASSERT(sizeClass != kNoSizeClass);
+
+            size = sClassSize[sizeClass];
+
+            if (cache)
+            {
+                cFreeObject* object = (cFreeObject*) p;
+
+                object->mNext = cache->mFree[sizeClass];
+                cache->mFree[sizeClass] = object;
+
+                if (++cache->mFreeCount[sizeClass] > 2 * sClassBatch[sizeClass])
+                    ReleaseBatch(cache, sizeClass, sClassBatch[sizeClass]);
+            }
+            else
+            {
+                cCentralList& central = sCentral[sizeClass];
+
+                pthread_mutex_lock(&central.mMutex);
+                ((cFreeObject*) p)->mNext = central.mFree;
+                central.mFree = (cFreeObject*) p;
+                central.mFreeCount++;
+                pthread_mutex_unlock(&central.mMutex);
+            }
+        }
+        else
+            size = FreeLarge(p);
+
+        if (cache)
+        {
+            AddCount(cache->mCounters[mKind].mNumFrees, 1);
+            AddCount(cache->mCounters[mKind].mBytesFreed, size);
+        }
+    }
+
+
+
+    // --- Per-thread local allocators -----------------------------------------
+
+    // Each thread gets its own cVMStackAllocator for scratch memory, created on
+    // first use, and released when the thread exits.
+
+    struct cLocalArena
+    {
+        cVMStackAllocator   mAllocator;
+        int                 mID   = 0;  ///< Creation order, for reporting
+        cLocalArena*        mPrev = 0;
+        cLocalArena*        mNext = 0;
+    };
+
+    pthread_once_t  sLocalArenaOnce = PTHREAD_ONCE_INIT;
+    pthread_key_t   sLocalArenaKey;
+    pthread_mutex_t sLocalArenaMutex = PTHREAD_MUTEX_INITIALIZER;
+    cLocalArena*    sLocalArenas = 0;   ///< List of live arenas, for stats
+    int             sNextLocalArenaID = 0;
+
+    __thread cLocalArena* tLocalArena = 0;
+
+    void ReleaseLocalArena(void* data)
+    /// Called on thread exit
+    {
+        cLocalArena* arena = (cLocalArena*) data;
+
+        pthread_mutex_lock(&sLocalArenaMutex);
+
+        if (arena->mPrev)
+            arena->mPrev->mNext = arena->mNext;
+        else
+            sLocalArenas = arena->mNext;
+
+        if (arena->mNext)
+            arena->mNext->mPrev = arena->mPrev;
+
+        pthread_mutex_unlock(&sLocalArenaMutex);
+
+        arena->~cLocalArena();
+        free(arena);
+    }
+
+    void InitLocalArenas()
+    {
+        pthread_key_create(&sLocalArenaKey, ReleaseLocalArena);
+    }
+
+    cLocalArena* CreateLocalArena()
+    {
+        pthread_once(&sLocalArenaOnce, InitLocalArenas);
+
+        void* mem = malloc(sizeof(cLocalArena));
+
+        if (!mem)
+            return 0;
+
+        cLocalArena* arena = new(mem) cLocalArena;
+
+        pthread_mutex_lock(&sLocalArenaMutex);
+
+        arena->mID = sNextLocalArenaID++;
+        arena->mNext = sLocalArenas;
+        if (sLocalArenas)
+            sLocalArenas->mPrev = arena;
+        sLocalArenas = arena;
+
+        pthread_mutex_unlock(&sLocalArenaMutex);
+
+        pthread_setspecific(sLocalArenaKey, arena);
+        tLocalArena = arena;
+
+        return arena;
+    }
+
+    class cThreadLocalAllocator : public cIAllocator
+    /// Forwards to the calling thread's local allocator, so kLocalAllocator
+    /// can be shared between threads.
+    {
+    public:
+        uint8_t* Alloc(size_t size, size_t align) override
+        {
+            return LocalAllocator()->Alloc(size, align);
+        }
+
+        void Free(void* p) override
+        {
+            LocalAllocator()->Free(p);
+        }
     };
 
 
     cIAllocator*        sAllocators[kMaxAllocators] = { 0 };
 
-    cNullAllocator      sNullAllocator;
-    cBasicHeapAllocator sHeapAllocator;
-    cStackAllocator     sLocalAllocator;
+    cNullAllocator          sNullAllocator;
+    cHeapAllocator          sHeapAllocators[kNumStatsKinds];
+    cThreadLocalAllocator   sLocalAllocator;
+
+    const char* const kAllocatorKindNames[kNumStatsKinds] =
+    {
+        "null",
+        "default",
+        "local",
+        "logging",
+        "debug",
+        "value",
+        "graphics",
+        "ui",
+        "audio",
+        "game",
+        "network",
+    };
 }
 
 cIAllocator* nCL::Allocator(tAllocatorKind allocatorKind)
@@ -132,18 +688,21 @@ bool nCL::InitAllocators()
 {
     CL_ASSERT(sAllocators[kNullAllocator] == 0);
 
+    for (int i = 0; i < kNumStatsKinds; i++)
+        sHeapAllocators[i].mKind = i;
+
     sAllocators[kNullAllocator]    = &sNullAllocator;
-    sAllocators[kDefaultAllocator] = &sHeapAllocator;
-    sAllocators[kLoggingAllocator] = &sHeapAllocator;
-    sAllocators[kValueAllocator]   = &sHeapAllocator;
+    sAllocators[kDefaultAllocator] = &sHeapAllocators[kDefaultAllocator];
+    sAllocators[kLoggingAllocator] = &sHeapAllocators[kLoggingAllocator];
+    sAllocators[kValueAllocator]   = &sHeapAllocators[kValueAllocator];
     sAllocators[kLocalAllocator]   = &sLocalAllocator;
 
-    // Generic
-    sAllocators[kGraphicsAllocator] = sAllocators[kDefaultAllocator];
-    sAllocators[kUIAllocator]       = sAllocators[kDefaultAllocator];
-    sAllocators[kAudioAllocator]    = sAllocators[kDefaultAllocator];
-    sAllocators[kGameAllocator]     = sAllocators[kDefaultAllocator];
-    sAllocators[kNetworkAllocator]  = sAllocators[kDefaultAllocator];
+    // Generic -- these share the default heap, but are tracked separately
+    sAllocators[kGraphicsAllocator] = &sHeapAllocators[kGraphicsAllocator];
+    sAllocators[kUIAllocator]       = &sHeapAllocators[kUIAllocator];
+    sAllocators[kAudioAllocator]    = &sHeapAllocators[kAudioAllocator];
+    sAllocators[kGameAllocator]     = &sHeapAllocators[kGameAllocator];
+    sAllocators[kNetworkAllocator]  = &sHeapAllocators[kNetworkAllocator];
 
     return true;
 }
@@ -156,6 +715,101 @@ bool nCL::ShutdownAllocators()
     return true;
 }
 
+bool nCL::IsThreadSafeAllocator(const cIAllocator* allocator)
+{
+    return allocator >= sHeapAllocators && allocator < sHeapAllocators + kNumStatsKinds;
+}
+
+bool nCL::GetAllocatorStats(tAllocatorKind kind, cAllocatorStats* stats)
+{
+    if (kind >= kNumStatsKinds || sAllocators[kind] != &sHeapAllocators[kind])
+        return false;
+
+    pthread_mutex_lock(&sThreadCacheMutex);
+
+    const cAllocCounters& retired = sRetiredCounters[kind];
+
+    stats->mNumAllocs      = retired.mNumAllocs     .load(std::memory_order_relaxed);
+    stats->mNumFrees       = retired.mNumFrees      .load(std::memory_order_relaxed);
+    stats->mBytesAllocated = retired.mBytesAllocated.load(std::memory_order_relaxed);
+    stats->mBytesFreed     = retired.mBytesFreed    .load(std::memory_order_relaxed);
+
+    for (cThreadCache* cache = sThreadCaches; cache; cache = cache->mNext)
+    {
+        const cAllocCounters& counters = cache->mCounters[kind];
+
+        stats->mNumAllocs      += counters.mNumAllocs     .load(std::memory_order_relaxed);
+        stats->mNumFrees       += counters.mNumFrees      .load(std::memory_order_relaxed);
+        stats->mBytesAllocated += counters.mBytesAllocated.load(std::memory_order_relaxed);
+        stats->mBytesFreed     += counters.mBytesFreed    .load(std::memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&sThreadCacheMutex);
+
+    return true;
+}
+
+cVMStackAllocator* nCL::LocalAllocator()
+{
+    cLocalArena* arena = tLocalArena;
+
+    if (!arena)
+    {
+        arena = CreateLocalArena();
+
+        if (!arena)
+            return 0;
+    }
+
+    return &arena->mAllocator;
+}
+
+void nCL::LogLocalAllocatorStats()
+{
+    CL_LOG("Memory", "%-10s %12s %12s %12s %12s\n", "Local", "Peak KB", "Frame KB", "Committed KB", "Reserved MB");
+
+    pthread_mutex_lock(&sLocalArenaMutex);
+
+    for (cLocalArena* arena = sLocalArenas; arena; arena = arena->mNext)
+    {
+        const cVMStackAllocator& alloc = arena->mAllocator;
+        (void) alloc;   // unused if logging is compiled out
+
+        CL_LOG("Memory", "thread %-3d %12.1f %12.1f %12.1f %12.1f\n",
+            arena->mID,
+            alloc.PeakSize() / 1024.0,
+            arena == tLocalArena ? alloc.LastFramePeakSize() / 1024.0 : 0.0,    // only meaningful on the owning thread
+            alloc.CommittedSize() / 1024.0,
+            alloc.ReservedSize() / (1024.0 * 1024.0)
+        );
+    }
+
+    pthread_mutex_unlock(&sLocalArenaMutex);
+}
+
+void nCL::LogAllocatorStats()
+{
+    CL_LOG("Memory", "%-10s %12s %12s %12s %12s\n", "Kind", "Allocs", "Live", "Total KB", "Live KB");
+
+    for (int i = 0; i < kNumStatsKinds; i++)
+    {
+        cAllocatorStats stats;
+
+        if (!GetAllocatorStats(tAllocatorKind(i), &stats) || stats.mNumAllocs == 0)
+            continue;
+
+        CL_LOG("Memory", "%-10s %12lld %12lld %12.1f %12.1f\n",
+            kAllocatorKindNames[i] ? kAllocatorKindNames[i] : "user",
+            (long long) stats.mNumAllocs,
+            (long long) (stats.mNumAllocs - stats.mNumFrees),
+            stats.mBytesAllocated / 1024.0,
+            (stats.mBytesAllocated - stats.mBytesFreed) / 1024.0
+        );
+    }
+
+    LogLocalAllocatorStats();
+}
+
 
 namespace
 {
@@ -172,13 +826,33 @@ void* nCL::AllocPages(size_t numPages)
 {
     size_t size = numPages * kPageSize;
     void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0); // may be MAP_ANONYMOUS on some systems
-    return p;
+    return p != MAP_FAILED ? p : 0;
 }
 
 void nCL::FreePages(void* p, size_t numPages)
 {
     int result = munmap(p, numPages * kPageSize);
     CL_ASSERT(result == 0);
+    (void) result;
+}
+
+void* nCL::ReservePages(size_t numPages)
+{
+    void* p = mmap(0, numPages * kPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    return p != MAP_FAILED ? p : 0;
+}
+
+bool nCL::CommitPages(void* p, size_t numPages)
+{
+    return mprotect(p, numPages * kPageSize, PROT_READ | PROT_WRITE) == 0;
+}
+
+void nCL::DecommitPages(void* p, size_t numPages)
+{
+    // Remapping drops the old pages, so they read back as zero if recommitted.
+    void* result = mmap(p, numPages * kPageSize, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0);
+    CL_ASSERT(result == p);
+    (void) result;
 }
 
 cMappedFileInfo nCL::MapFile(const char* path)
@@ -319,6 +993,115 @@ size_t cStackAllocator::BlockSize(int i) const
 }
 
 
+// cVMStackAllocator
+
+namespace
+{
+    const size_t kStackCommitSize = 64 * 1024;  ///< Granularity of commits, to keep mprotect calls infrequent
+}
+
+cVMStackAllocator::~cVMStackAllocator()
+{
+    if (mBase)
+        FreePages(mBase, mReserveSize / kPageSize);
+}
+
+uint8_t* cVMStackAllocator::AllocSlow(size_t size, size_t align)
+{
+    if (!mBase)
+    {
+        mReserveSize = (mReserveSize + kStackCommitSize - 1) & ~(kStackCommitSize - 1);
+        mBase = (uint8_t*) ReservePages(mReserveSize / kPageSize);
+
+        if (!mBase)
+        {
+            CL_LOG_E("Memory", "Couldn't reserve %zu MB for stack allocator\n", mReserveSize >> 20);
+            return 0;
+        }
+
+        mCurrent   = mBase;
+        mCommitEnd = mBase;
+        mFramePeak = mBase;
+    }
+
+    uint8_t* p = (uint8_t*) ((uintptr_t(mCurrent) + align - 1) & ~uintptr_t(align - 1));
+
+    if (size_t(p - mBase) + size >= mReserveSize)
+    {
+        CL_ERROR("Stack allocator out of reserved space");
+        return 0;
+    }
+
+    uint8_t* end = p + size;
+
+    if (end >= mCommitEnd)
+    {
+        uint8_t* commitEnd = mBase + ((end + 1 - mBase + kStackCommitSize - 1) & ~(kStackCommitSize - 1));
+
+        if (!CommitPages(mCommitEnd, (commitEnd - mCommitEnd) / kPageSize))
+        {
+            CL_LOG_E("Memory", "Couldn't commit stack allocator memory\n");
+            return 0;
+        }
+
+        mCommitEnd = commitEnd;
+        mCommittedSize.store(commitEnd - mBase, std::memory_order_relaxed);
+    }
+
+    mCurrent = end;
+    return p;
+}
+
+void cVMStackAllocator::NotePeak()
+{
+    mFramePeak = mCurrent;
+
+    size_t used = mCurrent - mBase;
+
+    if (used > mPeakSize.load(std::memory_order_relaxed))
+        mPeakSize.store(used, std::memory_order_relaxed);
+}
+
+void cVMStackAllocator::Reset()
+{
+    if (mCurrent > mFramePeak)
+        NotePeak();
+
+    mCurrent = mBase;
+}
+
+void cVMStackAllocator::Trim()
+{
+    uint8_t* keepEnd = mBase + ((mCurrent + 1 - mBase + kStackCommitSize - 1) & ~(kStackCommitSize - 1));
+
+    if (!mBase || keepEnd >= mCommitEnd)
+        return;
+
+    DecommitPages(keepEnd, (mCommitEnd - keepEnd) / kPageSize);
+
+    mCommitEnd = keepEnd;
+    mCommittedSize.store(keepEnd - mBase, std::memory_order_relaxed);
+}
+
+void cVMStackAllocator::SetResetPerFrame(bool enabled)
+{
+    mResetPerFrame = enabled;
+}
+
+void cVMStackAllocator::EndFrame()
+{
+    if (mCurrent > mFramePeak)
+        NotePeak();
+
+    mLastFramePeakSize = mFramePeak - mBase;
+
+    if (mResetPerFrame)
+        mCurrent = mBase;
+
+    mFramePeak = mCurrent;
+}
+
+
 // cAllocatable
 
 void* cAllocatable::operator new(size_t n, cIAllocator* a)
@@ -329,7 +1112,8 @@ void* cAllocatable::operator new(size_t n, cIAllocator* a)
     // So instead we manually manage the allocator pointer ourselves -- alloc
     // additional space for it in front of the object.
 
-    uint8_t* p = a->Alloc(n + sizeof(cIAllocator*), sizeof(void*));    // TODO: if we ever have Alloc(size, alignment, offset), use alignof()
+    // Cleared, as existing classes rely on this for members without initialisers.
+    uint8_t* p = a->AllocZeroed(n + sizeof(cIAllocator*), sizeof(void*));    // TODO: if we ever have Alloc(size, alignment, offset), use alignof()
 
     if (p)
     {
@@ -363,6 +1147,151 @@ int nCL::cAllocLinkable::Link(int count) const
     return 0;
 }
 
+#ifndef CL_RELEASE
+
+namespace
+{
+    const int kBenchSlots = 1024;           // live allocations per thread
+    const int kBenchIterations = 1 << 20;
+
+    struct cAllocBench
+    {
+        cIAllocator*        mAllocator;     ///< 0 for malloc/free
+        pthread_t           mThread;
+    };
+
+    void* AllocBenchMain(void* data)
+    {
+        cAllocBench* bench = (cAllocBench*) data;
+        cIAllocator* alloc = bench->mAllocator;
+
+        void*    slots[kBenchSlots] = { 0 };
+        uint32_t seed = uint32_t(uintptr_t(bench)) | 1;
+
+        for (int i = 0; i < kBenchIterations; i++)
+        {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+
+            int slot = seed % kBenchSlots;
+            size_t size = 16 + (seed >> 16) % 497;     // mostly small-object sized, like cValue etc.
+
+            if (slots[slot])
+            {
+                if (alloc)
+                    alloc->Free(slots[slot]);
+                else
+                    free(slots[slot]);
+            }
+
+            slots[slot] = alloc ? alloc->Alloc(size) : malloc(size);
+            *(uint8_t*) slots[slot] = 1;
+        }
+
+        for (int i = 0; i < kBenchSlots; i++)
+            if (slots[i])
+            {
+                if (alloc)
+                    alloc->Free(slots[i]);
+                else
+                    free(slots[i]);
+            }
+
+        return 0;
+    }
+
+    double RunAllocBench(cIAllocator* alloc, int numThreads)
+    /// Returns ns per alloc/free pair
+    {
+        cAllocBench benches[16];
+
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int i = 0; i < numThreads; i++)
+        {
+            benches[i].mAllocator = alloc;
+            pthread_create(&benches[i].mThread, 0, AllocBenchMain, benches + i);
+        }
+
+        for (int i = 0; i < numThreads; i++)
+            pthread_join(benches[i].mThread, 0);
+
+        uint64_t t1 = AbsoluteTicks();
+
+        return double(t1 - t0) / kBenchIterations;
+    }
+
+    const int kChurnObjects = 100000;
+    const int kChurnRounds  = 8;
+
+    struct cChurnObject : public cAllocatable
+    {
+        float   mData[24];   // roughly the size of a small effect instance
+    };
+
+    double RunChurnBench(cIAllocator* alloc)
+    /// Create and destroy kChurnObjects objects per round, freeing in a scattered
+    /// order. Returns ns per create/destroy pair. The first round is untimed, so
+    /// both allocators are measured with their memory already mapped in.
+    {
+        cChurnObject** objects = new cChurnObject*[kChurnObjects];
+
+        uint64_t t0 = 0;
+
+        for (int round = -1; round < kChurnRounds; round++)
+        {
+            if (round == 0)
+                t0 = AbsoluteTicks();
+
+            for (int i = 0; i < kChurnObjects; i++)
+                objects[i] = new(alloc) cChurnObject;
+
+            for (int i = 1; i < kChurnObjects; i += 2)
+                delete objects[i];
+            for (int i = 0; i < kChurnObjects; i += 2)
+                delete objects[i];
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        delete[] objects;
+
+        return double(t1 - t0) / (kChurnRounds * kChurnObjects);
+    }
+}
+
+namespace nCL
+{
+    void BenchAllocators()
+    {
+        int maxThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+
+        if (maxThreads > 16)
+            maxThreads = 16;
+
+        printf("Threads  malloc (ns/op)  kDefaultAllocator (ns/op)  Speedup\n");
+
+        for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        {
+            double mallocTime = RunAllocBench(0, numThreads);
+            double poolTime   = RunAllocBench(Allocator(kDefaultAllocator), numThreads);
+
+            printf("%7d  %14.1f  %25.1f  %7.2f\n", numThreads, mallocTime, poolTime, mallocTime / poolTime);
+        }
+
+        cPoolAllocator<cChurnObject> churnPool;
+        double heapChurn = RunChurnBench(Allocator(kDefaultAllocator));
+        double poolChurn = RunChurnBench(&churnPool);
+
+        printf("\n%d object churn: kDefaultAllocator %.1f ns, cPoolAllocator %.1f ns, speedup %.2f\n", kChurnObjects, heapChurn, poolChurn, heapChurn / poolChurn);
+
+        LogAllocatorStats();
+    }
+}
+
+#endif
+
 // Global operators. Direct to system heap for now, as these are mostly called
 // by system code, but we might want to add tracking here later.
 
@@ -0,0 +1,553 @@
+//
+//  File:       CLProfile.cpp
+//
+//  Function:   Hierarchical CPU profiler with scoped markers
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <CLProfile.h>
+
+#if CL_PROFILE
+
+#include <CLFIFO.h>
+#include <CLLog.h>
+#include <CLSTL.h>
+#include <CLString.h>
+#include <CLTimer.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+
+using namespace nCL;
+
+namespace
+{
+    const int kMaxProfileThreads    = 64;
+    const int kMaxProfileDepth      = 32;       ///< Deeper scopes are counted for nesting, but not recorded
+    const int kMaxThreadNameLength  = 32;
+    const int kProfileBufferSize    = 16384;    ///< Completed scopes buffered per thread between frames
+    const int kMaxCaptureScopes     = 1 << 20;
+
+    struct cProfileEvent
+    {
+        const char* mName;
+        uint64_t    mStart;
+        uint64_t    mEnd;
+        int         mDepth;
+    };
+
+    struct cOpenScope
+    {
+        const char* mName;
+        uint64_t    mStart;
+    };
+
+    struct cProfileThread
+    /// Per-thread state. Only the owning thread writes to mEvents, and only
+    /// the EndProfileFrame() thread reads from it.
+    {
+        cFIFO<cProfileEvent>    mEvents;
+        int                     mIndex = 0;
+        int                     mDepth = 0;
+        cOpenScope              mOpen[kMaxProfileDepth];
+
+        std::atomic<int>        mDropped { 0 };
+        std::atomic<bool>       mExited  { false };
+        cProfileThread*         mNext = 0;
+    };
+
+    struct cCapturedScope
+    {
+        const char* mName;
+        uint64_t    mStart;
+        uint64_t    mEnd;
+        int         mThread;
+    };
+
+    pthread_once_t  sProfileOnce = PTHREAD_ONCE_INIT;
+    pthread_key_t   sProfileThreadKey;
+    pthread_mutex_t sProfileMutex = PTHREAD_MUTEX_INITIALIZER;  ///< Protects the thread list and names
+    cProfileThread* sProfileThreads = 0;
+    bool            sThreadSlotUsed[kMaxProfileThreads];
+    char            sThreadNames   [kMaxProfileThreads][kMaxThreadNameLength];
+
+    __thread cProfileThread* tProfileThread = 0;
+    __thread bool            tProfileDisabled = false;  ///< Set if we've run out of thread slots
+
+    // Collector state, only touched by the EndProfileFrame() thread
+    vector<cProfileEvent>   sFrameEvents;
+    vector<cProfileStat>    sStats;
+    vector<cProfileStat>    sThreadStats;
+    vector<int>             sRemap;
+    uint64_t                sFrameStart = 0;
+    uint64_t                sFrameTicks = 0;
+    int                     sDropped = 0;
+
+    vector<cCapturedScope>  sCapture;
+    vector<uint64_t>        sCaptureFrames;
+    string                  sCapturePath;
+    int                     sCaptureFramesLeft = 0;
+
+    void ReleaseProfileThread(void* data)
+    /// Called on thread exit -- the collector frees the record once it has drained it.
+    {
+        cProfileThread* thread = (cProfileThread*) data;
+        thread->mExited.store(true, std::memory_order_release);
+    }
+
+    void InitProfiler()
+    {
+        pthread_key_create(&sProfileThreadKey, ReleaseProfileThread);
+    }
+
+    cProfileThread* CreateProfileThread()
+    {
+        pthread_once(&sProfileOnce, InitProfiler);
+
+        pthread_mutex_lock(&sProfileMutex);
+
+        int index = 0;
+        while (index < kMaxProfileThreads && sThreadSlotUsed[index])
+            index++;
+
+        if (index == kMaxProfileThreads)
+        {
+            pthread_mutex_unlock(&sProfileMutex);
+            tProfileDisabled = true;
+            return 0;
+        }
+
+        void* mem = malloc(sizeof(cProfileThread));
+        cProfileThread* thread = new(mem) cProfileThread;
+
+        thread->mEvents.Resize(kProfileBufferSize, Allocator(kDefaultAllocator));
+        thread->mIndex = index;
+        thread->mNext = sProfileThreads;
+        sProfileThreads = thread;
+
+        sThreadSlotUsed[index] = true;
+        snprintf(sThreadNames[index], kMaxThreadNameLength, "Thread %d", index);
+
+        pthread_mutex_unlock(&sProfileMutex);
+
+        pthread_setspecific(sProfileThreadKey, thread);
+        tProfileThread = thread;
+
+        return thread;
+    }
+
+    void AddStats(int threadIndex)
+    /// Fold sFrameEvents from the given thread into sStats
+    {
+        if (sFrameEvents.empty())
+            return;
+
+        // Events are written as scopes end, so children precede parents -- sort back into start order.
+        sort(sFrameEvents.begin(), sFrameEvents.end(),
+            [](const cProfileEvent& a, const cProfileEvent& b)
+            {
+                return a.mStart < b.mStart || (a.mStart == b.mStart && a.mDepth < b.mDepth);
+            }
+        );
+
+        sThreadStats.clear();
+
+        int      openStat[kMaxProfileDepth];  ///< Most recent stat at each depth
+        uint64_t openEnd [kMaxProfileDepth];  ///< ... and the end of its last scope
+
+        for (int i = 0; i < kMaxProfileDepth; i++)
+        {
+            openStat[i] = -1;
+            openEnd [i] = 0;
+        }
+
+        for (const cProfileEvent& event : sFrameEvents)
+        {
+            int depth = event.mDepth;
+            int parent = -1;
+
+            // No parent if it started in an earlier frame
+            if (depth > 0 && openStat[depth - 1] >= 0 && openEnd[depth - 1] >= event.mEnd)
+                parent = openStat[depth - 1];
+
+            int stat = openStat[depth];     // usually a repeat of the last scope at this depth
+
+            if (stat < 0 || sThreadStats[stat].mParent != parent || sThreadStats[stat].mName != event.mName)
+            {
+                stat = -1;
+
+                for (int i = 0, n = sThreadStats.size(); i < n; i++)
+                    if (sThreadStats[i].mParent == parent && sThreadStats[i].mName == event.mName)
+                    {
+                        stat = i;
+                        break;
+                    }
+
+                if (stat < 0)
+                {
+                    stat = sThreadStats.size();
+                    sThreadStats.push_back();
+
+                    cProfileStat& s = sThreadStats.back();
+                    s.mName   = event.mName;
+                    s.mThread = threadIndex;
+                    s.mDepth  = depth;
+                    s.mParent = parent;
+                    s.mCount  = 0;
+                    s.mTicks  = 0;
+                }
+            }
+
+            sThreadStats[stat].mCount++;
+            sThreadStats[stat].mTicks += event.mEnd - event.mStart;
+
+            openStat[depth] = stat;
+            openEnd [depth] = event.mEnd;
+        }
+
+        // Append to sStats in depth-first order, remapping parents.
+        int numStats = sThreadStats.size();
+        sRemap.resize(numStats);
+
+        int stack[kMaxProfileDepth + 1];    // stat whose children we're iterating over
+        int next [kMaxProfileDepth + 1];    // next candidate child
+        int top = 0;
+
+        stack[0] = -1;
+        next [0] = 0;
+
+        while (top >= 0)
+        {
+            int i = next[top];
+
+            while (i < numStats && sThreadStats[i].mParent != stack[top])
+                i++;
+
+            if (i == numStats)
+            {
+                top--;
+                continue;
+            }
+
+            next[top] = i + 1;
+
+            sRemap[i] = sStats.size();
+            sStats.push_back(sThreadStats[i]);
+
+            cProfileStat& s = sStats.back();
+            s.mParent = s.mParent >= 0 ? sRemap[s.mParent] : -1;
+
+            top++;
+            stack[top] = i;
+            next [top] = 0;
+        }
+    }
+
+    void WriteJSONString(FILE* file, const char* s)
+    {
+        fputc('"', file);
+
+        for ( ; *s; s++)
+        {
+            if (*s == '"' || *s == '\\')
+                fputc('\\', file);
+
+            fputc(*s, file);
+        }
+
+        fputc('"', file);
+    }
+
+    bool WriteCapture()
+    {
+        FILE* file = fopen(sCapturePath.c_str(), "w");
+
+        if (!file)
+        {
+            CL_LOG_E("Profile", "Couldn't write trace to %s\n", sCapturePath.c_str());
+            return false;
+        }
+
+        uint64_t origin = sCaptureFrames.empty() ? 0 : sCaptureFrames[0];
+
+        for (const cCapturedScope& scope : sCapture)
+            if (scope.mStart < origin)
+                origin = scope.mStart;
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        pthread_mutex_lock(&sProfileMutex);
+
+        for (int i = 0; i < kMaxProfileThreads; i++)
+            if (sThreadSlotUsed[i])
+            {
+                fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", i);
+                WriteJSONString(file, sThreadNames[i]);
+                fprintf(file, "}},\n");
+            }
+
+        pthread_mutex_unlock(&sProfileMutex);
+
+        for (uint64_t frame : sCaptureFrames)
+            fprintf(file, "{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":%.3f},\n", (frame - origin) * 1e-3);
+
+        for (const cCapturedScope& scope : sCapture)
+        {
+            fprintf(file, "{\"name\":");
+            WriteJSONString(file, scope.mName);
+            fprintf(file, ",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+                scope.mThread,
+                (scope.mStart - origin) * 1e-3,
+                (scope.mEnd - scope.mStart) * 1e-3
+            );
+        }
+
+        // Trailing empty object as JSON doesn't allow a final comma
+        fprintf(file, "{}\n]}\n");
+        fclose(file);
+
+        CL_LOG("Profile", "Wrote %d scopes over %d frames to %s\n", int(sCapture.size()), int(sCaptureFrames.size()), sCapturePath.c_str());
+
+        sCapture.clear();
+        sCaptureFrames.clear();
+
+        return true;
+    }
+}
+
+void nCL::BeginProfileScope(const char* name)
+{
+    cProfileThread* thread = tProfileThread;
+
+    if (!thread)
+    {
+        if (tProfileDisabled || !(thread = CreateProfileThread()))
+            return;
+    }
+
+    int depth = thread->mDepth++;
+
+    if (depth < kMaxProfileDepth)
+    {
+        thread->mOpen[depth].mName  = name;
+        thread->mOpen[depth].mStart = AbsoluteTicks();
+    }
+}
+
+void nCL::EndProfileScope()
+{
+    uint64_t end = AbsoluteTicks();
+    cProfileThread* thread = tProfileThread;
+
+    if (!thread)
+        return;
+
+    int depth = --thread->mDepth;
+
+    if (depth >= kMaxProfileDepth)
+        return;
+
+    cProfileEvent* event = thread->mEvents.NextWriteItem();
+
+    if (!event)
+    {
+        thread->mDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    event->mName  = thread->mOpen[depth].mName;
+    event->mStart = thread->mOpen[depth].mStart;
+    event->mEnd   = end;
+    event->mDepth = depth;
+
+    thread->mEvents.CommitWrite();
+}
+
+void nCL::SetProfileThreadName(const char* name)
+{
+    cProfileThread* thread = tProfileThread;
+
+    if (!thread)
+    {
+        if (tProfileDisabled || !(thread = CreateProfileThread()))
+            return;
+    }
+
+    pthread_mutex_lock(&sProfileMutex);
+    strncpy(sThreadNames[thread->mIndex], name, kMaxThreadNameLength - 1);
+    pthread_mutex_unlock(&sProfileMutex);
+}
+
+const char* nCL::ProfileThreadName(int thread)
+{
+    CL_INDEX(thread, kMaxProfileThreads);
+    return sThreadNames[thread];
+}
+
+void nCL::EndProfileFrame()
+{
+    uint64_t frameEnd = AbsoluteTicks();
+
+    sFrameTicks = sFrameStart ? frameEnd - sFrameStart : 0;
+    sFrameStart = frameEnd;
+
+    sStats.clear();
+    sDropped = 0;
+
+    bool capturing = sCaptureFramesLeft > 0;
+
+    if (capturing)
+        sCaptureFrames.push_back(frameEnd);
+
+    pthread_mutex_lock(&sProfileMutex);
+
+    cProfileThread** link = &sProfileThreads;
+
+    while (cProfileThread* thread = *link)
+    {
+        // Check before draining, so we don't lose anything written just before exit.
+        bool exited = thread->mExited.load(std::memory_order_acquire);
+
+        sFrameEvents.clear();
+
+        while (const cProfileEvent* event = thread->mEvents.NextReadItem())
+        {
+            sFrameEvents.push_back(*event);
+            thread->mEvents.CommitRead();
+        }
+
+        sDropped += thread->mDropped.exchange(0, std::memory_order_relaxed);
+
+        if (capturing)
+            for (const cProfileEvent& event : sFrameEvents)
+                if (sCapture.size() < kMaxCaptureScopes)
+                    sCapture.push_back({ event.mName, event.mStart, event.mEnd, thread->mIndex });
+
+        AddStats(thread->mIndex);
+
+        if (exited)
+        {
+            *link = thread->mNext;
+
+            sThreadSlotUsed[thread->mIndex] = false;
+            thread->~cProfileThread();
+            free(thread);
+        }
+        else
+            link = &thread->mNext;
+    }
+
+    pthread_mutex_unlock(&sProfileMutex);
+
+    if (capturing && --sCaptureFramesLeft == 0)
+        WriteCapture();
+}
+
+int nCL::NumProfileStats()
+{
+    return sStats.size();
+}
+
+const cProfileStat* nCL::ProfileStats()
+{
+    return sStats.data();
+}
+
+uint64_t nCL::ProfileFrameTicks()
+{
+    return sFrameTicks;
+}
+
+int nCL::ProfileDroppedScopes()
+{
+    return sDropped;
+}
+
+bool nCL::StartProfileCapture(const char* path, int numFrames)
+{
+    if (sCaptureFramesLeft > 0 || numFrames <= 0)
+        return false;
+
+    sCapturePath = path;
+    sCaptureFramesLeft = numFrames;
+    sCapture.clear();
+    sCaptureFrames.clear();
+
+    return true;
+}
+
+bool nCL::ProfileCaptureActive()
+{
+    return sCaptureFramesLeft > 0;
+}
+
+void nCL::BenchProfiler()
+{
+    const int kBatchSize  = kProfileBufferSize / 4;    // stay well inside the thread buffer
+    const int kNumBatches = 256;
+
+    uint64_t tickTime  = 0;
+    uint64_t scopeTime = 0;
+    uint64_t nestedTime = 0;
+
+    EndProfileFrame();
+
+    for (int batch = 0; batch < kNumBatches; batch++)
+    {
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int i = 0; i < kBatchSize; i++)
+            AbsoluteTicks();
+
+        uint64_t t1 = AbsoluteTicks();
+
+        for (int i = 0; i < kBatchSize; i++)
+        {
+            CL_PROFILE_SCOPE("BenchScope");
+        }
+
+        uint64_t t2 = AbsoluteTicks();
+
+        for (int i = 0; i < kBatchSize / 4; i++)
+        {
+            CL_PROFILE_SCOPE("BenchOuter");
+            {
+                CL_PROFILE_SCOPE("BenchInner1");
+                {
+                    CL_PROFILE_SCOPE("BenchInner2");
+                    {
+                        CL_PROFILE_SCOPE("BenchInner3");
+                    }
+                }
+            }
+        }
+
+        uint64_t t3 = AbsoluteTicks();
+
+        tickTime   += t1 - t0;
+        scopeTime  += t2 - t1;
+        nestedTime += t3 - t2;
+
+        EndProfileFrame();
+    }
+
+    double n = double(kBatchSize) * kNumBatches;
+
+    printf("AbsoluteTicks():              %6.1f ns\n", tickTime / n);
+    printf("CL_PROFILE_SCOPE:             %6.1f ns per marker\n", scopeTime / n);
+    printf("CL_PROFILE_SCOPE, nested x4:  %6.1f ns per marker\n", nestedTime / n);
+    printf("Dropped scopes: %d\n", ProfileDroppedScopes());
+
+    const cProfileStat* stats = ProfileStats();
+
+    for (int i = 0, n = NumProfileStats(); i < n; i++)
+        printf("  %*s%-16s %6d  %8.3f ms\n", 2 * stats[i].mDepth, "", stats[i].mName, stats[i].mCount, stats[i].mTicks * 1e-6);
+}
+
+#endif
@@ -11,8 +11,204 @@
 
 #include <CLRandom.h>
 
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
 using namespace nCL;
 
+namespace
+{
+    // NextSeed() constants, and the equivalents for advancing by four at once.
+    const uint32_t kLCGMul  = 1103515245;
+    const uint32_t kLCGAdd  = 12345;
+    const uint32_t kLCGMul2 = kLCGMul  * kLCGMul;
+    const uint32_t kLCGAdd2 = kLCGMul  * kLCGAdd  + kLCGAdd;
+    const uint32_t kLCGMul4 = kLCGMul2 * kLCGMul2;
+    const uint32_t kLCGAdd4 = kLCGMul2 * kLCGAdd2 + kLCGAdd2;
+
+    // Minimal four-lane wrappers: each lane runs the same LCG, offset by one step.
+#if defined(__SSE2__)
+    typedef __m128i tSeed32x4;
+    typedef __m128  tFloat32x4;
+
+    inline tSeed32x4 LoadSeeds(const tSeed32 s[4])
+    {
+        return _mm_loadu_si128((const __m128i*) s);
+    }
+    inline void StoreSeeds(tSeed32x4 s, tSeed32 values[4])
+    {
+        _mm_storeu_si128((__m128i*) values, s);
+    }
+    inline tSeed32x4 NextSeed4(tSeed32x4 s)
+    {
+        // No 32-bit mullo in SSE2, so do even and odd lanes separately
+        const __m128i mul = _mm_set1_epi32(kLCGMul4);
+
+        __m128i even = _mm_mul_epu32(s, mul);
+        __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(s, 32), mul);
+        __m128i lo   = _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+
+        return _mm_add_epi32(lo, _mm_set1_epi32(kLCGAdd4));
+    }
+    inline void StoreMapped(tSeed32x4 s, float m1, float a1, float m2, float a2, float values[4])
+    {
+        __m128 f = _mm_cvtepi32_ps(s);
+        f = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(m1)), _mm_set1_ps(a1));
+        f = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(m2)), _mm_set1_ps(a2));
+        _mm_storeu_ps(values, f);
+    }
+
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    typedef uint32x4_t  tSeed32x4;
+
+    inline tSeed32x4 LoadSeeds(const tSeed32 s[4])
+    {
+        return vld1q_u32(s);
+    }
+    inline void StoreSeeds(tSeed32x4 s, tSeed32 values[4])
+    {
+        vst1q_u32(values, s);
+    }
+    inline tSeed32x4 NextSeed4(tSeed32x4 s)
+    {
+        return vmlaq_u32(vdupq_n_u32(kLCGAdd4), s, vdupq_n_u32(kLCGMul4));
+    }
+    inline void StoreMapped(tSeed32x4 s, float m1, float a1, float m2, float a2, float values[4])
+    {
+        // Separate mul/add rather than vmla, to match the scalar tail.
+        float32x4_t f = vcvtq_f32_s32(vreinterpretq_s32_u32(s));
+        f = vaddq_f32(vmulq_n_f32(f, m1), vdupq_n_f32(a1));
+        f = vaddq_f32(vmulq_n_f32(f, m2), vdupq_n_f32(a2));
+        vst1q_f32(values, f);
+    }
+
+#else
+    struct tSeed32x4
+    {
+        tSeed32 mLane[4];
+    };
+
+    inline tSeed32x4 LoadSeeds(const tSeed32 s[4])
+    {
+        return { { s[0], s[1], s[2], s[3] } };
+    }
+    inline void StoreSeeds(tSeed32x4 s, tSeed32 values[4])
+    {
+        for (int i = 0; i < 4; i++)
+            values[i] = s.mLane[i];
+    }
+    inline tSeed32x4 NextSeed4(tSeed32x4 s)
+    {
+        for (int i = 0; i < 4; i++)
+            s.mLane[i] = s.mLane[i] * kLCGMul4 + kLCGAdd4;
+        return s;
+    }
+    inline void StoreMapped(tSeed32x4 s, float m1, float a1, float m2, float a2, float values[4])
+    {
+        for (int i = 0; i < 4; i++)
+            values[i] = a2 + m2 * (m1 * int32_t(s.mLane[i]) + a1);
+    }
+#endif
+
+    inline tSeed32x4 StartSeeds(tSeed32 seed)
+    {
+        tSeed32 s[4] = { seed, NextSeed(seed), NextSeed(NextSeed(seed)), 0 };
+        s[3] = NextSeed(s[2]);
+        return LoadSeeds(s);
+    }
+
+    void RandomMapped(int count, float m1, float a1, float m2, float a2, float values[], tSeed32* seed)
+    /// values[i] = a2 + m2 * (m1 * int32_t(NextSeed(seed)) + a1)
+    {
+        int i = 0;
+
+        if (count >= 4)
+        {
+            tSeed32x4 s = StartSeeds(*seed);
+
+            for ( ; i + 4 <= count; i += 4)
+            {
+                StoreMapped(s, m1, a1, m2, a2, values + i);
+                s = NextSeed4(s);
+            }
+
+            *seed = SkipSeed(*seed, i);
+        }
+
+        for ( ; i < count; i++)
+            values[i] = a2 + m2 * (m1 * int32_t(NextSeed(seed)) + a1);
+    }
+}
+
+
+// --- Streams -----------------------------------------------------------------
+
+tSeed32 nCL::SkipSeed(tSeed32 seed, uint32_t n)
+{
+    uint32_t mul = kLCGMul;
+    uint32_t add = kLCGAdd;
+
+    while (n)
+    {
+        if (n & 1)
+            seed = seed * mul + add;
+
+        add = mul * add + add;
+        mul = mul * mul;
+        n >>= 1;
+    }
+
+    return seed;
+}
+
+
+// --- Batch generation --------------------------------------------------------
+
+void nCL::RandomSeeds(int count, tSeed32 values[], tSeed32* seed)
+{
+    int i = 0;
+
+    if (count >= 4)
+    {
+        tSeed32x4 s = StartSeeds(*seed);
+
+        for ( ; i + 4 <= count; i += 4)
+        {
+            StoreSeeds(s, values + i);
+            s = NextSeed4(s);
+        }
+
+        *seed = SkipSeed(*seed, i);
+    }
+
+    for ( ; i < count; i++)
+        values[i] = NextSeed(seed);
+}
+
+void nCL::RandomUInt32(int count, uint32_t a, uint32_t values[], tSeed32* seed)
+{
+    RandomSeeds(count, values, seed);
+
+    for (int i = 0; i < count; i++)
+        values[i] = UIntFromSeed(values[i], a);
+}
+
+void nCL::RandomRange(int count, float a, float b, float values[], tSeed32* seed)
+{
+    RandomMapped(count, kSeedFloatScale, 0.5f, b - a, a, values, seed);
+}
+
+void nCL::RandomRangeAbout(int count, float a, float b, float values[], tSeed32* seed)
+{
+    RandomMapped(count, kSeedFloatScaleTwo, 0.0f, b, a, values, seed);
+}
+
+
+// --- cRandomMT ---------------------------------------------------------------
+
 //
 // This is the ``Mersenne Twister'' random number generator MT19937, which
 // generates pseudorandom integers uniformly distributed in 0..(2^32 - 1)
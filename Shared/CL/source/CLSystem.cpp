@@ -10,6 +10,7 @@
 
 #include <CLSystem.h>
 
+#include <CLDispatch.h>
 #include <CLImage.h>
 #include <CLLog.h>
 #include <CLMemory.h>
@@ -31,10 +32,12 @@ void nCL::InitTool()
     InitLogSystem();
     InitTagSystem(Allocator(kDefaultAllocator));
     InitImageSystem();
+    InitJobs(Allocator(kDefaultAllocator));
 }
 
 void nCL::ShutdownTool()
 {
+    ShutdownJobs();
     ShutdownImageSystem();
 
     ShutdownTagSystem();
@@ -10,9 +10,16 @@
 
 #include <CLTag.h>
 
+#include <CLHashMap.h>
 #include <CLMemory.h>
 #include <CLSTL.h>
 #include <CLString.h>
+#include <CLTimer.h>
+
+#include <atomic>
+#include <pthread.h>
+#include <stddef.h>
+#include <unistd.h>
 
 using namespace nCL;
 
@@ -25,22 +32,439 @@ using namespace nCL;
   
     
     We also provide unique string storage support, e.g., for cValue
-    fields. At the moment such strings are never freed, to allow
-    reuse, though that could potentially found.
-    
-    Want these to be integrated to share storage.
+    fields. By default such strings are never freed, to allow reuse,
+    but InitTagSystem(..., true) enables ref counting, so strings
+    from unloaded configs can be reclaimed.
 */
 
 namespace
 {
-    struct cLessString
+#if CL_TAG_DEBUG
+    // --- cInternSet -----------------------------------------------------------
+    //
+    // Hash-indexed set of interned strings. The set is split into shards by hash,
+    // each with its own open-addressed table. Find() is lock-free: tables are
+    // published with a release store, and only ever replaced, never modified in a
+    // way that could confuse a concurrent reader. Insertions, and table growth,
+    // take the shard's mutex. Retired tables are kept until Shutdown(), so a reader
+    // holding a stale table pointer is safe -- at worst it misses, and falls through
+    // to the locked path, which re-checks the current table.
+    //
+    // Strings live in per-shard arena blocks, unless ref counting is on, in which
+    // case each has its own allocation, prefixed by a count. Strings whose count
+    // drops to zero are unlinked straight away, but only freed by Collect(), as
+    // other threads may still be comparing against them.
+
+    const int       kInternShardBits    = 4;
+    const int       kNumInternShards    = 1 << kInternShardBits;
+    const uint32_t  kInternMinSlots     = 64;
+    const size_t    kInternArenaSize    = 16 * 1024;
+
+    const char* const kDeletedString = (const char*) uintptr_t(1);  ///< slot tombstone
+    const int32_t     kDeadRefs      = -1;
+
+    struct cInternSlot
     {
-        bool operator()(const char* a, const char* b) const
+        std::atomic<uint32_t>       mHash;
+        std::atomic<const char*>    mString;    ///< 0 = empty, kDeletedString = removed
+    };
+
+    struct cInternTable
+    {
+        uint32_t        mMask;
+        uint32_t        mUsed;      ///< Slots used, including deleted ones
+        uint32_t        mLive;      ///< Slots holding strings
+        cInternTable*   mRetired;   ///< Previous table, kept alive for lock-free readers
+        cInternSlot     mSlots[1];
+    };
+
+    struct cRefString
+    {
+        std::atomic<int32_t>    mRefs;
+        char                    mChars[4];  ///< actually variable length
+
+        static cRefString* FromString(const char* s) { return (cRefString*) (s - offsetof(cRefString, mChars)); }
+    };
+
+    struct cInternShard
+    {
+        pthread_mutex_t             mMutex = PTHREAD_MUTEX_INITIALIZER;
+        std::atomic<cInternTable*>  mTable { nullptr };
+
+        uint8_t*                    mArenaCursor = 0;
+        uint8_t*                    mArenaEnd    = 0;
+        uint8_t*                    mArenaBlocks = 0;   ///< Chain of blocks, linked by first word
+
+        vector<cRefString*>         mPendingFree;
+
+        uint8_t                     mPad[64];           ///< Keep hot shards off each other's cache lines
+    };
+
+    class cInternSet
+    {
+    public:
+        void Init(cIAllocator* alloc, bool matchStrings, bool refCount);
+        void Shutdown();
+
+        const char* Find  (uint32_t hash, const char* s) const;
+        ///< Returns existing string, or 0. In ref counting mode, a ref is added to the result.
+        const char* Insert(uint32_t hash, const char* begin, const char* end, bool copy);
+        ///< Inserts string unless a match has been added meanwhile. If !copy, the caller guarantees 'begin' persists.
+
+        bool Contains(uint32_t hash, const char* s) const;  ///< Returns true if 's' itself is in the set
+        void AddRef (const char* s);
+        bool Release(uint32_t hash, const char* s);         ///< Returns true if this was the last reference
+        void Collect();                                     ///< Frees released strings
+
+        int  NumStrings() const;
+        bool RefCounted() const { return mRefCount; }
+
+    protected:
+        bool Matches(uint32_t slotHash, const char* slotString, uint32_t hash, const char* begin, const char* end) const;
+        const char* FindLocked(cInternShard& shard, uint32_t hash, const char* begin, const char* end);
+        void        Grow(cInternShard& shard);
+        char*       ArenaAlloc(cInternShard& shard, size_t size);
+
+        cInternShard  mShards[kNumInternShards];
+        cIAllocator*  mAllocator    = 0;
+        bool          mMatchStrings = false;    ///< If false, hash (ID) equality is enough
+        bool          mRefCount     = false;
+    };
+
+    inline uint32_t InternSlotHash(uint32_t hash)
+    {
+        return HashMix(hash);
+    }
+
+    void cInternSet::Init(cIAllocator* alloc, bool matchStrings, bool refCount)
+    {
+        mAllocator = alloc ? alloc : Allocator(kDefaultAllocator);
+        mMatchStrings = matchStrings;
+        mRefCount = refCount;
+    }
+
+    void cInternSet::Shutdown()
+    {
+        Collect();
+
+        for (cInternShard& shard : mShards)
         {
-            return strcmp(a, b) < 0;
+            cInternTable* table = shard.mTable.load(std::memory_order_relaxed);
+
+            if (mRefCount && table)
+                for (uint32_t i = 0; i <= table->mMask; i++)
+                {
+                    const char* s = table->mSlots[i].mString.load(std::memory_order_relaxed);
+
+                    if (s && s != kDeletedString)
+                        mAllocator->Free(cRefString::FromString(s));
+                }
+
+            while (table)
+            {
+                cInternTable* retired = table->mRetired;
+                mAllocator->Free(table);
+                table = retired;
+            }
+
+            shard.mTable.store(nullptr, std::memory_order_relaxed);
+
+            while (shard.mArenaBlocks)
+            {
+                uint8_t* next = *(uint8_t**) shard.mArenaBlocks;
+                mAllocator->Free(shard.mArenaBlocks);
+                shard.mArenaBlocks = next;
+            }
+
+            shard.mArenaCursor = 0;
+            shard.mArenaEnd = 0;
+        }
+    }
+
+    inline bool cInternSet::Matches(uint32_t slotHash, const char* slotString, uint32_t hash, const char* begin, const char* end) const
+    {
+        if (slotHash != hash || slotString == kDeletedString)
+            return false;
+
+        if (!mMatchStrings)
+            return true;
+
+        if (!end)
+            return strcmp(slotString, begin) == 0;
+
+        size_t n = end - begin;
+        return strncmp(slotString, begin, n) == 0 && slotString[n] == 0;
+    }
+
+    const char* cInternSet::Find(uint32_t hash, const char* s) const
+    {
+        uint32_t slotHash = InternSlotHash(hash);
+        const cInternShard& shard = mShards[slotHash & (kNumInternShards - 1)];
+        const cInternTable* table = shard.mTable.load(std::memory_order_acquire);
+
+        if (!table)
+            return 0;
+
+        for (uint32_t i = (slotHash >> kInternShardBits) & table->mMask; ; i = (i + 1) & table->mMask)
+        {
+            const char* slotString = table->mSlots[i].mString.load(std::memory_order_acquire);
+
+            if (!slotString)
+                return 0;
+
+            if (Matches(table->mSlots[i].mHash.load(std::memory_order_relaxed), slotString, hash, s, 0))
+            {
+                if (!mRefCount)
+                    return slotString;
+
+                // Only take a ref on a live string. A zero count means a Release() is
+                // in flight, so leave it to the locked path to sort out.
+                std::atomic<int32_t>& refs = cRefString::FromString(slotString)->mRefs;
+                int32_t count = refs.load(std::memory_order_relaxed);
+
+                while (count > 0)
+                    if (refs.compare_exchange_weak(count, count + 1, std::memory_order_acquire))
+                        return slotString;
+
+                return 0;
+            }
+        }
+    }
+
+    const char* cInternSet::FindLocked(cInternShard& shard, uint32_t hash, const char* begin, const char* end)
+    {
+        cInternTable* table = shard.mTable.load(std::memory_order_relaxed);
+
+        if (!table)
+            return 0;
+
+        uint32_t slotHash = InternSlotHash(hash);
+
+        for (uint32_t i = (slotHash >> kInternShardBits) & table->mMask; ; i = (i + 1) & table->mMask)
+        {
+            const char* slotString = table->mSlots[i].mString.load(std::memory_order_relaxed);
+
+            if (!slotString)
+                return 0;
+
+            if (Matches(table->mSlots[i].mHash.load(std::memory_order_relaxed), slotString, hash, begin, end))
+            {
+                if (mRefCount)  // revives strings whose Release() hasn't yet taken the lock
+                    cRefString::FromString(slotString)->mRefs.fetch_add(1, std::memory_order_relaxed);
+
+                return slotString;
+            }
+        }
+    }
+
+    const char* cInternSet::Insert(uint32_t hash, const char* begin, const char* end, bool copy)
+    {
+        uint32_t slotHash = InternSlotHash(hash);
+        cInternShard& shard = mShards[slotHash & (kNumInternShards - 1)];
+
+        pthread_mutex_lock(&shard.mMutex);
+
+        const char* result = FindLocked(shard, hash, begin, end);
+
+        if (!result)
+        {
+            size_t length = end ? end - begin : strlen(begin);
+
+            if (mRefCount)
+            {
+                cRefString* refString = (cRefString*) mAllocator->Alloc(offsetof(cRefString, mChars) + length + 1, alignof(cRefString));
+                refString->mRefs.store(1, std::memory_order_relaxed);
+
+                char* p = refString->mChars;
+                memcpy(p, begin, length);
+                p[length] = 0;
+                result = p;
+            }
+            else if (copy || end)
+            {
+                char* p = ArenaAlloc(shard, length + 1);
+                memcpy(p, begin, length);
+                p[length] = 0;
+                result = p;
+            }
+            else
+                result = begin;
+
+            cInternTable* table = shard.mTable.load(std::memory_order_relaxed);
+
+            if (!table || 4 * (table->mUsed + 1) > 3 * (table->mMask + 1))
+            {
+                Grow(shard);
+                table = shard.mTable.load(std::memory_order_relaxed);
+            }
+
+            uint32_t i = (slotHash >> kInternShardBits) & table->mMask;
+
+            while (table->mSlots[i].mString.load(std::memory_order_relaxed))
+                i = (i + 1) & table->mMask;
+
+            table->mSlots[i].mHash.store(hash, std::memory_order_relaxed);
+            table->mSlots[i].mString.store(result, std::memory_order_release);  // publish
+            table->mUsed++;
+            table->mLive++;
         }
-    };
 
+        pthread_mutex_unlock(&shard.mMutex);
+
+        return result;
+    }
+
+    void cInternSet::Grow(cInternShard& shard)
+    {
+        cInternTable* oldTable = shard.mTable.load(std::memory_order_relaxed);
+
+        uint32_t numSlots = kInternMinSlots;
+
+        if (oldTable)
+            while (numSlots < 4 * (oldTable->mLive + 1))    // also drops deleted slots
+                numSlots *= 2;
+
+        cInternTable* table = (cInternTable*) mAllocator->AllocZeroed(sizeof(cInternTable) + (numSlots - 1) * sizeof(cInternSlot), alignof(cInternTable));
+        table->mMask = numSlots - 1;
+        table->mRetired = oldTable;
+
+        if (oldTable)
+            for (uint32_t j = 0; j <= oldTable->mMask; j++)
+            {
+                const char* s = oldTable->mSlots[j].mString.load(std::memory_order_relaxed);
+
+                if (!s || s == kDeletedString)
+                    continue;
+
+                uint32_t hash = oldTable->mSlots[j].mHash.load(std::memory_order_relaxed);
+                uint32_t i = (InternSlotHash(hash) >> kInternShardBits) & table->mMask;
+
+                while (table->mSlots[i].mString.load(std::memory_order_relaxed))
+                    i = (i + 1) & table->mMask;
+
+                table->mSlots[i].mHash  .store(hash, std::memory_order_relaxed);
+                table->mSlots[i].mString.store(s,    std::memory_order_relaxed);
+                table->mUsed++;
+                table->mLive++;
+            }
+
+        shard.mTable.store(table, std::memory_order_release);
+    }
+
+    char* cInternSet::ArenaAlloc(cInternShard& shard, size_t size)
+    {
+        if (shard.mArenaCursor + size > shard.mArenaEnd)
+        {
+            size_t blockSize = max(kInternArenaSize, size + sizeof(uint8_t*));
+            uint8_t* block = mAllocator->Alloc(blockSize, alignof(uint8_t*));
+
+            *(uint8_t**) block = shard.mArenaBlocks;
+            shard.mArenaBlocks = block;
+            shard.mArenaCursor = block + sizeof(uint8_t*);
+            shard.mArenaEnd    = block + blockSize;
+        }
+
+        char* result = (char*) shard.mArenaCursor;
+        shard.mArenaCursor += size;
+        return result;
+    }
+
+    bool cInternSet::Contains(uint32_t hash, const char* s) const
+    {
+        uint32_t slotHash = InternSlotHash(hash);
+        const cInternShard& shard = mShards[slotHash & (kNumInternShards - 1)];
+        const cInternTable* table = shard.mTable.load(std::memory_order_acquire);
+
+        if (!table)
+            return false;
+
+        for (uint32_t i = (slotHash >> kInternShardBits) & table->mMask; ; i = (i + 1) & table->mMask)
+        {
+            const char* slotString = table->mSlots[i].mString.load(std::memory_order_acquire);
+
+            if (!slotString)
+                return false;
+
+            if (slotString == s)
+                return true;
+        }
+    }
+
+    void cInternSet::AddRef(const char* s)
+    {
+        if (mRefCount)
+            cRefString::FromString(s)->mRefs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool cInternSet::Release(uint32_t hash, const char* s)
+    {
+        if (!mRefCount)
+            return false;
+
+        cRefString* refString = cRefString::FromString(s);
+
+        if (refString->mRefs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return false;
+
+        uint32_t slotHash = InternSlotHash(hash);
+        cInternShard& shard = mShards[slotHash & (kNumInternShards - 1)];
+
+        pthread_mutex_lock(&shard.mMutex);
+
+        bool released = false;
+        int32_t expected = 0;
+
+        // Fails if someone revived the string via Insert() before we got the lock.
+        if (refString->mRefs.compare_exchange_strong(expected, kDeadRefs))
+        {
+            cInternTable* table = shard.mTable.load(std::memory_order_relaxed);
+
+            for (uint32_t i = (slotHash >> kInternShardBits) & table->mMask; ; i = (i + 1) & table->mMask)
+                if (table->mSlots[i].mString.load(std::memory_order_relaxed) == s)
+                {
+                    table->mSlots[i].mString.store(kDeletedString, std::memory_order_release);
+                    table->mLive--;
+                    break;
+                }
+
+            shard.mPendingFree.push_back(refString);
+            released = true;
+        }
+
+        pthread_mutex_unlock(&shard.mMutex);
+
+        return released;
+    }
+
+    void cInternSet::Collect()
+    {
+        for (cInternShard& shard : mShards)
+        {
+            pthread_mutex_lock(&shard.mMutex);
+
+            for (cRefString* refString : shard.mPendingFree)
+                mAllocator->Free(refString);
+
+            shard.mPendingFree.clear();
+
+            pthread_mutex_unlock(&shard.mMutex);
+        }
+    }
+
+    int cInternSet::NumStrings() const
+    {
+        int result = 0;
+
+        for (const cInternShard& shard : mShards)
+            if (const cInternTable* table = shard.mTable.load(std::memory_order_acquire))
+                result += table->mLive;
+
+        return result;
+    }
+#endif
+
+
+    // --- cTagManager ----------------------------------------------------------
 
     class cTagManager :
         public cAllocatable
@@ -49,45 +473,32 @@ namespace
         cTagManager()
         {}
 
-        void Init(cIAllocator* alloc);
+        void Init(cIAllocator* alloc, bool refCountStrings);
         void Shutdown();
 
     #if CL_TAG_DEBUG
-        map<tTagID, tTag> mIDToTagMap;
-        vector<tTag> mAllocatedTags;
+        cInternSet mTags;       ///< Tag strings, keyed by NameToID(), so case insensitive
+        cInternSet mStringIDs;  ///< Other strings, keyed by content
     #endif
-
-        set<tStringID, cLessString> mStringIDs;
-
-        cIAllocator* mTagAllocator = 0;
-        cIAllocator* mStringAllocator = 0;
     };
 
-    void cTagManager::Init(cIAllocator* alloc)
+    void cTagManager::Init(cIAllocator* alloc, bool refCountStrings)
     {
-        mTagAllocator = alloc;
-        mStringAllocator = alloc;
+    #if CL_TAG_DEBUG
+        mTags.Init(alloc, false, false);
+        mStringIDs.Init(alloc, true, refCountStrings);
+    #endif
     }
+
     void cTagManager::Shutdown()
     {
     #if CL_TAG_DEBUG
-        for (auto a : mAllocatedTags)
-            mTagAllocator->Free((void*) a);
-
-        mAllocatedTags.clear();
+        mTags.Shutdown();
+        mStringIDs.Shutdown();
     #endif
-
-        for (auto a : mStringIDs)
-            mStringAllocator->Free((void*) a);
-
-        mStringIDs.clear();
-
-        mTagAllocator = 0;
-        mStringAllocator = 0;
     }
 
 
-
     cTagManager* sTagManager = 0;
 
 #if CL_TAG_DEBUG
@@ -138,90 +549,110 @@ tTag nCL::TagFromStrConst(const char* s)
     // also, some C compilers may not have a global string table.
     // also, if a runtime string was registered first, we're screwed! Ugh.
 
-    tTagID tagID = tTagID(NameToID(s));
+    uint32_t tagID = NameToID(s);
 
-    auto it = sTagManager->mIDToTagMap.find(tagID);
-    
-    if (it != sTagManager->mIDToTagMap.end())
+    tTag tag = sTagManager->mTags.Find(tagID, s);
+
+    if (!tag)
+        tag = sTagManager->mTags.Insert(tagID, s, 0, false);
+
+    if (tag != s)
     {
-        if (false && s != it->second)   // currently allow this...
+        if (false)   // currently allow this...
         {
-            CL_ERROR("Non-constant string tag already registered for %s (%p vs %p)\n", s, s, it->second);
+            CL_ERROR("Non-constant string tag already registered for %s (%p vs %p)\n", s, s, tag);
         }
-        else if (!eqi(s, it->second))
+        else if (!eqi(s, tag))
         {
-            CL_ERROR("ID collision for tags %s : %s\n", s, it->second);
+            CL_ERROR("ID collision for tags %s : %s\n", s, tag);
         }
-
-        return it->second;
     }
 
-    sTagManager->mIDToTagMap[tagID] = s;
-
-    return s;
+    return tag;
 }
 
 tTag nCL::TagFromString(const char* s)
 {
-    tTagID tagID = tTagID(NameToID(s));
+    uint32_t tagID = NameToID(s);
 
-    auto it = sTagManager->mIDToTagMap.find(tagID);
-    
-    if (it != sTagManager->mIDToTagMap.end())
-    {
-        if (!eqi(s, it->second))
-        {
-            CL_ERROR("ID collision for tags %s : %s\n", s, it->second);
-        }
+    tTag tag = sTagManager->mTags.Find(tagID, s);
+
+    if (!tag)
+        tag = sTagManager->mTags.Insert(tagID, s, 0, true);
 
-        return it->second;
+    if (!eqi(s, tag))
+    {
+        CL_ERROR("ID collision for tags %s : %s\n", s, tag);
     }
 
-    size_t debugStringSize = strlen(s);
-    char* p = (char*) sTagManager->mTagAllocator->Alloc(debugStringSize + 1, 1);
+    return tag;
+}
 
-    strcpy(p, s);
+tTag nCL::TagFromString(const char* begin, const char* end)
+{
+    uint32_t tagID = NameToID(begin, end);
+
+    tTag tag = sTagManager->mTags.Find(tagID, begin);   // tags match on ID alone, so 'begin' needn't be terminated
 
-    sTagManager->mIDToTagMap[tagID] = p;
-    sTagManager->mAllocatedTags.push_back(p);
+    if (!tag)
+        tag = sTagManager->mTags.Insert(tagID, begin, end, true);
 
-    return p;
+    if (strncasecmp(tag, begin, end - begin) != 0 || tag[end - begin] != 0)
+    {
+        CL_ERROR("ID collision for tags %.*s : %s\n", int(end - begin), begin, tag);
+    }
+
+    return tag;
 }
 
-tTag nCL::TagFromString(const char* begin, const char* end)
+bool nCL::IsTag(tTag tag)
 {
-    tTagID tagID = tTagID(NameToID(begin, end));
+    return sTagManager->mTags.Contains(NameToID(tag), tag);
+}
 
-    auto it = sTagManager->mIDToTagMap.find(tagID);
-    
-    if (it != sTagManager->mIDToTagMap.end())
+tStringID nCL::StringIDFromString(const char* s)
+{
+    cInternSet& strings = sTagManager->mStringIDs;
+
+    // Reuse tag if possible... but not when ref counting, as only our own strings carry counts.
+    if (!strings.RefCounted())
     {
-        if (strncasecmp(it->second, begin, end - begin))
-        {
-            CL_ERROR("ID collision for tags %s : %s\n", begin, it->second);
-        }
+        tTag tag = sTagManager->mTags.Find(NameToID(s), s);
 
-        return it->second;
+        if (tag && eq(s, tag))  // case is important for strings.
+            return tag;
     }
 
-    char* p = (char*) sTagManager->mTagAllocator->Alloc(end - begin + 1, 1);
+    uint32_t hash = StrWyHashU32(s);
+    tStringID result = strings.Find(hash, s);
 
-    strcpy(p, begin);
+    if (!result)
+        result = strings.Insert(hash, s, 0, true);
 
-    sTagManager->mIDToTagMap[tagID] = p;
-    sTagManager->mAllocatedTags.push_back(p);
+    return result;
+}
 
-    return p;
+tStringID nCL::CopyStringID(tStringID id)
+{
+    if (id)
+        sTagManager->mStringIDs.AddRef(id);
+
+    return id;
 }
 
-bool nCL::IsTag(tTag tag)
+bool nCL::ReleaseStringID(tStringID id)
 {
-    // TODO: check point directly somehow?
-    tTagID tagID = tTagID(NameToID(tag));
+    if (!id)
+        return false;
 
-    auto it = sTagManager->mIDToTagMap.find(tagID);
-    
-    return it != sTagManager->mIDToTagMap.end() && it->second == tag;
+    cInternSet& strings = sTagManager->mStringIDs;
+
+    return strings.RefCounted() && strings.Release(StrWyHashU32(id), id);
+}
+
+void nCL::CollectStringIDs()
+{
+    sTagManager->mStringIDs.Collect();
 }
 
 #else
@@ -236,38 +667,42 @@ tTag nCL::TagFromString(const char* s)
     return tTag(NameToID(s));
 }
 
-#endif
-
-tStringID nCL::StringIDFromString(const char* s)
+tTag nCL::TagFromString(const char* begin, const char* end)
 {
-    // Reuse tag if possible...
-    tTagID tagID = tTagID(NameToID(s));
-
-    auto it = sTagManager->mIDToTagMap.find(tagID);
-    
-    if (it != sTagManager->mIDToTagMap.end() && eq(s, it->second))  // case is important for strings.
-        return it->second;
-
-    auto it2 = sTagManager->mStringIDs.find(s);
+    return tTag(NameToID(begin, end));
+}
 
-    if (it2 != sTagManager->mStringIDs.end())
-        return *it2;
+bool nCL::IsTag(tTag tag)
+{
+    return tag != kNullTag;
+}
 
-    size_t stringSize = strlen(s);
-    char* p = (char*) sTagManager->mStringAllocator->Alloc(stringSize + 1, 1);
+tStringID nCL::StringIDFromString(const char* s)
+{
+    return tStringID(NameToID(s));
+}
 
-    strcpy(p, s);
+tStringID nCL::CopyStringID(tStringID id)
+{
+    return id;
+}
 
-    sTagManager->mStringIDs.insert(p);
+bool nCL::ReleaseStringID(tStringID id)
+{
+    return false;
+}
 
-    return p;
+void nCL::CollectStringIDs()
+{
 }
 
-bool nCL::InitTagSystem(cIAllocator* allocator)
+#endif
+
+bool nCL::InitTagSystem(cIAllocator* allocator, bool refCountStrings)
 {
     CL_ASSERT(!sTagManager);
     sTagManager = new(allocator) cTagManager;
-    sTagManager->Init(allocator);
+    sTagManager->Init(allocator, refCountStrings);
 
 #if CL_TAG_DEBUG
     for (cInitTagBlock* block = sInitTagBlocks; block != 0; )
@@ -277,13 +712,18 @@ bool nCL::InitTagSystem(cIAllocator* allocator)
             tTag s = *tag;
 
             // LOCAL_DEBUG("ctag %p: %s\n", s, s);
-            sTagManager->mIDToTagMap[tTagID(NameToID(s))] = s;
+            uint32_t tagID = NameToID(s);
+
+            if (!sTagManager->mTags.Find(tagID, s))
+                sTagManager->mTags.Insert(tagID, s, 0, false);
         }
 
         cInitTagBlock* blockToFree = block;
         block = block->mNext;
         free(blockToFree);  // using system allocator
     }
+
+    sInitTagBlocks = 0;
 #endif
 
     return true;
@@ -296,3 +736,211 @@ bool nCL::ShutdownTagSystem()
     sTagManager = 0;
     return true;
 }
+
+#if CL_TAG_DEBUG
+
+namespace
+{
+    struct cLessString
+    {
+        bool operator()(const char* a, const char* b) const
+        {
+            return strcmp(a, b) < 0;
+        }
+    };
+
+    struct cLockedStringSet
+    /// The previous scheme -- a sorted set of individually allocated strings -- plus the lock needed to share it between threads.
+    {
+        set<const char*, cLessString>   mSet;
+        pthread_mutex_t                 mMutex = PTHREAD_MUTEX_INITIALIZER;
+        cIAllocator*                    mAllocator;
+
+        cLockedStringSet(cIAllocator* alloc) : mAllocator(alloc) {}
+
+        ~cLockedStringSet()
+        {
+            for (const char* s : mSet)
+                mAllocator->Free((void*) s);
+        }
+
+        const char* Intern(const char* s)
+        {
+            pthread_mutex_lock(&mMutex);
+
+            auto it = mSet.find(s);
+            const char* result;
+
+            if (it != mSet.end())
+                result = *it;
+            else
+            {
+                size_t size = strlen(s) + 1;
+                char* p = (char*) mAllocator->Alloc(size, 1);
+                memcpy(p, s, size);
+                mSet.insert(p);
+                result = p;
+            }
+
+            pthread_mutex_unlock(&mMutex);
+            return result;
+        }
+    };
+
+    struct cInternBench
+    {
+        int                 mCount;
+        const char* const*  mStrings;
+        int                 mRounds;
+
+        cInternSet*         mInternSet;
+        cLockedStringSet*   mLockedSet;
+        bool                mFailed = false;
+    };
+
+    inline const char* BenchIntern(cInternSet* set, const char* s)
+    {
+        uint32_t hash = StrWyHashU32(s);
+        const char* result = set->Find(hash, s);
+
+        if (!result)
+            result = set->Insert(hash, s, 0, true);
+
+        return result;
+    }
+
+    void* BenchInternMain(void* data)
+    {
+        cInternBench* bench = (cInternBench*) data;
+
+        for (int r = 0; r < bench->mRounds; r++)
+            for (int i = 0; i < bench->mCount; i++)
+            {
+                const char* s = bench->mStrings[i];
+                const char* result = bench->mInternSet ? BenchIntern(bench->mInternSet, s) : bench->mLockedSet->Intern(s);
+
+                if (strcmp(result, s) != 0)
+                    bench->mFailed = true;
+            }
+
+        return 0;
+    }
+
+    double RunInternBench(cInternBench* bench, int numThreads)
+    /// Returns ns per intern call
+    {
+        const int kMaxBenchThreads = 16;
+        pthread_t threads[kMaxBenchThreads];
+        cInternBench threadBench[kMaxBenchThreads];
+
+        numThreads = min(numThreads, kMaxBenchThreads);
+
+        uint64_t t0 = AbsoluteTicks();
+
+        if (numThreads == 1)
+        {
+            BenchInternMain(bench);
+            return double(AbsoluteTicks() - t0) / (double(bench->mRounds) * bench->mCount);
+        }
+
+        for (int i = 0; i < numThreads; i++)
+        {
+            threadBench[i] = *bench;
+            pthread_create(threads + i, 0, BenchInternMain, threadBench + i);
+        }
+
+        for (int i = 0; i < numThreads; i++)
+        {
+            pthread_join(threads[i], 0);
+            bench->mFailed |= threadBench[i].mFailed;
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        return double(t1 - t0) / (double(bench->mRounds) * bench->mCount * numThreads);
+    }
+}
+
+void nCL::BenchTagInterning(int count, const char* const strings[])
+{
+    if (count == 0)
+        return;
+
+    cIAllocator* alloc = Allocator(kDefaultAllocator);
+
+    string_hash_set unique;
+    for (int i = 0; i < count; i++)
+        unique.insert(strings[i]);
+
+    printf("Interning %d strings, %d unique\n", count, int(unique.size()));
+
+    const int kColdRounds = max(1, 200000 / count);
+    const int kWarmRounds = max(1, 2000000 / count);
+    int maxThreads = max(2, min(8, int(sysconf(_SC_NPROCESSORS_ONLN))));
+
+    double coldNew = 0.0, coldOld = 0.0;
+    bool failed = false;
+
+    for (int r = 0; r < kColdRounds; r++)
+    {
+        cInternSet internSet;
+        internSet.Init(alloc, true, false);
+        cLockedStringSet lockedSet(alloc);
+
+        cInternBench bench = { count, strings, 1, &internSet, 0 };
+        coldNew += RunInternBench(&bench, 1) / kColdRounds;
+        failed |= bench.mFailed;
+
+        bench.mInternSet = 0;
+        bench.mLockedSet = &lockedSet;
+        coldOld += RunInternBench(&bench, 1) / kColdRounds;
+
+        internSet.Shutdown();
+    }
+
+    printf("Threads   Sorted set+lock (ns)   Intern table (ns)\n");
+    printf("cold 1    %20.1f  %18.1f\n", coldOld, coldNew);
+
+    // All threads racing to add the same strings
+    cInternSet racedSet;
+    racedSet.Init(alloc, true, false);
+    cInternBench racedBench = { count, strings, 1, &racedSet, 0 };
+    RunInternBench(&racedBench, maxThreads);
+
+    if (racedBench.mFailed || racedSet.NumStrings() != int(unique.size()))
+        failed = true;
+
+    racedSet.Shutdown();
+
+    cInternSet internSet;
+    internSet.Init(alloc, true, false);
+    cLockedStringSet lockedSet(alloc);
+
+    cInternBench warmup = { count, strings, 1, &internSet, &lockedSet };
+    BenchInternMain(&warmup);
+    warmup.mInternSet = 0;
+    BenchInternMain(&warmup);
+
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+    {
+        cInternBench bench = { count, strings, kWarmRounds / numThreads, &internSet, 0 };
+        double warmNew = RunInternBench(&bench, numThreads);
+        failed |= bench.mFailed;
+
+        bench.mInternSet = 0;
+        bench.mLockedSet = &lockedSet;
+        double warmOld = RunInternBench(&bench, numThreads);
+
+        printf("warm %-3d  %20.1f  %18.1f\n", numThreads, warmOld, warmNew);
+    }
+
+    if (internSet.NumStrings() != int(unique.size()))
+        failed = true;
+
+    internSet.Shutdown();
+
+    if (failed)
+        printf("FAILED: interned strings don't match\n");
+}
+
+#endif
@@ -11,21 +11,32 @@
 #include <CLArgSpec.h>
 #include <CLFileSpec.h>
 #include <CLJSON.h>
+#include <CLJSONStream.h>
 #include <CLSystem.h>
 
 #include <CLBits.h>
 #include <CLData.h>
+#include <CLFIFO.h>
+#include <CLFileWatch.h>
+#include <CLHash.h>
+#include <CLHashMap.h>
 #include <CLImage.h>
 #include <CLLog.h>
 #include <CLMemory.h>
+#include <CLProfile.h>
 #include <CLTag.h>
 #include <CLValue.h>
+#include <CLValueData.h>
 
 using namespace nCL;
 
 namespace nCL
 {
     void TestIO();
+#ifndef CL_RELEASE
+    void BenchJobs();
+    void BenchAllocators();
+#endif
 }
 
 // Various bits of test code
@@ -111,6 +122,26 @@ namespace nCL
     const uint32_t* GetEmbedPermuteMasks();
 }
 
+namespace
+{
+    void FindConfigStrings(const cValue& value, vector<const char*>* strings)
+    /// Collect member names and string values from the given config tree
+    {
+        if (value.IsString())
+            strings->push_back(value.AsString());
+
+        for (int i = 0, n = value.NumMembers(); i < n; i++)
+        {
+            strings->push_back(value.MemberName(i));
+            FindConfigStrings(value.MemberValue(i), strings);
+        }
+
+        if (value.IsArray() && !value.IsNull())
+            for (int i = 0, n = value.NumElts(); i < n; i++)
+                FindConfigStrings(value.Elt(i), strings);
+    }
+}
+
 int main(int argc, const char** argv)
 {
     InitLogSystem();
@@ -124,11 +155,27 @@ int main(int argc, const char** argv)
     {
         kFlagConvertConfig,
         kFlagDumpConfig,
+        kFlagBenchTags,
+        kFlagBenchJSON,
+        kFlagBenchBinary,
+        kFlagBenchStream,
+        kFlagBenchHashes,
         kFlagImage,
         kFlagEmbed,
         kFlagExtract,
         kFlagAscii,
         kFlagTestIO,
+        kFlagBenchJobs,
+        kFlagTestFIFOs,
+        kFlagBenchFIFOs,
+        kFlagBenchAlloc,
+        kFlagBenchProfiler,
+        kFlagTestHashMaps,
+        kFlagBenchHashMaps,
+        kFlagBenchConfig,
+        kFlagTestFileWatch,
+        kFlagBenchLog,
+        kFlagTestHashes,
         kMaxFlags
     };
 
@@ -143,6 +190,24 @@ int main(int argc, const char** argv)
             "Read the given top-level json file and process it",
          "-dump^", kFlagDumpConfig,
             "Dump input",
+         "-benchTags^", kFlagBenchTags,
+            "Benchmark interning the input's strings",
+#ifndef CL_RELEASE
+         "-benchJSON^", kFlagBenchJSON,
+            "Benchmark parsing the input, and report value memory",
+#endif
+#ifndef CL_RELEASE
+         "-benchBinary^", kFlagBenchBinary,
+            "Benchmark loading the input as json against its binary form",
+#endif
+#ifndef CL_RELEASE
+         "-benchStream^", kFlagBenchStream,
+            "Benchmark the streaming json reader against cJSONReader",
+#endif
+#ifndef CL_RELEASE
+         "-benchHashes^", kFlagBenchHashes,
+            "Benchmark hashing, and count tag ID collisions amongst the input's strings",
+#endif
         "-image^ <inputFile:cstr>", kFlagImage, &inputFileStr,
             "Read the given top-level json file and process it",
         "  -embed^ <message:cstr>", kFlagEmbed, &embedMessage,
@@ -155,6 +220,44 @@ int main(int argc, const char** argv)
             "Test permutation",
         "-testIO^", kFlagTestIO,
             "Test IO streams",
+#ifndef CL_RELEASE
+        "-benchJobs^", kFlagBenchJobs,
+            "Benchmark job system scaling",
+#endif
+#ifndef CL_RELEASE
+        "-testFIFOs^", kFlagTestFIFOs,
+            "Stress test lockless FIFOs",
+        "-benchFIFOs^", kFlagBenchFIFOs,
+            "Benchmark lockless FIFO throughput",
+#endif
+#ifndef CL_RELEASE
+        "-benchAlloc^", kFlagBenchAlloc,
+            "Benchmark default allocator against malloc",
+#endif
+        "-benchProfiler^", kFlagBenchProfiler,
+            "Benchmark profile marker overhead",
+#ifndef CL_RELEASE
+        "-testHashMaps^", kFlagTestHashMaps,
+            "Test hash_map against map",
+        "-benchHashMaps^", kFlagBenchHashMaps,
+            "Benchmark hash_map against map",
+#endif
+#ifndef CL_RELEASE
+        "-benchConfig^", kFlagBenchConfig,
+            "Benchmark config member lookup through inheritance",
+#endif
+#ifndef CL_RELEASE
+        "-testFileWatch^", kFlagTestFileWatch,
+            "Test file watcher batching over many files",
+#endif
+#ifndef CL_RELEASE
+        "-benchLog^", kFlagBenchLog,
+            "Benchmark log call latency",
+#endif
+#ifndef CL_RELEASE
+        "-testHashes^", kFlagTestHashes,
+            "Test hash and CRC variants",
+#endif
          0
     );
 
@@ -290,6 +393,41 @@ int main(int argc, const char** argv)
             cLink<cIConfigSource> configSource = CreateDefaultConfigSource(Allocator(kDefaultAllocator));
             ApplyImports(value.AsObject(), configSource);
 
+        #if CL_TAG_DEBUG
+            if (argSpec.Flag(kFlagBenchTags))
+            {
+                vector<const char*> strings;
+                FindConfigStrings(value, &strings);
+
+                BenchTagInterning(strings.size(), strings.data());
+            }
+        #endif
+
+        #ifndef CL_RELEASE
+            if (argSpec.Flag(kFlagBenchHashes))
+            {
+                vector<const char*> strings;
+                FindConfigStrings(value, &strings);
+
+                BenchHashes(strings.size(), strings.data());
+            }
+        #endif
+
+        #ifndef CL_RELEASE
+            if (argSpec.Flag(kFlagBenchJSON))
+                BenchJSONRead(inputFile);
+        #endif
+
+        #ifndef CL_RELEASE
+            if (argSpec.Flag(kFlagBenchBinary))
+                BenchValueDataRead(inputFile);
+        #endif
+
+        #ifndef CL_RELEASE
+            if (argSpec.Flag(kFlagBenchStream))
+                BenchJSONStreamRead(inputFile);
+        #endif
+
             if (argSpec.Flag(kFlagDumpConfig))
             {
                 printf("\n");
@@ -312,6 +450,57 @@ int main(int argc, const char** argv)
     if (argSpec.Flag(kFlagTestIO))
         TestIO();
 
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagBenchJobs))
+        BenchJobs();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagTestFIFOs))
+        TestFIFOs();
+
+    if (argSpec.Flag(kFlagBenchFIFOs))
+        BenchFIFOs();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagBenchAlloc))
+        BenchAllocators();
+#endif
+
+#if CL_PROFILE
+    if (argSpec.Flag(kFlagBenchProfiler))
+        BenchProfiler();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagTestHashMaps))
+        TestHashMaps();
+
+    if (argSpec.Flag(kFlagBenchHashMaps))
+        BenchHashMaps();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagBenchConfig))
+        BenchConfigLookup();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagTestFileWatch))
+        TestFileWatcher(2000);
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagBenchLog))
+        BenchLog();
+#endif
+
+#ifndef CL_RELEASE
+    if (argSpec.Flag(kFlagTestHashes))
+        TestHashes();
+#endif
+
     ShutdownTool();
 
     return 0;
@@ -18,11 +18,15 @@
 #include <CLDirectories.h>
 #include <CLFileSpec.h>
 
+#include <pthread.h>
+
 using namespace nCL;
 
 namespace
 {
     tTag kSourcePathTag = CL_TAG("_sourcePath");
+
+    const size_t kMaxInlineString = sizeof(double) - 1;     // leaves room for the terminator
 }
 
 const cValue cValue::kNull;
@@ -31,31 +35,223 @@ cValue cValue::kNullScratch;
 
 
 /////////////////////////////////////////////////////////////////////////////////////
-// cValue::cCommentInfo
+// Comment table
+//
+// Comments are rare, and usually only collected by tools, so rather than spend
+// a pointer on every value, values with comments hold an index into this table.
 //
 
-cValue::cCommentInfo::cCommentInfo()
+namespace
 {
+    struct cCommentInfo
+    {
+        tStringID mComment[kNumberOfCommentPlacements];
+    };
+
+    pthread_mutex_t         sCommentMutex = PTHREAD_MUTEX_INITIALIZER;
+    vector<cCommentInfo>    sComments;          // entry 0 is unused, so index 0 can mean 'none'
+    vector<uint32_t>        sFreeComments;
+
+    uint32_t NewComments()
+    {
+        pthread_mutex_lock(&sCommentMutex);
+
+        uint32_t index;
+
+        if (!sFreeComments.empty())
+        {
+            index = sFreeComments.back();
+            sFreeComments.pop_back();
+        }
+        else
+        {
+            if (sComments.empty())
+                sComments.push_back(cCommentInfo());
+
+            index = sComments.size();
+            sComments.push_back(cCommentInfo());
+        }
+
+        for (tStringID& comment : sComments[index].mComment)
+            comment = tStringID(0);
+
+        pthread_mutex_unlock(&sCommentMutex);
+
+        return index;
+    }
+
+    uint32_t CopyComments(uint32_t index)
+    {
+        uint32_t copyIndex = NewComments();
+
+        pthread_mutex_lock(&sCommentMutex);
+
+        for (int i = 0; i < kNumberOfCommentPlacements; i++)
+        {
+            tStringID comment = sComments[index].mComment[i];
+
+            if (comment)
+                sComments[copyIndex].mComment[i] = CopyStringID(comment);
+        }
+
+        pthread_mutex_unlock(&sCommentMutex);
+
+        return copyIndex;
+    }
+
+    void FreeComments(uint32_t index)
+    {
+        pthread_mutex_lock(&sCommentMutex);
+
+        for (tStringID& comment : sComments[index].mComment)
+            if (comment)
+            {
+                ReleaseStringID(comment);
+                comment = tStringID(0);
+            }
+
+        sFreeComments.push_back(index);
+
+        pthread_mutex_unlock(&sCommentMutex);
+    }
+
+    tStringID CommentAt(uint32_t index, tCommentPlacement placement)
+    {
+        pthread_mutex_lock(&sCommentMutex);
+        tStringID result = sComments[index].mComment[placement];
+        pthread_mutex_unlock(&sCommentMutex);
+
+        return result;
+    }
+
+    void SetCommentAt(uint32_t index, tCommentPlacement placement, tStringID comment)
+    {
+        pthread_mutex_lock(&sCommentMutex);
+
+        tStringID& slot = sComments[index].mComment[placement];
+
+        if (slot)
+            ReleaseStringID(slot);
+
+        slot = comment;
+
+        pthread_mutex_unlock(&sCommentMutex);
+    }
 }
 
-cValue::cCommentInfo::~cCommentInfo()
+
+/////////////////////////////////////////////////////////////////////////////////////
+// cValue::cPackedArray
+//
+
+struct cValue::cPackedArray
+/// Array of numbers, stored contiguously after this header.
+{
+    uint32_t                    mSize;
+    tValueType                  mEltType;   ///< kValueInt, kValueUInt, or kValueDouble
+    bool                        mIntMask;   ///< If true, doubles are followed by a bit per element that is set for int elements
+    std::atomic<tArrayValues*>  mElts;      ///< Elements as cValues, created on first by-reference access
+
+    const int32_t*  Ints()    const { return (const int32_t*) (this + 1); }
+    const double*   Doubles() const { return (const double*)  (this + 1); }
+    const uint32_t* IntMask() const { return (const uint32_t*) (Doubles() + mSize); }
+
+    static size_t AllocSize(uint32_t size, tValueType eltType, bool intMask);
+
+    static cPackedArray* Create(uint32_t size, tValueType eltType, bool intMask);
+    cPackedArray*        Clone() const;
+    static void          Free(cPackedArray* packed);
+
+    cValue              Elt(uint32_t i) const;
+    const tArrayValues& Elts();
+};
+
+size_t cValue::cPackedArray::AllocSize(uint32_t size, tValueType eltType, bool intMask)
+{
+    size_t dataSize = size * (eltType == kValueDouble ? sizeof(double) : sizeof(int32_t));
+    size_t maskSize = intMask ? sizeof(uint32_t) * ((size + 31) / 32) : 0;
+
+    return sizeof(cPackedArray) + dataSize + maskSize;
+}
+
+cValue::cPackedArray* cValue::cPackedArray::Create(uint32_t size, tValueType eltType, bool intMask)
+{
+    size_t allocSize = AllocSize(size, eltType, intMask);
+    uint8_t* mem = Allocator(kValueAllocator)->AllocZeroed(allocSize, alignof(double));
+
+    cPackedArray* packed = new(mem) cPackedArray;
+
+    packed->mSize    = size;
+    packed->mEltType = eltType;
+    packed->mIntMask = intMask;
+    packed->mElts    = 0;
+
+    return packed;
+}
+
+cValue::cPackedArray* cValue::cPackedArray::Clone() const
+{
+    cPackedArray* packed = Create(mSize, mEltType, mIntMask);
+    size_t headerSize = sizeof(cPackedArray);
+
+    memcpy((uint8_t*) packed + headerSize, (const uint8_t*) this + headerSize, AllocSize(mSize, mEltType, mIntMask) - headerSize);
+
+    return packed;
+}
+
+void cValue::cPackedArray::Free(cPackedArray* packed)
 {
-    if (mComment)
-        ReleaseStringID(mComment);
+    tArrayValues* elts = packed->mElts;
+
+    if (elts)
+        Destroy(&elts, Allocator(kValueAllocator));
+
+    packed->~cPackedArray();
+    Allocator(kValueAllocator)->Free(packed);
 }
 
+inline cValue cValue::cPackedArray::Elt(uint32_t i) const
+{
+    switch (mEltType)
+    {
+    case kValueInt:
+        return cValue(Ints()[i]);
+    case kValueUInt:
+        return cValue(uint32_t(Ints()[i]));
+    default:
+        if (mIntMask && (IntMask()[i >> 5] & (1u << (i & 31))))
+            return cValue(int32_t(Doubles()[i]));
+
+        return cValue(Doubles()[i]);
+    }
+}
 
-void cValue::cCommentInfo::SetComment(const char* text)
+const cValue::tArrayValues& cValue::cPackedArray::Elts()
 {
-    CL_ASSERT(text);
-    CL_ASSERT_MSG(text[0]=='\0' || text[0]=='/', "Comments must start with /");
+    tArrayValues* elts = mElts.load(std::memory_order_acquire);
+
+    if (!elts)
+    {
+        // We may be racing other readers here, in which case the first one wins
+        tArrayValues* newElts = nCL::Create<tArrayValues>(Allocator(kValueAllocator));
+        newElts->resize(mSize);
 
-    if (mComment)
-        ReleaseStringID(mComment);
+        for (uint32_t i = 0; i < mSize; i++)
+            (*newElts)[i] = Elt(i);
 
-    mComment = StringIDFromString(text);
+        if (mElts.compare_exchange_strong(elts, newElts, std::memory_order_acq_rel))
+            elts = newElts;
+        else
+            Destroy(&newElts, Allocator(kValueAllocator));
+    }
+
+    return *elts;
 }
 
+inline cValue cValue::PackedElt(uint32_t index) const
+{
+    return mValue.mPacked->Elt(index);
+}
 
 
 /////////////////////////////////////////////////////////////////////////////////////
@@ -79,7 +275,7 @@ cValue::cValue(tValueType type) :
         mValue.mDouble = 0.0;
         break;
     case kValueString:
-        mValue.mString = tStringID(0);
+        mStorage = kStorageInline;
         break;
     case kValueArray:
         mValue.mArray = Create<tArrayValues>(Allocator(kValueAllocator));
@@ -97,7 +293,8 @@ cValue::cValue(tValueType type) :
 }
 
 cValue::cValue(const cValue& other) :
-    mType(other.mType)
+    mType(other.mType),
+    mStorage(other.mStorage)
 {
     switch (mType)
     {
@@ -109,16 +306,16 @@ cValue::cValue(const cValue& other) :
         mValue = other.mValue;
         break;
     case kValueString:
-        if (other.mValue.mString)
-        {
-            mValue.mString = other.mValue.mString;
+        mValue = other.mValue;
+
+        if (mStorage == kStorageDefault && mValue.mString)
             CopyStringID(mValue.mString);
-        }
-        else
-            mValue.mString = tStringID(0);
         break;
     case kValueArray:
-        mValue.mArray = Create<tArrayValues>(Allocator(kValueAllocator), *other.mValue.mArray);
+        if (mStorage == kStoragePacked)
+            mValue.mPacked = other.mValue.mPacked->Clone();
+        else
+            mValue.mArray = Create<tArrayValues>(Allocator(kValueAllocator), *other.mValue.mArray);
         break;
     case kValueObject:
         mValue.mObject = new(Allocator(kValueAllocator)) cObjectValue(*other.mValue.mObject);
@@ -129,17 +326,7 @@ cValue::cValue(const cValue& other) :
     }
 
     if (other.mComments)
-    {
-        mComments = new(Allocator(kValueAllocator)) cCommentInfo[kNumberOfCommentPlacements];
-
-        for (int comment = 0; comment < kNumberOfCommentPlacements; ++comment)
-        {
-            const cCommentInfo& otherComment = other.mComments[comment];
-
-            if (otherComment.mComment)
-                mComments[comment].mComment = CopyStringID(otherComment.mComment);
-        }
-    }
+        mComments = CopyComments(other.mComments);
 }
 
 
@@ -148,7 +335,7 @@ cValue::~cValue()
     MakeNull();
 
     if (mComments)
-        DestroyArray(&mComments, kNumberOfCommentPlacements, Allocator(kValueAllocator));
+        FreeComments(mComments);
 }
 
 void cValue::operator=(const cValue& other)
@@ -159,9 +346,8 @@ void cValue::operator=(const cValue& other)
 
 void cValue::Swap(cValue& other)
 {
-    tValueType temp = mType;
-    mType = other.mType;
-    other.mType = temp;
+    ustl::swap(mType, other.mType);
+    ustl::swap(mStorage, other.mStorage);
     ustl::swap(mValue, other.mValue);
 }
 
@@ -184,23 +370,16 @@ bool cValue::operator < (const cValue& other) const
     case kValueBool:
         return mValue.mBool < other.mValue.mBool;
     case kValueString:
-        return (mValue.mString == 0 && other.mValue.mString)
-            || (other.mValue.mString
-                && mValue.mString
-                && strcasecmp(StringFromStringID(mValue.mString), StringFromStringID(other.mValue.mString)) < 0
-                );
+        return strcasecmp(StringValue(), other.StringValue()) < 0;
     case kValueArray:
         {
-            int delta = int(mValue.mArray->size() - other.mValue.mArray->size());
+            int delta = int(size() - other.size());
 
             if (delta)
                 return delta < 0;
 
-            tArrayValues& m1 = *mValue.mArray;
-            tArrayValues& m2 = *other.mValue.mArray;
-
-            for (int i = 0, n = mValue.mArray->size(); i < n; i++)
-                if (mValue.mArray->at(i) < other.mValue.mArray->at(i))
+            for (int i = 0, n = size(); i < n; i++)
+                if ((*this)[i] < other[i])
                     return true;
 
             return false;
@@ -260,13 +439,32 @@ bool cValue::operator == (const cValue& other) const
     case kValueBool:
         return mValue.mBool == other.mValue.mBool;
     case kValueString:
-        return (mValue.mString == other.mValue.mString)
-            || (other.mValue.mString  
-                && mValue.mString == other.mValue.mString
-               );
+        // Short strings are always inline, and long ones always interned
+        if (mStorage != other.mStorage)
+            return false;
+        if (mStorage == kStorageInline)
+            return memcmp(mValue.mChars, other.mValue.mChars, sizeof(mValue.mChars)) == 0;
+        return mValue.mString == other.mValue.mString;
     case kValueArray:
-        return mValue.mArray->size() == other.mValue.mArray->size()
-            && (*mValue.mArray) == (*other.mValue.mArray);
+        // Compare by element, as vector == compares bytes
+        if (size() != other.size())
+            return false;
+
+        for (uint32_t i = 0, n = size(); i < n; i++)
+        {
+            // Compare packed elements by value, to avoid creating their element caches
+            bool equal;
+
+            if (mStorage == kStoragePacked)
+                equal = other.mStorage == kStoragePacked ? PackedElt(i) == other.PackedElt(i) : PackedElt(i) == other[i];
+            else
+                equal = other.mStorage == kStoragePacked ? (*this)[i] == other.PackedElt(i) : (*this)[i] == other[i];
+
+            if (!equal)
+                return false;
+        }
+
+        return true;
 
     case kValueObject:
         return mValue.mObject->NumMembers() == other.mValue.mObject->NumMembers()
@@ -281,7 +479,7 @@ const char* cValue::AsString(const char* defaultValue) const
     switch (mType)
     {
     case kValueString:
-        return mValue.mString ? StringFromStringID(mValue.mString) : "";
+        return StringValue();
     case kValueBool:
         return mValue.mBool ? "true" : "false";
     default:
@@ -296,6 +494,8 @@ uint32_t cValue::AsID(uint32_t defaultValue) const
     switch (mType)
     {
     case kValueString:
+        if (mStorage == kStorageInline)
+            return mValue.mChars[0] ? NameToID(mValue.mChars) : defaultValue;
         return mValue.mString ? IDFromStringID(mValue.mString) : defaultValue;
     case kValueUInt:
         return mValue.mUint;
@@ -315,6 +515,8 @@ tTag cValue::AsTag(tTag defaultValue) const
     switch (mType)
     {
     case kValueString:
+        if (mStorage == kStorageInline)
+            return mValue.mChars[0] ? TagFromString(mValue.mChars) : defaultValue;
         return mValue.mString ? TagFromStringID(mValue.mString) : defaultValue;
     case kValueUInt:
     #if CL_TAG_DEBUG
@@ -444,9 +646,9 @@ bool cValue::AsBool(bool defaultValue) const
     case kValueBool:
         return mValue.mBool;
     case kValueString:
-        return mValue.mString && mValue.mString[0] != 0;
+        return StringValue()[0] != 0;
     case kValueArray:
-        return !mValue.mArray->empty();
+        return size() != 0;
     case kValueObject:
         return !mValue.mObject->IsNull();
 
@@ -497,14 +699,14 @@ bool cValue::IsConvertibleTo(tValueType other) const
             ||  other == kValueBool;
 
     case kValueString:
-        return (other == kValueNull && (!mValue.mString || mValue.mString[0] == 0))
+        return (other == kValueNull && StringValue()[0] == 0)
             ||  other == kValueString
             ||  other == kValueInt
             ||  other == kValueUInt
             ||  other == kValueDouble;
 
     case kValueArray:
-        return (other == kValueNull && mValue.mArray->size() == 0)
+        return (other == kValueNull && size() == 0)
             ||  other == kValueArray;
 
     case kValueObject:
@@ -516,6 +718,7 @@ bool cValue::IsConvertibleTo(tValueType other) const
 }
 
 
+
 // Array/Object
 
 /// Number of values in array or object
@@ -524,6 +727,8 @@ uint32_t cValue::size() const
     switch (mType)
     {
     case kValueArray:  // size of the array is highest index + 1
+        if (mStorage == kStoragePacked)
+            return mValue.mPacked->mSize;
         return mValue.mArray->size();
 
     case kValueObject:
@@ -543,7 +748,7 @@ bool cValue::empty() const
     case kValueNull:
         return true;
     case kValueArray:
-        return mValue.mArray->empty();
+        return size() == 0;
     case kValueObject:
         return mValue.mObject->IsNull();
     default:
@@ -556,7 +761,7 @@ void cValue::clear()
     switch (mType)
     {
     case kValueArray:
-        mValue.mArray->clear();
+        Unpack()->clear();
         break;
     case kValueObject:
         mValue.mObject->RemoveMembers();
@@ -572,11 +777,13 @@ cValue& cValue::operator[](uint32_t index)
 {
     if (MakeArray())
     {
+        tArrayValues* elts = Unpack();
+
         // TODO: emulating old 'map' semantics.
-        if (index >= mValue.mArray->size())
-            mValue.mArray->resize(index + 1);
+        if (index >= elts->size())
+            elts->resize(index + 1);
 
-        return mValue.mArray->at(index);
+        return elts->at(index);
     }
 
     CL_ERROR("Not an array");
@@ -585,9 +792,12 @@ cValue& cValue::operator[](uint32_t index)
 
 const cValue& cValue::operator[](uint32_t index) const
 {
-    if (mType != kValueArray || index >= mValue.mArray->size())
+    if (mType != kValueArray || index >= size())
         return kNull;
 
+    if (mStorage == kStoragePacked)
+        return mValue.mPacked->Elts()[index];
+
     return mValue.mArray->at(index);
 }
 
@@ -595,17 +805,144 @@ const cValue& cValue::operator[](uint32_t index) const
 void cValue::Append(const cValue& value)
 {
     if (MakeArray())
-        mValue.mArray->push_back(value);
+        Unpack()->push_back(value);
+}
+
+int32_t cValue::EltAsInt(uint32_t index, int32_t defaultValue) const
+{
+    if (mStorage == kStoragePacked && index < mValue.mPacked->mSize)
+        return PackedElt(index).AsInt(defaultValue);
+
+    return (*this)[index].AsInt(defaultValue);
+}
+
+uint32_t cValue::EltAsUInt(uint32_t index, uint32_t defaultValue) const
+{
+    if (mStorage == kStoragePacked && index < mValue.mPacked->mSize)
+        return PackedElt(index).AsUInt(defaultValue);
+
+    return (*this)[index].AsUInt(defaultValue);
+}
+
+float cValue::EltAsFloat(uint32_t index, float defaultValue) const
+{
+    if (mStorage == kStoragePacked && index < mValue.mPacked->mSize)
+        return PackedElt(index).AsFloat(defaultValue);
+
+    return (*this)[index].AsFloat(defaultValue);
+}
+
+void cValue::PackArray()
+{
+    if (mType != kValueArray || mStorage != kStorageDefault || mValue.mArray->empty())
+        return;
+
+    const tArrayValues& elts = *mValue.mArray;
+    uint32_t n = elts.size();
+    uint32_t numInts = 0;
+    uint32_t numUInts = 0;
+
+    for (const cValue& elt : elts)
+    {
+        if (elt.mComments)
+            return;
+
+        if (elt.mType == kValueInt)
+            numInts++;
+        else if (elt.mType == kValueUInt)
+            numUInts++;
+        else if (elt.mType != kValueDouble)
+            return;
+    }
+
+    tValueType eltType;
+
+    if (numInts == n)
+        eltType = kValueInt;
+    else if (numUInts == n)
+        eltType = kValueUInt;
+    else if (numUInts == 0)
+        eltType = kValueDouble;     // doubles, or a mix of doubles and ints, which is common for hand-written values
+    else
+        return;
+
+    bool intMask = eltType == kValueDouble && numInts > 0;
+
+    cPackedArray* packed = cPackedArray::Create(n, eltType, intMask);
+
+    if (eltType == kValueDouble)
+    {
+        double*   data = (double*) packed->Doubles();
+        uint32_t* mask = (uint32_t*) packed->IntMask();
+
+        for (uint32_t i = 0; i < n; i++)
+        {
+            if (elts[i].mType == kValueInt)
+            {
+                data[i] = elts[i].mValue.mInt;
+                mask[i >> 5] |= 1u << (i & 31);
+            }
+            else
+                data[i] = elts[i].mValue.mDouble;
+        }
+    }
+    else
+    {
+        int32_t* data = (int32_t*) packed->Ints();
+
+        for (uint32_t i = 0; i < n; i++)
+            data[i] = elts[i].mValue.mInt;
+    }
+
+    Destroy(&mValue.mArray, Allocator(kValueAllocator));
+
+    mValue.mPacked = packed;
+    mStorage = kStoragePacked;
+}
+
+const void* cValue::PackedArrayData(uint32_t* size, tValueType* eltType, bool* intMask) const
+{
+    if (mType != kValueArray || mStorage != kStoragePacked)
+        return 0;
+
+    *size    = mValue.mPacked->mSize;
+    *eltType = mValue.mPacked->mEltType;
+    *intMask = mValue.mPacked->mIntMask;
+
+    return mValue.mPacked + 1;
+}
+
+void cValue::SetPackedArray(uint32_t size, tValueType eltType, bool intMask, const void* data)
+{
+    CL_ASSERT(eltType == kValueInt || eltType == kValueUInt || eltType == kValueDouble);
+    CL_ASSERT(!intMask || eltType == kValueDouble);
+
+    cPackedArray* packed = cPackedArray::Create(size, eltType, intMask);
+    memcpy(packed + 1, data, PackedArrayDataSize(size, eltType, intMask));
+
+    MakeNull();
+
+    mValue.mPacked = packed;
+    mType = kValueArray;
+    mStorage = kStoragePacked;
+}
+
+size_t cValue::PackedArrayDataSize(uint32_t size, tValueType eltType, bool intMask)
+{
+    return cPackedArray::AllocSize(size, eltType, intMask) - sizeof(cPackedArray);
 }
 
 // Comments
 
 void cValue::SetComment(const char* comment, tCommentPlacement placement)
 {
+    CL_ASSERT(comment);
+    CL_ASSERT_MSG(comment[0]=='\0' || comment[0]=='/', "Comments must start with /");
+
     if (!mComments)
-        mComments = new(Allocator(kValueAllocator)) cCommentInfo[kNumberOfCommentPlacements];
+        mComments = NewComments();
 
-    mComments[placement].SetComment(comment);
+    SetCommentAt(mComments, placement, StringIDFromString(comment));
 }
 
 void cValue::SetComment(const string& comment, tCommentPlacement placement)
@@ -616,39 +953,87 @@ void cValue::SetComment(const string& comment, tCommentPlacement placement)
 
 bool cValue::HasComment(tCommentPlacement placement) const
 {
-    return mComments != 0 && mComments[placement].mComment != 0;
+    return mComments != 0 && CommentAt(mComments, placement) != 0;
 }
 
 const char* cValue::Comment(tCommentPlacement placement) const
 {
     if (HasComment(placement))
-        return StringFromStringID(mComments[placement].mComment);
+        return StringFromStringID(CommentAt(mComments, placement));
 
     return "";
 }
 
+// Diagnostics
+
+size_t cValue::MemoryUsed() const
+{
+    size_t bytes = 0;
+    const tArrayValues* elts = 0;
+
+    switch (mType)
+    {
+    case kValueArray:
+        if (mStorage == kStoragePacked)
+        {
+            const cPackedArray* packed = mValue.mPacked;
+            bytes += cPackedArray::AllocSize(packed->mSize, packed->mEltType, packed->mIntMask);
+            elts = packed->mElts.load(std::memory_order_acquire);
+        }
+        else
+            elts = mValue.mArray;
+
+        if (elts)
+        {
+            bytes += sizeof(tArrayValues) + elts->capacity() * sizeof(cValue);
+
+            for (const cValue& elt : *elts)
+                bytes += elt.MemoryUsed();
+        }
+        break;
+
+    case kValueObject:
+        bytes += sizeof(cObjectValue) + NumMembers() * sizeof(pair<tTag, cValue>);
+
+        for (int i = 0, n = NumMembers(); i < n; i++)
+            bytes += MemberValue(i).MemoryUsed();
+        break;
+
+    default:
+        break;
+    }
+
+    if (mComments)
+        bytes += sizeof(cCommentInfo);
+
+    return bytes;
+}
+
 // Internal
 void cValue::MakeNull()
 {
     switch (mType)
     {
     case kValueString:
-        ReleaseStringID(mValue.mString);
-        mValue.mString = tStringID(0);
+        if (mStorage == kStorageDefault)
+            ReleaseStringID(mValue.mString);
         break;
     case kValueArray:
-        Destroy(&mValue.mArray, Allocator(kValueAllocator));
-        mValue.mArray = 0;
+        if (mStorage == kStoragePacked)
+            cPackedArray::Free(mValue.mPacked);
+        else
+            Destroy(&mValue.mArray, Allocator(kValueAllocator));
         break;
     case kValueObject:
         mValue.mObject->Link(-1);
-        mValue.mObject = 0;
         break;
     default:
         break;
     }
 
+    mValue.mDouble = 0.0;
     mType = kValueNull;
+    mStorage = kStorageDefault;
 }
 
 bool cValue::MakeArray()
@@ -676,11 +1061,64 @@ bool cValue::MakeObject()
     return mType == kValueObject;
 }
 
+void cValue::SetString(const char* s)
+{
+    mType = kValueString;
+
+    size_t length = strlen(s);
+
+    if (length <= kMaxInlineString)
+    {
+        mStorage = kStorageInline;
+        mValue.mDouble = 0.0;   // so inline strings can be compared with memcmp
+        memcpy(mValue.mChars, s, length);
+    }
+    else
+    {
+        mStorage = kStorageDefault;
+        mValue.mString = StringIDFromString(s);
+    }
+}
+
+const char* cValue::StringValue() const
+{
+    if (mStorage == kStorageInline)
+        return mValue.mChars;
+
+    return mValue.mString ? StringFromStringID(mValue.mString) : "";
+}
+
+cValue::tArrayValues* cValue::Unpack()
+{
+    if (mStorage == kStoragePacked)
+    {
+        cPackedArray* packed = mValue.mPacked;
+
+        // Take over the element cache if it exists, so outstanding references stay valid
+        packed->Elts();
+        mValue.mArray = packed->mElts.exchange(0);
+        cPackedArray::Free(packed);
+
+        mStorage = kStorageDefault;
+    }
+
+    return mValue.mArray;
+}
+
 
 // --- cObjectValue ------------------------------------------------------------
 
+std::atomic<uint32_t> cObjectValue::sGeneration(1);
+
+namespace
+{
+    const uint32_t kFlattenAfterLookups = 8;    // most objects are only queried a few times, on load
+}
+
 cObjectValue::~cObjectValue()
 {
+    // Ensure cached lookups don't match a new object at the same address
+    sGeneration.fetch_add(1, std::memory_order_relaxed);
 }
 
 const cValue& cObjectValue::Member(tTag key) const
@@ -694,21 +1132,35 @@ const cValue& cObjectValue::Member(tTag key) const
         tag = TagFromString(key, subKey);
         subKey++;
 
-        return Member(tag).Member(subKey);
+        return TagMember(tag).Member(subKey);
     }
 
-    tag = TagFromString(key);
-    tMap::const_iterator it = mMap.find(tag);
+    return TagMember(TagFromString(key));
 #else
-    tMap::const_iterator it = mMap.find(key);
+    return TagMember(key);
 #endif
+}
+
+const cValue& cObjectValue::TagMember(tTag tag) const
+{
+    if (!mParents.empty() && FlatMembersReady())
+    {
+        auto it = mFlatMembers.mMembers.find(tag);
+
+        if (it != mFlatMembers.mMembers.end())
+            return *it->second;
+
+        return cValue::kNull;
+    }
+
+    tMap::const_iterator it = mMap.find(tag);
 
     if (it != mMap.end())
         return it->second;
 
     for (auto& p : mParents)
     {
-        const cValue& result = p->Member(key);
+        const cValue& result = p->TagMember(tag);
 
         if (&result != &cValue::kNull)
             return result;
@@ -769,7 +1221,7 @@ void cObjectValue::SetMember(tTag key, const cValue& v)
     mMap[key] = v;
 #endif
 
-    mModCount++;
+    IncModCount();
 }
 
 cValue& cObjectValue::InsertMember(tTag key)
@@ -783,21 +1235,31 @@ cValue& cObjectValue::InsertMember(tTag key)
         tag = TagFromString(key, subKey);
         subKey++;
 
+        size_t oldSize = mMap.size();
         cValue& v = mMap[tag];
 
+        if (mMap.size() != oldSize)
+            IncModCount();
+
         if (!v.IsObject())
             v = cValue(kValueObject);
 
         return v.AsObject()->InsertMember(subKey);
     }
-    mModCount++;
 
     tag = TagFromString(key);
-    return mMap[tag];
 #else
-    mModCount++;
-    return mMap[key];
+    tTag tag = key;
 #endif
+
+    // Only a new member invalidates flattened caches and config paths; plain lookups mustn't.
+    size_t oldSize = mMap.size();
+    cValue& v = mMap[tag];
+
+    if (mMap.size() != oldSize)
+        IncModCount();
+
+    return v;
 }
 
 cValue* cObjectValue::ModifyMember(tTag key)
@@ -849,7 +1311,7 @@ bool cObjectValue::RemoveMember(tTag key)
         return false;
 
     mMap.erase(it);
-    mModCount++;
+    IncModCount();
 
     return true;
 }
@@ -962,12 +1424,144 @@ void cObjectValue::Swap(cObjectValue* other)
 
     // Purposefully don't swap owner
 
-    mModCount++;
-    other->mModCount++;
+    IncModCount();
+    other->IncModCount();
+}
+
+namespace
+{
+    void TransferOwnership(cValue* value, const cObjectValue* oldOwner, cObjectValue* newOwner)
+    /// Re-own any objects in 'value' that belong to oldOwner
+    {
+        if (value->Type() == kValueObject)
+        {
+            cObjectValue* object = value->AsObject();
+
+            if (object->Owner() != oldOwner)
+                return;
+
+            object->SetOwner(newOwner);
+
+            for (int i = 0, n = object->NumMembers(); i < n; i++)
+                TransferOwnership(&object->MemberValue(i), oldOwner, newOwner);
+        }
+        else if (value->Type() == kValueArray && !value->IsPackedArray())
+        {
+            for (int i = 0, n = value->size(); i < n; i++)
+                TransferOwnership(&(*value)[i], oldOwner, newOwner);
+        }
+    }
+}
+
+bool cObjectValue::Update(cObjectValue* source)
+{
+    const cObjectValue* sourceOwner = source->mOwner ? source->mOwner : source;
+    cObjectValue*       owner       = mOwner ? mOwner : this;
+
+    return Update(source, sourceOwner, owner);
+}
+
+bool cObjectValue::Update(cObjectValue* source, const cObjectValue* sourceOwner, cObjectValue* owner)
+{
+    CL_ASSERT(source != this);
+
+    bool changed = false;
+
+    for (int i = mMap.size() - 1; i >= 0; i--)
+        if (!source->HasLocalMember(mMap.at(i).first))
+        {
+            mMap.erase(mMap.begin() + i);
+            changed = true;
+        }
+
+    for (int i = 0, n = source->NumMembers(); i < n; i++)
+    {
+        tTag    tag         = source->MemberTag(i);
+        cValue& sourceValue = source->MemberValue(i);
+
+        auto it = mMap.find(tag);
+
+        if (it == mMap.end())
+        {
+            cValue& value = mMap[tag];
+
+            value.Swap(sourceValue);
+            TransferOwnership(&value, sourceOwner, owner);
+            changed = true;
+            continue;
+        }
+
+        cValue& value = it->second;
+
+        if (value.Type() == kValueObject && sourceValue.Type() == kValueObject)
+        {
+            // Keep our object, so anyone holding on to it sees the new contents
+            if (value.AsObject()->Update(sourceValue.AsObject(), sourceOwner, owner))
+                changed = true;
+        }
+        else if (value != sourceValue)
+        {
+            value.Swap(sourceValue);
+            TransferOwnership(&value, sourceOwner, owner);
+            changed = true;
+        }
+    }
+
+    // Parents normally come from imports, which are shared, so compare them by pointer.
+    bool parentsMatch = mParents.size() == source->mParents.size();
+
+    for (int i = 0, n = mParents.size(); parentsMatch && i < n; i++)
+        parentsMatch = mParents[i] == source->mParents[i];
+
+    if (!parentsMatch)
+    {
+        mParents.swap(source->mParents);
+        changed = true;
+    }
+
+    if (changed)
+        IncModCount();
+
+    return changed;
 }
 
 // Internal
 
+bool cObjectValue::FlatMembersReady() const
+{
+    cFlatMembers& flat = mFlatMembers;
+    uint32_t generation = Generation();
+
+    if (flat.mGeneration != generation)
+    {
+        flat.mGeneration = generation;
+        flat.mLookups = 0;
+
+        if (!flat.mMembers.empty())
+            flat.mMembers.clear();
+    }
+
+    if (flat.mLookups > kFlattenAfterLookups)
+        return true;
+
+    if (++flat.mLookups <= kFlattenAfterLookups)
+        return false;
+
+    AddFlatMembers(&flat.mMembers);
+    return true;
+}
+
+void cObjectValue::AddFlatMembers(tag_hash_map<const cValue*>* members) const
+{
+    // Same order as TagMember(): our members first, then each parent's in turn.
+    // insert() leaves existing entries alone, so the first definition found wins.
+    for (const auto& entry : mMap)
+        members->insert(std::make_pair(entry.first, &entry.second));
+
+    for (auto& p : mParents)
+        p->AddFlatMembers(members);
+}
+
 void cObjectValue::AddChildren(tObjectChildren* children) const
 {
     int cursor = 0;
@@ -999,6 +1593,58 @@ void cObjectValue::AddChildren(tObjectChildren* children) const
 
 
 
+// --- cConfigPath -------------------------------------------------------------
+
+void cConfigPath::Resolve() const
+{
+    const char* begin = mPath;
+    mNumTags = 0;
+
+    while (true)
+    {
+        const char* end = strchr(begin, '.');
+
+        if (!end)
+            end = begin + strlen(begin);
+
+        CL_ASSERT_MSG(mNumTags < kMaxTags, "Path %s is too long\n", mPath);
+
+        if (mNumTags < kMaxTags)
+            mTags[mNumTags++] = TagFromString(begin, end);
+
+        if (*end == 0)
+            break;
+
+        begin = end + 1;
+    }
+}
+
+
+// --- cConfigChangeTracker ----------------------------------------------------
+
+bool cConfigChangeTracker::Changed(const cObjectValue* object)
+{
+    if (!object)
+        return false;
+
+    cEntry& entry = mEntries[object];
+    uint32_t modCount = object->ModCount();
+
+    if (entry.mObject && entry.mModCount == modCount)
+        return false;
+
+    entry.mObject = object;
+    entry.mModCount = modCount;
+
+    return true;
+}
+
+void cConfigChangeTracker::Reset()
+{
+    mEntries.clear();
+}
+
+
 // --- Utilities ---------------------------------------------------------------
 
 int nCL::SetFromValue(const cValue& value, nCL::vector<int>* v)
@@ -1296,3 +1942,118 @@ void WriteValue(const cValue& v)
         break;
     }
 }
+
+
+#ifndef CL_RELEASE
+
+#include <CLTimer.h>
+
+#include <stdio.h>
+
+namespace
+{
+    const cValue& WalkMember(const cObjectValue* object, tTag key)
+    /// Uncached lookup: local members, then each parent in turn
+    {
+        const cValue& local = object->LocalMember(key);
+
+        if (&local != &cValue::kNull)
+            return local;
+
+        for (int i = 0, n = object->NumParents(); i < n; i++)
+        {
+            const cValue& result = WalkMember(object->Parent(i), key);
+
+            if (&result != &cValue::kNull)
+                return result;
+        }
+
+        return cValue::kNull;
+    }
+}
+
+void nCL::BenchConfigLookup()
+{
+    const int kNumMembers = 32;
+    const int kNumLookups = 200000;
+
+    static char sNames[kNumMembers][16];
+
+    printf("Depth   Walk (ns)  Member (ns)  TagMember (ns)  cConfigPath (ns)\n");
+
+    for (int depth : { 1, 4, 16 })
+    {
+        // objects[0] is the root ancestor, and the only one defining the member we look up
+        vector<cValue> objects(depth);
+
+        for (int d = 0; d < depth; d++)
+        {
+            cObjectValue* object = objects[d].AsObject();
+
+            for (int i = 0; i < kNumMembers; i++)
+            {
+                char name[16];
+                snprintf(name, sizeof(name), "m%d_%d", d, i);
+                object->SetMember(TagFromString(name), cValue(i));
+            }
+
+            if (d > 0)
+                object->AddParent(objects[d - 1].AsObject());
+        }
+
+        const cObjectValue* leaf = objects[depth - 1].AsObject();
+
+        tTag tags[kNumMembers];
+        vector<cConfigPath> paths;
+
+        for (int i = 0; i < kNumMembers; i++)
+        {
+            snprintf(sNames[i], sizeof(sNames[i]), "m0_%d", i);
+            tags[i] = TagFromString(sNames[i]);
+            paths.push_back(cConfigPath(sNames[i]));
+        }
+
+        bool success = true;
+
+        for (int i = 0; i < kNumMembers; i++)
+        {
+            const cValue* expected = &WalkMember(leaf, sNames[i]);
+
+            for (int r = 0; r < 16; r++)   // get past the flattening threshold
+                if (&leaf->Member(sNames[i]) != expected || &leaf->TagMember(tags[i]) != expected || &paths[i].Find(leaf) != expected)
+                    success = false;
+        }
+
+        int sum = 0;
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int i = 0; i < kNumLookups; i++)
+            sum += WalkMember(leaf, sNames[i % kNumMembers]).AsInt();
+
+        uint64_t t1 = AbsoluteTicks();
+
+        for (int i = 0; i < kNumLookups; i++)
+            sum += leaf->Member(sNames[i % kNumMembers]).AsInt();
+
+        uint64_t t2 = AbsoluteTicks();
+
+        for (int i = 0; i < kNumLookups; i++)
+            sum += leaf->TagMember(tags[i % kNumMembers]).AsInt();
+
+        uint64_t t3 = AbsoluteTicks();
+
+        for (int i = 0; i < kNumLookups; i++)
+            sum += paths[i % kNumMembers].Find(leaf).AsInt();
+
+        uint64_t t4 = AbsoluteTicks();
+
+        double scale = 1.0 / kNumLookups;
+
+        printf("%5d  %10.1f  %11.1f  %14.1f  %16.1f%s\n", depth, (t1 - t0) * scale, (t2 - t1) * scale, (t3 - t2) * scale, (t4 - t3) * scale, success ? "" : "  FAILED");
+
+        if (sum == 0x7fffffff)  // keep the lookups from being optimised away
+            printf("\n");
+    }
+}
+
+#endif
@@ -0,0 +1,514 @@
+//
+//  File:       CLValueData.cpp
+//
+//  Function:   Binary form of cValue trees, for fast loading of config data
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <CLValueData.h>
+
+#include <CLData.h>
+#include <CLFileSpec.h>
+#include <CLHashMap.h>
+#include <CLMemory.h>
+
+#include <stddef.h>
+#include <stdio.h>
+
+using namespace nCL;
+
+const char* const nCL::kValueDataExtension = "bin";
+
+namespace
+{
+    const uint32_t kValueDataMagic   = 0x42564C43;   // 'CLVB' when read as little-endian, so byte-swapped data is rejected
+    const uint16_t kValueDataVersion = 1;
+
+    enum tValueDataFlags : uint8_t
+    {
+        kValueDataPacked  = 0x01,   ///< Array data is in packed form, see cValue::PackedArrayData()
+        kValueDataIntMask = 0x02    ///< Packed doubles are followed by an int mask
+    };
+
+    struct cValueData
+    /// A single value. Strings, arrays and objects refer to their contents via mData.
+    {
+        tValueType  mType;
+        uint8_t     mFlags;
+        tValueType  mEltType;       ///< Packed array element type
+        uint8_t     mPad;
+        uint32_t    mCount;         ///< Number of array elements or object members
+
+        union
+        {
+            bool        mBool;
+            int32_t     mInt;
+            uint32_t    mUInt;
+            double      mDouble;
+            tDataOffset mData;
+        };
+    };
+
+    struct cMemberData
+    {
+        uint32_t    mTag;           ///< Index into cValueDataHeader::mTags
+        uint32_t    mPad;
+        cValueData  mValue;
+    };
+
+    struct cValueDataHeader
+    {
+        uint32_t    mMagic;
+        uint16_t    mVersion;
+        uint16_t    mValueSize;     ///< sizeof(cValueData), to catch layout changes
+        uint32_t    mSize;          ///< Total size of the data, including this header
+        tDataOffset mRoot;          ///< cValueData for the top-level value
+
+        cDataArray<tDataOffset> mTags;  ///< Tag names
+    };
+
+    class cValueDataWriter
+    {
+    public:
+        void Write(const cValue& value, vector<uint8_t>* data);
+
+    protected:
+        void     WriteValue(const cValue& value, tDataOffset valueOffset);
+        uint32_t TagIndex(tTag tag);
+
+        cValueData* ValueData(tDataOffset offset) { return (cValueData*) mStore.Data(offset); }
+
+        struct cStore : public cWriteableDataStore
+        {
+            vector<uint8_t>& Bytes() { return mData; }
+        };
+
+        cStore                      mStore;
+        tag_hash_map<uint32_t>      mTagIndices;
+        vector<tDataOffset>         mTagNames;
+        string_hash_map<tDataOffset> mStrings;  ///< Strings written so far, as config data often repeats them
+    };
+
+    void cValueDataWriter::Write(const cValue& value, vector<uint8_t>* data)
+    {
+        tDataOffset headerOffset = mStore.Allocate(sizeof(cValueDataHeader), alignof(cValueDataHeader));
+        tDataOffset rootOffset   = mStore.Allocate(sizeof(cValueData), alignof(cValueData));
+
+        WriteValue(value, rootOffset);
+
+        // Note: the store may move on allocation, so we fill in the header last
+        cDataArray<tDataOffset> tags;
+        tags.Set(&mStore, mTagNames);
+
+        cValueDataHeader* header = (cValueDataHeader*) mStore.Data(headerOffset);
+
+        header->mMagic     = kValueDataMagic;
+        header->mVersion   = kValueDataVersion;
+        header->mValueSize = sizeof(cValueData);
+        header->mSize      = mStore.Bytes().size();
+        header->mRoot      = rootOffset;
+        header->mTags      = tags;
+
+        data->swap(mStore.Bytes());
+    }
+
+    void cValueDataWriter::WriteValue(const cValue& value, tDataOffset valueOffset)
+    {
+        cValueData vd = { value.Type() };
+
+        switch (vd.mType)
+        {
+        case kValueNull:
+            break;
+        case kValueBool:
+            vd.mBool = value.AsBool();
+            break;
+        case kValueInt:
+            vd.mInt = value.AsInt();
+            break;
+        case kValueUInt:
+            vd.mUInt = value.AsUInt();
+            break;
+        case kValueDouble:
+            vd.mDouble = value.AsDouble();
+            break;
+
+        case kValueString:
+            {
+                const char* s = value.AsString();
+                auto it = mStrings.find(s);
+
+                if (it != mStrings.end())
+                    vd.mData = it->second;
+                else
+                {
+                    vd.mData = AddCStr(s, &mStore);
+                    mStrings[s] = vd.mData;
+                }
+            }
+            break;
+
+        case kValueArray:
+            {
+                bool intMask;
+                const void* packedData = value.PackedArrayData(&vd.mCount, &vd.mEltType, &intMask);
+
+                if (packedData)
+                {
+                    size_t dataSize = cValue::PackedArrayDataSize(vd.mCount, vd.mEltType, intMask);
+
+                    vd.mFlags = kValueDataPacked | (intMask ? kValueDataIntMask : 0);
+                    vd.mData  = mStore.Allocate(dataSize, alignof(double));
+                    memcpy(mStore.Data(vd.mData), packedData, dataSize);
+                    break;
+                }
+
+                vd.mCount = value.NumElts();
+
+                if (vd.mCount == 0)
+                    break;
+
+                vd.mData = mStore.Allocate(vd.mCount * sizeof(cValueData), alignof(cValueData));
+
+                for (uint32_t i = 0; i < vd.mCount; i++)
+                    WriteValue(value.Elt(i), vd.mData + i * sizeof(cValueData));
+            }
+            break;
+
+        case kValueObject:
+            {
+                vd.mCount = value.NumMembers();
+
+                if (vd.mCount == 0)
+                    break;
+
+                vd.mData = mStore.Allocate(vd.mCount * sizeof(cMemberData), alignof(cMemberData));
+
+                for (uint32_t i = 0; i < vd.mCount; i++)
+                {
+                    tDataOffset memberOffset = vd.mData + i * sizeof(cMemberData);
+                    uint32_t tagIndex = TagIndex(value.MemberTag(i));
+
+                    ((cMemberData*) mStore.Data(memberOffset))->mTag = tagIndex;
+
+                    WriteValue(value.MemberValue(i), memberOffset + offsetof(cMemberData, mValue));
+                }
+            }
+            break;
+        }
+
+        *ValueData(valueOffset) = vd;
+    }
+
+    uint32_t cValueDataWriter::TagIndex(tTag tag)
+    {
+        auto it = mTagIndices.find(tag);
+
+        if (it != mTagIndices.end())
+            return it->second;
+
+        uint32_t index = mTagNames.size();
+
+        mTagIndices[tag] = index;
+        mTagNames.push_back(AddCStr(StringFromTag(tag), &mStore));
+
+        return index;
+    }
+
+
+    class cValueDataReader
+    {
+    public:
+        cValueDataReader(const uint8_t* data) : mStore(data) {}
+
+        bool Read(size_t size, cValue* value);
+
+    protected:
+        void ReadValue (const cValueData& vd, cValue* value);
+        void ReadObject(const cValueData& vd, cValue* value);
+
+        const cReadOnlyDataStore mStore;
+        vector<tTag>        mTags;
+        cValue*             mRoot = 0;
+    };
+
+    bool cValueDataReader::Read(size_t size, cValue* value)
+    {
+        const cValueDataHeader* header = (const cValueDataHeader*) mStore.Data(0);
+
+        if (size < sizeof(cValueDataHeader)
+         || header->mMagic     != kValueDataMagic
+         || header->mVersion   != kValueDataVersion
+         || header->mValueSize != sizeof(cValueData)
+         || header->mSize      != size
+        )
+            return false;
+
+        // Tags are interned once up front, so members are then just an index lookup
+        int numTags = header->mTags.NumElts();
+        const tDataOffset* tagNames = header->mTags.Elts(&mStore);
+
+        mTags.resize(numTags);
+
+        for (int i = 0; i < numTags; i++)
+            mTags[i] = TagFromString(AsCStr(tagNames[i], &mStore));
+
+        mRoot = value;
+        ReadValue(As<cValueData>(header->mRoot, &mStore), value);
+
+        return true;
+    }
+
+    void cValueDataReader::ReadValue(const cValueData& vd, cValue* value)
+    {
+        switch (vd.mType)
+        {
+        case kValueBool:
+            *value = vd.mBool;
+            break;
+        case kValueInt:
+            *value = vd.mInt;
+            break;
+        case kValueUInt:
+            *value = vd.mUInt;
+            break;
+        case kValueDouble:
+            *value = vd.mDouble;
+            break;
+        case kValueString:
+            *value = AsCStr(vd.mData, &mStore);
+            break;
+
+        case kValueArray:
+            if (vd.mFlags & kValueDataPacked)
+                value->SetPackedArray(vd.mCount, vd.mEltType, (vd.mFlags & kValueDataIntMask) != 0, mStore.Data(vd.mData));
+            else
+            {
+                *value = cValue(kValueArray);
+
+                if (vd.mCount == 0)
+                    break;
+
+                value->resize(vd.mCount);
+
+                const cValueData* elts = &As<cValueData>(vd.mData, &mStore);
+
+                for (uint32_t i = 0; i < vd.mCount; i++)
+                    ReadValue(elts[i], &(*value)[i]);
+            }
+            break;
+
+        case kValueObject:
+            ReadObject(vd, value);
+            break;
+
+        default:
+            value->MakeNull();
+        }
+    }
+
+    void cValueDataReader::ReadObject(const cValueData& vd, cValue* value)
+    /// Mirrors cJSONReader::ReadObject(), so existing objects are kept
+    {
+        cObjectValue* object;
+        cObjectValue savedChildren;
+
+        if (value->Type() == kValueObject)
+        {
+            object = value->AsObject();
+            object->Swap(&savedChildren);
+            object->RemoveParents();
+        }
+        else
+        {
+            value->MakeNull();
+            value->MakeObject();
+
+            object = value->AsObject();
+        }
+
+        if (value != mRoot)
+            object->SetOwner(mRoot->AsObject());
+
+        const cMemberData* members = vd.mCount ? &As<cMemberData>(vd.mData, &mStore) : 0;
+
+        for (uint32_t i = 0; i < vd.mCount; i++)
+        {
+            tTag tag = mTags[members[i].mTag];
+
+            cValue* member = &object->InsertMember(tag);
+            cValue* oldValue = savedChildren.ModifyMember(tag);
+
+            if (oldValue)
+            {
+                cObjectValue* oldObjectValue = oldValue->AsObject();
+
+                if (oldObjectValue)
+                    *member = oldObjectValue;
+            }
+
+            ReadValue(members[i].mValue, member);
+        }
+
+        object->IncModCount();
+    }
+
+    bool sValueDataFilesEnabled = true;
+}
+
+bool nCL::WriteValueData(const cValue& value, vector<uint8_t>* data)
+{
+    cValueDataWriter writer;
+    writer.Write(value, data);
+
+    return true;
+}
+
+bool nCL::WriteValueDataFile(const cValue& value, const cFileSpec& spec)
+{
+    vector<uint8_t> data;
+
+    if (!WriteValueData(value, &data))
+        return false;
+
+    FILE* file = spec.FOpen("wb");
+
+    if (!file)
+        return false;
+
+    bool success = fwrite(data.data(), 1, data.size(), file) == data.size();
+
+    fclose(file);
+
+    return success;
+}
+
+bool nCL::ReadValueData(size_t size, const uint8_t* data, cValue* value)
+{
+    cValueDataReader reader(data);
+
+    return reader.Read(size, value);
+}
+
+bool nCL::ReadValueDataFile(const cFileSpec& spec, cValue* value)
+{
+    cMappedFileInfo mapInfo = MapFile(spec.Path());
+
+    if (!mapInfo.mData)
+        return false;
+
+    bool success = ReadValueData(mapInfo.mSize, mapInfo.mData, value);
+
+    UnmapFile(mapInfo);
+
+    return success;
+}
+
+bool nCL::FindValueDataFile(const cFileSpec& jsonSpec, cFileSpec* dataSpec)
+{
+    *dataSpec = jsonSpec;
+    dataSpec->AddExtension(kValueDataExtension);
+
+    if (!dataSpec->IsReadable())
+        return false;
+
+    // If only the binary form has been shipped, use it
+    return !jsonSpec.Exists() || dataSpec->TimeStamp() >= jsonSpec.TimeStamp();
+}
+
+void nCL::SetValueDataFilesEnabled(bool enabled)
+{
+    sValueDataFilesEnabled = enabled;
+}
+
+bool nCL::ValueDataFilesEnabled()
+{
+    return sValueDataFilesEnabled;
+}
+
+
+#ifndef CL_RELEASE
+
+#include <CLJSON.h>
+#include <CLTimer.h>
+
+void nCL::BenchValueDataRead(const cFileSpec& jsonSpec)
+{
+    bool wasEnabled = ValueDataFilesEnabled();
+    SetValueDataFilesEnabled(false);
+
+    cValue jsonValue;
+
+    if (!ReadFromJSONFile(jsonSpec, &jsonValue))
+    {
+        printf("Couldn't read %s\n", jsonSpec.Path());
+        SetValueDataFilesEnabled(wasEnabled);
+        return;
+    }
+
+    // Use the existing binary form if present, so we're measuring what ships
+    cFileSpec dataSpec;
+
+    if (!FindValueDataFile(jsonSpec, &dataSpec))
+    {
+        dataSpec = jsonSpec;
+        dataSpec.AddExtension(kValueDataExtension);
+
+        WriteValueDataFile(jsonValue, dataSpec);
+    }
+
+    cValue dataValue;
+
+    if (!ReadValueDataFile(dataSpec, &dataValue))
+    {
+        printf("Couldn't read %s\n", dataSpec.Path());
+        SetValueDataFilesEnabled(wasEnabled);
+        return;
+    }
+
+    // Compare via the text form, as that covers types, member order, and packing
+    string jsonText, dataText;
+    cJSONWriter writer;
+
+    writer.Write(jsonValue, &jsonText);
+    writer.Write(dataValue, &dataText);
+
+    cMappedFileInfo jsonInfo = MapFile(jsonSpec.Path());
+    cMappedFileInfo dataInfo = MapFile(dataSpec.Path());
+
+    printf("%s: json %d bytes, binary %d bytes, results %s\n", jsonSpec.Path(), int(jsonInfo.mSize), int(dataInfo.mSize), jsonText == dataText ? "match" : "DIFFER");
+
+    UnmapFile(jsonInfo);
+    UnmapFile(dataInfo);
+
+    // Time the whole load, including mapping the file, as that's what startup sees
+    const int kRounds = 200;
+
+    printf("Format  Load (us)\n");
+
+    for (int binary = 0; binary < 2; binary++)
+    {
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int r = 0; r < kRounds; r++)
+        {
+            cValue value;
+
+            if (binary)
+                ReadValueDataFile(dataSpec, &value);
+            else
+                ReadFromJSONFile(jsonSpec, &value);
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        printf("%-6s  %9.2f\n", binary ? "binary" : "json", (t1 - t0) * 1e-3 / kRounds);
+    }
+
+    SetValueDataFilesEnabled(wasEnabled);
+}
+
+#endif
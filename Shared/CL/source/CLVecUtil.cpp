@@ -8,6 +8,39 @@
 
 #include <CLVecUtil.h>
 
+using namespace nCL;
+
+namespace
+{
+    const int kBatchSamples = 32;   ///< Number of candidate points generated at once by the batch routines
+
+    template<class T_ACCEPT> void RejectionSample(int count, bool signedSamples, Vec3f values[], tSeed32* seed, T_ACCEPT accept)
+    /// Generates candidate points kBatchSamples at a time, and passes them to accept(candidate, &result)
+    /// until 'count' are accepted. The seed is left just after the last accepted candidate, as per the
+    /// single-sample versions.
+    {
+        float c[3 * kBatchSamples];
+        int i = 0;
+
+        while (i < count)
+        {
+            tSeed32 batchSeed = *seed;
+
+            if (signedSamples)
+                RandomSFloat(3 * kBatchSamples, c, seed);
+            else
+                RandomUFloat(3 * kBatchSamples, c, seed);
+
+            for (int j = 0; j < kBatchSamples; j++)
+                if (accept(Vec3f(c[3 * j + 0], c[3 * j + 1], c[3 * j + 2]), values + i) && ++i == count)
+                {
+                    *seed = SkipSeed(batchSeed, 3 * (j + 1));
+                    return;
+                }
+        }
+    }
+}
+
 bool nCL::Refract
 (
     float         fromIndex, 
@@ -362,6 +395,89 @@ Vec3f nCL::RandomEllipsoid(const cBounds3& bounds, tSeed32* seed)
     }
 }
 
+void nCL::RandomRange(int count, const cBounds3& bounds, Vec3f values[], tSeed32* seed)
+{
+    Vec3f d = bounds.mMax - bounds.mMin;
+    float u[3 * kBatchSamples];
+
+    for (int i = 0; i < count; i += kBatchSamples)
+    {
+        int n = count - i < kBatchSamples ? count - i : kBatchSamples;
+
+        RandomUFloat(3 * n, u, seed);
+
+        for (int j = 0; j < n; j++)
+        {
+            values[i + j][0] = bounds.mMin[0] + d[0] * u[3 * j + 0];
+            values[i + j][1] = bounds.mMin[1] + d[1] * u[3 * j + 1];
+            values[i + j][2] = bounds.mMin[2] + d[2] * u[3 * j + 2];
+        }
+    }
+}
+
+void nCL::RandomSphere3f(int count, Vec3f values[], tSeed32* seed)
+{
+    RejectionSample(count, true, values, seed,
+        [](const Vec3f& v, Vec3f* result)
+        {
+            *result = v;
+            return sqrlen(v) <= 1.0f;
+        }
+    );
+}
+
+void nCL::RandomEllipsoid(int count, const cBounds3& bounds, Vec3f values[], tSeed32* seed)
+{
+    Vec3f c = bounds.Centre();
+    Vec3f d = bounds.mMax - bounds.mMin;
+    Vec3f r = c - bounds.mMin;
+    Vec3f r2 = r * r;
+
+    Vec3f invR2 =
+    {
+        r2[0] > 0.0f ? 1.0f / r2[0] : 0.0f,
+        r2[1] > 0.0f ? 1.0f / r2[1] : 0.0f,
+        r2[2] > 0.0f ? 1.0f / r2[2] : 0.0f
+    };
+
+    RejectionSample(count, false, values, seed,
+        [&](const Vec3f& u, Vec3f* result)
+        {
+            Vec3f p = bounds.mMin + d * u;
+            Vec3f v = (p - c);
+
+            *result = p;
+            return dot((v * v), invR2) <= 1;
+        }
+    );
+}
+
+void nCL::RandomTorus(int count, const cBounds3& bounds, float r, Vec3f values[], tSeed32* seed)
+{
+    RejectionSample(count, true, values, seed,
+        [&](const Vec3f& v, Vec3f* result)
+        {
+            float len2xy = sqrlen(v.AsVec2());
+
+            if (len2xy < 1e-8f)
+                return false;
+
+            float len2z  = sqr(v[2]);
+            float r1 = sqrtf(len2xy);
+
+            if (len2z + len2xy > r1)
+                return false;
+
+            float r1Dash = r + (1.0f - r) / r1;
+
+            Vec3f p(v[0] * r1Dash, v[1] * r1Dash, v[2] * r);
+
+            *result = bounds.MapFromLocal(0.5f * (p + vl_1));
+            return true;
+        }
+    );
+}
+
 Vec3f nCL::RandomTorus(const cBounds3& bounds, float r, tSeed32* seed)
 /// Returns samples from within the given torus, ring, or line.
 {
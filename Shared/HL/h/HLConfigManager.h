@@ -62,7 +62,8 @@ namespace nHL
         cObjectValue* ConfigFileForPath      (const nCL::cFileSpec& configPath, bool watchConfig = true);
         bool          ReloadConfigFileForPath(const nCL::cFileSpec& configPath);
 
-        bool ReadConfig(const nCL::cFileSpec& configPath, cObjectValue* config);
+        bool ReadConfig(const nCL::cFileSpec& configPath, cObjectValue* config, bool* changed = 0);
+        ///< Reads the given file and updates 'config' from it in place. 'changed' is set to whether anything differed.
 
         void ApplyImports(cObjectValue* config);
         bool ApplyImport(const cValue& import, const nCL::cFileSpec& configSpec, cObjectValue* config);
@@ -113,8 +113,7 @@ namespace nHL
         // cEffectParticles
         int NumParticles() const;     ///< Returns the number of particles currently alive.
 
-        uint32_t mRenderHash  = 0;  ///< Hash of render state for sorting
-        uint32_t mRenderOrder = 0;  ///< Ordering control for sorting
+        float    mDepth = 0.0f;     ///< Squared distance from camera, if mDesc->mDepth, for sorting
 
     protected:
         friend class ::cEffectTypeParticles;
@@ -136,6 +135,7 @@ namespace nHL
         const cDescParticles*   mDesc = 0;
         cEffectTypeParticles*   mTypeManager = 0;
         uint32_t                mParamsModCount = 0;
+        nCL::tSeed32            mSeed = nCL::kDefaultSeed32;   ///< This instance's random stream, set up by the type on creation
 
         nCL::cBounds3           mBounds;        //!< Particles bounding box in world space, used for culling etc.
 
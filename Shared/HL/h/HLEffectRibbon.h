@@ -69,8 +69,6 @@ namespace nHL
 
         void Update(float dt, const cEffectParams* params);
 
-        uint32_t mRenderHash  = 0;  ///< Hash of render state for sorting
-        uint32_t mRenderOrder = 0;  ///< Ordering control for sorting
 
     //protected:
         friend class ::cEffectTypeRibbon;
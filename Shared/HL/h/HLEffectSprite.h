@@ -92,9 +92,9 @@ namespace nHL
         const cDescSprite*      mDesc = 0;
         cEffectTypeSprites*     mTypeManager = 0;
         uint32_t                mParamsModCount = 0;
+        nCL::tSeed32            mSeed = nCL::kDefaultSeed32;   ///< This instance's random stream, set up by the type on creation
 
-        uint32_t mRenderHash  = 0;  ///< Hash of render state for sorting
-        uint32_t mRenderOrder = 0;  ///< Ordering control for sorting
+        float    mDepth = 0.0f;     ///< Squared distance from camera, if mDesc->mDepth, for sorting
 
         Vec3f   mPosition = vl_0;   ///< Position
         Vec3f   mVelocity = vl_0;   ///< Velocity
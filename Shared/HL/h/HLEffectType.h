@@ -13,6 +13,7 @@
 
 #include <IHLEffectsManager.h>
 
+#include <CLHashMap.h>
 #include <CLMemory.h>
 #include <CLParams.h>
 #include <CLSlotArray.h>
@@ -73,6 +74,8 @@ namespace nHL
         virtual bool IsActive     (tEIRef ref) const = 0;
         virtual bool Update       (tEIRef ref, float dt, const cEffectParams* params) = 0;
 
+        virtual bool ParallelUpdate() const = 0;    ///< Returns true if Update() only touches per-instance state, and so can be called concurrently on different instances.
+
         virtual const char* StatsString(const char* typeName) const = 0;    ///< Return stats about this effect type or 0 if none
         virtual void DebugMenu(cUIState* uiState) = 0;      ///< Display debug menu
     };
@@ -97,6 +100,8 @@ namespace nHL
         void PreUpdate (float realDT, float gameDT) override;
         void PostUpdate(float realDT, float gameDT) override;
 
+        bool ParallelUpdate() const override;
+
         // cEffectType
         cIEffectsManager*   Manager() const;
         cIRenderer*         Renderer() const;
@@ -104,7 +109,7 @@ namespace nHL
 
     protected:
         // Data decls
-        typedef nCL::map<tTag, int> tTagToIndexMap;
+        typedef nCL::tag_hash_map<int> tTagToIndexMap;
 
         // Data
         cIEffectsManager*           mManager = 0;
@@ -150,11 +155,17 @@ namespace nHL
 
         // cEffectType
         void RemoveAllInstances();
+    #ifndef CL_RELEASE
+        void BenchInstances();  ///< Logs create/destroy churn timings for heap vs. pooled instances
+    #endif
 
     protected:
         // Data
         nCL::vector<T_DESC>         mDescs;
         nCL::vector<cLink<T_EFFECT>> mEffects;
+
+        nCL::cPoolAllocator<T_EFFECT> mInstancePool;
+        bool                        mPoolInstances = false;    ///< Allocate instances from mInstancePool rather than mAllocator. Set via 'poolInstances' in config.
     };
 
     // Alternate implementation of an effect type that stores instances by value
@@ -218,6 +229,11 @@ namespace nHL
         return mData.clear();
     }
 
+    inline bool cEffectTypeBase::ParallelUpdate() const
+    {
+        return false;
+    }
+
     inline cIEffectsManager* cEffectTypeBase::Manager() const
     {
         return mManager;
@@ -15,10 +15,12 @@
 
 #include <HLEffectType.h>
 
+#include <CLDispatch.h>
 #include <CLLink.h>
 #include <CLMemory.h>
 #include <CLParams.h>
 #include <CLRandom.h>
+#include <CLValue.h>
 
 namespace nHL
 {
@@ -121,6 +123,11 @@ namespace nHL
         // Data decls
         typedef nCL::map<tTag, cLink<cIPhysicsController>> tTagToControllerMap;
 
+        // Utils
+        void UpdateInstancesSerial  (float realDT, float gameDT);
+        void UpdateInstancesParallel(float realDT, float gameDT);
+        bool UseParallelUpdate() const;     ///< Returns true if parallel update is enabled and possible
+
         // Data
         cIAllocator*                mAllocator;
 
@@ -135,10 +142,18 @@ namespace nHL
         cLink<cIEffectType>         mEffectTypes   [kMaxEffectTypes];
         tTag                        mEffectTypeTags[kMaxEffectTypes] = { 0 };
         tTag                        mEffectSetTags [kMaxEffectTypes] = { 0 };
+        nCL::cConfigChangeTracker   mEffectSetConfigs;  ///< So reloads only reconfigure types whose effects were edited
 
         // Extras
         tTagToControllerMap         mPhysicsControllers;
 
+        // Parallel update
+        bool                        mParallelUpdate = false;
+        nCL::vector<int>            mTypeBatches[kMaxEffectTypes];   ///< Per-type lists of instances to be updated in parallel
+        nCL::vector<int>            mUpdateBatch;           ///< mTypeBatches concatenated, so instances of the same type are updated together
+        nCL::vector<int>            mDeferredDestroys;      ///< Finished one-shot instances, destroyed after the parallel update
+        int                         mThreadUpdates[nCL::kMaxJobThreads] = { 0 };
+
         // Debug/Info
         bool mEnabled = true;
         bool mShowStats = false;
@@ -0,0 +1,446 @@
+//
+//  File:       HLGLShim.h
+//
+//  Function:   Swappable table for the GL calls HL makes, with a recording
+//              implementation for running the renderer without a GPU.
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2014
+//
+
+#ifndef HL_GL_SHIM_H
+#define HL_GL_SHIM_H
+
+#include <GLConfig.h>
+#include <CLSTL.h>
+#include <CLString.h>
+
+// Only active when HL_GL_SHIM is defined, in which case GLConfig.h pulls this
+// in, and all the gl* calls below are redirected through nHL::gGL. Otherwise
+// GL is called directly as normal, and none of this is compiled. Debug builds
+// define it via Config/Debug.xcconfig.
+//
+// HL_GL_NO_DRIVER leaves out the table that calls the real GL, so the recorder
+// is the only backend, and no GL library is needed at link time.
+
+#ifdef HL_GL_SHIM
+
+// Each entry is F(return type, name, parameters, arguments, call kind).
+
+#define HL_GL_FUNCTIONS_RECORDED(F) \
+    F(void, ActiveTexture,              (GLenum texture), (texture), kGLCallTexture) \
+    F(void, AttachShader,               (GLuint program, GLuint shader), (program, shader), kGLCallResource) \
+    F(void, BindAttribLocation,         (GLuint program, GLuint index, const GLchar* name), (program, index, name), kGLCallResource) \
+    F(void, BindBuffer,                 (GLenum target, GLuint buffer), (target, buffer), kGLCallBuffer) \
+    F(void, BindFramebuffer,            (GLenum target, GLuint framebuffer), (target, framebuffer), kGLCallTarget) \
+    F(void, BindRenderbuffer,           (GLenum target, GLuint renderbuffer), (target, renderbuffer), kGLCallTarget) \
+    F(void, BindTexture,                (GLenum target, GLuint texture), (target, texture), kGLCallTexture) \
+    F(void, BindVertexArray,            (GLuint array), (array), kGLCallBuffer) \
+    F(void, BlendColor,                 (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha), kGLCallState) \
+    F(void, BlendEquation,              (GLenum mode), (mode), kGLCallState) \
+    F(void, BlendEquationSeparate,      (GLenum modeRGB, GLenum modeAlpha), (modeRGB, modeAlpha), kGLCallState) \
+    F(void, BlendFunc,                  (GLenum sfactor, GLenum dfactor), (sfactor, dfactor), kGLCallState) \
+    F(void, BlendFuncSeparate,          (GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha), (srcRGB, dstRGB, srcAlpha, dstAlpha), kGLCallState) \
+    F(void, BufferData,                 (GLenum target, GLsizeiptr size, const void* data, GLenum usage), (target, size, data, usage), kGLCallUpload) \
+    F(void, BufferSubData,              (GLenum target, GLintptr offset, GLsizeiptr size, const void* data), (target, offset, size, data), kGLCallUpload) \
+    F(void, Clear,                      (GLbitfield mask), (mask), kGLCallClear) \
+    F(void, ClearColor,                 (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha), (red, green, blue, alpha), kGLCallState) \
+    F(void, ClearStencil,               (GLint s), (s), kGLCallState) \
+    F(void, ColorMask,                  (GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha), (red, green, blue, alpha), kGLCallState) \
+    F(void, CompileShader,              (GLuint shader), (shader), kGLCallResource) \
+    F(void, CompressedTexImage2D,       (GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data), (target, level, internalformat, width, height, border, imageSize, data), kGLCallUpload) \
+    F(void, CullFace,                   (GLenum mode), (mode), kGLCallState) \
+    F(void, DeleteBuffers,              (GLsizei n, const GLuint* buffers), (n, buffers), kGLCallResource) \
+    F(void, DeleteFramebuffers,         (GLsizei n, const GLuint* framebuffers), (n, framebuffers), kGLCallResource) \
+    F(void, DeleteProgram,              (GLuint program), (program), kGLCallResource) \
+    F(void, DeleteRenderbuffers,        (GLsizei n, const GLuint* renderbuffers), (n, renderbuffers), kGLCallResource) \
+    F(void, DeleteShader,               (GLuint shader), (shader), kGLCallResource) \
+    F(void, DeleteTextures,             (GLsizei n, const GLuint* textures), (n, textures), kGLCallResource) \
+    F(void, DeleteVertexArrays,         (GLsizei n, const GLuint* arrays), (n, arrays), kGLCallResource) \
+    F(void, DepthFunc,                  (GLenum func), (func), kGLCallState) \
+    F(void, DepthMask,                  (GLboolean flag), (flag), kGLCallState) \
+    F(void, DetachShader,               (GLuint program, GLuint shader), (program, shader), kGLCallResource) \
+    F(void, Disable,                    (GLenum cap), (cap), kGLCallState) \
+    F(void, DisableVertexAttribArray,   (GLuint index), (index), kGLCallBuffer) \
+    F(void, DrawArrays,                 (GLenum mode, GLint first, GLsizei count), (mode, first, count), kGLCallDraw) \
+    F(void, DrawElements,               (GLenum mode, GLsizei count, GLenum type, const void* indices), (mode, count, type, indices), kGLCallDraw) \
+    F(void, Enable,                     (GLenum cap), (cap), kGLCallState) \
+    F(void, EnableVertexAttribArray,    (GLuint index), (index), kGLCallBuffer) \
+    F(void, FramebufferRenderbuffer,    (GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer), (target, attachment, renderbuffertarget, renderbuffer), kGLCallResource) \
+    F(void, FramebufferTexture2D,       (GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level), (target, attachment, textarget, texture, level), kGLCallResource) \
+    F(void, FrontFace,                  (GLenum mode), (mode), kGLCallState) \
+    F(void, GenerateMipmap,             (GLenum target), (target), kGLCallResource) \
+    F(void, LineWidth,                  (GLfloat width), (width), kGLCallState) \
+    F(void, PixelStorei,                (GLenum pname, GLint param), (pname, param), kGLCallState) \
+    F(void, PolygonOffset,              (GLfloat factor, GLfloat units), (factor, units), kGLCallState) \
+    F(void, RenderbufferStorage,        (GLenum target, GLenum internalformat, GLsizei width, GLsizei height), (target, internalformat, width, height), kGLCallResource) \
+    F(void, SampleCoverage,             (GLfloat value, GLboolean invert), (value, invert), kGLCallState) \
+    F(void, Scissor,                    (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), kGLCallState) \
+    F(void, StencilFunc,                (GLenum func, GLint ref, GLuint mask), (func, ref, mask), kGLCallState) \
+    F(void, StencilFuncSeparate,        (GLenum face, GLenum func, GLint ref, GLuint mask), (face, func, ref, mask), kGLCallState) \
+    F(void, StencilMask,                (GLuint mask), (mask), kGLCallState) \
+    F(void, StencilMaskSeparate,        (GLenum face, GLuint mask), (face, mask), kGLCallState) \
+    F(void, StencilOp,                  (GLenum fail, GLenum zfail, GLenum zpass), (fail, zfail, zpass), kGLCallState) \
+    F(void, StencilOpSeparate,          (GLenum face, GLenum fail, GLenum zfail, GLenum zpass), (face, fail, zfail, zpass), kGLCallState) \
+    F(void, TexImage2D,                 (GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const void* pixels), (target, level, internalformat, width, height, border, format, type, pixels), kGLCallUpload) \
+    F(void, TexParameterf,              (GLenum target, GLenum pname, GLfloat param), (target, pname, param), kGLCallTexture) \
+    F(void, TexParameteri,              (GLenum target, GLenum pname, GLint param), (target, pname, param), kGLCallTexture) \
+    F(void, TexSubImage2D,              (GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const void* pixels), (target, level, xoffset, yoffset, width, height, format, type, pixels), kGLCallUpload) \
+    F(void, Uniform1i,                  (GLint location, GLint x), (location, x), kGLCallUniform) \
+    F(void, Uniform1fv,                 (GLint location, GLsizei count, const GLfloat* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform2fv,                 (GLint location, GLsizei count, const GLfloat* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform3fv,                 (GLint location, GLsizei count, const GLfloat* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform4fv,                 (GLint location, GLsizei count, const GLfloat* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform1iv,                 (GLint location, GLsizei count, const GLint* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform2iv,                 (GLint location, GLsizei count, const GLint* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform3iv,                 (GLint location, GLsizei count, const GLint* v), (location, count, v), kGLCallUniform) \
+    F(void, Uniform4iv,                 (GLint location, GLsizei count, const GLint* v), (location, count, v), kGLCallUniform) \
+    F(void, UniformMatrix2fv,           (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), kGLCallUniform) \
+    F(void, UniformMatrix3fv,           (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), kGLCallUniform) \
+    F(void, UniformMatrix4fv,           (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value), (location, count, transpose, value), kGLCallUniform) \
+    F(void, UseProgram,                 (GLuint program), (program), kGLCallProgram) \
+    F(void, ValidateProgram,            (GLuint program), (program), kGLCallResource) \
+    F(void, VertexAttribPointer,        (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer), (index, size, type, normalized, stride, pointer), kGLCallBuffer) \
+    F(void, Viewport,                   (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height), kGLCallState)
+
+// These return values, or have side effects the recorder must emulate, so are written by hand.
+#define HL_GL_FUNCTIONS_EMULATED(F) \
+    F(GLenum,   CheckFramebufferStatus, (GLenum target), (target), kGLCallQuery) \
+    F(GLuint,   CreateProgram,          (), (), kGLCallResource) \
+    F(GLuint,   CreateShader,           (GLenum type), (type), kGLCallResource) \
+    F(void,     GenBuffers,             (GLsizei n, GLuint* buffers), (n, buffers), kGLCallResource) \
+    F(void,     GenFramebuffers,        (GLsizei n, GLuint* framebuffers), (n, framebuffers), kGLCallResource) \
+    F(void,     GenRenderbuffers,       (GLsizei n, GLuint* renderbuffers), (n, renderbuffers), kGLCallResource) \
+    F(void,     GenTextures,            (GLsizei n, GLuint* textures), (n, textures), kGLCallResource) \
+    F(void,     GenVertexArrays,        (GLsizei n, GLuint* arrays), (n, arrays), kGLCallResource) \
+    F(void,     GetActiveAttrib,        (GLuint program, GLuint index, GLsizei bufsize, GLsizei* length, GLint* size, GLenum* type, GLchar* name), (program, index, bufsize, length, size, type, name), kGLCallQuery) \
+    F(void,     GetActiveUniform,       (GLuint program, GLuint index, GLsizei bufsize, GLsizei* length, GLint* size, GLenum* type, GLchar* name), (program, index, bufsize, length, size, type, name), kGLCallQuery) \
+    F(void,     GetAttachedShaders,     (GLuint program, GLsizei maxcount, GLsizei* count, GLuint* shaders), (program, maxcount, count, shaders), kGLCallQuery) \
+    F(GLenum,   GetError,               (), (), kGLCallQuery) \
+    F(void,     GetIntegerv,            (GLenum pname, GLint* params), (pname, params), kGLCallQuery) \
+    F(void,     GetProgramInfoLog,      (GLuint program, GLsizei bufsize, GLsizei* length, GLchar* infolog), (program, bufsize, length, infolog), kGLCallQuery) \
+    F(void,     GetProgramiv,           (GLuint program, GLenum pname, GLint* params), (program, pname, params), kGLCallQuery) \
+    F(void,     GetShaderInfoLog,       (GLuint shader, GLsizei bufsize, GLsizei* length, GLchar* infolog), (shader, bufsize, length, infolog), kGLCallQuery) \
+    F(void,     GetShaderiv,            (GLuint shader, GLenum pname, GLint* params), (shader, pname, params), kGLCallQuery) \
+    F(const GLubyte*, GetString,        (GLenum name), (name), kGLCallQuery) \
+    F(GLint,    GetUniformLocation,     (GLuint program, const GLchar* name), (program, name), kGLCallQuery) \
+    F(void,     GetUniformiv,           (GLuint program, GLint location, GLint* params), (program, location, params), kGLCallQuery) \
+    F(void,     GetVertexAttribiv,      (GLuint index, GLenum pname, GLint* params), (index, pname, params), kGLCallQuery) \
+    F(void,     LinkProgram,            (GLuint program), (program), kGLCallResource) \
+    F(void*,    MapBuffer,              (GLenum target, GLenum access), (target, access), kGLCallUpload) \
+    F(void,     ReadPixels,             (GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels), (x, y, width, height, format, type, pixels), kGLCallQuery) \
+    F(void,     ShaderSource,           (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length), (shader, count, (const GLchar**) string, length), kGLCallResource) \
+    F(GLboolean, UnmapBuffer,           (GLenum target), (target), kGLCallUpload)
+
+// Platform-dependent entry points, present under the same conditions the calling code uses.
+
+#ifndef CL_GLES
+    #define HL_GL_FUNCTIONS_DESKTOP(F) \
+        F(void, BlitFramebuffer,        (GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter), (srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter), kGLCallDraw) \
+        F(void, DrawRangeElements,      (GLenum mode, GLuint start, GLuint end, GLsizei count, GLenum type, const void* indices), (mode, start, end, count, type, indices), kGLCallDraw) \
+        F(void, PolygonMode,            (GLenum face, GLenum mode), (face, mode), kGLCallState)
+#else
+    #define HL_GL_FUNCTIONS_DESKTOP(F)
+#endif
+
+#if GL_EXT_discard_framebuffer
+    #define HL_GL_FUNCTIONS_DISCARD(F) \
+        F(void, DiscardFramebufferEXT,  (GLenum target, GLsizei numAttachments, const GLenum* attachments), (target, numAttachments, attachments), kGLCallTarget)
+#else
+    #define HL_GL_FUNCTIONS_DISCARD(F)
+#endif
+
+#if GL_APPLE_framebuffer_multisample
+    #define HL_GL_FUNCTIONS_RESOLVE(F) \
+        F(void, ResolveMultisampleFramebufferAPPLE, (), (), kGLCallDraw)
+#else
+    #define HL_GL_FUNCTIONS_RESOLVE(F)
+#endif
+
+#if GL_EXT_debug_label
+    #define HL_GL_FUNCTIONS_LABEL(F) \
+        F(void, LabelObjectEXT,         (GLenum type, GLuint object, GLsizei length, const GLchar* label), (type, object, length, label), kGLCallMarker) \
+        F(void, InsertEventMarkerEXT,   (GLsizei length, const GLchar* marker), (length, marker), kGLCallMarker) \
+        F(void, PushGroupMarkerEXT,     (GLsizei length, const GLchar* marker), (length, marker), kGLCallMarker) \
+        F(void, PopGroupMarkerEXT,      (), (), kGLCallMarker)
+#else
+    #define HL_GL_FUNCTIONS_LABEL(F)
+#endif
+
+#ifdef CL_GL_INSTANCING
+    #define HL_GL_FUNCTIONS_INSTANCING(F) \
+        F(void, DrawElementsInstanced,  (GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instancecount), (mode, count, type, indices, instancecount), kGLCallDraw) \
+        F(void, VertexAttribDivisor,    (GLuint index, GLuint divisor), (index, divisor), kGLCallBuffer)
+#else
+    #define HL_GL_FUNCTIONS_INSTANCING(F)
+#endif
+
+#if GL_EXT_map_buffer_range
+    #define HL_GL_FUNCTIONS_MAP_RANGE(F) \
+        F(void*, MapBufferRange,        (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access), (target, offset, length, access), kGLCallUpload)
+#else
+    #define HL_GL_FUNCTIONS_MAP_RANGE(F)
+#endif
+
+#define HL_GL_FUNCTIONS_OPTIONAL(F) \
+    HL_GL_FUNCTIONS_DESKTOP(F)      \
+    HL_GL_FUNCTIONS_INSTANCING(F)   \
+    HL_GL_FUNCTIONS_DISCARD(F)      \
+    HL_GL_FUNCTIONS_RESOLVE(F)      \
+    HL_GL_FUNCTIONS_LABEL(F)
+
+#define HL_GL_FUNCTIONS(F)          \
+    HL_GL_FUNCTIONS_RECORDED(F)     \
+    HL_GL_FUNCTIONS_OPTIONAL(F)     \
+    HL_GL_FUNCTIONS_EMULATED(F)     \
+    HL_GL_FUNCTIONS_MAP_RANGE(F)
+
+
+namespace nHL
+{
+    enum tGLCallKind : uint8_t
+    {
+        kGLCallState,       ///< Fixed-function state: blending, depth, stencil, viewport etc.
+        kGLCallDraw,
+        kGLCallClear,
+        kGLCallProgram,     ///< glUseProgram
+        kGLCallTexture,     ///< Texture unit/binding/parameter changes
+        kGLCallBuffer,      ///< Vertex array, buffer and attribute binding
+        kGLCallTarget,      ///< Frame/render buffer binding
+        kGLCallUniform,
+        kGLCallUpload,      ///< Buffer and texture data, including buffer mapping
+        kGLCallResource,    ///< Object creation/deletion, shader compilation, etc.
+        kGLCallQuery,       ///< glGet* and friends, which may stall a real driver
+        kGLCallMarker,      ///< Debug labels and markers
+        kMaxGLCallKinds
+    };
+
+    enum tGLFunction : uint16_t
+    {
+    #define HL_GL_ENUM(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) kGLFn##M_NAME,
+        HL_GL_FUNCTIONS(HL_GL_ENUM)
+    #undef HL_GL_ENUM
+        kMaxGLFunctions
+    };
+
+    struct cGLShim
+    /// Table of GL entry points. All gl* calls from HL go through gGL.
+    {
+    #define HL_GL_MEMBER(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) M_RET (*M_NAME) M_PARAMS;
+        HL_GL_FUNCTIONS(HL_GL_MEMBER)
+    #undef HL_GL_MEMBER
+    };
+
+    extern const cGLShim* gGL;          ///< Current GL implementation
+
+    const cGLShim* GLShimDriver();      ///< Returns table that calls the real GL, or 0 if built with HL_GL_NO_DRIVER.
+    void SetGLShim(const cGLShim* shim);
+
+    const char* GLFunctionName(tGLFunction f);
+    tGLCallKind GLFunctionKind(tGLFunction f);
+
+    struct cGLCounters
+    {
+        int     mCalls = 0;             ///< All GL calls
+        int     mCallsOfKind[kMaxGLCallKinds] = { 0 };
+
+        int     mDraws = 0;             ///< Draw calls, including blits and resolves
+        int     mDrawElements = 0;      ///< Vertices or indices submitted by draws
+        int     mStateChanges = 0;      ///< All calls that change state rather than draw, create or query
+
+        size_t  mUniformBytes = 0;
+        size_t  mBufferBytes  = 0;      ///< Uploaded via glBufferData/glBufferSubData, or written to mapped buffers
+        size_t  mTextureBytes = 0;      ///< Uploaded via glTexImage2D etc.
+    };
+
+    struct cGLCommand
+    {
+        tGLFunction mFunction;
+        uint8_t     mNumArgs;
+        uint32_t    mFirstArg;          ///< Index of first argument in cGLRecorder's argument list
+        uint32_t    mDataOffset;        ///< Captured data, e.g., uniform values. Indexes cGLRecorder's data list.
+        uint32_t    mDataSize;
+    };
+
+    struct cGLRecorderInternal;
+
+    class cGLRecorder
+    /// GL implementation that does no rendering, but logs every call and keeps
+    /// per-frame counters. Emulates enough GL that HL can load shaders (uniforms
+    /// and attributes are parsed from the GLSL), create resources and map buffers.
+    /// In pass-through mode, calls are logged and then forwarded to the previous
+    /// implementation instead, for capturing frames from a running renderer.
+    {
+    public:
+        cGLRecorder();
+        ~cGLRecorder();
+
+        void Begin();               ///< Routes GL calls to this recorder.
+        void End();                 ///< Restores the GL implementation that was current on Begin().
+
+        void BeginFrame();          ///< Clears the command log and frame counters.
+        void EndFrame();            ///< Adds frame counters to totals.
+
+        void SetRecordCommands(bool enabled);   ///< If false, only counters are kept, for lower overhead when benchmarking. Defaults to true.
+        void SetPassThrough(bool enabled);      ///< If true, calls are forwarded to the implementation that was current on Begin() rather than emulated. Set before Begin(). Defaults to false.
+
+        const cGLCounters& FrameCounters() const;
+        const cGLCounters& TotalCounters() const;
+        int                NumFrames() const;
+
+        // Command log for the current frame
+        int                 NumCommands() const;
+        const cGLCommand&   Command(int i) const;
+        uint64_t            CommandArg(int i, int arg) const;       ///< Raw argument. Floats are stored as their bit pattern, pointers as addresses.
+        const uint8_t*      CommandData(int i, size_t* size) const; ///< Returns data captured with command, or 0 if none.
+
+        void DescribeCommand (int i, nCL::string* description) const;   ///< Appends e.g. "BindBuffer(0x8892, 3)"
+        void DescribeCounters(const cGLCounters& counters, nCL::string* description) const;
+
+    protected:
+        cGLRecorderInternal* mInternal = 0;
+    };
+
+#ifndef CL_RELEASE
+    bool TestGLRecorder();
+    ///< Loads a shader and draws through the recorder, and checks the resulting log and counters. Returns false on failure.
+#endif
+}
+
+
+// Redirect GL calls through the current table
+#ifndef HL_GL_SHIM_IMPL
+
+#undef glBindVertexArray
+#undef glGenVertexArrays
+#undef glDeleteVertexArrays
+#undef glGenerateMipmap
+#undef glMapBuffer
+#undef glUnmapBuffer
+#undef glMapBufferRange
+#undef glDiscardFramebuffer
+#undef glVertexAttribDivisor
+#undef glDrawElementsInstanced
+
+#define glActiveTexture                         (nHL::gGL->ActiveTexture)
+#define glAttachShader                          (nHL::gGL->AttachShader)
+#define glBindAttribLocation                    (nHL::gGL->BindAttribLocation)
+#define glBindBuffer                            (nHL::gGL->BindBuffer)
+#define glBindFramebuffer                       (nHL::gGL->BindFramebuffer)
+#define glBindRenderbuffer                      (nHL::gGL->BindRenderbuffer)
+#define glBindTexture                           (nHL::gGL->BindTexture)
+#define glBindVertexArray                       (nHL::gGL->BindVertexArray)
+#define glBlendColor                            (nHL::gGL->BlendColor)
+#define glBlendEquation                         (nHL::gGL->BlendEquation)
+#define glBlendEquationSeparate                 (nHL::gGL->BlendEquationSeparate)
+#define glBlendFunc                             (nHL::gGL->BlendFunc)
+#define glBlendFuncSeparate                     (nHL::gGL->BlendFuncSeparate)
+#define glBufferData                            (nHL::gGL->BufferData)
+#define glBufferSubData                         (nHL::gGL->BufferSubData)
+#define glClear                                 (nHL::gGL->Clear)
+#define glClearColor                            (nHL::gGL->ClearColor)
+#define glClearStencil                          (nHL::gGL->ClearStencil)
+#define glColorMask                             (nHL::gGL->ColorMask)
+#define glCompileShader                         (nHL::gGL->CompileShader)
+#define glCompressedTexImage2D                  (nHL::gGL->CompressedTexImage2D)
+#define glCullFace                              (nHL::gGL->CullFace)
+#define glDeleteBuffers                         (nHL::gGL->DeleteBuffers)
+#define glDeleteFramebuffers                    (nHL::gGL->DeleteFramebuffers)
+#define glDeleteProgram                         (nHL::gGL->DeleteProgram)
+#define glDeleteRenderbuffers                   (nHL::gGL->DeleteRenderbuffers)
+#define glDeleteShader                          (nHL::gGL->DeleteShader)
+#define glDeleteTextures                        (nHL::gGL->DeleteTextures)
+#define glDeleteVertexArrays                    (nHL::gGL->DeleteVertexArrays)
+#define glDepthFunc                             (nHL::gGL->DepthFunc)
+#define glDepthMask                             (nHL::gGL->DepthMask)
+#define glDetachShader                          (nHL::gGL->DetachShader)
+#define glDisable                               (nHL::gGL->Disable)
+#define glDisableVertexAttribArray              (nHL::gGL->DisableVertexAttribArray)
+#define glDrawArrays                            (nHL::gGL->DrawArrays)
+#define glDrawElements                          (nHL::gGL->DrawElements)
+#define glEnable                                (nHL::gGL->Enable)
+#define glEnableVertexAttribArray               (nHL::gGL->EnableVertexAttribArray)
+#define glFramebufferRenderbuffer               (nHL::gGL->FramebufferRenderbuffer)
+#define glFramebufferTexture2D                  (nHL::gGL->FramebufferTexture2D)
+#define glFrontFace                             (nHL::gGL->FrontFace)
+#define glGenerateMipmap                        (nHL::gGL->GenerateMipmap)
+#define glLineWidth                             (nHL::gGL->LineWidth)
+#define glPixelStorei                           (nHL::gGL->PixelStorei)
+#define glPolygonOffset                         (nHL::gGL->PolygonOffset)
+#define glRenderbufferStorage                   (nHL::gGL->RenderbufferStorage)
+#define glSampleCoverage                        (nHL::gGL->SampleCoverage)
+#define glScissor                               (nHL::gGL->Scissor)
+#define glStencilFunc                           (nHL::gGL->StencilFunc)
+#define glStencilFuncSeparate                   (nHL::gGL->StencilFuncSeparate)
+#define glStencilMask                           (nHL::gGL->StencilMask)
+#define glStencilMaskSeparate                   (nHL::gGL->StencilMaskSeparate)
+#define glStencilOp                             (nHL::gGL->StencilOp)
+#define glStencilOpSeparate                     (nHL::gGL->StencilOpSeparate)
+#define glTexImage2D                            (nHL::gGL->TexImage2D)
+#define glTexParameterf                         (nHL::gGL->TexParameterf)
+#define glTexParameteri                         (nHL::gGL->TexParameteri)
+#define glTexSubImage2D                         (nHL::gGL->TexSubImage2D)
+#define glUniform1i                             (nHL::gGL->Uniform1i)
+#define glUniform1fv                            (nHL::gGL->Uniform1fv)
+#define glUniform2fv                            (nHL::gGL->Uniform2fv)
+#define glUniform3fv                            (nHL::gGL->Uniform3fv)
+#define glUniform4fv                            (nHL::gGL->Uniform4fv)
+#define glUniform1iv                            (nHL::gGL->Uniform1iv)
+#define glUniform2iv                            (nHL::gGL->Uniform2iv)
+#define glUniform3iv                            (nHL::gGL->Uniform3iv)
+#define glUniform4iv                            (nHL::gGL->Uniform4iv)
+#define glUniformMatrix2fv                      (nHL::gGL->UniformMatrix2fv)
+#define glUniformMatrix3fv                      (nHL::gGL->UniformMatrix3fv)
+#define glUniformMatrix4fv                      (nHL::gGL->UniformMatrix4fv)
+#define glUseProgram                            (nHL::gGL->UseProgram)
+#define glValidateProgram                       (nHL::gGL->ValidateProgram)
+#define glVertexAttribPointer                   (nHL::gGL->VertexAttribPointer)
+#define glViewport                              (nHL::gGL->Viewport)
+
+#define glBlitFramebuffer                       (nHL::gGL->BlitFramebuffer)
+#define glDrawRangeElements                     (nHL::gGL->DrawRangeElements)
+#define glPolygonMode                           (nHL::gGL->PolygonMode)
+#define glDrawElementsInstanced                 (nHL::gGL->DrawElementsInstanced)
+#define glVertexAttribDivisor                   (nHL::gGL->VertexAttribDivisor)
+#define glDiscardFramebufferEXT                 (nHL::gGL->DiscardFramebufferEXT)
+#define glDiscardFramebuffer                    (nHL::gGL->DiscardFramebufferEXT)
+#define glResolveMultisampleFramebufferAPPLE    (nHL::gGL->ResolveMultisampleFramebufferAPPLE)
+#define glLabelObjectEXT                        (nHL::gGL->LabelObjectEXT)
+#define glInsertEventMarkerEXT                  (nHL::gGL->InsertEventMarkerEXT)
+#define glPushGroupMarkerEXT                    (nHL::gGL->PushGroupMarkerEXT)
+#define glPopGroupMarkerEXT                     (nHL::gGL->PopGroupMarkerEXT)
+
+#define glCheckFramebufferStatus                (nHL::gGL->CheckFramebufferStatus)
+#define glCreateProgram                         (nHL::gGL->CreateProgram)
+#define glCreateShader                          (nHL::gGL->CreateShader)
+#define glGenBuffers                            (nHL::gGL->GenBuffers)
+#define glGenFramebuffers                       (nHL::gGL->GenFramebuffers)
+#define glGenRenderbuffers                      (nHL::gGL->GenRenderbuffers)
+#define glGenTextures                           (nHL::gGL->GenTextures)
+#define glGenVertexArrays                       (nHL::gGL->GenVertexArrays)
+#define glGetActiveAttrib                       (nHL::gGL->GetActiveAttrib)
+#define glGetActiveUniform                      (nHL::gGL->GetActiveUniform)
+#define glGetAttachedShaders                    (nHL::gGL->GetAttachedShaders)
+#define glGetError                              (nHL::gGL->GetError)
+#define glGetIntegerv                           (nHL::gGL->GetIntegerv)
+#define glGetProgramInfoLog                     (nHL::gGL->GetProgramInfoLog)
+#define glGetProgramiv                          (nHL::gGL->GetProgramiv)
+#define glGetShaderInfoLog                      (nHL::gGL->GetShaderInfoLog)
+#define glGetShaderiv                           (nHL::gGL->GetShaderiv)
+#define glGetString                             (nHL::gGL->GetString)
+#define glGetUniformLocation                    (nHL::gGL->GetUniformLocation)
+#define glGetUniformiv                          (nHL::gGL->GetUniformiv)
+#define glGetVertexAttribiv                     (nHL::gGL->GetVertexAttribiv)
+#define glLinkProgram                           (nHL::gGL->LinkProgram)
+#define glMapBuffer                             (nHL::gGL->MapBuffer)
+#define glMapBufferRange                        (nHL::gGL->MapBufferRange)
+#define glReadPixels                            (nHL::gGL->ReadPixels)
+#define glShaderSource                          (nHL::gGL->ShaderSource)
+#define glUnmapBuffer                           (nHL::gGL->UnmapBuffer)
+
+#endif
+
+#endif
+
+#endif
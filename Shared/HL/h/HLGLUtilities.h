@@ -78,6 +78,10 @@ namespace nHL
     // Meshes
     bool LoadMesh    (cGLMeshInfo* info, const char* modelName, const char* textureName);
     void DispatchMesh(const cGLMeshInfo* meshInfo);
+#ifdef CL_GL_INSTANCING
+    void DispatchMeshInstances(const cGLMeshInfo* meshInfo, GLuint instanceBuffer, int firstInstance, int count);
+    ///< Draw instances of the mesh, with per-instance cDrawInstance data taken from the given buffer
+#endif
     void DestroyMesh (cGLMeshInfo* meshInfo);
 
     void DestroyMesh(GLuint meshName);  // Destroys given mesh (VA) and all its included VBs
@@ -15,11 +15,13 @@
 #include <IHLRenderer.h>
 #include <HLGLUtilities.h>
 
+#include <CLHashMap.h>
 #include <CLLink.h>
 #include <CLMemory.h>
 #include <CLSlotArray.h>
 #include <CLSTL.h>
 #include <CLTransform.h>
+#include <CLValue.h>
 #include <CLVecUtil.h>
 
 namespace nCL
@@ -52,9 +54,19 @@ namespace nHL
     };
     typedef uint32_t tMIFlagSet;
 
+    struct cInstanceGroup
+    /// Visible instances of one model, drawn with a single instanced draw
+    {
+        int mModel;         ///< Index into mModels
+        int mMaterial;      ///< Instanced variant of the model's material
+        int mFirst;         ///< First instance in the renderer's instance buffer
+        int mCount;
+    };
+
     class cModelManager :
         public cIModelManager,
         public cIRenderLayer,
+        public cIDrawSource,
         public nCL::cAllocLinkable
     {
     public:
@@ -90,18 +102,38 @@ namespace nHL
 
         cIRenderLayer* AsLayer() override;
 
+    #ifndef CL_RELEASE
+        void DebugMenu(cUIState* uiState) override;
+    #endif
+
         // cIRenderLayer
         void Dispatch(cIRenderer* renderer, const cRenderLayerState& state) override;
-        ///< Draw all models according to state
+        ///< Submit all visible models to the renderer's draw queue
+
+        // cIDrawSource
+        void Draw(cIRenderer* renderer, uint32_t item) override;
 
         // cModelManager
+    #ifndef CL_RELEASE
+        void BenchInstances();  ///< Logs create/destroy churn timings for 100k instances
+    #ifdef HL_GL_SHIM
+        void BenchDispatch(cIRenderer* renderer, int numInstances);  ///< Logs draw calls and dispatch time for a scene of 'numInstances' instances of the loaded models, with and without instancing. GL calls go to a recorder rather than the driver.
+    #endif
+    #endif
+
     protected:
+        void ReserveInstances(int count);
+
+        void ModelToWorld(int instance, Mat4f* modelToWorld) const;
+        void SubmitInstanceGroups(cIRenderer* renderer);    ///< Group mVisibleInstances by model, and submit one draw per group
+
         // Data definitions
-        typedef nCL::map<tTag, int> tTagToIndexMap;
+        typedef nCL::tag_hash_map<int> tTagToIndexMap;
 
         // Data
         tTagToIndexMap              mModelTagToIndex;
         nCL::vector<cModel>         mModels;
+        nCL::cConfigChangeTracker   mModelConfigs;      ///< So reloads only reprocess edited models
 
         nCL::cSlotArray             mInstanceSlots;
         nCL::vector<cTransform>     mInstanceTransforms;
@@ -109,6 +141,15 @@ namespace nHL
         nCL::vector<int>            mInstanceModelIndex;
 
         cTransform                  mNullTransform;
+
+        // Dispatch
+        bool                        mInstancing = true;         ///< Draw models whose material has an instanced variant with one draw per model
+        bool                        mCulling = true;            ///< Skip instances outside the main camera's frustum
+        nCL::vector<int>            mModelInstancedMaterial;    ///< Per model, instanced material, or 0 to draw instances individually
+        nCL::vector<int>            mModelInstanceCounts;       ///< Per model, visible instance count, then fill cursor
+        nCL::vector<int>            mVisibleInstances;          ///< Visible instances to draw instanced
+        nCL::vector<cDrawInstance>  mDrawInstances;
+        nCL::vector<cInstanceGroup> mInstanceGroups;
     };
 
 
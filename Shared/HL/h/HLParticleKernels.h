@@ -0,0 +1,112 @@
+//
+//  File:       HLParticleKernels.h
+//
+//  Function:   SIMD versions of the HLParticleUtils processing routines
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#ifndef HL_PARTICLE_KERNELS_H
+#define HL_PARTICLE_KERNELS_H
+
+#include <HLParticleUtils.h>
+
+namespace nHL
+{
+    struct cParticleKernels
+    /// Each kernel processes as many whole SIMD-width blocks of 'count' as it
+    /// can, and returns the number of particles handled. The caller finishes
+    /// off the remainder with the scalar version. Input strides must be either
+    /// zero or the element size, and outputs are always dense.
+    {
+        int (*mApplyRotations)
+        (
+            int count,
+            const Vec3f a0s[], const Vec3f a1s[], size_t aStride,
+            const float rotations[], size_t rotationStride,
+            Vec3f a0sOut[], Vec3f a1sOut[]
+        );
+
+        int (*mApplyScalesAndAspects)
+        (
+            int count,
+            const Vec3f a0s[], const Vec3f a1s[], size_t aStride,
+            const float scales[], size_t scaleStride,
+            const float aspects[], size_t aspectStride,
+            Vec3f a0sOut[], Vec3f a1sOut[]
+        );
+
+        int (*mApplyVelocityStretch)
+        (
+            float psVelocityStretch, const cTransform& effectToWorld,
+            int count,
+            const Vec3f velocities[], size_t velocityStride,
+            const Vec3f a0s[], const Vec3f a1s[], size_t aStride,
+            Vec3f a0Out[], Vec3f a1Out[]
+        );
+
+        int (*mFindTiles)
+        (
+            const cParticleTileInfo& psi,
+            int count,
+            const uint8_t startFrames[], size_t startFrameStride,
+            const tPtAge ages[],
+            cParticleTile tiles[]
+        );
+
+        int (*mFindTilePairs)
+        (
+            const cParticleTileInfo& psi,
+            int count,
+            const uint8_t startFrames[], size_t startFrameStride,
+            const tPtAge ages[],
+            cParticleTilePair tiles[]
+        );
+
+        int (*mWriteQuads)
+        (
+            int count,
+            const Vec3f positions[], size_t positionStride,
+            const Vec3f d0s[], const Vec3f d1s[], size_t dStride,
+            const Vec3f colours[], size_t colourStride,
+            const float alphas[], size_t alphaStride,
+            const cParticleTile tiles[], Vec2f tw,     ///< 'tiles' may be 0
+            cQuadVertex* vertices
+        );
+
+        int (*mUpdatePhysicsSimple)
+        (
+            const cParticlesPhysicsDesc& desc,
+            int count,
+            const float dts[], size_t dtStride,
+            Vec3f positions[],
+            Vec3f velocities[]
+        );
+
+        int (*mUpdateAges)
+        (
+            tPtAge da,
+            int count,
+            const tPtAge ages[],
+            const tPtAge ageSteps[],
+            tPtAge agesOut[]
+        );
+    };
+
+    const cParticleKernels* ParticleKernels();                      ///< Returns the currently selected kernels, or 0 if scalar code should be used.
+    const cParticleKernels* ParticleKernels(tParticleSIMD simd);    ///< Returns kernels for the given SIMD type, or 0 if not supported.
+
+    bool IsDenseOrUniform(size_t stride, size_t elementSize);       ///< Returns true if stride is suitable as an input to the kernels
+
+
+    // --- Inlines -------------------------------------------------------------
+
+    inline bool IsDenseOrUniform(size_t stride, size_t elementSize)
+    {
+        return stride == 0 || stride == elementSize;
+    }
+}
+
+#endif
@@ -329,6 +329,7 @@ namespace nHL
         const cTransform&   cameraToEffect,
 
         const cDispatchScale* dispatchScale,
+        bool                parallel,
 
         int                 particlesCount,
         const tPtAge        ages[],
@@ -343,6 +344,43 @@ namespace nHL
         const uint8_t       frames    [] = 0, size_t frameStride    = 0
     );
     ///< Standard dispatch of coloured particles, as per the supplied cParticlesDispatchDesc.
+    ///< If 'parallel' is set, quad generation is spread across the job threads.
+
+    struct cQuadVertex;
+
+    int WriteParticleQuads
+    (
+        int                 maxQuads,
+        cQuadVertex         quads[],
+        int*                particlesUsed,
+
+        const cParticlesDispatchDesc& desc,
+        const cTransform&   sourceToEffect,
+        const cTransform&   effectToWorld,
+        const cTransform&   cameraToEffect,
+
+        const cDispatchScale* dispatchScale,
+        bool                parallel,
+
+        int                 particlesCount,
+        const tPtAge        ages[],
+        const tPtAge        ageSteps  [],     size_t ageStride,
+        const Vec3f         positions [],     size_t positionStride,
+        const Vec3f         velocities[],     size_t velocityStride,
+        const Vec3f         colours   [] = 0, size_t colourStride   = 0,
+        const float         alphas    [] = 0, size_t alphaStride    = 0,
+        const float         sizes     [] = 0, size_t sizeStride     = 0,
+        const float         rotations [] = 0, size_t rotationStride = 0,
+        const float         aspects   [] = 0, size_t aspectStride   = 0,
+        const uint8_t       frames    [] = 0, size_t frameStride    = 0
+    );
+    ///< Does the work of DispatchParticles() into the given buffer. Writes quads for up to
+    ///< 'maxQuads' live particles, and returns the number written. The number of input
+    ///< particles consumed is returned in 'particlesUsed'. Work is split into fixed-size
+    ///< chunks of input particles, each written to its own range of 'quads', so the
+    ///< result is the same whether or not 'parallel' is set.
+
+    bool TestParticleDispatch();    ///< Checks quad generation matches the previous serial expansion, in parallel and not, returns false on mismatch.
 
 
 
@@ -599,6 +637,33 @@ namespace nHL
 
 
 
+    // --- SIMD support --------------------------------------------------------
+
+    // ApplyRotations, ApplyScalesAndAspects, ApplyVelocityStretch, FindTiles,
+    // FindTilePairs, WriteQuads, UpdatePhysicsSimple, and UpdateAges have SIMD
+    // versions that are used when inputs are either dense or uniform (stride 0),
+    // and in-place data is dense. The scalar loops handle any remainder, and
+    // are used for everything with kParticleSIMDNone. They remain the reference
+    // implementations.
+
+    enum tParticleSIMD
+    {
+        kParticleSIMDNone,      ///< Scalar code only
+        kParticleSIMDSSE,       ///< SSE2, 4-wide
+        kParticleSIMDAVX2,      ///< AVX2, 8-wide
+        kParticleSIMDNEON,      ///< 64-bit ARM NEON, 4-wide
+        kMaxParticleSIMD
+    };
+
+    tParticleSIMD BestParticleSIMD();                   ///< Returns the best kernel set supported by the current CPU.
+    tParticleSIMD ParticleSIMD();                       ///< Returns the currently selected kernel set. Defaults to BestParticleSIMD().
+    bool          SetParticleSIMD(tParticleSIMD simd);  ///< Select kernel set, returns false if it's not supported on this CPU.
+    const char*   ParticleSIMDName(tParticleSIMD simd);
+
+    bool TestParticleKernels();     ///< Checks each supported kernel set against the scalar versions, returns false on mismatch.
+    void BenchParticleKernels();    ///< Logs particles/second for each kernel and supported kernel set.
+
+
     // --- Inlines -------------------------------------------------------------
     template<class T> inline cMemArray<T>::cMemArray()
     {
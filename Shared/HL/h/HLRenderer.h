@@ -18,11 +18,13 @@
 #include <CLColour.h>
 #include <CLData.h>
 #include <CLFileWatch.h>
+#include <CLHashMap.h>
 #include <CLImage.h>
 #include <CLLink.h>
 #include <CLMemory.h>
 #include <CLSTL.h>
 #include <CLSlotArray.h>
+#include <CLValue.h>
 
 #include <VL234f.h>
 #include <VL234i.h>
@@ -63,6 +65,9 @@ namespace nHL
         nCL::set<tShaderDataRef>     mUpdateDependents;    // Shader data that's dependent on the contents of this.
 
         tShaderDataConfigFunc*       mConfigFunc = 0;
+
+        uint32_t                     mStamp = 0;          // Changes whenever the data does, including via mUpdateFunc.
+        bool                         mDirty = false;      // mUpdateFunc must be run before the data is next used.
     };
 
     // Mapping between a shader uniform, and corresponding CPU-side shader data.
@@ -73,16 +78,32 @@ namespace nHL
         GLenum   mType;
         int      mCount;
         GLboolean mTranspose;
+        uint32_t mStamp;        // Stamp of the shader data when last uploaded to this uniform, 0 if never.
 
         cShaderDataBinding() :
             mDataRef (kNullDataRef),
             mLocation(0),
             mType    (GL_FLOAT),
             mCount   (0),
-            mTranspose(GL_FALSE)
+            mTranspose(GL_FALSE),
+            mStamp   (0)
         {}
     };
 
+    struct cShaderDataCounters
+    {
+        int mUploads = 0;       ///< Uniforms uploaded
+        int mSkipped = 0;       ///< Uniforms skipped as their data was unchanged since the last upload
+        int mUpdates = 0;       ///< Derived data recomputed by update functions
+    };
+
+    struct cQueuedDraw
+    {
+        tDrawKey      mKey;
+        cIDrawSource* mSource;
+        uint32_t      mItem;
+    };
+
     struct cTextureBinding
     {
         tTag    mKind;
@@ -96,6 +117,7 @@ namespace nHL
         nCL::vector<uint32_t>           mRenderStates;                  ///< Render states to set
         nCL::vector<cShaderDataBinding> mShaderDataBindings;            ///< Shader data we reference
         nCL::vector<cTextureBinding>    mTextureBindings;               ///< Texture kinds we reference
+        tTag                            mInstancedTag = kNullTag;       ///< Variant of this material for instanced draws, if any
         bool                            mIsValid = true;                ///< True if compiled successfully
 
     #ifndef CL_RELEASE
@@ -327,6 +349,13 @@ namespace nHL
 
         void DrawMesh(const cGLMeshInfo* meshInfo) override;
 
+        void SubmitDraw(tDrawKey key, cIDrawSource* source, uint32_t item) override;
+        void FlushDraws() override;  ///< Issue queued draws in key order, minimising material and texture changes
+
+        int  InstancedMaterialRef(int materialRef) override;
+        int  AddInstances(int count, const cDrawInstance instances[]) override;
+        void DrawMeshInstances(const cGLMeshInfo* meshInfo, int firstInstance, int count) override;
+
         void PushState(const char* debugTag) override;
         void PopState (const char* debugTag) override;
 
@@ -341,6 +370,15 @@ namespace nHL
 
         void SetStateForDispatch();  ///< set up state for current material given current shader data
 
+        const cShaderDataCounters& ShaderDataCounters() const;     ///< Uniform upload counts for the last rendered frame
+
+    #if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+        static bool TestShaderDataUploads(int numModels);   ///< Headless check that skipped uploads leave uniforms correct
+        static void BenchShaderDataUpdates(int numModels);  ///< Logs per-draw CPU cost of derived shader data: eager without and with the inverse matrices, and lazy
+        static bool TestDrawQueue(int numDraws);            ///< Headless check of draw queue ordering and state change savings
+        static bool TestInstancedDraws(int numInstances);   ///< Headless check that instanced draws match per-instance ones
+    #endif
+
     protected:
         // Utilities
         void LoadRenderBuffers(const cObjectValue* config);
@@ -355,8 +393,15 @@ namespace nHL
         void    ResetState();
 
         void    GetBindingsFromProgram(GLuint program, nCL::vector<cShaderDataBinding>* bindings);
-        void    UploadShaderData(GLuint programID, const nCL::vector<cShaderDataBinding>& bindings);
-        void*   ShaderData(tShaderDataRef ref);
+        void    UploadShaderData(GLuint programID, nCL::vector<cShaderDataBinding>& bindings);
+        void*   ShaderDataStorage(tShaderDataRef ref);      ///< Raw storage for ref, which may be dirty
+        void    UpdateShaderData(tShaderDataRef ref);       ///< Brings derived data up to date, dependencies first
+        void    MarkDependentsDirty(const cShaderDataInfo& info);
+        void    UpdateDependents(const cShaderDataInfo& info);
+
+    #if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+        int     AddTestMaterials(const char* dir, int count);   ///< Loads 'count' copies of dir/test.[vf]sh, returns first index or -1
+    #endif
 
         void    GetBindingsFromProgram(GLuint program, nCL::vector<cTextureBinding>* bindings);
         void    BindTextures(GLuint programID, const nCL::vector<cTextureBinding>& bindings);
@@ -364,7 +409,7 @@ namespace nHL
 
         // Data definitions
         typedef cLink<cICamera> tAutoCamera;
-        typedef nCL::map<tTag, int>   tTagToIndexMap;
+        typedef nCL::tag_hash_map<int> tTagToIndexMap;
 
         // Data
         cIAllocator* mAllocator = 0;
@@ -393,6 +438,7 @@ namespace nHL
         // Keeping materials & textures permanently loaded for now.
         tTagToIndexMap                  mMaterialTagToIndex;
         nCL::vector<cMaterial>          mMaterials;
+        nCL::cConfigChangeTracker       mMaterialConfigs;   ///< So reloads only reprocess edited materials
 
         tTagToIndexMap                  mTextureTagToIndex;
         nCL::vector<cTextureInfo>       mTextureInfo;
@@ -403,6 +449,11 @@ namespace nHL
         tTagToIndexMap                  mShaderDataTagToIndex;
         nCL::vector<cShaderDataInfo>    mShaderData;   // Current shader data
         nCL::cWriteableDataStore        mShaderDataStore;
+        uint32_t                        mShaderDataStamp = 0;           ///< Last stamp handed out to shader data
+        bool                            mSkipUnchangedShaderData = true;
+        bool                            mLazyShaderDataUpdates = true;  ///< Derive data when first used rather than when its sources change
+        cShaderDataCounters             mShaderDataCounters;            ///< This frame's uploads
+        cShaderDataCounters             mLastShaderDataCounters;
 
         // Copy-back buffers
         tTagToIndexMap                  mCopyBackBufferTagToIndex;
@@ -413,6 +464,7 @@ namespace nHL
         nCL::vector<int>                mStateMarkers;
 
         tMaterialRef                    mCurrentMaterial = -1;
+        uint32_t                        mCurrentProgram = 0;    ///< Program bound by the last SetMaterial()
         int                             mDeviceOrientation = 0;
         Mat3f                           mDeviceOrient = vl_I;
         cLink<cICamera>                 mCurrentCamera;
@@ -425,12 +477,24 @@ namespace nHL
         // Quad mesh support
         nCL::cSlotArrayT<cQuadMesh> mQuadMeshSlots;
 
+        // Draw queue
+        nCL::vector<cQueuedDraw> mDrawQueue;
+        nCL::vector<cQueuedDraw> mDrawQueueScratch;    ///< For sorting
+
+        // Instancing
+        nCL::vector<cDrawInstance> mInstances;          ///< This frame's instance data
+        uint32_t                   mInstanceBuffer = 0;
+        int                        mInstancesUploaded = 0;  ///< Number of mInstances currently in mInstanceBuffer
+        bool                       mInstancingEnabled = true;
+
         // Dev support
         nCL::cFileWatcher mDocumentsWatcher;    ///< For shader reloading
         
         nCL::multimap<int, int> mRefToMaterialIndexMap;
-        nCL::set<int>           mMaterialsToReload;
-        int                     mMaterialReloadCounter = 0;
+
+    #if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+        bool mRecordFrame = false;              ///< Log the GL calls made by the next Render()
+    #endif
     };
 
 
@@ -455,9 +519,18 @@ namespace nHL
         return ((1 << flag) & mRenderFlags) != 0;
     }
 
+    inline const cShaderDataCounters& cRenderer::ShaderDataCounters() const
+    {
+        return mLastShaderDataCounters;
+    }
+
     inline const void* cRenderer::ShaderData(tShaderDataRef ref) const
     {
         CL_INDEX(ref, mShaderData.size());
+
+        if (mShaderData[ref].mDirty)
+            const_cast<cRenderer*>(this)->UpdateShaderData(ref);    // derived data is a cache, so this is logically const
+
         return mShaderDataStore.Data(mShaderData[ref].mOffset);
     }
 
@@ -467,7 +540,7 @@ namespace nHL
         return mShaderData[ref].mSize;
     }
 
-    inline void* cRenderer::ShaderData(tShaderDataRef ref)
+    inline void* cRenderer::ShaderDataStorage(tShaderDataRef ref)
     {
         CL_INDEX(ref, mShaderData.size());
         return mShaderDataStore.Data(mShaderData[ref].mOffset);
@@ -129,7 +129,8 @@ namespace nHL
             Vec3f positions[],  size_t positionStride,
             Vec3f velocities[], size_t velocityStride
         ) = 0;
-        ///< Called to apply the controller to the given points
+        ///< Called to apply the controller to the given points. With parallel effect
+        ///< update on, this may be called from several threads at once.
     };
 
     class cIEffectType;
@@ -17,6 +17,7 @@
 namespace nHL
 {
     class cIRenderLayer;
+    class cUIState;
     typedef nCL::cSlotRef tMIRef;   // model instance reference
 
     class cIModelManager
@@ -54,6 +55,11 @@ namespace nHL
 
         virtual cIRenderLayer* AsLayer() = 0;
         // TODO: animation etc.
+
+    #ifndef CL_RELEASE
+        // Development
+        virtual void DebugMenu(cUIState* uiState) = 0;
+    #endif
     };
 
     cIModelManager* CreateModelManager(nCL::cIAllocator* alloc);
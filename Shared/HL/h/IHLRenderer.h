@@ -74,6 +74,9 @@ namespace nHL
         kVBTexCoords,
         kVBColours,
         kVBNormals,
+        kVBInstance0,       ///< Per-instance model-to-world, see cDrawInstance
+        kVBInstance1,
+        kVBInstance2,
         kMaxAttributes
     };
 
@@ -120,6 +123,30 @@ namespace nHL
         virtual void Dispatch(cIRenderer* renderer, const cRenderLayerState& state) = 0;
     };
 
+    // Draw queue support. Layers submit a sort key per draw, and are called back
+    // to issue each one in key order, with the key's material and texture already set.
+    typedef uint64_t tDrawKey;
+
+    class cIDrawSource
+    {
+    public:
+        virtual void Draw(cIRenderer* renderer, uint32_t item) = 0;    ///< Issue the given submitted draw. Shouldn't change the material or diffuse texture.
+    };
+
+    tDrawKey DrawKey(int pass, int layer, bool translucent, int material, int texture = -1, float depth = 0.0f);
+    ///< Pack draw attributes into a sort key. Sorts by pass (0-3), layer (-128-127), opaque before translucent,
+    ///< and then for opaque draws by material, texture, and front to back, and for translucent ones back to front.
+    ///< 'texture' is the diffuse texture or -1, 'depth' is e.g. squared distance from the camera.
+    int DrawKeyMaterial(tDrawKey key);
+    int DrawKeyTexture (tDrawKey key);
+
+    struct cDrawInstance
+    /// Per-instance data for DrawMeshInstances(). Instanced shaders read this
+    /// as inInstance0-2, and find worldPos[i] = dot(inInstance[i], inPosition).
+    {
+        Vec4f mModelToWorld[3];
+    };
+
     // Camera
     class cICamera
     {
@@ -297,6 +324,18 @@ namespace nHL
 
         virtual void DrawMesh(const cGLMeshInfo* meshInfo) = 0; ///< Draw predefined mesh
 
+        virtual void SubmitDraw(tDrawKey key, cIDrawSource* source, uint32_t item) = 0;
+        ///< Queue a draw of 'item' from 'source'. Queued draws are sorted and issued once the current layer's Dispatch() returns.
+        virtual void FlushDraws() = 0;  ///< Issue queued draws now
+
+        // Instancing
+        virtual int  InstancedMaterialRef(int materialRef) = 0;
+        ///< Returns the material to draw instances of 'materialRef' with, as set by its 'instanced' member, or 0 if there is none, or instancing isn't available.
+        virtual int  AddInstances(int count, const cDrawInstance instances[]) = 0;
+        ///< Append to this frame's instance buffer, and return the index of the first added instance. The buffer is cleared once queued draws are flushed.
+        virtual void DrawMeshInstances(const cGLMeshInfo* meshInfo, int firstInstance, int count) = 0;
+        ///< Draw 'count' instances of the given mesh from the frame's instance buffer, using the current material, which should come from InstancedMaterialRef().
+
         virtual void PushState(const char* debugTag) = 0;   ///< push camera/shader/render state
         virtual void PopState (const char* debugTag) = 0;   ///< pop camera/shader/render state. If specified debugTag will be matched against the corresponding PushState to check nesting.
 
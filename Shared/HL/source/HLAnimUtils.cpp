@@ -10,6 +10,8 @@
 
 #include <HLAnimUtils.h>
 
+#include <HLParticleKernels.h>
+
 #include <VL234f.h>
 
 using namespace nHL;
@@ -31,8 +33,19 @@ void nHL::UpdateAges
 )
 {
     tPtAgeMul da = DeltaSecondsToIotas(dt);
+    int i = 0;
 
-    for (int i = 0; i < count; i++)
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && ageStride == sizeof(tPtAge))
+    {
+        i = kernels->mUpdateAges(tPtAge(da), count, ages, ageSteps, agesOut);
+
+        ((uint8_t*&) ages)        += i * ageStride;
+        ((uint8_t*&) ageSteps)    += i * ageStride;
+    }
+
+    for ( ; i < count; i++)
     {
         tPtAgeMul age = *ages + da * *ageSteps;
 
@@ -15,6 +15,7 @@
 #include <IHLConfigManager.h>
 #include <IHLRenderer.h>
 #include <IHLEffectsManager.h>
+#include <IHLModelManager.h>
 
 #include <HLAppRemote.h>
 #include <HLDebugDraw.h>
@@ -23,10 +24,13 @@
 #include <HLSystem.h>
 #include <HLUI.h>
 
+#include <CLDirectories.h>
+#include <CLFileSpec.h>
 #include <CLInputState.h>
 #include <CLJSON.h>
 #include <CLLog.h>
 #include <CLMemory.h>
+#include <CLProfile.h>
 #include <CLSystemInfo.h>
 #include <CLUtilities.h>
 #include <CLValue.h>
@@ -37,6 +41,10 @@ using namespace nCL;
 namespace
 {
     const float kMaxDeltaTime = 0.5f;
+
+    // Per-frame config lookups
+    const cConfigPath kShowBoundsPath("showBounds");
+    const cConfigPath kTimeScalePath ("timeScale");
 }
 
 // Declare this locally so the destructor isn't instantiated in other compilation units.
@@ -57,6 +65,10 @@ bool cApp::Init()
 
     cIAllocator* alloc = AllocatorFromObject(this);
 
+#if CL_PROFILE
+    SetProfileThreadName("Main");
+#endif
+
     mSystem = CreateSystem(alloc);
     if (!mSystem)
         return false;
@@ -117,6 +129,9 @@ bool cApp::Init()
     for (auto appMode : mAppModes)
         appMode->UpdateFromConfig(config);
 
+    // If set, main-thread scratch allocations can't outlive the frame.
+    LocalAllocator()->SetResetPerFrame(config->Member("resetLocalAllocatorPerFrame").AsBool(false));
+
     if (!mAppModes.empty() && mAppModeIndex < 0)
         SetAppMode(0);
 
@@ -209,11 +224,16 @@ bool cApp::SetAppMode(nCL::tTag tag)
 
 void cApp::Update()
 {
+#if CL_PROFILE
+    EndProfileFrame();  // frame = previous Update + Render
+#endif
+    CL_PROFILE_SCOPE("App Update");
+
     const cServices* hl = HL();
 
     const cObjectValue* config = hl->mConfigManager->Config();
 
-    HL()->mEffectsManager->Params()->mFlags.mDebugBoundingBoxes = hl->mConfigManager->Preferences()->Member(CL_TAG("showBounds")).AsBool();
+    HL()->mEffectsManager->Params()->mFlags.mDebugBoundingBoxes = kShowBoundsPath.Find(hl->mConfigManager->Preferences()).AsBool();
 
     float deltaT = mFrameTimer.DeltaTime();
 
@@ -228,7 +248,7 @@ void cApp::Update()
         gameDT = 0.0f;
     else
     {
-        float timeScale = config->Member("timeScale").AsFloat(1.0f);
+        float timeScale = kTimeScalePath.Find(config).AsFloat(1.0f);
         gameDT *= timeScale;
     }
 
@@ -291,6 +311,7 @@ void cApp::Update()
 
         lineY += DrawTextF(dd, lineX, lineY, "MSPF: %5.1f", mMSPF)[1];
         lineY += DrawTextF(dd, lineX, lineY, "MB: %5.1f", UsedMemory() / 1024.0f / 1024.0f)[1];
+        lineY += DrawTextF(dd, lineX, lineY, "Scratch KB: %5.1f", LocalAllocator()->LastFramePeakSize() / 1024.0f)[1];
 
         dd->SetColour(kColourYellow);
 
@@ -312,10 +333,14 @@ void cApp::Update()
 #endif
 
     mUIState->End();
+
+    LocalAllocator()->EndFrame();
 }
 
 void cApp::Render()
 {
+    CL_PROFILE_SCOPE("App Render");
+
     const cServices* hl = HL();
     cIRenderer* renderer = hl->mRenderer;
 
@@ -550,6 +575,9 @@ bool cApp::BeginDevUI()
             Unpause();
     }
 
+    if (mUIState->HandleButton(ItemID(0x0241c5d3), "Log Allocators"))
+        LogAllocatorStats();
+
     cObjectValue* prefs = hl->mConfigManager->Preferences();
 
     if (mUIState->BeginSubMenu(itemID++, "Render"))
@@ -559,7 +587,7 @@ bool cApp::BeginDevUI()
         if (mUIState->HandleToggle(itemID++, "Wireframe", &wireframe))
             prefs->InsertMember("wireframe") = wireframe;
 
-        bool showBounds = prefs->InsertMember("showBounds").AsBool();
+        bool showBounds = prefs->Member("showBounds").AsBool();
 
         if (mUIState->HandleToggle(itemID++, "Show Bounds", &showBounds))
             prefs->InsertMember("showBounds") = showBounds;
@@ -570,6 +598,49 @@ bool cApp::BeginDevUI()
         mUIState->EndSubMenu();
     }
 
+    if (hl->mModelManager && mUIState->BeginSubMenu(ItemID(0x0243b7df), "Models"))
+    {
+        hl->mModelManager->DebugMenu(mUIState);
+
+        mUIState->EndSubMenu();
+    }
+
+#if CL_PROFILE
+    if (mUIState->BeginSubMenu(ItemID(0x0245a1c9), "Profile"))
+    {
+        if (ProfileCaptureActive())
+            mUIState->DrawLabel("Capturing...");
+        else if (mUIState->HandleButton(ItemID(0x0245a1ca), "Capture Trace"))
+        {
+            cFileSpec spec;
+            SetDirectory(&spec, kDirectoryDocuments);
+            spec.SetNameAndExtension("trace.json");
+
+            StartProfileCapture(spec.Path(), hl->mConfigManager->Config()->Member("profileCaptureFrames").AsInt(60));
+        }
+
+        mUIState->DrawLabel(Format("Frame: %5.2f ms, %d dropped", ProfileFrameTicks() * 1e-6f, ProfileDroppedScopes()));
+
+        const cProfileStat* stats = ProfileStats();
+        int lastThread = -1;
+
+        for (int i = 0, n = NumProfileStats(); i < n; i++)
+        {
+            const cProfileStat& stat = stats[i];
+
+            if (stat.mThread != lastThread)
+            {
+                mUIState->DrawLabel(ProfileThreadName(stat.mThread));
+                lastThread = stat.mThread;
+            }
+
+            mUIState->DrawLabel(Format("%*s%s: %5.2f ms x %d", 2 * (stat.mDepth + 1), "", stat.mName, stat.mTicks * 1e-6f, stat.mCount));
+        }
+
+        mUIState->EndSubMenu();
+    }
+#endif
+
     if (hl->mEffectsManager && mUIState->BeginSubMenu(itemID++, "Effects"))
     {
         hl->mEffectsManager->DebugMenu(mUIState);
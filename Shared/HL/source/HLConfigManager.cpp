@@ -14,6 +14,8 @@
 #include <CLFileSpec.h>
 #include <CLJSON.h>
 #include <CLLog.h>
+#include <CLProfile.h>
+#include <CLTimer.h>
 #include <CLUtilities.h>
 
 #include <sys/errno.h>  // TODO
@@ -206,68 +208,6 @@ bool cConfigManager::OpenConfig(const nCL::cValue* config)
 
 // Internal
 
-namespace
-{
-    // TODO: this didn't work out, it's too hard to keep super/owner stuff in sync. Try doing
-    // it during the Read() instead.
-    void UpdateWithNewConfig(cObjectValue* targetObject, cObjectValue* sourceObject)
-    /// Updates target with the contents of source, while keeping intact
-    /// any still-relevant cObjectValue pointers from 'target'
-    {
-        // Strategy:
-        // - UpdateConfig on any child members of the target that are present in the source
-        // - Swap those members with the source's. (Thus source now preserves children of target.)
-        // - Swap source with target.
-
-        CL_ASSERT(targetObject);
-
-        if (!sourceObject)
-        {
-            // Mark targetObject as no longer live. Maybe clear it?
-            return;
-        }
-
-        for (int i = 0, n = sourceObject->NumMembers(); i < n; i++)
-        {
-            tTag tag = sourceObject->MemberTag(i);
-
-            cValue* targetChildValue = targetObject->ModifyMember(tag);
-
-            if (!targetChildValue)
-                continue;
-
-            cObjectValue* targetChild = targetChildValue->AsObject();
-            cObjectValue* sourceChild = sourceObject->MemberValue(i).AsObject();
-
-            if (!sourceChild)
-            {
-                if (targetChild)
-                    ;   // TODO: clear/mark?
-
-                continue;
-            }
-
-            if (!targetChild)
-            {
-                continue;
-            }
-
-            // update with source's contents so we maintain existing cObjectValue pointer
-            targetChild->Swap(sourceChild);
-            // Transfer target to source
-            UpdateWithNewConfig(sourceChild, targetChild);
-        }
-
-        // We leave the 'super' stuff alone, because that's usually a reference either to another
-        // file's object, or something already rooted in the tree.
-
-        // now all the sourceObject members possible have had their cObjectValue
-        // pointers replaced with the 'persistent' ones. So swap the sourceObject
-        // contents into the target.
-        targetObject->Swap(sourceObject);
-    }
-}
-
 cObjectValue* cConfigManager::ConfigFileForPath(const nCL::cFileSpec& configPath, bool watchConfig)
 {
     tStringID pathStringID = StringIDFromString(configPath.Path());
@@ -301,7 +241,16 @@ bool cConfigManager::ReloadConfigFileForPath(const nCL::cFileSpec& configPath)
 
     if (it != mConfigFileToObject.end())
     {
-        bool result =  ReadConfig(configPath, it->second);
+        CL_PROFILE_SCOPE("Reload Config");
+
+        cWallClockTimer timer;
+        timer.Start();
+
+        bool changed = false;
+        bool result = ReadConfig(configPath, it->second, &changed);
+
+        if (result)
+            CL_LOG("Config", "  %s in %.2f ms\n", changed ? "Updated" : "Unchanged", timer.GetTime() * 1000.0f);
 
         if (!result && mShowErrors)
             OpenLastErrorFile();
@@ -312,28 +261,38 @@ bool cConfigManager::ReloadConfigFileForPath(const nCL::cFileSpec& configPath)
     return false;
 }
 
-bool cConfigManager::ReadConfig(const cFileSpec& configPath, cObjectValue* config)
+bool cConfigManager::ReadConfig(const cFileSpec& configPath, cObjectValue* config, bool* changed)
 {
+    CL_PROFILE_SCOPE("Read Config");
+
     string errorMessages;
     int errorLine = 0;
 
-    cValue wrapperValue(config);
+    // Read into a fresh object and then patch 'config' from it, so on a reload only
+    // the objects that actually differ are modified, and existing pointers stay valid.
+    tObjectLink newConfig = new(AllocatorFromObject(this)) cObjectValue;
+    cValue wrapperValue(newConfig);
 
     bool success = ReadFromJSONFile(configPath, &wrapperValue, &errorMessages, &errorLine);
 
     success = success && wrapperValue.IsObject();
 
-    config->SetMember(kSourcePathTag, cValue(configPath.Path()));
+    cValue sourcePath(configPath.Path());
 
     if (success)
     {
+        newConfig->SetMember(kSourcePathTag, sourcePath);
+        ApplyImports(newConfig);
+
+        bool updated = config->Update(newConfig);
+
+        if (changed)
+            *changed = updated;
+
     #ifdef LOCAL_DEBUG
         LogJSON("Config", "ReadJSON", config);
     #endif
 
-        config->IncModCount();
-        ApplyImports(config);
-
     #ifdef LOCAL_DEBUG
         printf("\n");
         DumpHierarchy(configPath.Name(), 0, config);
@@ -342,6 +301,9 @@ bool cConfigManager::ReadConfig(const cFileSpec& configPath, cObjectValue* confi
     }
     else
     {
+        if (config->LocalMember(kSourcePathTag) != sourcePath)
+            config->SetMember(kSourcePathTag, sourcePath);
+
         if (!errorMessages.empty())
             CL_LOG_E("Config", "%s: %s\n", configPath.Path(), errorMessages.c_str());
 
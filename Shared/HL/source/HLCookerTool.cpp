@@ -18,6 +18,7 @@
 #include <CLMemory.h>
 #include <CLTag.h>
 #include <CLValue.h>
+#include <CLValueData.h>
 
 using namespace nCL;
 
@@ -77,6 +78,23 @@ int main(int argc, const char** argv)
     {
         printf("read %s successfully\n", inputFile.Path());
 
+        if (argSpec.Flag(kFlagConvertConfig))
+        {
+            // Convert the file as is, without the source path tag or imports, which are added on load
+            cValue fileValue;
+            cFileSpec dataFile(inputFile);
+            dataFile.AddExtension(kValueDataExtension);
+
+            SetValueDataFilesEnabled(false);
+
+            if (ReadFromJSONFile(inputFile, &fileValue) && WriteValueDataFile(fileValue, dataFile))
+                printf("wrote %s\n", dataFile.Path());
+            else
+                fprintf(stderr, "Couldn't write %s\n", dataFile.Path());
+
+            SetValueDataFilesEnabled(true);
+        }
+
         cLink<cIConfigSource> configSource = CreateDefaultConfigSource(Allocator(kDefaultAllocator));
         ApplyImports(value.AsObject(), configSource);
 
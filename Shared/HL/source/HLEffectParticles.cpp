@@ -13,11 +13,14 @@
 #include <IHLRenderer.h>
 
 #include <HLDebugDraw.h>
+#include <HLParticleKernels.h>
 #include <HLParticleUtils.h>
 
 #include <ICLInterface.h>
 #include <CLFrustum.h>
+#include <CLHash.h>
 #include <CLParams.h>
+#include <CLProfile.h>
 #include <CLString.h>
 #include <CLTimer.h>
 #include <CLValue.h>
@@ -48,7 +51,8 @@ namespace
 
     class cEffectTypeParticles :
         public tEffectTypeParticles,
-        public cIRenderLayer
+        public cIRenderLayer,
+        public cIDrawSource
     {
     public:
         CL_ALLOC_LINK_DECL;
@@ -58,26 +62,32 @@ namespace
         void PostInit() override;
         void Shutdown() override;
 
+        tEIRef CreateInstance(tTag tag) override;
+        bool ParallelUpdate() const override;
+
         const char* StatsString(const char* typeName) const override;
         void DebugMenu(cUIState* uiState) override;
 
         // cIRenderer
         void Dispatch(cIRenderer* renderer, const cRenderLayerState& state) override;
 
+        // cIDrawSource
+        void Draw(cIRenderer* renderer, uint32_t item) override;
+
         // cEffectTypeParticles
         void DispatchParticleSystem(const cEffectParticles* effect, cIRenderer* renderer, const cTransform& c2w);
 
         // Data
-        tSeed32     mSeed = kDefaultSeed32;
+        tSeed32     mSeed = kDefaultSeed32;     ///< Master seed, used to derive instance seeds
 
     protected:
         // Data
         int         mParticleQuadMesh = -1;
 
-        vector<int> mPass[2];
         int         mShaderRef[4] = { 0 };
 
         bool        mDispatchEnabled = true;
+        bool        mParallelDispatch = true;   ///< Spread quad generation across job threads
         float       mDispatchMSPF = 0.0f;
         int         mParticleDispatches = 0;
     };
@@ -112,6 +122,27 @@ namespace
         tEffectTypeParticles::Shutdown();
     }
 
+    tEIRef cEffectTypeParticles::CreateInstance(tTag tag)
+    {
+        tEIRef ref = tEffectTypeParticles::CreateInstance(tag);
+
+        if (ref != kNullRef)
+            mEffects[ref]->mSeed = SeedFromKey(SeedFromKey(StrHashU32(tag), ref), NextSeed(&mSeed));
+
+        return ref;
+    }
+
+    bool cEffectTypeParticles::ParallelUpdate() const
+    {
+    #ifndef CL_RELEASE
+        // Bounding box display goes via the shared debug draw
+        if (mManager->Params()->mFlags.mDebugBoundingBoxes)
+            return false;
+    #endif
+
+        return true;
+    }
+
     const char* cEffectTypeParticles::StatsString(const char* typeName) const
     {
         mStats.clear();
@@ -161,26 +192,39 @@ namespace
         tEffectTypeParticles::DebugMenu(uiState);
 
         uiState->HandleToggle(ItemID(0x022c3477), "Dispatch", &mDispatchEnabled);
-    }
+        uiState->HandleToggle(ItemID(0x0238e6a1), "Parallel Dispatch", &mParallelDispatch);
 
-    // cIRenderer
-    struct cParticlesSortLess
-    {
-        cParticlesSortLess(const cEffectParticles* effects) : mEffects(effects) {}
+        if (uiState->HandleButton(ItemID(0x0238e6a2), "Test Dispatch"))
+            CL_LOG("Effects", "Particle dispatch %s\n", TestParticleDispatch() ? "matches" : "DOESN'T match");
+
+        tUIItemID itemID = ItemID(0x022c3478);
 
-        bool operator()(int a, int b) const
+        if (uiState->BeginSubMenu(itemID++, "SIMD"))
         {
-            if (mEffects[a].mRenderOrder != mEffects[b].mRenderOrder)
-                return mEffects[a].mRenderOrder > mEffects[b].mRenderOrder;
+            for (int i = 0; i < kMaxParticleSIMD; i++)
+            {
+                tParticleSIMD simd = tParticleSIMD(i);
 
-            return mEffects[a].mRenderHash < mEffects[b].mRenderHash;
-        }
+                if ((simd == kParticleSIMDNone || ParticleKernels(simd)) && uiState->HandleToggle(itemID + i, ParticleSIMDName(simd), ParticleSIMD() == simd))
+                    SetParticleSIMD(simd);
+            }
 
-        const cEffectParticles* mEffects = 0;
-    };
+            itemID += kMaxParticleSIMD;
 
+            if (uiState->HandleButton(itemID++, "Test Kernels"))
+                CL_LOG("Effects", "Particle kernels %s\n", TestParticleKernels() ? "match" : "DON'T match");
+            if (uiState->HandleButton(itemID++, "Bench Kernels"))
+                BenchParticleKernels();
+
+            uiState->EndSubMenu();
+        }
+    }
+
+    // cIRenderer
     void cEffectTypeParticles::Dispatch(cIRenderer* renderer, const cRenderLayerState& state)
     {
+        CL_PROFILE_SCOPE("Particles Dispatch");
+
         mParticleDispatches = 0;
 
         if (!mDispatchEnabled || mSlots.NumSlotsInUse() == 0)
@@ -190,7 +234,6 @@ namespace
         timer.Start();
 
         cEffectsManagerParams* params = mManager->Params();
-        const cTransform& c2w = params->mCameraToWorld;
 
         Vec4f planes[6];
         ExtractPlanes(params->mProjectionMatrix, planes);
@@ -198,9 +241,6 @@ namespace
         OffsetPlanes(HL()->mConfigManager->Config()->Member(CL_TAG("clipPlanesOffset")).AsFloat(0.0f), planes);
     #endif
 
-        mPass[0].clear();
-        mPass[1].clear();
-
         uint32_t layerFlags = state.mLayerFlags;
         if (layerFlags == 0)
             layerFlags = 0x00FF;
@@ -227,47 +267,29 @@ namespace
             if (FrustumTestAABB(effect->mBounds, planes) & kOutsideFrustum)
                 continue;
 
+            // Pass is the top key field, so all first passes still draw before any second pass
+            int layer = effect->mDesc->mLayer;
+
             if (IsValid(effect->mMaterial1))
-                mPass[0].push_back(i);
+                renderer->SubmitDraw(DrawKey(0, layer, true, effect->mMaterial1, effect->mTexture1, effect->mDepth), this, i);
 
             if (effect->mMaterial2 > 0)    // just skip second pass if invalid material
-                mPass[1].push_back(i);
-        }
-
-        for (int i = 0, n = mPass[0].size(); i < n; i++)
-        {
-            const cEffectParticles* effect = mEffects[mPass[0][i]];
-
-            Mat4f modelToWorld;
-            effect->mEffectToWorld.MakeMat4(&modelToWorld);
-            renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
-
-            if (renderer->SetMaterial(effect->mMaterial1))
-                DispatchParticleSystem(effect, renderer, c2w);
-        }
-
-        for (int i = 0, n = mPass[1].size(); i < n; i++)
-        {
-            const cEffectParticles* effect = mEffects[mPass[1][i]];
-
-            Mat4f modelToWorld;
-            effect->mEffectToWorld.MakeMat4(&modelToWorld);
-            renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
-
-            if (renderer->SetMaterial(effect->mMaterial2))
-                DispatchParticleSystem(effect, renderer, c2w);
+                renderer->SubmitDraw(DrawKey(1, layer, true, effect->mMaterial2, effect->mTexture1, effect->mDepth), this, i);
         }
 
         UpdateMSPF(timer.GetTime(), &mDispatchMSPF);
     }
 
+    void cEffectTypeParticles::Draw(cIRenderer* renderer, uint32_t item)
+    {
+        DispatchParticleSystem(mEffects[item], renderer, mManager->Params()->mCameraToWorld);
+    }
+
     void cEffectTypeParticles::DispatchParticleSystem(const cEffectParticles* effect, cIRenderer* renderer, const cTransform& c2w)
     {
         const tStandardParticles& particles = effect->mParticles;
 
-        if (effect->mTexture1 >= 0)
-            renderer->SetTexture(kTextureDiffuseMap, effect->mTexture1);
-
+        // Diffuse map is bound by the draw queue from the draw key
         if (effect->mTexture2 >= 0)
             renderer->SetTexture(kTextureNormalMap, effect->mTexture2);
 
@@ -310,6 +332,7 @@ namespace
             effect->mEffectToWorld,
             c2w,
             &effect->mDispatchScale,
+            mParallelDispatch,
 
             particles.Size(),
 
@@ -497,14 +520,6 @@ void cEffectParticles::SetDescription(const cDescParticles* desc)
     if (mParticles.Size() != 0)
         AllocNewArrays(&mParticles);
 
-    // TODO: these are all small integers, may be better to just xor across 4 bytes?
-    mRenderHash = CRC32((uint8_t*) &mMaterial1, sizeof(mMaterial1));
-    mRenderHash = CRC32((uint8_t*) &mMaterial2, sizeof(mMaterial1), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture1 , sizeof(mTexture1 ), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture2 , sizeof(mTexture2 ), mRenderHash);
-
-    mRenderOrder &= 0x00FFFFFF;
-    mRenderOrder |= (127 - mDesc->mLayer) << 24;
 }
 
 void cEffectParticles::SetTransforms(const cTransform& sourceXform, const cTransform& effectXform)
@@ -519,10 +534,7 @@ void cEffectParticles::SetTransforms(const cTransform& sourceXform, const cTrans
     {
         Vec3f representativePosition = mSourceToEffect.Trans(); // TODO: track active bounding box instead
         Vec3f worldPos = mEffectToWorld.TransformPoint(representativePosition);
-        float depth = sqrlen(worldPos - mTypeManager->Manager()->Params()->mCameraToWorld.Trans());
-
-        mRenderOrder &= 0xFF000000;
-        mRenderOrder |= OrderedU32(depth) >> 8;
+        mDepth = sqrlen(worldPos - mTypeManager->Manager()->Params()->mCameraToWorld.Trans());
     }
 }
 
@@ -649,7 +661,7 @@ int cEffectParticles::CreateParticles(float dt, float animScale, const cEffectPa
     if (params->HasParams())
         SetupCreateParams(params, &createScale);
 
-    tSeed32* seed = &mTypeManager->mSeed;
+    tSeed32* seed = &mSeed;
 
     do
     {
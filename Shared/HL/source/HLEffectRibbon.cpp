@@ -15,6 +15,7 @@
 #include <CLColour.h>
 #include <CLValue.h>
 #include <CLMemory.h>
+#include <CLProfile.h>
 #include <CLTimer.h>
 
 #include <GLConfig.h> // for vertex format constants
@@ -46,7 +47,8 @@ namespace
 
     class cEffectTypeRibbon :
         public tEffectTypeRibbon,
-        public cIRenderLayer
+        public cIRenderLayer,
+        public cIDrawSource
     {
     public:
         CL_ALLOC_LINK_DECL;
@@ -56,19 +58,23 @@ namespace
         void PreUpdate (float realDT, float gameDT) override;
         void PostUpdate(float realDT, float gameDT) override;
 
+        bool ParallelUpdate() const override { return true; }
+
         const char* StatsString(const char* typeName) const override;
         void DebugMenu(cUIState* uiState) override;
 
         // cIRenderer
         void Dispatch(cIRenderer* renderer, const cRenderLayerState& state) override;
 
+        // cIDrawSource
+        void Draw(cIRenderer* renderer, uint32_t item) override;
+
         // cEffectTypeRibbon
         void DispatchRibbon(const cEffectRibbon* effect, cIRenderer* renderer, const cTransform& c2w);
 
     protected:
         int         mQuadMesh = -1;
 
-        vector<int> mPass[2];
         int         mShaderRef[4] = { 0 };
 
         float       mDispatchMSPF = 0.0f;
@@ -151,34 +157,16 @@ namespace
     }
 
     // cIRenderer
-    struct cRibbonsSortLess
-    {
-        cRibbonsSortLess(const cEffectRibbon* effects) : mEffects(effects) {}
-
-        bool operator()(int a, int b) const
-        {
-            if (mEffects[a].mRenderOrder != mEffects[b].mRenderOrder)
-                return mEffects[a].mRenderOrder > mEffects[b].mRenderOrder;
-
-            return mEffects[a].mRenderHash < mEffects[b].mRenderHash;
-        }
-
-        const cEffectRibbon* mEffects = 0;
-    };
-
     void cEffectTypeRibbon::Dispatch(cIRenderer* renderer, const cRenderLayerState& state)
     {
+        CL_PROFILE_SCOPE("Ribbon Dispatch");
+
         if (!mDispatchEnabled)
             return;
 
         cProgramTimer timer;
         timer.Start();
 
-        const cTransform& c2w = mManager->Params()->mCameraToWorld;
-
-        mPass[0].clear();
-        mPass[1].clear();
-
         uint32_t layerFlags = state.mLayerFlags;
         if (layerFlags == 0)
             layerFlags = 0x00FF;
@@ -202,45 +190,30 @@ namespace
             if (effect->mDesc->mLayer < layerBegin || layerEnd <= effect->mDesc->mLayer)
                 continue;
 
+            // Ribbons are positioned in world space, and have no depth to sort on.
+            // The second pass falls back to mTexture2 for its diffuse map.
+            int layer = effect->mDesc->mLayer;
+
             if (IsValid(effect->mMaterial1))
-                mPass[0].push_back(i);
+                renderer->SubmitDraw(DrawKey(0, layer, true, effect->mMaterial1, effect->mTexture1), this, i);
 
             if (effect->mMaterial2 > 0)    // just skip second pass if invalid material
-                mPass[1].push_back(i);
-        }
-
-        renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, Mat4f(vl_I));
-
-        for (int i = 0, n = mPass[0].size(); i < n; i++)
-        {
-            const cEffectRibbon* effect = mEffects[mPass[0][i]];
-
-            if (renderer->SetMaterial(effect->mMaterial1))
-                DispatchRibbon(effect, renderer, c2w);
-        }
-
-        for (int i = 0, n = mPass[1].size(); i < n; i++)
-        {
-            const cEffectRibbon* effect = mEffects[mPass[1][i]];
-
-            if (renderer->SetMaterial(effect->mMaterial2))
-            {
-                if (effect->mTexture2 >= 0)
-                    renderer->SetTexture(kTextureDiffuseMap, effect->mTexture2);
-
-                DispatchRibbon(effect, renderer, c2w);
-            }
+                renderer->SubmitDraw(DrawKey(1, layer, true, effect->mMaterial2, effect->mTexture1 >= 0 ? effect->mTexture1 : effect->mTexture2), this, i);
         }
 
         UpdateMSPF(timer.GetTime(), &mDispatchMSPF);
     }
 
+    void cEffectTypeRibbon::Draw(cIRenderer* renderer, uint32_t item)
+    {
+        renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, Mat4f(vl_I));
+
+        DispatchRibbon(mEffects[item], renderer, mManager->Params()->mCameraToWorld);
+    }
 
     void cEffectTypeRibbon::DispatchRibbon(const cEffectRibbon* effect, cIRenderer* renderer, const cTransform& c2w)
     {
-        if (effect->mTexture1 >= 0)
-            renderer->SetTexture(kTextureDiffuseMap, effect->mTexture1);
-
+        // Diffuse map is bound by the draw queue from the draw key
         if (effect->mTexture2 >= 0)
             renderer->SetTexture(kTextureNormalMap, effect->mTexture2);
 
@@ -352,14 +325,6 @@ void cEffectRibbon::SetDescription(const cDescRibbon* desc)
         mTexture1 = renderer->TextureRefFromTag(mDesc->mDispatch.mTextureTag);
     if (mDesc->mDispatch.mTexture2Tag != 0)
         mTexture2 = renderer->TextureRefFromTag(mDesc->mDispatch.mTexture2Tag);
-
-    mRenderHash = CRC32((uint8_t*) &mMaterial1, sizeof(mMaterial1));
-    mRenderHash = CRC32((uint8_t*) &mMaterial2, sizeof(mMaterial1), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture1 , sizeof(mTexture1 ), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture2 , sizeof(mTexture2 ), mRenderHash);
-
-    mRenderOrder &= 0x00FFFFFF;
-    mRenderOrder |= (127 - mDesc->mLayer) << 24;
 }
 
 void cEffectRibbon::SetTransforms(const cTransform& sourceTransform, const cTransform& effectTransform)
@@ -183,6 +183,8 @@ namespace
         void PostInit() override;
         void Shutdown() override;
 
+        bool ParallelUpdate() const override { return true; }
+
         void DebugMenu(cUIState* uiState) override;
 
         // cIRenderer
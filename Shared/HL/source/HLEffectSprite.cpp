@@ -16,6 +16,7 @@
 
 #include <CLHash.h>
 #include <CLParams.h>
+#include <CLProfile.h>
 #include <CLString.h>
 #include <CLTimer.h>
 #include <CLValue.h>
@@ -50,7 +51,8 @@ namespace
 
     class cEffectTypeSprites :
         public tEffectTypeSprites,
-        public cIRenderLayer
+        public cIRenderLayer,
+        public cIDrawSource
     {
     public:
         CL_ALLOC_LINK_DECL;
@@ -60,24 +62,28 @@ namespace
         void PostInit() override;
         void Shutdown() override;
 
+        tEIRef CreateInstance(tTag tag) override;
+        bool ParallelUpdate() const override;
+
         const char* StatsString(const char* typeName) const override;
         void DebugMenu(cUIState* uiState) override;
 
         // cIRenderer
         void Dispatch(cIRenderer* renderer, const cRenderLayerState& state) override;
 
+        // cIDrawSource
+        void Draw(cIRenderer* renderer, uint32_t item) override;
+
         // cEffectTypeSprites
         void DispatchSprites(const cEffectSprite* effect, cIRenderer* renderer, const cTransform& c2w);
 
         // Data
-        tSeed32     mSeed = kDefaultSeed32;
+        tSeed32     mSeed = kDefaultSeed32;     ///< Master seed, used to derive instance seeds
 
     protected:
         // Data
         int         mParticleQuadMesh = -1;
 
-        vector<int> mPass[2];       ///< For sorting sprites
-
         int         mShaderRef[4] = { 0 };
 
         float       mDispatchMSPF = 0.0f;
@@ -114,6 +120,21 @@ namespace
         tEffectTypeSprites::Shutdown();
     }
 
+    tEIRef cEffectTypeSprites::CreateInstance(tTag tag)
+    {
+        tEIRef ref = tEffectTypeSprites::CreateInstance(tag);
+
+        if (ref != kNullRef)
+            mEffects[ref].mSeed = SeedFromKey(SeedFromKey(StrHashU32(tag), ref), NextSeed(&mSeed));
+
+        return ref;
+    }
+
+    bool cEffectTypeSprites::ParallelUpdate() const
+    {
+        return true;
+    }
+
     const char* cEffectTypeSprites::StatsString(const char* typeName) const
     {
         mStats.clear();
@@ -154,34 +175,16 @@ namespace
 
     // cIRenderLayer
 
-    struct cSpriteSortLess
-    {
-        cSpriteSortLess(const cEffectSprite* effects) : mEffects(effects) {}
-
-        bool operator()(int a, int b) const
-        {
-            if (mEffects[a].mRenderOrder != mEffects[b].mRenderOrder)
-                return mEffects[a].mRenderOrder > mEffects[b].mRenderOrder;
-
-            return mEffects[a].mRenderHash < mEffects[b].mRenderHash;
-        }
-
-        const cEffectSprite* mEffects = 0;
-    };
-
     void cEffectTypeSprites::Dispatch(cIRenderer* renderer, const cRenderLayerState& state)
     {
+        CL_PROFILE_SCOPE("Sprites Dispatch");
+
         if (!mDispatchEnabled)
             return;
 
         cProgramTimer timer;
         timer.Start();
 
-        const cTransform& c2w = mManager->Params()->mCameraToWorld;
-
-        mPass[0].clear();
-        mPass[1].clear();
-
         uint32_t layerFlags = state.mLayerFlags;
         if (layerFlags == 0)
             layerFlags = 0x00FF;
@@ -202,48 +205,27 @@ namespace
             if (effect.mDesc->mLayer < layerBegin || layerEnd <= effect.mDesc->mLayer)
                 continue;
 
+            // Pass is the top key field, so all first passes still draw before any second pass
+            int layer = effect.mDesc->mLayer;
+
             if (IsValid(effect.mMaterial1))
-                mPass[0].push_back(i);
+                renderer->SubmitDraw(DrawKey(0, layer, true, effect.mMaterial1, effect.mTexture1, effect.mDepth), this, i);
 
             if (effect.mMaterial2 > 0)    // just skip second pass if invalid material
-                mPass[1].push_back(i);
-        }
-
-        sort(mPass[0].begin(), mPass[0].end(), cSpriteSortLess(mEffects.data()));
-        sort(mPass[1].begin(), mPass[1].end(), cSpriteSortLess(mEffects.data()));
-
-        for (int i = 0, n = mPass[0].size(); i < n; i++)
-        {
-            const cEffectSprite& effect = mEffects[mPass[0][i]];
-
-            Mat4f modelToWorld;
-            effect.mEffectToWorld.MakeMat4(&modelToWorld);
-            renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
-
-            if (renderer->SetMaterial(effect.mMaterial1))
-                DispatchSprites(&effect, renderer, c2w);
-        }
-
-        for (int i = 0, n = mPass[1].size(); i < n; i++)
-        {
-            const cEffectSprite& effect = mEffects[mPass[1][i]];
-
-            Mat4f modelToWorld;
-            effect.mEffectToWorld.MakeMat4(&modelToWorld);
-            renderer->SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
-
-            if (renderer->SetMaterial(effect.mMaterial2))
-                DispatchSprites(&effect, renderer, c2w);
+                renderer->SubmitDraw(DrawKey(1, layer, true, effect.mMaterial2, effect.mTexture1, effect.mDepth), this, i);
         }
 
         UpdateMSPF(timer.GetTime(), &mDispatchMSPF);
     }
 
-    void cEffectTypeSprites::DispatchSprites(const cEffectSprite* effect, cIRenderer* renderer, const cTransform& c2w)
+    void cEffectTypeSprites::Draw(cIRenderer* renderer, uint32_t item)
     {
-        if (effect->mTexture1 >= 0)
-            renderer->SetTexture(kTextureDiffuseMap, effect->mTexture1);
+        DispatchSprites(&mEffects[item], renderer, mManager->Params()->mCameraToWorld);
+    }
 
+    void cEffectTypeSprites::DispatchSprites(const cEffectSprite* effect, cIRenderer* renderer, const cTransform& c2w)
+    {
+        // Diffuse map is bound by the draw queue from the draw key
         if (effect->mTexture2 >= 0)
             renderer->SetTexture(kTextureNormalMap, effect->mTexture2);
 
@@ -270,6 +252,7 @@ namespace
             effect->mEffectToWorld,
             c2w,
             &effect->mDispatchScale,
+            false,
 
             1,
 
@@ -429,15 +412,6 @@ void cEffectSprite::SetDescription(const cDescSprite* desc)
 
     if (mDesc->mControllerTag != 0)
         mController = mTypeManager->Manager()->PhysicsController(mDesc->mControllerTag);
-
-    // TODO: these are all small integers, may be better to just xor across 4 bytes?
-    mRenderHash = CRC32((uint8_t*) &mMaterial1, sizeof(mMaterial1));
-    mRenderHash = CRC32((uint8_t*) &mMaterial2, sizeof(mMaterial1), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture1 , sizeof(mTexture1 ), mRenderHash);
-    mRenderHash = CRC32((uint8_t*) &mTexture2 , sizeof(mTexture2 ), mRenderHash);
-
-    mRenderOrder &= 0x00FFFFFF;
-    mRenderOrder |= (127 - mDesc->mLayer) << 24;
 }
 
 void cEffectSprite::SetTransforms(const cTransform& sourceXform, const cTransform& effectXform)
@@ -451,10 +425,7 @@ void cEffectSprite::SetTransforms(const cTransform& sourceXform, const cTransfor
     if (mDesc->mDepth)
     {
         Vec3f worldPos = mEffectToWorld.TransformPoint(mPosition);
-        float depth = sqrlen(worldPos - mTypeManager->Manager()->Params()->mCameraToWorld.Trans());
-
-        mRenderOrder &= 0xFF000000;
-        mRenderOrder |= OrderedU32(depth) >> 8;
+        mDepth = sqrlen(worldPos - mTypeManager->Manager()->Params()->mCameraToWorld.Trans());
     }
 }
 
@@ -538,7 +509,7 @@ void cEffectSprite::CreateSprite(float animScale, const nCL::cParams* params)
     if (params && params->HasParams())
         SetupCreateParams(params, &createScale);
 
-    tSeed32* seed = &mTypeManager->mSeed;
+    tSeed32* seed = &mSeed;
 
     mAge = 0;
     mAgeStep = LifeToAgeStep(RandomRange(mDesc->mLife, seed));
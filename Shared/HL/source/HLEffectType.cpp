@@ -16,6 +16,7 @@
 
 #include <CLFileSpec.h>
 #include <CLLog.h>
+#include <CLTimer.h>
 #include <CLValue.h>
 
 using namespace nHL;
@@ -57,6 +58,7 @@ inline void cEffectTypeBase::PostUpdate(float realDT, float gameDT)
 template<class T_D, class T_E> void cEffectType<T_D, T_E>::Shutdown()
 {
     RemoveAllInstances();
+    mInstancePool.Clear();
     
     mDescs.clear();
     cEffectTypeBase::Shutdown();
@@ -67,6 +69,10 @@ template<class T_D, class T_E> void cEffectType<T_D, T_E>::Config(const cObjectV
     mTagToIndex.clear();
     mDescs.clear();
 
+    // Existing instances keep track of their own allocator, so these are safe to change on reload.
+    mPoolInstances = config->Member("poolInstances").AsBool(mPoolInstances);
+    mInstancePool.SetPoison(config->Member("poisonInstances").AsBool(false));
+
     for (auto c : config->Children())
     {
         tTag          tag  = c.Tag();
@@ -116,7 +122,7 @@ template<class T_D, class T_E> tEIRef cEffectType<T_D, T_E>::CreateInstance(tTag
         mEffectTags[result] = tag;
 
         mEffects.resize(mSlots.NumSlots());
-        mEffects[result] = new(mAllocator) T_E;
+        mEffects[result] = new(mPoolInstances ? &mInstancePool : mAllocator) T_E;
         mEffects[result]->Init(this);
         mEffects[result]->SetDescription(&mDescs[it->second]);
 
@@ -215,7 +221,59 @@ template<class T_D, class T_E> void cEffectType<T_D, T_E>::DebugMenu(cUIState* u
 
     uiState->HandleToggle(itemID++, "Enabled", &mEnabled);
     uiState->DrawLabel(Format("%d / %d Active", numActiveInstances, numInstances));
+
+    uiState->HandleToggle(itemID++, "Pool Instances", &mPoolInstances);
+
+    if (mInstancePool.NumChunks() > 0)
+        uiState->DrawLabel(Format("Pool: %d instances, %d KB", mInstancePool.NumAllocs(), int(mInstancePool.NumChunks() * mInstancePool.ChunkSize() / 1024)));
+
+#ifndef CL_RELEASE
+    if (uiState->HandleButton(itemID++, "Bench Instance Churn"))
+        BenchInstances();
+#endif
+}
+
+#ifndef CL_RELEASE
+template<class T_D, class T_E> void cEffectType<T_D, T_E>::BenchInstances()
+{
+    if (mTagToIndex.empty())
+        return;
+
+    const int kNumInstances = 100000;
+    const int kNumRounds = 4;
+
+    tTag tag = mTagToIndex.begin()->first;
+    vector<tEIRef> refs;
+    refs.resize(kNumInstances);
+
+    bool poolInstances = mPoolInstances;
+
+    for (int pooled = 0; pooled < 2; pooled++)
+    {
+        mPoolInstances = pooled != 0;
+
+        uint64_t t0 = AbsoluteTicks();
+
+        for (int round = 0; round < kNumRounds; round++)
+        {
+            for (int i = 0; i < kNumInstances; i++)
+                refs[i] = CreateInstance(tag);
+
+            // Destroy odd instances first, so the next round allocates in a scattered order
+            for (int i = 1; i < kNumInstances; i += 2)
+                DestroyInstance(refs[i]);
+            for (int i = 0; i < kNumInstances; i += 2)
+                DestroyInstance(refs[i]);
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        CL_LOG("Effects", "%s instances: %.1f ns per create/destroy (%d x %d)\n", pooled ? "Pooled" : "Heap", double(t1 - t0) / (kNumRounds * kNumInstances), kNumRounds, kNumInstances);
+    }
+
+    mPoolInstances = poolInstances;
 }
+#endif
 
 template<class T_D, class T_E> void cEffectType<T_D, T_E>::RemoveAllInstances()
 {
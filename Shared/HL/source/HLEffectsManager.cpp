@@ -16,7 +16,9 @@
 #include <HLServices.h>
 #include <HLUI.h>
 
+#include <CLDispatch.h>
 #include <CLLog.h>
+#include <CLProfile.h>
 #include <CLTimer.h>
 #include <CLValue.h>
 
@@ -27,6 +29,8 @@ using namespace nCL;
 
 namespace
 {
+    const int kParallelUpdateGrain = 8;     ///< Number of instances per parallel update job
+
     const cTransform kNullTransform;
     const cEffectInstance::cFlags kNullEffectInstanceFlags = { 0 };
 
@@ -133,18 +137,22 @@ bool cEffectsManager::LoadEffects(const cObjectValue* effectsConfig)
         {
             const cObjectValue* config = effectsConfig->Member(mEffectSetTags[i]).AsObject();
 
-            if (config)
+            if (config && mEffectSetConfigs.Changed(config))
             {
                 CL_LOG("Effects", "Adding " CL_TAG_FMT ":\n", mEffectSetTags[i]);
                 mEffectTypes[i]->Config(config);
             }
         }
 
+    mParallelUpdate = effectsConfig->Member("parallelUpdate").AsBool(mParallelUpdate);
+
     return true;
 }
 
 void cEffectsManager::Update(float realDT, float gameDT)
 {
+    CL_PROFILE_SCOPE("Effects Update");
+
     if (!mEnabled)
     {
         mPostMSPF = 0.0f;
@@ -162,6 +170,26 @@ void cEffectsManager::Update(float realDT, float gameDT)
 
     UpdateMSPF(timer.DeltaTime(), &mPreMSPF);
 
+    if (UseParallelUpdate())
+        UpdateInstancesParallel(realDT, gameDT);
+    else
+        UpdateInstancesSerial(realDT, gameDT);
+
+    timer.DeltaTime();
+
+    for (int i = 0; i < kMaxEffectTypes; i++)
+        if (mEffectTypes[i])
+            mEffectTypes[i]->PostUpdate(realDT, gameDT);
+
+    UpdateMSPF(timer.DeltaTime(), &mPostMSPF);
+
+    UpdateMSPF(timer.GetTime(), &mOverallMSPF);
+}
+
+void cEffectsManager::UpdateInstancesSerial(float realDT, float gameDT)
+{
+    CL_PROFILE_SCOPE("Effects Instances");
+
     for (int i = 0, n = mInstanceEffects.size(); i < n; i++)
     {
         if (!mInstanceEffects[i].mRef.IsNull())
@@ -192,16 +220,89 @@ void cEffectsManager::Update(float realDT, float gameDT)
                 DestroyInstance(mInstanceSlots.RefFromIndex(i));
         }
     }
+}
 
-    timer.DeltaTime();
+bool cEffectsManager::UseParallelUpdate() const
+{
+    // Instances can grow their arrays during Update(), so this also needs an allocator that's safe to call from job threads.
+    return mParallelUpdate && NumJobThreads() > 1 && IsThreadSafeAllocator(mAllocator);
+}
+
+void cEffectsManager::UpdateInstancesParallel(float realDT, float gameDT)
+{
+    CL_PROFILE_SCOPE("Effects Instances");
 
+    // Serial pass: set transforms, update any types that can't run in parallel,
+    // and gather the rest into per-type batches.
     for (int i = 0; i < kMaxEffectTypes; i++)
-        if (mEffectTypes[i])
-            mEffectTypes[i]->PostUpdate(realDT, gameDT);
+        mTypeBatches[i].clear();
 
-    UpdateMSPF(timer.DeltaTime(), &mPostMSPF);
+    mUpdateBatch.clear();
+    mDeferredDestroys.clear();
 
-    UpdateMSPF(timer.GetTime(), &mOverallMSPF);
+    for (int i = 0, n = mInstanceEffects.size(); i < n; i++)
+    {
+        if (!mInstanceEffects[i].mRef.IsNull())
+        {
+            cEffectInstance& instance = mInstanceEffects[i];
+
+            CL_INDEX(instance.mType, kMaxEffectTypes);
+            cIEffectType* effectType = mEffectTypes[instance.mType];
+
+            if (effectType->IsActive(instance.mRef))
+            {
+                effectType->SetTransforms(instance.mRef, instance.mSourceTransform, Transform(mParams.mTransform, instance.mEffectTransform));
+
+                if (instance.mFlags.mPaused)
+                    ;
+                else if (effectType->ParallelUpdate())
+                    mTypeBatches[instance.mType].push_back(i);
+                else
+                {
+                    effectType->Update(instance.mRef, instance.mFlags.mRealTime ? realDT : gameDT, instance.mParams);
+
+                    if (instance.mParams->HasData())
+                        instance.mParams->ClearData();
+                }
+            }
+            else if (mInstanceEffects[i].mFlags.mOneShot)
+                mDeferredDestroys.push_back(i);
+        }
+    }
+
+    for (int i = 0; i < kMaxEffectTypes; i++)
+        mUpdateBatch.insert(mUpdateBatch.end(), mTypeBatches[i].begin(), mTypeBatches[i].end());
+
+    // Parallel pass: instances only touch their own state here.
+    for (int i = 0; i < kMaxJobThreads; i++)
+        mThreadUpdates[i] = 0;
+
+    ParallelFor(mUpdateBatch.size(), kParallelUpdateGrain,
+        [this, realDT, gameDT](int begin, int end)
+        {
+            for (int i = begin; i < end; i++)
+            {
+                const cEffectInstance& instance = mInstanceEffects[mUpdateBatch[i]];
+
+                mEffectTypes[instance.mType]->Update(instance.mRef, instance.mFlags.mRealTime ? realDT : gameDT, instance.mParams);
+            }
+
+            int thread = JobThreadIndex();
+            mThreadUpdates[thread >= 0 ? thread : 0] += end - begin;    // jobs are pinned to a thread for their duration
+        }
+    );
+
+    // Commit: anything that modifies shared state happens back on this thread.
+    for (int i = 0, n = mUpdateBatch.size(); i < n; i++)
+    {
+        cEffectInstance& instance = mInstanceEffects[mUpdateBatch[i]];
+
+        if (instance.mParams->HasData())
+            instance.mParams->ClearData();
+    }
+
+    for (int i = 0, n = mDeferredDestroys.size(); i < n; i++)
+        DestroyInstance(mInstanceSlots.RefFromIndex(mDeferredDestroys[i]));
 }
 
 
@@ -554,6 +655,21 @@ const char* cEffectsManager::StatsString() const
 
     mStats.format("%1.1f mspf", mOverallMSPF);
 
+    if (UseParallelUpdate())
+    {
+        mStats.append(" (");
+
+        for (int i = 0, n = NumJobThreads(); i < n; i++)
+        {
+            if (i > 0)
+                mStats.append("/");
+
+            mStats.append_format("%d", mThreadUpdates[i]);
+        }
+
+        mStats.append(" updates per thread)");
+    }
+
     for (int i = 0; i < kMaxEffectTypes; i++)
     {
         if (mEffectTypes[i])
@@ -579,6 +695,7 @@ void cEffectsManager::DebugMenu(nHL::cUIState* uiState)
 
     uiState->HandleToggle(itemID++, "Enabled", &mEnabled);
     uiState->HandleToggle(itemID++, "Stats", &mShowStats);
+    uiState->HandleToggle(itemID++, "Parallel Update", &mParallelUpdate);
 
     uiState->DrawSeparator();
 
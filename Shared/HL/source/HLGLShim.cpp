@@ -0,0 +1,1783 @@
+//
+//  File:       HLGLShim.cpp
+//
+//  Function:   Swappable table for the GL calls HL makes, with a recording
+//              implementation for running the renderer without a GPU.
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2014
+//
+
+#define HL_GL_SHIM_IMPL
+#include <HLGLShim.h>
+
+#ifdef HL_GL_SHIM
+
+#include <CLFileSpec.h>
+#include <CLLog.h>
+#include <CLSTL.h>
+#include <CLString.h>
+
+#ifndef CL_RELEASE
+    #include <HLGLUtilities.h>
+
+    #include <unistd.h>
+#endif
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace nHL;
+using namespace nCL;
+
+namespace
+{
+#ifndef HL_GL_NO_DRIVER
+    // --- Driver --------------------------------------------------------------
+
+    // The wrappers mostly exist to paper over differences in constness between
+    // the various platform headers.
+#define HL_GL_DRIVER(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) \
+    M_RET Driver##M_NAME M_PARAMS { return gl##M_NAME M_ARGS; }
+    HL_GL_FUNCTIONS(HL_GL_DRIVER)
+#undef HL_GL_DRIVER
+
+    const cGLShim kGLDriver =
+    {
+    #define HL_GL_DRIVER_ENTRY(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) Driver##M_NAME,
+        HL_GL_FUNCTIONS(HL_GL_DRIVER_ENTRY)
+    #undef HL_GL_DRIVER_ENTRY
+    };
+#endif
+
+
+    // --- Function info -------------------------------------------------------
+
+    const char* const kGLFunctionNames[] =
+    {
+    #define HL_GL_NAME(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) #M_NAME,
+        HL_GL_FUNCTIONS(HL_GL_NAME)
+    #undef HL_GL_NAME
+    };
+
+    const char* const kGLFunctionParams[] =
+    {
+    #define HL_GL_PARAMS(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) #M_PARAMS,
+        HL_GL_FUNCTIONS(HL_GL_PARAMS)
+    #undef HL_GL_PARAMS
+    };
+
+    const tGLCallKind kGLFunctionKinds[] =
+    {
+    #define HL_GL_KIND(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) M_KIND,
+        HL_GL_FUNCTIONS(HL_GL_KIND)
+    #undef HL_GL_KIND
+    };
+
+    const char* const kGLCallKindNames[kMaxGLCallKinds] =
+    {
+        "state",
+        "draw",
+        "clear",
+        "program",
+        "texture",
+        "buffer",
+        "target",
+        "uniform",
+        "upload",
+        "resource",
+        "query",
+        "marker"
+    };
+
+    const uint32_t kGLStateChangeKinds =
+          1 << kGLCallState
+        | 1 << kGLCallProgram
+        | 1 << kGLCallTexture
+        | 1 << kGLCallBuffer
+        | 1 << kGLCallTarget
+        | 1 << kGLCallUniform;
+
+    const int kMaxGLArgs = 10;          // glBlitFramebuffer
+    const int kMaxGLVertexAttribs = 16;
+}
+
+const cGLShim* nHL::GLShimDriver()
+{
+#ifdef HL_GL_NO_DRIVER
+    return 0;
+#else
+    return &kGLDriver;
+#endif
+}
+
+void nHL::SetGLShim(const cGLShim* shim)
+{
+    gGL = shim;
+}
+
+const char* nHL::GLFunctionName(tGLFunction f)
+{
+    return kGLFunctionNames[f];
+}
+
+tGLCallKind nHL::GLFunctionKind(tGLFunction f)
+{
+    return kGLFunctionKinds[f];
+}
+
+
+// --- Recorder state ----------------------------------------------------------
+
+namespace
+{
+    struct cGLVariable
+    {
+        tString     mName;
+        GLenum      mType       = 0;
+        GLint       mSize       = 1;    ///< Array size
+        GLint       mLocation   = -1;
+    };
+
+    struct cGLShaderInfo
+    {
+        GLenum                  mType = 0;
+        size_t                  mSourceLength = 0;
+        vector<cGLVariable>     mUniforms;
+        vector<cGLVariable>     mAttributes;
+    };
+
+    struct cGLProgramInfo
+    {
+        vector<GLuint>          mShaders;
+        vector<cGLVariable>     mUniforms;
+        vector<cGLVariable>     mAttributes;
+        map<GLint, GLint>       mUniformValues;     ///< Values set via glUniform1i, so samplers can be queried
+        bool                    mLinked = false;
+    };
+
+    struct cGLVertexArrayInfo
+    {
+        GLuint                  mElementBuffer = 0;
+        GLuint                  mAttribBuffers[kMaxGLVertexAttribs] = { 0 };
+    };
+}
+
+struct nHL::cGLRecorderInternal
+{
+    void Record(tGLFunction f, int numArgs, const uint64_t args[]);
+
+    cGLProgramInfo*     Program(GLuint program);
+    cGLShaderInfo*      Shader (GLuint shader);
+    cGLVertexArrayInfo& VertexArray() { return mVertexArrays[mVertexArray]; }
+    GLuint*             BufferBinding(GLenum target);
+
+    // Data
+    const cGLShim*          mPreviousShim = 0;
+    cGLRecorderInternal*    mPreviousRecorder = 0;
+
+    bool                    mRecordCommands = true;
+    bool                    mPassThrough = false;
+    cGLCounters             mFrame;
+    cGLCounters             mTotal;
+    int                     mNumFrames = 0;
+
+    vector<cGLCommand>      mCommands;
+    vector<uint64_t>        mArgs;
+    vector<uint8_t>         mData;
+
+    // Emulated GL state
+    GLuint                  mNextName = 1;      ///< Shared across object types, so names in the log are unambiguous
+
+    map<GLuint, cGLShaderInfo>      mShaders;
+    map<GLuint, cGLProgramInfo>     mPrograms;
+    map<GLuint, cGLVertexArrayInfo> mVertexArrays;
+    map<GLuint, size_t>             mBufferSizes;
+
+    GLuint                  mArrayBuffer = 0;
+    GLuint                  mVertexArray = 0;
+    GLuint                  mFrameBuffer = 0;
+    GLuint                  mProgram = 0;
+    GLint                   mViewport[4] = { 0 };
+
+    vector<uint8_t>         mMapped;
+    size_t                  mMappedSize = 0;
+};
+
+namespace
+{
+    cGLRecorderInternal* sRecorder = 0;     // Recorder between cGLRecorder::Begin/End
+
+    cGLRecorderInternal* Recorder()
+    {
+        if (sRecorder)
+            return sRecorder;
+
+        // Calls made via the recorder table outside of Begin/End, e.g., in
+        // HL_GL_NO_DRIVER builds, still need somewhere to go.
+        static cGLRecorderInternal sDefaultRecorder;
+        return &sDefaultRecorder;
+    }
+
+    // Arguments are recorded as raw 64-bit values
+    inline uint64_t ArgBits(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    }
+
+    template<class T> inline uint64_t ArgBits(T* p)
+    {
+        return uint64_t(uintptr_t(p));
+    }
+
+    template<class T> inline uint64_t ArgBits(T v)
+    {
+        return uint64_t(int64_t(v));
+    }
+
+    struct cGLCall
+    /// Records a call along with its arguments, via RecordCall(kGLFnName)(arg0, arg1, ...)
+    {
+        tGLFunction mFunction;
+
+        cGLCall(tGLFunction f) : mFunction(f) {}
+
+        template<class... T> void operator()(T... args) const
+        {
+            static_assert(sizeof...(args) <= kMaxGLArgs, "too many arguments");
+
+            const uint64_t argBits[] = { 0, ArgBits(args)... };
+            Recorder()->Record(mFunction, sizeof...(args), argBits + 1);
+        }
+    };
+
+    inline cGLCall RecordCall(tGLFunction f)
+    {
+        return cGLCall(f);
+    }
+
+    inline int ArgInt(const uint64_t args[], int i)
+    {
+        return int(int64_t(args[i]));
+    }
+
+    inline const void* ArgPointer(const uint64_t args[], int i)
+    {
+        return (const void*) uintptr_t(args[i]);
+    }
+
+    int Channels(GLenum format)
+    {
+        switch (format)
+        {
+        case GL_ALPHA:
+        case GL_LUMINANCE:
+        case GL_DEPTH_COMPONENT:
+        #ifdef GL_RED
+        case GL_RED:
+        #endif
+            return 1;
+        case GL_LUMINANCE_ALPHA:
+        #ifdef GL_RG
+        case GL_RG:
+        #endif
+            return 2;
+        case GL_RGB:
+            return 3;
+        }
+
+        return 4;
+    }
+
+    size_t PixelSize(GLenum format, GLenum type)
+    {
+        switch (type)
+        {
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            return 2;
+        #ifdef GL_UNSIGNED_INT_24_8
+        case GL_UNSIGNED_INT_24_8:
+            return 4;
+        #endif
+        case GL_UNSIGNED_SHORT:
+        #ifdef GL_HALF_FLOAT
+        case GL_HALF_FLOAT:
+        #endif
+            return 2 * Channels(format);
+        case GL_UNSIGNED_INT:
+        case GL_FLOAT:
+            return 4 * Channels(format);
+        }
+
+        return Channels(format);
+    }
+
+    void AddCounters(const cGLCounters& a, cGLCounters* b)
+    {
+        b->mCalls += a.mCalls;
+
+        for (int i = 0; i < kMaxGLCallKinds; i++)
+            b->mCallsOfKind[i] += a.mCallsOfKind[i];
+
+        b->mDraws        += a.mDraws;
+        b->mDrawElements += a.mDrawElements;
+        b->mStateChanges += a.mStateChanges;
+        b->mUniformBytes += a.mUniformBytes;
+        b->mBufferBytes  += a.mBufferBytes;
+        b->mTextureBytes += a.mTextureBytes;
+    }
+}
+
+cGLProgramInfo* cGLRecorderInternal::Program(GLuint program)
+{
+    auto it = mPrograms.find(program);
+
+    if (it != mPrograms.end())
+        return &it->second;
+
+    return 0;
+}
+
+cGLShaderInfo* cGLRecorderInternal::Shader(GLuint shader)
+{
+    auto it = mShaders.find(shader);
+
+    if (it != mShaders.end())
+        return &it->second;
+
+    return 0;
+}
+
+GLuint* cGLRecorderInternal::BufferBinding(GLenum target)
+{
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+        return &VertexArray().mElementBuffer;
+
+    return &mArrayBuffer;
+}
+
+void cGLRecorderInternal::Record(tGLFunction f, int numArgs, const uint64_t args[])
+{
+    tGLCallKind kind = kGLFunctionKinds[f];
+
+    mFrame.mCalls++;
+    mFrame.mCallsOfKind[kind]++;
+
+    if (kGLStateChangeKinds & (1 << kind))
+        mFrame.mStateChanges++;
+
+    if (kind == kGLCallDraw)
+        mFrame.mDraws++;
+
+    const void* data = 0;
+    size_t dataSize = 0;
+
+    switch (f)
+    {
+    // Draws
+    case kGLFnDrawArrays:
+        mFrame.mDrawElements += ArgInt(args, 2);
+        break;
+    case kGLFnDrawElements:
+        mFrame.mDrawElements += ArgInt(args, 1);
+        break;
+#ifndef CL_GLES
+    case kGLFnDrawRangeElements:
+        mFrame.mDrawElements += ArgInt(args, 3);
+        break;
+#endif
+#ifdef CL_GL_INSTANCING
+    case kGLFnDrawElementsInstanced:
+        mFrame.mDrawElements += ArgInt(args, 1) * ArgInt(args, 4);
+        break;
+#endif
+
+    // Uniforms
+    case kGLFnUniform1i:
+        mFrame.mUniformBytes += sizeof(GLint);
+
+        if (cGLProgramInfo* info = Program(mProgram))
+            info->mUniformValues[ArgInt(args, 0)] = ArgInt(args, 1);
+        break;
+
+    case kGLFnUniform1iv:
+        if (cGLProgramInfo* info = Program(mProgram))
+        {
+            const GLint* values = (const GLint*) ArgPointer(args, 2);
+
+            for (int i = 0, n = ArgInt(args, 1); i < n; i++)
+                info->mUniformValues[ArgInt(args, 0) + i] = values[i];
+        }
+        // fall through
+    case kGLFnUniform1fv:
+        dataSize = 1 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 2);
+        break;
+    case kGLFnUniform2fv:
+    case kGLFnUniform2iv:
+        dataSize = 2 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 2);
+        break;
+    case kGLFnUniform3fv:
+    case kGLFnUniform3iv:
+        dataSize = 3 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 2);
+        break;
+    case kGLFnUniform4fv:
+    case kGLFnUniform4iv:
+        dataSize = 4 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 2);
+        break;
+    case kGLFnUniformMatrix2fv:
+        dataSize = 4 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 3);
+        break;
+    case kGLFnUniformMatrix3fv:
+        dataSize = 9 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 3);
+        break;
+    case kGLFnUniformMatrix4fv:
+        dataSize = 16 * sizeof(GLfloat) * ArgInt(args, 1);
+        data = ArgPointer(args, 3);
+        break;
+
+    // Uploads
+    case kGLFnBufferData:
+        mBufferSizes[*BufferBinding(args[0])] = size_t(args[1]);
+
+        if (ArgPointer(args, 2))
+            mFrame.mBufferBytes += size_t(args[1]);
+        break;
+    case kGLFnBufferSubData:
+        mFrame.mBufferBytes += size_t(args[2]);
+        break;
+    case kGLFnMapBuffer:
+        mMappedSize = mBufferSizes[*BufferBinding(args[0])];
+        break;
+#if GL_EXT_map_buffer_range
+    case kGLFnMapBufferRange:
+        mMappedSize = size_t(args[2]);
+        break;
+#endif
+    case kGLFnUnmapBuffer:
+        mFrame.mBufferBytes += mMappedSize;
+        mMappedSize = 0;
+        break;
+    case kGLFnTexImage2D:
+        if (ArgPointer(args, 8))
+            mFrame.mTextureBytes += size_t(ArgInt(args, 3)) * ArgInt(args, 4) * PixelSize(args[6], args[7]);
+        break;
+    case kGLFnTexSubImage2D:
+        mFrame.mTextureBytes += size_t(ArgInt(args, 4)) * ArgInt(args, 5) * PixelSize(args[6], args[7]);
+        break;
+    case kGLFnCompressedTexImage2D:
+        if (ArgPointer(args, 7))
+            mFrame.mTextureBytes += ArgInt(args, 6);
+        break;
+
+    // Bindings
+    case kGLFnBindBuffer:
+        *BufferBinding(args[0]) = args[1];
+        break;
+    case kGLFnBindVertexArray:
+        mVertexArray = args[0];
+        break;
+    case kGLFnVertexAttribPointer:
+        if (args[0] < kMaxGLVertexAttribs)
+            VertexArray().mAttribBuffers[args[0]] = mArrayBuffer;
+        break;
+    case kGLFnBindFramebuffer:
+        mFrameBuffer = args[1];
+        break;
+    case kGLFnUseProgram:
+        mProgram = args[0];
+        break;
+    case kGLFnViewport:
+        for (int i = 0; i < 4; i++)
+            mViewport[i] = ArgInt(args, i);
+        break;
+
+    // Objects
+    case kGLFnAttachShader:
+        if (cGLProgramInfo* info = Program(args[0]))
+            info->mShaders.push_back(args[1]);
+        break;
+    case kGLFnDetachShader:
+        if (cGLProgramInfo* info = Program(args[0]))
+        {
+            auto it = find(info->mShaders.begin(), info->mShaders.end(), GLuint(args[1]));
+
+            if (it != info->mShaders.end())
+                info->mShaders.erase(it);
+        }
+        break;
+    case kGLFnDeleteShader:
+        mShaders.erase(args[0]);
+        break;
+    case kGLFnDeleteProgram:
+        mPrograms.erase(args[0]);
+        break;
+    case kGLFnDeleteBuffers:
+        {
+            const GLuint* buffers = (const GLuint*) ArgPointer(args, 1);
+
+            for (int i = 0, n = ArgInt(args, 0); i < n; i++)
+                mBufferSizes.erase(buffers[i]);
+        }
+        break;
+    case kGLFnDeleteVertexArrays:
+        {
+            const GLuint* arrays = (const GLuint*) ArgPointer(args, 1);
+
+            for (int i = 0, n = ArgInt(args, 0); i < n; i++)
+                if (arrays[i] != 0)
+                    mVertexArrays.erase(arrays[i]);
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (data)
+        mFrame.mUniformBytes += dataSize;
+
+    if (!mRecordCommands)
+        return;
+
+    mCommands.push_back();
+    cGLCommand& command = mCommands.back();
+
+    command.mFunction   = f;
+    command.mNumArgs    = numArgs;
+    command.mFirstArg   = mArgs.size();
+    command.mDataOffset = mData.size();
+    command.mDataSize   = data ? dataSize : 0;
+
+    mArgs.insert(mArgs.end(), args, args + numArgs);
+
+    if (data)
+        mData.insert(mData.end(), (const uint8_t*) data, (const uint8_t*) data + dataSize);
+}
+
+
+// --- GLSL scanning -----------------------------------------------------------
+
+namespace
+{
+    // There's no compiler behind the recorder, so to support HL's shader
+    // reflection we pull uniform and attribute declarations out of the source.
+    // Unlike a real driver, everything declared is reported as active.
+
+    struct cGLSLType
+    {
+        const char* mName;
+        GLenum      mType;
+    };
+
+    const cGLSLType kGLSLTypes[] =
+    {
+        "float",        GL_FLOAT,
+        "vec2",         GL_FLOAT_VEC2,
+        "vec3",         GL_FLOAT_VEC3,
+        "vec4",         GL_FLOAT_VEC4,
+        "int",          GL_INT,
+        "ivec2",        GL_INT_VEC2,
+        "ivec3",        GL_INT_VEC3,
+        "ivec4",        GL_INT_VEC4,
+        "bool",         GL_BOOL,
+        "bvec2",        GL_BOOL_VEC2,
+        "bvec3",        GL_BOOL_VEC3,
+        "bvec4",        GL_BOOL_VEC4,
+        "mat2",         GL_FLOAT_MAT2,
+        "mat3",         GL_FLOAT_MAT3,
+        "mat4",         GL_FLOAT_MAT4,
+        "sampler2D",    GL_SAMPLER_2D,
+        "samplerCube",  GL_SAMPLER_CUBE,
+    #ifdef GL_SAMPLER_3D
+        "sampler3D",    GL_SAMPLER_3D,
+    #endif
+    #ifdef GL_SAMPLER_2D_SHADOW
+        "sampler2DShadow", GL_SAMPLER_2D_SHADOW,
+    #endif
+    };
+
+    const char* const kGLSLQualifiers[] =
+    {
+        "lowp", "mediump", "highp", "precise", "invariant", "const",
+        "flat", "smooth", "noperspective", "centroid"
+    };
+
+    GLenum GLSLType(const tString& name)
+    {
+        for (const cGLSLType& t : kGLSLTypes)
+            if (name == t.mName)
+                return t.mType;
+
+        return 0;
+    }
+
+    bool IsQualifier(const tString& name)
+    {
+        for (const char* q : kGLSLQualifiers)
+            if (name == q)
+                return true;
+
+        return false;
+    }
+
+    inline bool IsIdentChar(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    const char* SkipToLineEnd(const char* s, const char* end)
+    {
+        // Includes any continuation lines
+        while (s < end && *s != '\n')
+        {
+            if (s[0] == '\\' && s + 1 < end && s[1] == '\n')
+                s++;
+            s++;
+        }
+
+        return s;
+    }
+
+    void AddVariable(vector<cGLVariable>* variables, const tString& name, GLenum type, int size)
+    {
+        for (const cGLVariable& v : *variables)
+            if (v.mName == name)
+                return;
+
+        variables->push_back();
+        variables->back().mName = name;
+        variables->back().mType = type;
+        variables->back().mSize = size;
+    }
+
+    void ScanDeclaration(const vector<tString>& tokens, GLenum shaderType, cGLShaderInfo* info)
+    {
+        int n = tokens.size();
+        int i = 0;
+
+        // Leading qualifiers and layout(...)
+        while (i < n)
+        {
+            if (tokens[i] == "layout")
+            {
+                while (i < n && tokens[i] != ")")
+                    i++;
+                i++;
+            }
+            else if (IsQualifier(tokens[i]))
+                i++;
+            else
+                break;
+        }
+
+        if (i >= n)
+            return;
+
+        vector<cGLVariable>* variables;
+
+        if (tokens[i] == "uniform")
+            variables = &info->mUniforms;
+        else if (tokens[i] == "attribute" || (tokens[i] == "in" && shaderType == GL_VERTEX_SHADER))
+            variables = &info->mAttributes;
+        else
+            return;
+
+        // Skip precision qualifiers, including macros like LP, up to the type
+        GLenum type = 0;
+
+        for (i++; i < n && type == 0; i++)
+            type = GLSLType(tokens[i]);
+
+        if (type == 0)
+            return;     // struct or uniform block
+
+        // name [N], name, ...
+        while (i < n)
+        {
+            const tString& name = tokens[i++];
+            int size = 1;
+
+            if (i + 2 < n && tokens[i] == "[" && tokens[i + 2] == "]")
+            {
+                size = atoi(tokens[i + 1].c_str());
+                i += 3;
+            }
+
+            AddVariable(variables, name, type, size > 0 ? size : 1);
+
+            while (i < n && tokens[i] != ",")
+                i++;
+            i++;
+        }
+    }
+
+    void ScanGLSL(const char* s, const char* end, GLenum shaderType, cGLShaderInfo* info)
+    {
+        vector<tString> tokens;
+        bool lineStart = true;
+
+        while (s < end)
+        {
+            char c = *s;
+
+            if (c == '\n')
+            {
+                lineStart = true;
+                s++;
+                continue;
+            }
+
+            if (c == ' ' || c == '\t' || c == '\r')
+            {
+                s++;
+                continue;
+            }
+
+            if (c == '#' && lineStart)
+            {
+                s = SkipToLineEnd(s, end);
+                continue;
+            }
+
+            lineStart = false;
+
+            if (c == '/' && s + 1 < end && s[1] == '/')
+            {
+                s = SkipToLineEnd(s, end);
+                continue;
+            }
+
+            if (c == '/' && s + 1 < end && s[1] == '*')
+            {
+                for (s += 2; s + 1 < end && !(s[0] == '*' && s[1] == '/'); s++)
+                    ;
+                s += 2;
+                continue;
+            }
+
+            if (c == ';' || c == '{' || c == '}')
+            {
+                ScanDeclaration(tokens, shaderType, info);
+                tokens.clear();
+                s++;
+                continue;
+            }
+
+            const char* tokenStart = s;
+
+            if (IsIdentChar(c))
+                while (s < end && IsIdentChar(*s))
+                    s++;
+            else
+                s++;
+
+            tokens.push_back(tString(tokenStart, s - tokenStart));
+        }
+    }
+
+    void LinkVariables(const vector<cGLVariable>& shaderVariables, vector<cGLVariable>* programVariables, GLint* nextLocation)
+    {
+        for (const cGLVariable& v : shaderVariables)
+        {
+            bool found = false;
+
+            for (const cGLVariable& pv : *programVariables)
+                if (pv.mName == v.mName)
+                    found = true;
+
+            if (found)
+                continue;
+
+            programVariables->push_back(v);
+            programVariables->back().mLocation = *nextLocation;
+            *nextLocation += v.mSize;
+        }
+    }
+
+    GLint MaxNameLength(const vector<cGLVariable>& variables)
+    {
+        GLint maxLength = 0;
+
+        for (const cGLVariable& v : variables)
+            maxLength = max(maxLength, GLint(v.mName.size() + (v.mSize > 1 ? 3 : 0) + 1));
+
+        return maxLength;
+    }
+
+    void GetActiveVariable(const vector<cGLVariable>& variables, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+    {
+        if (index >= variables.size())
+        {
+            if (length)
+                *length = 0;
+            if (bufSize > 0)
+                name[0] = 0;
+            return;
+        }
+
+        const cGLVariable& v = variables[index];
+
+        // As with a real driver, arrays are reported as "name[0]"
+        tString fullName(v.mName);
+
+        if (v.mSize > 1)
+            fullName += "[0]";
+
+        GLsizei copyLength = 0;
+
+        if (bufSize > 0)
+        {
+            copyLength = min(GLsizei(fullName.size()), bufSize - 1);
+            memcpy(name, fullName.c_str(), copyLength);
+            name[copyLength] = 0;
+        }
+
+        if (length)
+            *length = copyLength;
+
+        *size = v.mSize;
+        *type = v.mType;
+    }
+}
+
+
+// --- Recorder GL implementation ----------------------------------------------
+
+namespace
+{
+    // Functions that only need recording
+#define HL_GL_RECORD(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) \
+    void Record##M_NAME M_PARAMS { RecordCall(kGLFn##M_NAME) M_ARGS; }
+    HL_GL_FUNCTIONS_RECORDED(HL_GL_RECORD)
+    HL_GL_FUNCTIONS_OPTIONAL(HL_GL_RECORD)
+#undef HL_GL_RECORD
+
+    // Emulated functions
+    GLenum RecordCheckFramebufferStatus(GLenum target)
+    {
+        RecordCall(kGLFnCheckFramebufferStatus)(target);
+        return GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    GLuint RecordCreateProgram()
+    {
+        cGLRecorderInternal* r = Recorder();
+        GLuint program = r->mNextName++;
+
+        r->mPrograms[program];
+
+        RecordCall(kGLFnCreateProgram)();
+        return program;
+    }
+
+    GLuint RecordCreateShader(GLenum type)
+    {
+        cGLRecorderInternal* r = Recorder();
+        GLuint shader = r->mNextName++;
+
+        r->mShaders[shader].mType = type;
+
+        RecordCall(kGLFnCreateShader)(type);
+        return shader;
+    }
+
+    void GenNames(GLsizei n, GLuint* names)
+    {
+        cGLRecorderInternal* r = Recorder();
+
+        for (int i = 0; i < n; i++)
+            names[i] = r->mNextName++;
+    }
+
+    void RecordGenBuffers(GLsizei n, GLuint* buffers)
+    {
+        GenNames(n, buffers);
+        RecordCall(kGLFnGenBuffers)(n, buffers);
+    }
+
+    void RecordGenFramebuffers(GLsizei n, GLuint* framebuffers)
+    {
+        GenNames(n, framebuffers);
+        RecordCall(kGLFnGenFramebuffers)(n, framebuffers);
+    }
+
+    void RecordGenRenderbuffers(GLsizei n, GLuint* renderbuffers)
+    {
+        GenNames(n, renderbuffers);
+        RecordCall(kGLFnGenRenderbuffers)(n, renderbuffers);
+    }
+
+    void RecordGenTextures(GLsizei n, GLuint* textures)
+    {
+        GenNames(n, textures);
+        RecordCall(kGLFnGenTextures)(n, textures);
+    }
+
+    void RecordGenVertexArrays(GLsizei n, GLuint* arrays)
+    {
+        GenNames(n, arrays);
+        RecordCall(kGLFnGenVertexArrays)(n, arrays);
+    }
+
+    void RecordGetActiveAttrib(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+    {
+        RecordCall(kGLFnGetActiveAttrib)(program, index, bufSize, length, size, type, name);
+
+        static const vector<cGLVariable> kNone;
+        cGLProgramInfo* info = Recorder()->Program(program);
+
+        GetActiveVariable(info ? info->mAttributes : kNone, index, bufSize, length, size, type, name);
+    }
+
+    void RecordGetActiveUniform(GLuint program, GLuint index, GLsizei bufSize, GLsizei* length, GLint* size, GLenum* type, GLchar* name)
+    {
+        RecordCall(kGLFnGetActiveUniform)(program, index, bufSize, length, size, type, name);
+
+        static const vector<cGLVariable> kNone;
+        cGLProgramInfo* info = Recorder()->Program(program);
+
+        GetActiveVariable(info ? info->mUniforms : kNone, index, bufSize, length, size, type, name);
+    }
+
+    void RecordGetAttachedShaders(GLuint program, GLsizei maxCount, GLsizei* count, GLuint* shaders)
+    {
+        RecordCall(kGLFnGetAttachedShaders)(program, maxCount, count, shaders);
+
+        cGLProgramInfo* info = Recorder()->Program(program);
+        GLsizei n = info ? min(GLsizei(info->mShaders.size()), maxCount) : 0;
+
+        for (int i = 0; i < n; i++)
+            shaders[i] = info->mShaders[i];
+
+        if (count)
+            *count = n;
+    }
+
+    GLenum RecordGetError()
+    {
+        RecordCall(kGLFnGetError)();
+        return GL_NO_ERROR;
+    }
+
+    void RecordGetIntegerv(GLenum pname, GLint* params)
+    {
+        RecordCall(kGLFnGetIntegerv)(pname, params);
+
+        cGLRecorderInternal* r = Recorder();
+
+        switch (pname)
+        {
+        case GL_ARRAY_BUFFER_BINDING:
+            *params = r->mArrayBuffer;
+            break;
+        case GL_ELEMENT_ARRAY_BUFFER_BINDING:
+            *params = r->VertexArray().mElementBuffer;
+            break;
+        case GL_FRAMEBUFFER_BINDING:
+            *params = r->mFrameBuffer;
+            break;
+        case GL_CURRENT_PROGRAM:
+            *params = r->mProgram;
+            break;
+        case GL_VIEWPORT:
+            for (int i = 0; i < 4; i++)
+                params[i] = r->mViewport[i];
+            break;
+    #ifdef GL_VERTEX_ARRAY_BINDING
+        case GL_VERTEX_ARRAY_BINDING:
+            *params = r->mVertexArray;
+            break;
+    #endif
+
+        // Limits: typical of current mobile hardware
+        case GL_MAX_TEXTURE_SIZE:
+            *params = 4096;
+            break;
+        case GL_DEPTH_BITS:
+            *params = 24;
+            break;
+        case GL_STENCIL_BITS:
+            *params = 8;
+            break;
+        case GL_MAX_VERTEX_ATTRIBS:
+            *params = kMaxGLVertexAttribs;
+            break;
+    #ifdef GL_MAX_VERTEX_UNIFORM_VECTORS
+        case GL_MAX_VERTEX_UNIFORM_VECTORS:
+        case GL_MAX_FRAGMENT_UNIFORM_VECTORS:
+            *params = 128;
+            break;
+        case GL_MAX_VARYING_VECTORS:
+            *params = 8;
+            break;
+    #endif
+        case GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS:
+        case GL_MAX_TEXTURE_IMAGE_UNITS:
+            *params = 8;
+            break;
+    #ifdef GL_IMPLEMENTATION_COLOR_READ_FORMAT
+        case GL_IMPLEMENTATION_COLOR_READ_FORMAT:
+            *params = GL_RGBA;
+            break;
+        case GL_IMPLEMENTATION_COLOR_READ_TYPE:
+            *params = GL_UNSIGNED_BYTE;
+            break;
+    #endif
+
+        default:
+            *params = 0;
+        }
+    }
+
+    void RecordGetProgramInfoLog(GLuint program, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+    {
+        RecordCall(kGLFnGetProgramInfoLog)(program, bufSize, length, infoLog);
+
+        if (length)
+            *length = 0;
+        if (bufSize > 0)
+            infoLog[0] = 0;
+    }
+
+    void RecordGetProgramiv(GLuint program, GLenum pname, GLint* params)
+    {
+        RecordCall(kGLFnGetProgramiv)(program, pname, params);
+
+        const cGLProgramInfo* info = Recorder()->Program(program);
+
+        if (!info)
+        {
+            *params = 0;
+            return;
+        }
+
+        switch (pname)
+        {
+        case GL_LINK_STATUS:
+            *params = info->mLinked ? GL_TRUE : GL_FALSE;
+            break;
+        case GL_VALIDATE_STATUS:
+            *params = GL_TRUE;
+            break;
+        case GL_ATTACHED_SHADERS:
+            *params = info->mShaders.size();
+            break;
+        case GL_ACTIVE_UNIFORMS:
+            *params = info->mUniforms.size();
+            break;
+        case GL_ACTIVE_UNIFORM_MAX_LENGTH:
+            *params = MaxNameLength(info->mUniforms);
+            break;
+        case GL_ACTIVE_ATTRIBUTES:
+            *params = info->mAttributes.size();
+            break;
+        case GL_ACTIVE_ATTRIBUTE_MAX_LENGTH:
+            *params = MaxNameLength(info->mAttributes);
+            break;
+        default:
+            *params = 0;    // includes GL_INFO_LOG_LENGTH, GL_DELETE_STATUS
+        }
+    }
+
+    void RecordGetShaderInfoLog(GLuint shader, GLsizei bufSize, GLsizei* length, GLchar* infoLog)
+    {
+        RecordCall(kGLFnGetShaderInfoLog)(shader, bufSize, length, infoLog);
+
+        if (length)
+            *length = 0;
+        if (bufSize > 0)
+            infoLog[0] = 0;
+    }
+
+    void RecordGetShaderiv(GLuint shader, GLenum pname, GLint* params)
+    {
+        RecordCall(kGLFnGetShaderiv)(shader, pname, params);
+
+        const cGLShaderInfo* info = Recorder()->Shader(shader);
+
+        if (!info)
+        {
+            *params = 0;
+            return;
+        }
+
+        switch (pname)
+        {
+        case GL_COMPILE_STATUS:
+            *params = GL_TRUE;
+            break;
+        case GL_SHADER_TYPE:
+            *params = info->mType;
+            break;
+        case GL_SHADER_SOURCE_LENGTH:
+            *params = info->mSourceLength;
+            break;
+        default:
+            *params = 0;
+        }
+    }
+
+    const GLubyte* RecordGetString(GLenum name)
+    {
+        RecordCall(kGLFnGetString)(name);
+
+        switch (name)
+        {
+        case GL_VENDOR:
+            return (const GLubyte*) "HL";
+        case GL_RENDERER:
+            return (const GLubyte*) "HL GL recorder";
+        case GL_VERSION:
+        #ifdef CL_GLES
+            return (const GLubyte*) "OpenGL ES 2.0";
+        #else
+            return (const GLubyte*) "2.1";
+        #endif
+        case GL_SHADING_LANGUAGE_VERSION:
+        #ifdef CL_GLES
+            return (const GLubyte*) "OpenGL ES GLSL ES 1.00";
+        #else
+            return (const GLubyte*) "1.20";
+        #endif
+        }
+
+        return (const GLubyte*) "";
+    }
+
+    GLint RecordGetUniformLocation(GLuint program, const GLchar* name)
+    {
+        RecordCall(kGLFnGetUniformLocation)(program, name);
+
+        const cGLProgramInfo* info = Recorder()->Program(program);
+
+        if (!info)
+            return -1;
+
+        // Accept "name", "name[0]", and "name[i]"
+        const char* bracket = strchr(name, '[');
+        size_t nameLength = bracket ? bracket - name : strlen(name);
+        int element = bracket ? atoi(bracket + 1) : 0;
+
+        for (const cGLVariable& v : info->mUniforms)
+            if (v.mName.size() == nameLength && memcmp(v.mName.c_str(), name, nameLength) == 0)
+                return (element >= 0 && element < v.mSize) ? v.mLocation + element : -1;
+
+        return -1;
+    }
+
+    void RecordGetUniformiv(GLuint program, GLint location, GLint* params)
+    {
+        RecordCall(kGLFnGetUniformiv)(program, location, params);
+
+        const cGLProgramInfo* info = Recorder()->Program(program);
+        *params = 0;
+
+        if (info)
+        {
+            auto it = info->mUniformValues.find(location);
+
+            if (it != info->mUniformValues.end())
+                *params = it->second;
+        }
+    }
+
+    void RecordGetVertexAttribiv(GLuint index, GLenum pname, GLint* params)
+    {
+        RecordCall(kGLFnGetVertexAttribiv)(index, pname, params);
+
+        if (pname == GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING && index < kMaxGLVertexAttribs)
+            *params = Recorder()->VertexArray().mAttribBuffers[index];
+        else
+            *params = 0;
+    }
+
+    void RecordLinkProgram(GLuint program)
+    {
+        RecordCall(kGLFnLinkProgram)(program);
+
+        cGLRecorderInternal* r = Recorder();
+        cGLProgramInfo* info = r->Program(program);
+
+        if (!info)
+            return;
+
+        info->mUniforms.clear();
+        info->mAttributes.clear();
+
+        GLint nextUniform = 0;
+        GLint nextAttribute = 0;
+
+        for (GLuint shader : info->mShaders)
+            if (const cGLShaderInfo* shaderInfo = r->Shader(shader))
+            {
+                LinkVariables(shaderInfo->mUniforms,   &info->mUniforms,   &nextUniform);
+                LinkVariables(shaderInfo->mAttributes, &info->mAttributes, &nextAttribute);
+            }
+
+        info->mLinked = true;
+    }
+
+    void* MapScratch(size_t size)
+    {
+        cGLRecorderInternal* r = Recorder();
+
+        if (r->mMapped.size() < size)
+            r->mMapped.resize(size);
+
+        return r->mMapped.data();
+    }
+
+    void* RecordMapBuffer(GLenum target, GLenum access)
+    {
+        RecordCall(kGLFnMapBuffer)(target, access);
+
+        cGLRecorderInternal* r = Recorder();
+        return MapScratch(r->mBufferSizes[*r->BufferBinding(target)]);
+    }
+
+#if GL_EXT_map_buffer_range
+    void* RecordMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+    {
+        RecordCall(kGLFnMapBufferRange)(target, offset, length, access);
+        return MapScratch(length);
+    }
+#endif
+
+    void RecordReadPixels(GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, void* pixels)
+    {
+        RecordCall(kGLFnReadPixels)(x, y, width, height, format, type, pixels);
+
+        memset(pixels, 0, size_t(width) * height * PixelSize(format, type));
+    }
+
+    void RecordShaderSource(GLuint shader, GLsizei count, const GLchar* const* strings, const GLint* lengths)
+    {
+        RecordCall(kGLFnShaderSource)(shader, count, strings, lengths);
+
+        cGLShaderInfo* info = Recorder()->Shader(shader);
+
+        if (!info)
+            return;
+
+        info->mUniforms.clear();
+        info->mAttributes.clear();
+        info->mSourceLength = 0;
+
+        tString source;
+
+        for (int i = 0; i < count; i++)
+        {
+            size_t length = (lengths && lengths[i] >= 0) ? lengths[i] : strlen(strings[i]);
+            source.append(strings[i], length);
+        }
+
+        info->mSourceLength = source.size() + 1;
+
+        ScanGLSL(source.data(), source.data() + source.size(), info->mType, info);
+    }
+
+    GLboolean RecordUnmapBuffer(GLenum target)
+    {
+        RecordCall(kGLFnUnmapBuffer)(target);
+        return GL_TRUE;
+    }
+
+    const cGLShim kGLRecorder =
+    {
+    #define HL_GL_RECORD_ENTRY(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) Record##M_NAME,
+        HL_GL_FUNCTIONS(HL_GL_RECORD_ENTRY)
+    #undef HL_GL_RECORD_ENTRY
+    };
+
+
+    // --- Pass-through --------------------------------------------------------
+
+    // Records each call, then forwards it to the implementation that was
+    // current on Begin(), so a live frame can be captured without the
+    // renderer's GL state caches going out of sync with the driver.
+
+    struct cForwardScope
+    /// Makes the previous recorder current while forwarding, so that if we're
+    /// forwarding to another recorder, the call is recorded there rather than
+    /// twice here.
+    {
+        cGLRecorderInternal* mRecorder;
+
+        cForwardScope(cGLRecorderInternal* r) : mRecorder(r) { sRecorder = r->mPreviousRecorder; }
+        ~cForwardScope() { sRecorder = mRecorder; }
+    };
+
+#define HL_GL_PASS(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) \
+    M_RET Pass##M_NAME M_PARAMS                             \
+    {                                                       \
+        cGLRecorderInternal* r = Recorder();                \
+        RecordCall(kGLFn##M_NAME) M_ARGS;                   \
+                                                            \
+        cForwardScope scope(r);                             \
+        return r->mPreviousShim->M_NAME M_ARGS;             \
+    }
+    HL_GL_FUNCTIONS(HL_GL_PASS)
+#undef HL_GL_PASS
+
+    const cGLShim kGLPassThrough =
+    {
+    #define HL_GL_PASS_ENTRY(M_RET, M_NAME, M_PARAMS, M_ARGS, M_KIND) Pass##M_NAME,
+        HL_GL_FUNCTIONS(HL_GL_PASS_ENTRY)
+    #undef HL_GL_PASS_ENTRY
+    };
+}
+
+#ifdef HL_GL_NO_DRIVER
+const cGLShim* nHL::gGL = &kGLRecorder;
+#else
+const cGLShim* nHL::gGL = &kGLDriver;
+#endif
+
+
+// --- cGLRecorder -------------------------------------------------------------
+
+cGLRecorder::cGLRecorder() :
+    mInternal(new cGLRecorderInternal)
+{
+}
+
+cGLRecorder::~cGLRecorder()
+{
+    if (sRecorder == mInternal)
+        End();
+
+    delete mInternal;
+}
+
+void cGLRecorder::Begin()
+{
+    CL_ASSERT(sRecorder != mInternal);
+
+    mInternal->mPreviousShim = gGL;
+    mInternal->mPreviousRecorder = sRecorder;
+
+    sRecorder = mInternal;
+    gGL = mInternal->mPassThrough && mInternal->mPreviousShim ? &kGLPassThrough : &kGLRecorder;
+}
+
+void cGLRecorder::End()
+{
+    CL_ASSERT(sRecorder == mInternal);
+
+    gGL = mInternal->mPreviousShim;
+    sRecorder = mInternal->mPreviousRecorder;
+}
+
+void cGLRecorder::BeginFrame()
+{
+    mInternal->mFrame = cGLCounters();
+
+    mInternal->mCommands.clear();
+    mInternal->mArgs.clear();
+    mInternal->mData.clear();
+}
+
+void cGLRecorder::EndFrame()
+{
+    AddCounters(mInternal->mFrame, &mInternal->mTotal);
+    mInternal->mNumFrames++;
+}
+
+void cGLRecorder::SetRecordCommands(bool enabled)
+{
+    mInternal->mRecordCommands = enabled;
+}
+
+void cGLRecorder::SetPassThrough(bool enabled)
+{
+    CL_ASSERT_MSG(sRecorder != mInternal, "Pass-through must be set before Begin()\n");
+    mInternal->mPassThrough = enabled;
+}
+
+const cGLCounters& cGLRecorder::FrameCounters() const
+{
+    return mInternal->mFrame;
+}
+
+const cGLCounters& cGLRecorder::TotalCounters() const
+{
+    return mInternal->mTotal;
+}
+
+int cGLRecorder::NumFrames() const
+{
+    return mInternal->mNumFrames;
+}
+
+int cGLRecorder::NumCommands() const
+{
+    return mInternal->mCommands.size();
+}
+
+const cGLCommand& cGLRecorder::Command(int i) const
+{
+    return mInternal->mCommands[i];
+}
+
+uint64_t cGLRecorder::CommandArg(int i, int arg) const
+{
+    const cGLCommand& command = mInternal->mCommands[i];
+    CL_ASSERT(arg < command.mNumArgs);
+
+    return mInternal->mArgs[command.mFirstArg + arg];
+}
+
+const uint8_t* cGLRecorder::CommandData(int i, size_t* size) const
+{
+    const cGLCommand& command = mInternal->mCommands[i];
+
+    *size = command.mDataSize;
+
+    if (command.mDataSize == 0)
+        return 0;
+
+    return mInternal->mData.data() + command.mDataOffset;
+}
+
+namespace
+{
+    enum tArgFormat
+    {
+        kArgSigned,
+        kArgHex,            ///< enums and bitfields
+        kArgFloat,
+        kArgPointer
+    };
+
+    tArgFormat ArgFormat(const char* params, int arg)
+    {
+        // params is the stringised parameter list, e.g., "(GLenum target, GLuint buffer)"
+        const char* s = params + 1;
+
+        for (int i = 0; i < arg; i++)
+        {
+            s = strchr(s, ',');
+
+            if (!s)
+                return kArgSigned;
+
+            s++;
+        }
+
+        while (*s == ' ')
+            s++;
+
+        const char* paramEnd = strpbrk(s, ",)");
+
+        if (memchr(s, '*', paramEnd - s))
+            return kArgPointer;
+        if (strncmp(s, "GLenum", 6) == 0 || strncmp(s, "GLbitfield", 10) == 0)
+            return kArgHex;
+        if (strncmp(s, "GLfloat", 7) == 0)
+            return kArgFloat;
+
+        return kArgSigned;
+    }
+
+    void AppendFormat(nCL::string* s, const char* format, ...)
+    {
+        char buffer[256];
+
+        va_list args;
+        va_start(args, format);
+        vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+
+        s->append(buffer);
+    }
+}
+
+void cGLRecorder::DescribeCommand(int i, nCL::string* description) const
+{
+    const cGLCommand& command = mInternal->mCommands[i];
+    const char* params = kGLFunctionParams[command.mFunction];
+
+    description->append(kGLFunctionNames[command.mFunction]);
+    description->append("(");
+
+    for (int j = 0; j < command.mNumArgs; j++)
+    {
+        uint64_t arg = mInternal->mArgs[command.mFirstArg + j];
+
+        if (j > 0)
+            description->append(", ");
+
+        switch (ArgFormat(params, j))
+        {
+        case kArgSigned:
+            AppendFormat(description, "%lld", (long long) arg);
+            break;
+        case kArgHex:
+            AppendFormat(description, "0x%04x", uint32_t(arg));
+            break;
+        case kArgFloat:
+            {
+                uint32_t bits = uint32_t(arg);
+                float f;
+                memcpy(&f, &bits, sizeof(f));
+                AppendFormat(description, "%g", f);
+            }
+            break;
+        case kArgPointer:
+            AppendFormat(description, "0x%llx", (unsigned long long) arg);
+            break;
+        }
+    }
+
+    description->append(")");
+}
+
+void cGLRecorder::DescribeCounters(const cGLCounters& counters, nCL::string* description) const
+{
+    AppendFormat(description, "%d calls, %d draws (%d elements), %d state changes, uniforms %zu bytes, buffers %zu bytes, textures %zu bytes\n",
+        counters.mCalls, counters.mDraws, counters.mDrawElements, counters.mStateChanges,
+        counters.mUniformBytes, counters.mBufferBytes, counters.mTextureBytes
+    );
+
+    for (int i = 0; i < kMaxGLCallKinds; i++)
+        if (counters.mCallsOfKind[i])
+            AppendFormat(description, "  %-8s %d\n", kGLCallKindNames[i], counters.mCallsOfKind[i]);
+}
+
+
+#ifndef CL_RELEASE
+
+// --- Test --------------------------------------------------------------------
+
+namespace
+{
+    const char* const kTestVS =
+        "// test vertex shader\n"
+        "#ifdef GL_ES\n"
+        "    #define MP mediump\n"
+        "#endif\n"
+        "uniform mat4 modelToClip;\n"
+        "uniform MP vec4 tints[4], fade;\n"
+        "attribute vec4 inPosition;\n"
+        "attribute vec2 inTexCoord;\n"
+        "varying vec2 varyUV;\n"
+        "\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = modelToClip * inPosition;\n"
+        "    varyUV = inTexCoord;\n"
+        "}\n";
+
+    const char* const kTestFS =
+        "/* test fragment shader,\n"
+        "   uniform float notAUniform; */\n"
+        "uniform lowp sampler2D diffuseMap;\n"
+        "uniform mat4 modelToClip;\n"
+        "varying vec2 varyUV;\n"
+        "\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = texture2D(diffuseMap, varyUV);\n"
+        "}\n";
+
+    bool WriteTestFile(const char* path, const char* contents)
+    {
+        FILE* file = fopen(path, "w");
+
+        if (!file)
+            return false;
+
+        fputs(contents, file);
+        fclose(file);
+
+        return true;
+    }
+
+    bool Check(bool condition, const char* what)
+    {
+        if (!condition)
+            printf("GL recorder test: %s failed\n", what);
+
+        return condition;
+    }
+}
+
+bool nHL::TestGLRecorder()
+{
+    tString tempPath;
+    GetTempPath(&tempPath);
+    tempPath += "/glrecorder-XXXXXX";
+
+    if (!mkdtemp(&tempPath[0]))
+    {
+        printf("GL recorder test: couldn't create scratch directory %s\n", tempPath.c_str());
+        return false;
+    }
+
+    tString vsPath = tempPath + "/test.vsh";
+    tString fsPath = tempPath + "/test.fsh";
+
+    if (!WriteTestFile(vsPath.c_str(), kTestVS) || !WriteTestFile(fsPath.c_str(), kTestFS))
+    {
+        printf("GL recorder test: couldn't write shaders\n");
+        return false;
+    }
+
+    bool success = true;
+
+    cGLRecorder recorder;
+    recorder.Begin();
+
+    // Shader loading relies on emulated reflection
+    GLuint program = LoadShaders(vsPath.c_str(), fsPath.c_str(), 0, "test");
+
+    success &= Check(program != 0, "LoadShaders");
+
+    GLint numUniforms = 0;
+    GLint numAttributes = 0;
+    gGL->GetProgramiv(program, GL_ACTIVE_UNIFORMS,   &numUniforms);
+    gGL->GetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &numAttributes);
+
+    success &= Check(numUniforms == 4 && numAttributes == 2, "uniform/attribute scan");
+
+    GLint diffuseLocation = gGL->GetUniformLocation(program, "diffuseMap");
+    GLint diffuseUnit = -1;
+    gGL->GetUniformiv(program, diffuseLocation, &diffuseUnit);
+
+    success &= Check(diffuseLocation >= 0 && diffuseUnit == kTextureDiffuseMap, "sampler binding");
+    success &= Check(gGL->GetUniformLocation(program, "tints[2]") == gGL->GetUniformLocation(program, "tints") + 2, "array uniform location");
+
+    // One frame's worth of drawing
+    recorder.BeginFrame();
+
+    const GLfloat kMatrix[16] = { 1, 0, 0, 0,  0, 1, 0, 0,  0, 0, 1, 0,  0, 0, 0, 1 };
+    GLuint vb;
+
+    gGL->UseProgram(program);
+    gGL->UniformMatrix4fv(gGL->GetUniformLocation(program, "modelToClip"), 1, GL_FALSE, kMatrix);
+
+    gGL->GenBuffers(1, &vb);
+    gGL->BindBuffer(GL_ARRAY_BUFFER, vb);
+    gGL->BufferData(GL_ARRAY_BUFFER, 256, 0, GL_DYNAMIC_DRAW);
+
+    void* mapped = gGL->MapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
+    success &= Check(mapped != 0, "MapBuffer");
+
+    if (mapped)
+        memset(mapped, 0, 256);
+
+    gGL->UnmapBuffer(GL_ARRAY_BUFFER);
+    gGL->VertexAttribPointer(kVBPositions, 4, GL_FLOAT, GL_FALSE, 16, 0);
+    gGL->ClearColor(0.5f, 0.5f, 0.5f, 1.0f);
+    gGL->DrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    gGL->BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    GLint boundVB = 0;
+    gGL->GetVertexAttribiv(kVBPositions, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &boundVB);
+    success &= Check(GLuint(boundVB) == vb, "attribute buffer tracking");
+
+    recorder.EndFrame();
+    recorder.End();
+
+    success &= Check(gGL != &kGLRecorder || GLShimDriver() == 0, "End");
+
+    const cGLCounters& counters = recorder.FrameCounters();
+
+    success &= Check(counters.mDraws == 1 && counters.mDrawElements == 6, "draw counters");
+    success &= Check(counters.mUniformBytes == sizeof(kMatrix), "uniform counters");
+    success &= Check(counters.mBufferBytes == 256, "buffer counters");
+    success &= Check(counters.mStateChanges == 6, "state counters");
+    success &= Check(recorder.NumFrames() == 1 && recorder.TotalCounters().mCalls == counters.mCalls, "total counters");
+
+    // Check the log
+    int numCommands = recorder.NumCommands();
+    success &= Check(numCommands == counters.mCalls, "command count");
+
+    tString description;
+
+    for (int i = 0; i < numCommands; i++)
+    {
+        const cGLCommand& command = recorder.Command(i);
+        size_t dataSize;
+        const uint8_t* data = recorder.CommandData(i, &dataSize);
+
+        if (command.mFunction == kGLFnUniformMatrix4fv)
+            success &= Check(data && dataSize == sizeof(kMatrix) && memcmp(data, kMatrix, dataSize) == 0, "uniform capture");
+        else if (command.mFunction == kGLFnClearColor)
+        {
+            recorder.DescribeCommand(i, &description);
+            success &= Check(description == "ClearColor(0.5, 0.5, 0.5, 1)", "float arguments");
+            description.clear();
+        }
+        else if (command.mFunction == kGLFnDrawElements)
+        {
+            recorder.DescribeCommand(i, &description);
+            success &= Check(description == "DrawElements(0x0004, 6, 0x1403, 0x0)", "describe command");
+            description.clear();
+        }
+    }
+
+    if (!success)
+        for (int i = 0; i < numCommands; i++)
+        {
+            recorder.DescribeCommand(i, &description);
+            description += "\n";
+        }
+
+    recorder.DescribeCounters(counters, &description);
+    printf("%s", description.c_str());
+
+    // Pass-through, forwarding to an emulating recorder that owns the program
+    const cGLShim* shim = gGL;
+
+    cGLRecorder target;
+    target.Begin();
+
+    GLuint targetProgram = LoadShaders(vsPath.c_str(), fsPath.c_str(), 0, "test");
+
+    target.BeginFrame();
+
+    cGLRecorder passThrough;
+    passThrough.SetPassThrough(true);
+    passThrough.Begin();
+    passThrough.BeginFrame();
+
+    gGL->UseProgram(targetProgram);
+    GLint targetLocation = gGL->GetUniformLocation(targetProgram, "modelToClip");
+    gGL->UniformMatrix4fv(targetLocation, 1, GL_FALSE, kMatrix);
+    gGL->DrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+
+    passThrough.EndFrame();
+    passThrough.End();
+
+    target.EndFrame();
+    target.End();
+
+    success &= Check(targetLocation >= 0, "pass-through return values");
+    success &= Check(passThrough.NumCommands() == 4 && passThrough.FrameCounters().mDraws == 1, "pass-through recording");
+    success &= Check(target.NumCommands() == 4 && target.FrameCounters().mUniformBytes == sizeof(kMatrix), "pass-through forwarding");
+    success &= Check(gGL == shim, "pass-through End");
+
+    unlink(vsPath.c_str());
+    unlink(fsPath.c_str());
+    rmdir(tempPath.c_str());
+
+    return success;
+}
+
+#endif
+
+#endif
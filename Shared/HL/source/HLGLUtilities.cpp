@@ -256,6 +256,9 @@ namespace
         "inColour",     kVBColours,
         "inColor",      kVBColours,
         "inNormal",     kVBNormals,
+        "inInstance0",  kVBInstance0,
+        "inInstance1",  kVBInstance1,
+        "inInstance2",  kVBInstance2,
         0, 0
     };
     // CL_CT_ASSERT(sizeof(kAttributeLocationsEnum) / sizeof(kAttributeLocationsEnum[0]) == kMaxVertexAttributes + 1);
@@ -811,6 +814,57 @@ void nHL::DispatchMesh(const cGLMeshInfo* meshInfo)
     GL_CHECK;
 }
 
+#ifdef CL_GL_INSTANCING
+void nHL::DispatchMeshInstances(const cGLMeshInfo* meshInfo, GLuint instanceBuffer, int firstInstance, int count)
+{
+    GL_CHECK;
+
+    glBindVertexArray(meshInfo->mMesh);
+
+    // The instance attributes are only enabled for the duration of the draw, so
+    // the mesh can still be used with non-instanced shaders.
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+    const uint8_t* instanceOffset = (const uint8_t*) 0 + firstInstance * sizeof(cDrawInstance);
+
+    for (int i = 0; i < 3; i++)
+    {
+        glEnableVertexAttribArray(kVBInstance0 + i);
+        glVertexAttribPointer(kVBInstance0 + i, 4, GL_FLOAT, GL_FALSE, sizeof(cDrawInstance), instanceOffset + i * sizeof(Vec4f));
+        glVertexAttribDivisor(kVBInstance0 + i, 1);
+    }
+
+    for (int i = 0; i < kMaxTextureKinds; i++)
+        if (meshInfo->mTextures[i])
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, meshInfo->mTextures[i]);
+        }
+
+    GL_CHECK;
+    glDrawElementsInstanced(GL_TRIANGLES, meshInfo->mNumElts, meshInfo->mEltType, 0, count);
+    GL_CHECK;
+
+    for (int i = 0; i < kMaxTextureKinds; i++)
+        if (meshInfo->mTextures[i])
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+
+    // The divisors are VAO state too, so put them back for non-instanced draws of this mesh
+    for (int i = 0; i < 3; i++)
+    {
+        glVertexAttribDivisor(kVBInstance0 + i, 0);
+        glDisableVertexAttribArray(kVBInstance0 + i);
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    GL_CHECK;
+}
+#endif
+
 void nHL::DestroyMesh(cGLMeshInfo* meshInfo)
 {
     if (meshInfo->mMesh)
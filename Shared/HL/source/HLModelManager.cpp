@@ -17,11 +17,14 @@
 #include <HLReadObj.h>
 #include <HLReadAppleModel.h>
 #include <HLServices.h>
+#include <HLUI.h>
 
 #include <CLFrustum.h>
 #include <CLDirectories.h>
 #include <CLFileSpec.h>
 #include <CLLog.h>
+#include <CLProfile.h>
+#include <CLTimer.h>
 #include <CLValue.h>
 
 using namespace nCL;
@@ -29,7 +32,7 @@ using namespace nHL;
 
 namespace
 {
-
+    const uint32_t kInstanceGroupItem = 0x80000000;     // Flags Draw() items that are indices into mInstanceGroups
 }
 
 
@@ -70,6 +73,11 @@ bool cModelManager::LoadModels(const cObjectValue* config)
 {
     cFileSpec baseSpec;
 
+    // Instance data is kept by value in the slot-indexed arrays below, so there
+    // are no per-instance allocations to pool. Instead allow reserving the arrays
+    // up front, so creation churn doesn't cause reallocation.
+    ReserveInstances(config->Member("reserveInstances").AsInt(0));
+
     for (auto c : config->Children())
     {
         tTag          modelTag  = c.Tag();
@@ -78,11 +86,26 @@ bool cModelManager::LoadModels(const cObjectValue* config)
         if (!modelInfo.IsObject())
             continue;
 
+        if (!mModelConfigs.Changed(modelInfo.AsObject()))
+            continue;
+
         CL_LOG("ModelManager", "Adding model %s\n", c.Name());
 
-        mModelTagToIndex[modelTag] = mModels.size();
-        mModels.push_back();
-        cModel& model = mModels.back();
+        // Update existing models in place, so instances pick up the changes
+        auto it = mModelTagToIndex.find(modelTag);
+
+        if (it == mModelTagToIndex.end())
+        {
+            it = mModelTagToIndex.insert( { modelTag, mModels.size() } ).first;
+            mModels.push_back();
+        }
+        else
+        {
+            DestroyMesh(&mModels[it->second].mMeshLOD0);
+            mModels[it->second] = cModel();
+        }
+
+        cModel& model = mModels[it->second];
 
         model.mTag = modelTag;
         model.mConfig = modelInfo.AsObject();
@@ -202,11 +225,23 @@ bool cModelManager::DestroyInstance(tMIRef ref)
     return result;
 }
 
+void cModelManager::ReserveInstances(int count)
+{
+    if (count <= mInstanceSlots.NumSlots())
+        return;
+
+    mInstanceSlots     .ReserveSlots(count);
+    mInstanceModelIndex.reserve(count);
+    mInstanceTransforms.reserve(count);
+    mInstanceFlags     .reserve(count);
+}
+
 void cModelManager::RemoveAllInstances()
 {
     mInstanceSlots.ClearSlots();
     mInstanceModelIndex.clear();
     mInstanceTransforms.clear();
+    mInstanceFlags.clear();
 }
 
 bool cModelManager::SetTransform(tMIRef ref, const cTransform& xform)
@@ -277,18 +312,180 @@ void cModelManager::DestroyInstances(int count, tMIRef refs[])
 }
 
 
+#ifndef CL_RELEASE
+void cModelManager::DebugMenu(cUIState* uiState)
+{
+    tUIItemID itemID = ItemID(0x0243b7e0);
+
+    uiState->DrawLabel(Format("%d / %d Instance Slots", mInstanceSlots.NumSlotsInUse(), mInstanceSlots.NumSlots()));
+
+    uiState->HandleToggle(itemID++, "Instancing", &mInstancing);
+    uiState->HandleToggle(itemID++, "Frustum Culling", &mCulling);
+
+    if (uiState->HandleButton(itemID++, "Bench Instance Churn"))
+        BenchInstances();
+#ifdef HL_GL_SHIM
+    if (uiState->HandleButton(itemID++, "Bench 10k Instance Dispatch"))
+        BenchDispatch(HL()->mRenderer, 10000);
+#endif
+}
+
+void cModelManager::BenchInstances()
+{
+    if (mModelTagToIndex.empty())
+        return;
+
+    const int kNumInstances = 100000;
+    const int kNumRounds = 4;
+
+    vector<tTag> tags;
+    tags.resize(kNumInstances, mModelTagToIndex.begin()->first);
+    vector<tMIRef> refs;
+    refs.resize(kNumInstances);
+
+    uint64_t t0 = AbsoluteTicks();
+
+    for (int round = 0; round < kNumRounds; round++)
+    {
+        for (int i = 0; i < kNumInstances; i++)
+            refs[i] = CreateInstance(tags[i]);
+
+        // Destroy odd instances first, so the next round reuses slots in a scattered order
+        for (int i = 1; i < kNumInstances; i += 2)
+            DestroyInstance(refs[i]);
+        for (int i = 0; i < kNumInstances; i += 2)
+            DestroyInstance(refs[i]);
+    }
+
+    uint64_t t1 = AbsoluteTicks();
+
+    for (int round = 0; round < kNumRounds; round++)
+    {
+        CreateInstances (kNumInstances, tags.data(), refs.data());
+        DestroyInstances(kNumInstances, refs.data());
+    }
+
+    uint64_t t2 = AbsoluteTicks();
+
+    CL_LOG("ModelManager", "Instances: %.1f ns per create/destroy, %.1f ns bulk (%d x %d)\n",
+        double(t1 - t0) / (kNumRounds * kNumInstances),
+        double(t2 - t1) / (kNumRounds * kNumInstances),
+        kNumRounds, kNumInstances
+    );
+}
+
+#ifdef HL_GL_SHIM
+void cModelManager::BenchDispatch(cIRenderer* renderer, int numInstances)
+{
+    vector<tTag> modelTags;
+
+    for (int i = 1, n = mModels.size(); i < n; i++)     // skip placeholder
+        if (mModels[i].mMeshLOD0.mMesh && mModels[i].mMaterialIndex >= 0)
+            modelTags.push_back(mModels[i].mTag);
+
+    if (modelTags.empty())
+        return;
+
+    const int kBenchFrames = 16;
+
+    // A cube of instances around the origin, cycling through the loaded models
+    vector<tTag> tags(numInstances);
+    vector<tMIRef> refs(numInstances);
+
+    for (int i = 0; i < numInstances; i++)
+        tags[i] = modelTags[i % modelTags.size()];
+
+    CreateInstances(numInstances, tags.data(), refs.data());
+
+    float spacing = 0.0f;
+    for (int i = 1, n = mModels.size(); i < n; i++)
+        if (spacing < 2.0f * mModels[i].mBoundingRadius)
+            spacing = 2.0f * mModels[i].mBoundingRadius;
+
+    int side = 1;
+    while (side * side * side < numInstances)
+        side++;
+
+    for (int i = 0; i < numInstances; i++)
+    {
+        Vec3f position(i % side, (i / side) % side, i / (side * side));
+        position -= Vec3f(0.5f * (side - 1));
+
+        SetTransform(refs[i], cTransform(1.0f, spacing * position));
+    }
+
+    // Most of the cube is outside the main camera's view, so turn culling off to time dispatch alone
+    cRenderLayerState state;
+    bool instancing = mInstancing;
+    bool culling = mCulling;
+
+    mCulling = false;
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        mInstancing = (pass != 0);
+
+        // Just count GL calls rather than draw. This also keeps us from
+        // issuing real draws outside the renderer's Render().
+        cGLRecorder recorder;
+        recorder.SetRecordCommands(false);
+        recorder.Begin();
+
+        uint64_t t0 = 0;
+
+        for (int frame = -1; frame < kBenchFrames; frame++)     // first frame is warm-up
+        {
+            if (frame == 0)
+                t0 = AbsoluteTicks();
+
+            recorder.BeginFrame();
+
+            Dispatch(renderer, state);
+            renderer->FlushDraws();
+
+            recorder.EndFrame();
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+
+        const cGLCounters& counters = recorder.FrameCounters();
+
+        CL_LOG("ModelManager", "%s: %.1f us per frame, %d draws, %d uniform calls (%d instances of %d models)\n",
+            mInstancing ? "Instanced   " : "Per-instance",
+            double(t1 - t0) / (1000.0 * kBenchFrames),
+            counters.mDraws, counters.mCallsOfKind[kGLCallUniform],
+            numInstances, int(modelTags.size())
+        );
+
+        recorder.End();
+    }
+
+    mInstancing = instancing;
+    mCulling = culling;
+
+    DestroyInstances(numInstances, refs.data());
+}
+#endif
+#endif
+
 
 // cIRenderLayer
 
 void cModelManager::Dispatch(cIRenderer* renderer, const cRenderLayerState& state)
 {
+    CL_PROFILE_SCOPE("Models Dispatch");
+
     Vec2f orientedSize = renderer->ShaderDataT<Vec2f>(kDataIDOrientedViewSize);
     cICamera* camera = renderer->Camera(kMainTag);
 
     Mat4f vp;
+    Vec3f cameraPos(vl_0);
 
     if (camera)
+    {
         camera->FindViewProjection(orientedSize, &vp);
+        cameraPos = camera->CameraToWorld().Trans();
+    }
     else
         vp = vl_one;
 
@@ -302,19 +499,35 @@ void cModelManager::Dispatch(cIRenderer* renderer, const cRenderLayerState& stat
     int8_t ip1[6][3];
     FindFrustumAABBIndices(planes, ip0, ip1);
 
+    // Instances of models whose material has an instanced variant are
+    // gathered and drawn a model at a time, the rest individually.
+    int numModels = mModels.size();
+
+    mModelInstancedMaterial.resize(numModels);
+    mModelInstanceCounts.clear();
+    mModelInstanceCounts.resize(numModels, 0);
+    mVisibleInstances.clear();
+
+    for (int i = 0; i < numModels; i++)
+    {
+        int materialIndex = mModels[i].mMaterialIndex;
+        mModelInstancedMaterial[i] = (mInstancing && materialIndex >= 0) ? renderer->InstancedMaterialRef(materialIndex) : 0;
+    }
+
     for (int i = 0; i < mInstanceSlots.NumSlots(); i++)
     {
         if (!mInstanceSlots.InUse(i))
             continue;
 
-        const cModel& model = mModels[mInstanceModelIndex[i]];
+        int modelIndex = mInstanceModelIndex[i];
+        const cModel& model = mModels[modelIndex];
 
         if ((model.mMaterialIndex < 0) || !model.mMeshLOD0.mMesh || (mInstanceFlags[i] & kMIFlagHidden))
             continue;
 
         const cTransform& modelTransform = mInstanceTransforms[i];
 
-        tClipFlags clipFlags = FrustumTestSphere(modelTransform.Trans(), modelTransform.Scale() * model.mBoundingRadius, planes);
+        tClipFlags clipFlags = mCulling ? FrustumTestSphere(modelTransform.Trans(), modelTransform.Scale() * model.mBoundingRadius, planes) : kNoFlags;
 
         if (clipFlags & kOutsideFrustum)
             continue;
@@ -329,24 +542,91 @@ void cModelManager::Dispatch(cIRenderer* renderer, const cRenderLayerState& stat
                 continue;
         }
 
-        if (renderer->SetMaterial(model.mMaterialIndex))
+        if (mModelInstancedMaterial[modelIndex] > 0)
         {
-            Mat4f modelToWorld;
+            mModelInstanceCounts[modelIndex]++;
+            mVisibleInstances.push_back(i);
+            continue;
+        }
 
-            if (model.mMeshTransform.IsIdentity())
-                modelTransform.MakeMat4(&modelToWorld);
-            else
-            {
-                ::Transform(modelTransform, model.mMeshTransform).MakeMat4(&modelToWorld);
-            }
+        float depth = sqrlen(modelTransform.Trans() - cameraPos);
 
-            renderer->SetShaderDataT(kDataIDModelToWorld, modelToWorld);
-            renderer->DrawMesh(&model.mMeshLOD0);
-        }
+        renderer->SubmitDraw(DrawKey(0, 0, false, model.mMaterialIndex, -1, depth), this, i);
+    }
+
+    if (!mVisibleInstances.empty())
+        SubmitInstanceGroups(renderer);
+}
+
+void cModelManager::SubmitInstanceGroups(cIRenderer* renderer)
+{
+    // Counting sort by model: counts become each group's start, then its fill cursor
+    mInstanceGroups.clear();
+    int numInstances = 0;
+
+    for (int i = 0, n = mModels.size(); i < n; i++)
+    {
+        int count = mModelInstanceCounts[i];
+
+        if (count == 0)
+            continue;
+
+        mInstanceGroups.push_back( { i, mModelInstancedMaterial[i], numInstances, count } );
+        mModelInstanceCounts[i] = numInstances;
+        numInstances += count;
+    }
+
+    mDrawInstances.resize(numInstances);
+
+    for (int i : mVisibleInstances)
+    {
+        Mat4f modelToWorld;
+        ModelToWorld(i, &modelToWorld);
+
+        // Transforms are row-oriented, so each world coordinate is a column of modelToWorld dotted with the position
+        cDrawInstance& instance = mDrawInstances[mModelInstanceCounts[mInstanceModelIndex[i]]++];
+
+        for (int j = 0; j < 3; j++)
+            instance.mModelToWorld[j] = Vec4f(modelToWorld[0][j], modelToWorld[1][j], modelToWorld[2][j], modelToWorld[3][j]);
     }
 
-    // Clear back to invalid material if any
-    renderer->SetMaterial(0);
+    int firstInstance = renderer->AddInstances(numInstances, mDrawInstances.data());
+
+    for (int i = 0, n = mInstanceGroups.size(); i < n; i++)
+    {
+        mInstanceGroups[i].mFirst += firstInstance;
+        renderer->SubmitDraw(DrawKey(0, 0, false, mInstanceGroups[i].mMaterial), this, kInstanceGroupItem | i);
+    }
+}
+
+void cModelManager::ModelToWorld(int instance, Mat4f* modelToWorld) const
+{
+    const cModel& model = mModels[mInstanceModelIndex[instance]];
+    const cTransform& modelTransform = mInstanceTransforms[instance];
+
+    if (model.mMeshTransform.IsIdentity())
+        modelTransform.MakeMat4(modelToWorld);
+    else
+    {
+        ::Transform(modelTransform, model.mMeshTransform).MakeMat4(modelToWorld);
+    }
+}
+
+void cModelManager::Draw(cIRenderer* renderer, uint32_t item)
+{
+    if (item & kInstanceGroupItem)
+    {
+        const cInstanceGroup& group = mInstanceGroups[item & ~kInstanceGroupItem];
+
+        renderer->DrawMeshInstances(&mModels[group.mModel].mMeshLOD0, group.mFirst, group.mCount);
+        return;
+    }
+
+    Mat4f modelToWorld;
+    ModelToWorld(item, &modelToWorld);
+
+    renderer->SetShaderDataT(kDataIDModelToWorld, modelToWorld);
+    renderer->DrawMesh(&mModels[mInstanceModelIndex[item]].mMeshLOD0);
 }
 
 
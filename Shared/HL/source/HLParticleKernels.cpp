@@ -0,0 +1,780 @@
+//
+//  File:       HLParticleKernels.cpp
+//
+//  Function:   SIMD versions of the HLParticleUtils processing routines
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+#include <HLParticleKernels.h>
+
+#include <CLLog.h>
+#include <CLMath.h>
+#include <CLRandom.h>
+#include <CLTimer.h>
+
+#if defined(__SSE2__)
+    #define HL_KERNELS_SSE 1
+    #include <emmintrin.h>
+
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        #define HL_KERNELS_AVX2 1
+        #include <immintrin.h>
+    #endif
+
+#elif defined(__aarch64__)
+    #define HL_KERNELS_NEON 1
+    #include <arm_neon.h>
+#endif
+
+using namespace nHL;
+using namespace nCL;
+
+// Each kernel set below is a namespace providing kWidth, the vector types
+// tVF (float), tVI (int32) and tVM (mask), and a handful of basic operations.
+// Float vectors use the compiler's built-in arithmetic operators. The actual
+// kernels are then shared via HLParticleKernels.inl.
+
+#ifdef HL_KERNELS_SSE
+
+namespace
+{
+    namespace nSSE
+    {
+        const int kWidth = 4;
+
+        typedef __m128  tVF;
+        typedef __m128i tVI;
+        typedef __m128  tVM;
+
+        inline tVF  Splat (float f)                 { return _mm_set1_ps(f); }
+        inline tVI  SplatI(int32_t i)               { return _mm_set1_epi32(i); }
+        inline tVF  LoadF (const float* p)          { return _mm_loadu_ps(p); }
+        inline void StoreF(float* p, tVF v)         { _mm_storeu_ps(p, v); }
+        inline tVI  LoadU (const uint32_t* p)       { return _mm_loadu_si128((const __m128i*) p); }
+        inline void StoreU(uint32_t* p, tVI v)      { _mm_storeu_si128((__m128i*) p, v); }
+
+        inline tVI  AsInt  (tVF v)                  { return _mm_castps_si128(v); }
+        inline tVF  ToFloat(tVI v)                  { return _mm_cvtepi32_ps(v); }
+        inline tVF  ToFloatU(tVI v)
+        {
+            // No unsigned conversion in SSE, so convert 16-bit halves. Both
+            // are exact, so the final add gives the same rounding as scalar.
+            tVF hi = _mm_cvtepi32_ps(_mm_srli_epi32(v, 16));
+            tVF lo = _mm_cvtepi32_ps(_mm_and_si128(v, _mm_set1_epi32(0xFFFF)));
+            return hi * Splat(65536.0f) + lo;
+        }
+
+        inline tVI  AddI(tVI a, tVI b)              { return _mm_add_epi32(a, b); }
+        inline tVI  SubI(tVI a, tVI b)              { return _mm_sub_epi32(a, b); }
+        inline tVI  AndI(tVI a, tVI b)              { return _mm_and_si128(a, b); }
+        inline tVI  OrI (tVI a, tVI b)              { return _mm_or_si128 (a, b); }
+        inline tVI  MulI(tVI a, tVI b)
+        {
+            // No 32-bit mullo in SSE2, so do even and odd lanes separately
+            __m128i even = _mm_mul_epu32(a, b);
+            __m128i odd  = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+            return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+        }
+        inline tVI  ShlI (tVI v, int n)             { return _mm_sll_epi32(v, _mm_cvtsi32_si128(n)); }
+        inline tVI  ShrI (tVI v, int n)             { return _mm_srl_epi32(v, _mm_cvtsi32_si128(n)); }
+        inline tVI  ShrAI(tVI v, int n)             { return _mm_sra_epi32(v, _mm_cvtsi32_si128(n)); }
+
+        inline tVF  Min (tVF a, tVF b)              { return _mm_min_ps(a, b); }
+        inline tVF  Max (tVF a, tVF b)              { return _mm_max_ps(a, b); }
+        inline tVF  Sqrt(tVF v)                     { return _mm_sqrt_ps(v); }
+        inline tVF  Floor(tVF v)
+        {
+            // No roundps in SSE2. Fine for |v| < 2^31, which covers our uses.
+            tVF t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+            return t - _mm_and_ps(_mm_cmpgt_ps(t, v), Splat(1.0f));
+        }
+
+        inline tVM  Less   (tVF a, tVF b)           { return _mm_cmplt_ps(a, b); }
+        inline tVM  Greater(tVF a, tVF b)           { return _mm_cmpgt_ps(a, b); }
+        inline tVF  Select (tVM m, tVF a, tVF b)    { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+        inline tVF GatherF(const float* p, tVI indices)
+        {
+            int32_t i[kWidth];
+            _mm_storeu_si128((__m128i*) i, indices);
+            return _mm_setr_ps(p[i[0]], p[i[1]], p[i[2]], p[i[3]]);
+        }
+
+        inline void Load3(const Vec3f* p, tVF* x, tVF* y, tVF* z)
+        {
+            // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+            const float* f = p[0].Ref();
+
+            tVF a = _mm_loadu_ps(f + 0);
+            tVF b = _mm_loadu_ps(f + 4);
+            tVF c = _mm_loadu_ps(f + 8);
+
+            tVF xu = _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2));
+            *x = _mm_shuffle_ps(a, xu, _MM_SHUFFLE(2, 0, 3, 0));
+
+            tVF yu = _mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1));
+            tVF yv = _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3));
+            *y = _mm_shuffle_ps(yu, yv, _MM_SHUFFLE(2, 0, 2, 0));
+
+            tVF zu = _mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2));
+            *z = _mm_shuffle_ps(zu, c, _MM_SHUFFLE(3, 0, 2, 0));
+        }
+
+        inline void Store3(Vec3f* p, tVF x, tVF y, tVF z)
+        {
+            float* f = p[0].Ref();
+
+            tVF au = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 0, 0));
+            tVF aw = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0));
+            tVF bu = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1));
+            tVF bw = _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2));
+            tVF cu = _mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2));
+            tVF cw = _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3));
+
+            _mm_storeu_ps(f + 0, _mm_shuffle_ps(au, aw, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(f + 4, _mm_shuffle_ps(bu, bw, _MM_SHUFFLE(2, 0, 2, 0)));
+            _mm_storeu_ps(f + 8, _mm_shuffle_ps(cu, cw, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+
+        #include "HLParticleKernels.inl"
+    }
+}
+
+#endif
+
+#ifdef HL_KERNELS_AVX2
+
+// Compile this set for AVX2 regardless of the project's target flags, as
+// it's only used after checking the CPU at runtime.
+#if defined(__clang__)
+    #pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+    #pragma GCC push_options
+    #pragma GCC target("avx2")
+#endif
+
+namespace
+{
+    namespace nAVX2
+    {
+        const int kWidth = 8;
+
+        typedef __m256  tVF;
+        typedef __m256i tVI;
+        typedef __m256  tVM;
+
+        inline tVF  Splat (float f)                 { return _mm256_set1_ps(f); }
+        inline tVI  SplatI(int32_t i)               { return _mm256_set1_epi32(i); }
+        inline tVF  LoadF (const float* p)          { return _mm256_loadu_ps(p); }
+        inline void StoreF(float* p, tVF v)         { _mm256_storeu_ps(p, v); }
+        inline tVI  LoadU (const uint32_t* p)       { return _mm256_loadu_si256((const __m256i*) p); }
+        inline void StoreU(uint32_t* p, tVI v)      { _mm256_storeu_si256((__m256i*) p, v); }
+
+        inline tVI  AsInt  (tVF v)                  { return _mm256_castps_si256(v); }
+        inline tVF  ToFloat(tVI v)                  { return _mm256_cvtepi32_ps(v); }
+        inline tVF  ToFloatU(tVI v)
+        {
+            tVF hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16));
+            tVF lo = _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xFFFF)));
+            return hi * Splat(65536.0f) + lo;
+        }
+
+        inline tVI  AddI(tVI a, tVI b)              { return _mm256_add_epi32(a, b); }
+        inline tVI  SubI(tVI a, tVI b)              { return _mm256_sub_epi32(a, b); }
+        inline tVI  AndI(tVI a, tVI b)              { return _mm256_and_si256(a, b); }
+        inline tVI  OrI (tVI a, tVI b)              { return _mm256_or_si256 (a, b); }
+        inline tVI  MulI(tVI a, tVI b)              { return _mm256_mullo_epi32(a, b); }
+        inline tVI  ShlI (tVI v, int n)             { return _mm256_sll_epi32(v, _mm_cvtsi32_si128(n)); }
+        inline tVI  ShrI (tVI v, int n)             { return _mm256_srl_epi32(v, _mm_cvtsi32_si128(n)); }
+        inline tVI  ShrAI(tVI v, int n)             { return _mm256_sra_epi32(v, _mm_cvtsi32_si128(n)); }
+
+        inline tVF  Min  (tVF a, tVF b)             { return _mm256_min_ps(a, b); }
+        inline tVF  Max  (tVF a, tVF b)             { return _mm256_max_ps(a, b); }
+        inline tVF  Sqrt (tVF v)                    { return _mm256_sqrt_ps(v); }
+        inline tVF  Floor(tVF v)                    { return _mm256_floor_ps(v); }
+
+        inline tVM  Less   (tVF a, tVF b)           { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+        inline tVM  Greater(tVF a, tVF b)           { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+        inline tVF  Select (tVM m, tVF a, tVF b)    { return _mm256_blendv_ps(b, a, m); }
+
+        inline tVF  GatherF(const float* p, tVI indices) { return _mm256_i32gather_ps(p, indices, 4); }
+
+        inline void Load3(const Vec3f* p, tVF* x, tVF* y, tVF* z)
+        {
+            __m128 x0, y0, z0, x1, y1, z1;
+
+            nSSE::Load3(p + 0, &x0, &y0, &z0);
+            nSSE::Load3(p + 4, &x1, &y1, &z1);
+
+            *x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+            *y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+            *z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+        }
+
+        inline void Store3(Vec3f* p, tVF x, tVF y, tVF z)
+        {
+            nSSE::Store3(p + 0, _mm256_castps256_ps128(x),    _mm256_castps256_ps128(y),    _mm256_castps256_ps128(z));
+            nSSE::Store3(p + 4, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1), _mm256_extractf128_ps(z, 1));
+        }
+
+        #include "HLParticleKernels.inl"
+    }
+}
+
+#if defined(__clang__)
+    #pragma clang attribute pop
+#else
+    #pragma GCC pop_options
+#endif
+
+#endif
+
+#ifdef HL_KERNELS_NEON
+
+namespace
+{
+    namespace nNEON
+    {
+        const int kWidth = 4;
+
+        typedef float32x4_t tVF;
+        typedef int32x4_t   tVI;
+        typedef uint32x4_t  tVM;
+
+        inline tVF  Splat (float f)                 { return vdupq_n_f32(f); }
+        inline tVI  SplatI(int32_t i)               { return vdupq_n_s32(i); }
+        inline tVF  LoadF (const float* p)          { return vld1q_f32(p); }
+        inline void StoreF(float* p, tVF v)         { vst1q_f32(p, v); }
+        inline tVI  LoadU (const uint32_t* p)       { return vreinterpretq_s32_u32(vld1q_u32(p)); }
+        inline void StoreU(uint32_t* p, tVI v)      { vst1q_u32(p, vreinterpretq_u32_s32(v)); }
+
+        inline tVI  AsInt   (tVF v)                 { return vreinterpretq_s32_f32(v); }
+        inline tVF  ToFloat (tVI v)                 { return vcvtq_f32_s32(v); }
+        inline tVF  ToFloatU(tVI v)                 { return vcvtq_f32_u32(vreinterpretq_u32_s32(v)); }
+
+        inline tVI  AddI(tVI a, tVI b)              { return vaddq_s32(a, b); }
+        inline tVI  SubI(tVI a, tVI b)              { return vsubq_s32(a, b); }
+        inline tVI  AndI(tVI a, tVI b)              { return vandq_s32(a, b); }
+        inline tVI  OrI (tVI a, tVI b)              { return vorrq_s32(a, b); }
+        inline tVI  MulI(tVI a, tVI b)              { return vmulq_s32(a, b); }
+        inline tVI  ShlI (tVI v, int n)             { return vshlq_s32(v, vdupq_n_s32(n)); }
+        inline tVI  ShrI (tVI v, int n)             { return vreinterpretq_s32_u32(vshlq_u32(vreinterpretq_u32_s32(v), vdupq_n_s32(-n))); }
+        inline tVI  ShrAI(tVI v, int n)             { return vshlq_s32(v, vdupq_n_s32(-n)); }
+
+        inline tVF  Min  (tVF a, tVF b)             { return vminq_f32(a, b); }
+        inline tVF  Max  (tVF a, tVF b)             { return vmaxq_f32(a, b); }
+        inline tVF  Sqrt (tVF v)                    { return vsqrtq_f32(v); }
+        inline tVF  Floor(tVF v)                    { return vrndmq_f32(v); }
+
+        inline tVM  Less   (tVF a, tVF b)           { return vcltq_f32(a, b); }
+        inline tVM  Greater(tVF a, tVF b)           { return vcgtq_f32(a, b); }
+        inline tVF  Select (tVM m, tVF a, tVF b)    { return vbslq_f32(m, a, b); }
+
+        inline tVF GatherF(const float* p, tVI indices)
+        {
+            int32_t i[kWidth];
+            vst1q_s32(i, indices);
+
+            float f[kWidth] = { p[i[0]], p[i[1]], p[i[2]], p[i[3]] };
+            return vld1q_f32(f);
+        }
+
+        inline void Load3(const Vec3f* p, tVF* x, tVF* y, tVF* z)
+        {
+            float32x4x3_t v = vld3q_f32(p[0].Ref());
+
+            *x = v.val[0];
+            *y = v.val[1];
+            *z = v.val[2];
+        }
+
+        inline void Store3(Vec3f* p, tVF x, tVF y, tVF z)
+        {
+            float32x4x3_t v = { { x, y, z } };
+            vst3q_f32(p[0].Ref(), v);
+        }
+
+        #include "HLParticleKernels.inl"
+    }
+}
+
+#endif
+
+
+// --- Selection ---------------------------------------------------------------
+
+namespace
+{
+    const char* const kParticleSIMDNames[kMaxParticleSIMD] =
+    {
+        "Scalar",
+        "SSE",
+        "AVX2",
+        "NEON"
+    };
+
+    bool IsSupported(tParticleSIMD simd)
+    {
+        switch (simd)
+        {
+        case kParticleSIMDNone:
+            return true;
+    #ifdef HL_KERNELS_SSE
+        case kParticleSIMDSSE:
+            return true;
+    #endif
+    #ifdef HL_KERNELS_AVX2
+        case kParticleSIMDAVX2:
+            __builtin_cpu_init();   // we may be called during static init
+            return __builtin_cpu_supports("avx2");
+    #endif
+    #ifdef HL_KERNELS_NEON
+        case kParticleSIMDNEON:
+            return true;
+    #endif
+        default:
+            return false;
+        }
+    }
+
+    tParticleSIMD sParticleSIMD = BestParticleSIMD();
+    const cParticleKernels* sParticleKernels = ParticleKernels(sParticleSIMD);
+}
+
+tParticleSIMD nHL::BestParticleSIMD()
+{
+    for (int i = kMaxParticleSIMD - 1; i > kParticleSIMDNone; i--)
+        if (IsSupported(tParticleSIMD(i)))
+            return tParticleSIMD(i);
+
+    return kParticleSIMDNone;
+}
+
+tParticleSIMD nHL::ParticleSIMD()
+{
+    return sParticleSIMD;
+}
+
+bool nHL::SetParticleSIMD(tParticleSIMD simd)
+{
+    if (!IsSupported(simd))
+        return false;
+
+    sParticleSIMD = simd;
+    sParticleKernels = ParticleKernels(simd);
+
+    return true;
+}
+
+const char* nHL::ParticleSIMDName(tParticleSIMD simd)
+{
+    if (simd < 0 || simd >= kMaxParticleSIMD)
+        return "unknown";
+
+    return kParticleSIMDNames[simd];
+}
+
+const cParticleKernels* nHL::ParticleKernels()
+{
+    return sParticleKernels;
+}
+
+const cParticleKernels* nHL::ParticleKernels(tParticleSIMD simd)
+{
+    if (!IsSupported(simd))
+        return 0;
+
+    switch (simd)
+    {
+#ifdef HL_KERNELS_SSE
+    case kParticleSIMDSSE:
+        return &nSSE::kKernels;
+#endif
+#ifdef HL_KERNELS_AVX2
+    case kParticleSIMDAVX2:
+        return &nAVX2::kKernels;
+#endif
+#ifdef HL_KERNELS_NEON
+    case kParticleSIMDNEON:
+        return &nNEON::kKernels;
+#endif
+    default:
+        return 0;
+    }
+}
+
+
+// --- Testing -----------------------------------------------------------------
+
+namespace
+{
+    enum tKernel
+    {
+        kKernelApplyRotations,
+        kKernelApplyScalesAndAspects,
+        kKernelApplyVelocityStretch,
+        kKernelFindTiles,
+        kKernelFindTilePairs,
+        kKernelWriteQuads,
+        kKernelWriteQuadsTiled,
+        kKernelUpdatePhysicsSimple,
+        kKernelUpdateAges,
+        kMaxKernels
+    };
+
+    const char* const kKernelNames[kMaxKernels] =
+    {
+        "ApplyRotations",
+        "ApplyScalesAndAspects",
+        "ApplyVelocityStretch",
+        "FindTiles",
+        "FindTilePairs",
+        "WriteQuads",
+        "WriteQuads (tiled)",
+        "UpdatePhysicsSimple",
+        "UpdateAges"
+    };
+
+    struct cKernelData
+    /// Inputs and outputs for running each kernel over 'mCount' particles.
+    /// If mUniform is set, per-particle axes, scales, and dts are passed with
+    /// a stride of zero.
+    {
+        int         mCount   = 0;
+        bool        mUniform = false;
+
+        cParticleTileInfo     mTileInfo;
+        cParticlesPhysicsDesc mPhysics;
+        cTransform            mEffectToWorld;
+
+        vector<Vec3f>   mA0;
+        vector<Vec3f>   mA1;
+        vector<Vec3f>   mPositions;
+        vector<Vec3f>   mVelocities;
+        vector<Vec3f>   mColours;
+        vector<float>   mRotations;
+        vector<float>   mScales;
+        vector<float>   mAspects;
+        vector<float>   mAlphas;
+        vector<float>   mDTs;
+        vector<uint8_t> mStartFrames;
+        vector<tPtAge>  mAges;
+        vector<tPtAge>  mAgeSteps;
+
+        vector<Vec3f>             mA0Out;
+        vector<Vec3f>             mA1Out;
+        vector<Vec3f>             mPositionsOut;
+        vector<Vec3f>             mVelocitiesOut;
+        vector<cParticleTile>     mTiles;
+        vector<cParticleTilePair> mTilePairs;
+        vector<cQuadVertex>       mVertices;
+        vector<tPtAge>            mAgesOut;
+
+        void Setup(int count, tSeed32 seed);
+        void Run(tKernel kernel);
+    };
+
+    void cKernelData::Setup(int count, tSeed32 seed)
+    {
+        mCount = count;
+
+        mTileInfo.mCount     = 12;
+        mTileInfo.mTimeScale = 40.0f / kPtAgeFractionMask;
+        mTileInfo.mDT        = Vec2f(0.25f, 0.25f);
+        mTileInfo.mMask[0]   = 3;
+        mTileInfo.mMask[1]   = 3;
+        mTileInfo.mShift     = 2;
+
+        mPhysics.mDirForces = Vec3f(0.5f, -9.8f, 0.25f);
+        mPhysics.mDrag      = 0.1f;
+
+        float c = 0.8f;
+        float s = 0.6f;
+        mEffectToWorld.mRotation = Mat3f(c, s, 0.0f, -s, c, 0.0f, 0.0f, 0.0f, 1.0f);
+
+        mA0        .resize(count);
+        mA1        .resize(count);
+        mPositions .resize(count);
+        mVelocities.resize(count);
+        mColours   .resize(count);
+        mRotations .resize(count);
+        mScales    .resize(count);
+        mAspects   .resize(count);
+        mAlphas    .resize(count);
+        mDTs       .resize(count);
+        mStartFrames.resize(count);
+        mAges      .resize(count);
+        mAgeSteps  .resize(count);
+
+        for (int i = 0; i < count; i++)
+        {
+            mA0[i] = Vec3f(RandomSFloat(&seed), RandomSFloat(&seed), RandomSFloat(&seed));
+            mA1[i] = Vec3f(RandomSFloat(&seed), RandomSFloat(&seed), RandomSFloat(&seed));
+
+            mPositions [i] = Vec3f(RandomSFloat(10.0f, &seed), RandomSFloat(10.0f, &seed), RandomSFloat(10.0f, &seed));
+            mVelocities[i] = Vec3f(RandomSFloat(5.0f, &seed),  RandomSFloat(5.0f, &seed),  RandomSFloat(5.0f, &seed));
+
+            // Include out-of-range colours to exercise clamping
+            mColours[i] = Vec3f(RandomRange(-0.1f, 1.1f, &seed), RandomRange(-0.1f, 1.1f, &seed), RandomRange(-0.1f, 1.1f, &seed));
+            mAlphas [i] = RandomRange(-0.1f, 1.1f, &seed);
+
+            mRotations[i] = RandomSFloat(2.0f, &seed);
+            mScales   [i] = RandomRange(0.1f, 4.0f, &seed);
+            mAspects  [i] = RandomRange(0.25f, 2.0f, &seed);
+            mDTs      [i] = RandomRange(0.0f, 0.1f, &seed);
+
+            mStartFrames[i] = RandomUInt32(4, &seed);
+            mAges       [i] = RandomUInt32(kPtAgeFractionMax, &seed);
+            mAgeSteps   [i] = LifeToAgeStep(RandomRange(0.1f, 5.0f, &seed));
+        }
+
+        // Make sure the velocity stretch degenerate case is covered
+        mVelocities[count / 2] = vl_0;
+
+        mA0Out        .resize(count);
+        mA1Out        .resize(count);
+        mPositionsOut .resize(count);
+        mVelocitiesOut.resize(count);
+        mTiles        .resize(count);
+        mTilePairs    .resize(count);
+        mVertices     .resize(4 * count);
+        mAgesOut      .resize(count);
+    }
+
+    void cKernelData::Run(tKernel kernel)
+    {
+        size_t vStride = mUniform ? 0 : sizeof(Vec3f);
+        size_t fStride = mUniform ? 0 : sizeof(float);
+
+        switch (kernel)
+        {
+        case kKernelApplyRotations:
+            ApplyRotations(mCount, mA0.data(), mA1.data(), vStride, mRotations.data(), fStride, mA0Out.data(), mA1Out.data());
+            break;
+        case kKernelApplyScalesAndAspects:
+            ApplyScalesAndAspects(mCount, mA0.data(), mA1.data(), vStride, mScales.data(), fStride, mAspects.data(), fStride, mA0Out.data(), mA1Out.data());
+            break;
+        case kKernelApplyVelocityStretch:
+            ApplyVelocityStretch(0.5f, mEffectToWorld, mCount, mVelocities.data(), sizeof(Vec3f), mA0.data(), mA1.data(), vStride, mA0Out.data(), mA1Out.data());
+            break;
+        case kKernelFindTiles:
+            FindTiles(mTileInfo, mCount, mStartFrames.data(), sizeof(uint8_t), mAges.data(), mAgeSteps.data(), sizeof(tPtAge), mTiles.data());
+            break;
+        case kKernelFindTilePairs:
+            FindTilePairs(mTileInfo, mCount, mStartFrames.data(), sizeof(uint8_t), mAges.data(), mAgeSteps.data(), sizeof(tPtAge), mTilePairs.data());
+            break;
+        case kKernelWriteQuads:
+            {
+                cQuadVertex* v = mVertices.data();
+                WriteQuads(mCount, mPositions.data(), sizeof(Vec3f), mA0.data(), mA1.data(), vStride, mColours.data(), sizeof(Vec3f), mAlphas.data(), fStride, &v);
+            }
+            break;
+        case kKernelWriteQuadsTiled:
+            {
+                cQuadVertex* v = mVertices.data();
+                WriteQuads(mCount, mPositions.data(), sizeof(Vec3f), mA0.data(), mA1.data(), vStride, mColours.data(), sizeof(Vec3f), mAlphas.data(), fStride, mTiles.data(), sizeof(cParticleTile), mTileInfo.mDT, &v);
+            }
+            break;
+        case kKernelUpdatePhysicsSimple:
+            // In-place, so start from the same state each time
+            mPositionsOut  = mPositions;
+            mVelocitiesOut = mVelocities;
+            UpdatePhysicsSimple(mPhysics, mCount, mDTs.data(), fStride, mPositionsOut.data(), sizeof(Vec3f), mVelocitiesOut.data(), sizeof(Vec3f));
+            break;
+        case kKernelUpdateAges:
+            UpdateAges(1.0f / 60.0f, mCount, mAges.data(), mAgeSteps.data(), sizeof(tPtAge), mAgesOut.data());
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Float results may differ slightly where the compiler contracts
+    // multiply-adds differently in the scalar and vector code, so allow a
+    // few ULPs, or a small absolute error near zero.
+    const int   kMaxULPs      = 4;
+    const float kMaxAbsError  = 1e-5f;
+
+    bool Matches(float a, float b)
+    {
+        if (a == b || fabsf(a - b) <= kMaxAbsError)
+            return true;
+
+        int32_t ia = (int32_t&) a;
+        int32_t ib = (int32_t&) b;
+
+        if ((ia < 0) != (ib < 0))
+            return false;
+
+        return abs(ia - ib) <= kMaxULPs;
+    }
+
+    bool Matches(const float* a, const float* b, int count)
+    {
+        for (int i = 0; i < count; i++)
+            if (!Matches(a[i], b[i]))
+                return false;
+
+        return true;
+    }
+
+    bool Matches(Vec3f a, Vec3f b)
+    {
+        return Matches(a.Ref(), b.Ref(), 3);
+    }
+
+    bool Matches(Vec2f a, Vec2f b)
+    {
+        return Matches(a.Ref(), b.Ref(), 2);
+    }
+
+    int FindMismatch(tKernel kernel, const cKernelData& a, const cKernelData& b)
+    /// Returns the first particle whose outputs for 'kernel' differ, or -1
+    {
+        for (int i = 0; i < a.mCount; i++)
+        {
+            bool ok = true;
+
+            switch (kernel)
+            {
+            case kKernelApplyRotations:
+            case kKernelApplyScalesAndAspects:
+            case kKernelApplyVelocityStretch:
+                ok = Matches(a.mA0Out[i], b.mA0Out[i]) && Matches(a.mA1Out[i], b.mA1Out[i]);
+                break;
+            case kKernelFindTiles:
+                ok = a.mTiles[i].mU == b.mTiles[i].mU && a.mTiles[i].mV == b.mTiles[i].mV;
+                break;
+            case kKernelFindTilePairs:
+                ok = Matches(a.mTilePairs[i].mT, b.mTilePairs[i].mT)
+                    && a.mTilePairs[i].mU0 == b.mTilePairs[i].mU0 && a.mTilePairs[i].mV0 == b.mTilePairs[i].mV0
+                    && a.mTilePairs[i].mU1 == b.mTilePairs[i].mU1 && a.mTilePairs[i].mV1 == b.mTilePairs[i].mV1;
+                break;
+            case kKernelWriteQuads:
+            case kKernelWriteQuadsTiled:
+                for (int j = 4 * i; j < 4 * i + 4; j++)
+                    ok = ok
+                        && Matches(a.mVertices[j].mPosition, b.mVertices[j].mPosition)
+                        && Matches(a.mVertices[j].mUV, b.mVertices[j].mUV)
+                        && a.mVertices[j].mColour == b.mVertices[j].mColour;
+                break;
+            case kKernelUpdatePhysicsSimple:
+                ok = Matches(a.mPositionsOut[i], b.mPositionsOut[i]) && Matches(a.mVelocitiesOut[i], b.mVelocitiesOut[i]);
+                break;
+            case kKernelUpdateAges:
+                ok = a.mAgesOut[i] == b.mAgesOut[i];
+                break;
+            default:
+                break;
+            }
+
+            if (!ok)
+                return i;
+        }
+
+        return -1;
+    }
+}
+
+bool nHL::TestParticleKernels()
+{
+    // Odd count so the scalar remainder path is always exercised too.
+    const int kTestCount = 1003;
+
+    tParticleSIMD oldSIMD = ParticleSIMD();
+    bool success = true;
+
+    cKernelData reference;
+    cKernelData result;
+
+    reference.Setup(kTestCount, kDefaultSeed32);
+    result   .Setup(kTestCount, kDefaultSeed32);
+
+    for (int uniform = 0; uniform < 2; uniform++)
+    {
+        reference.mUniform = (uniform != 0);
+        result   .mUniform = (uniform != 0);
+
+        for (int k = 0; k < kMaxKernels; k++)
+        {
+            SetParticleSIMD(kParticleSIMDNone);
+
+            if (k == kKernelWriteQuadsTiled)
+                reference.Run(kKernelFindTiles);
+            reference.Run(tKernel(k));
+
+            for (int simd = kParticleSIMDNone + 1; simd < kMaxParticleSIMD; simd++)
+            {
+                if (!SetParticleSIMD(tParticleSIMD(simd)))
+                    continue;
+
+                if (k == kKernelWriteQuadsTiled)
+                    result.Run(kKernelFindTiles);
+                result.Run(tKernel(k));
+
+                int mismatch = FindMismatch(tKernel(k), reference, result);
+
+                if (mismatch >= 0)
+                {
+                    CL_LOG("Effects", "%s %s%s: mismatch at particle %d\n", ParticleSIMDName(tParticleSIMD(simd)), kKernelNames[k], uniform ? " (uniform)" : "", mismatch);
+                    success = false;
+                }
+            }
+        }
+    }
+
+    SetParticleSIMD(oldSIMD);
+
+    return success;
+}
+
+void nHL::BenchParticleKernels()
+{
+    const int kBenchCount = 4096;   // small enough to stay in cache
+    const int kBenchRuns  = 200;
+
+    tParticleSIMD oldSIMD = ParticleSIMD();
+
+    cKernelData data;
+    data.Setup(kBenchCount, kDefaultSeed32);
+    data.Run(kKernelFindTiles);
+
+    string line;
+    line.format("%-24s", "Mparticles/s");
+
+    for (int simd = 0; simd < kMaxParticleSIMD; simd++)
+        if (IsSupported(tParticleSIMD(simd)))
+            line.append_format(" %8s", ParticleSIMDName(tParticleSIMD(simd)));
+
+    CL_LOG("Effects", "%s\n", line.c_str());
+
+    for (int k = 0; k < kMaxKernels; k++)
+    {
+        line.format("%-24s", kKernelNames[k]);
+
+        for (int simd = 0; simd < kMaxParticleSIMD; simd++)
+        {
+            if (!SetParticleSIMD(tParticleSIMD(simd)))
+                continue;
+
+            data.Run(tKernel(k));   // warm up
+
+            uint64_t t0 = AbsoluteTicks();
+
+            for (int i = 0; i < kBenchRuns; i++)
+                data.Run(tKernel(k));
+
+            uint64_t t1 = AbsoluteTicks();
+
+            double seconds = (t1 - t0) * 1e-9;
+            line.append_format(" %8.1f", kBenchCount * kBenchRuns * 1e-6 / seconds);
+        }
+
+        CL_LOG("Effects", "%s\n", line.c_str());
+    }
+
+    SetParticleSIMD(oldSIMD);
+}
@@ -0,0 +1,495 @@
+//
+//  File:       HLParticleKernels.inl
+//
+//  Function:   ISA-independent bodies of the particle kernels. Included once
+//              per SIMD type by HLParticleKernels.cpp, inside a namespace that
+//              defines kWidth, tVF/tVI/tVM, and the basic vector operations.
+//
+//  Author(s):  Andrew Willmott
+//
+//  Copyright:  2013
+//
+
+// --- Helpers -----------------------------------------------------------------
+
+inline tVF LoadF(const float* p, size_t stride, int i)
+{
+    return stride ? LoadF(p + i) : Splat(*p);
+}
+
+inline void Load3(const Vec3f* p, size_t stride, int i, tVF* x, tVF* y, tVF* z)
+{
+    if (stride)
+        Load3(p + i, x, y, z);
+    else
+    {
+        *x = Splat((*p)[0]);
+        *y = Splat((*p)[1]);
+        *z = Splat((*p)[2]);
+    }
+}
+
+inline tVI ToIntRound(tVF v)
+// Same bias trick as RoundToSInt32()
+{
+    return SubI(AsInt(v + Splat(kFToIBiasF32)), SplatI(kFToIBiasS32));
+}
+
+inline tVI UnitToU8(tVF v)
+// Same as ClampUnitRealToUInt8()
+{
+    v = Min(Max(v, Splat(0.0f)), Splat(1.0f));
+
+    tVI i = SubI(AsInt(v + Splat(kFToI8BiasF32)), SplatI(kFToI8BiasS32));
+
+    return SubI(i, ShrI(i, 8));
+}
+
+inline tVI ColourAlphaToRGBA(tVF r, tVF g, tVF b, tVF a)
+// Matches ColourAlphaToRGBA32(), assuming little-endian
+{
+    return OrI(OrI(UnitToU8(r), ShlI(UnitToU8(g), 8)), OrI(ShlI(UnitToU8(b), 16), ShlI(UnitToU8(a), 24)));
+}
+
+inline void SinCosFast(tVF theta, tVF* s, tVF* c)
+// Vector version of nCL::SinCosFast
+{
+    tVI fi = AsInt(theta * Splat(kSinCosScale) + Splat(kBias.f));
+    tVI i  = AndI(fi, SplatI(cSinCosTable::kSize - 1));
+    i = AddI(i, i);
+
+    tVF t = theta - ToFloat(SubI(fi, SplatI(kBias.i))) * Splat(kSinCosInvScale);
+
+    tVF t0 = GatherF(sSinCosTable.mTable,     i);
+    tVF t1 = GatherF(sSinCosTable.mTable + 1, i);
+    tVF half = Splat(0.5f);
+
+    *s = t0 + (t1 - half * t0 * t) * t;
+    *c = t1 - (t0 + half * t1 * t) * t;
+}
+
+inline tVF RemainderF(tVF f, tVF n, tVF invN)
+// C-style integer remainder, f % n, for integral floats with |f| < 2^22.
+{
+    tVF zero = Splat(0.0f);
+    tVF a = Max(f, zero - f);
+    tVF r = a - Floor(a * invN) * n;
+
+    // invN is inexact, so correct for being off by one
+    r = Select(Less(r, zero), r + n, r);
+    r = Select(Less(r, n), r, r - n);
+
+    return Select(Less(f, zero), zero - r, r);
+}
+
+inline void FindFrames
+(
+    const cParticleTileInfo& psi,
+    const uint8_t   startFrames[],
+    size_t          startFrameStride,
+    const tPtAge    ages[],
+    int             i,
+    tVF*            frameT,
+    tVF*            frame0,
+    tVI*            startFrame
+)
+{
+    uint32_t sf[kWidth];
+
+    for (int j = 0; j < kWidth; j++)
+        sf[j] = startFrames[startFrameStride * (i + j)];
+
+    tVF t = ToFloatU(LoadU(ages + i)) * Splat(psi.mTimeScale);
+    tVF ft = Floor(t);
+
+    *frameT = t - ft;
+    *frame0 = ft;
+    *startFrame = LoadU(sf);
+}
+
+
+// --- Kernels -----------------------------------------------------------------
+
+int ApplyRotations
+(
+    int         count,
+    const Vec3f a0s[],
+    const Vec3f a1s[],          size_t aStride,
+    const float rotations[],    size_t rotationStride,
+    Vec3f       a0sOut[],
+    Vec3f       a1sOut[]
+)
+{
+    tVF twoPi = Splat(vl_twoPi);
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF a0x, a0y, a0z;
+        tVF a1x, a1y, a1z;
+
+        Load3(a0s, aStride, i, &a0x, &a0y, &a0z);
+        Load3(a1s, aStride, i, &a1x, &a1y, &a1z);
+
+        tVF sr, cr;
+        SinCosFast(LoadF(rotations, rotationStride, i) * twoPi, &sr, &cr);
+
+        Store3(a0sOut + i, cr * a0x - sr * a1x, cr * a0y - sr * a1y, cr * a0z - sr * a1z);
+        Store3(a1sOut + i, cr * a1x + sr * a0x, cr * a1y + sr * a0y, cr * a1z + sr * a0z);
+    }
+
+    return i;
+}
+
+int ApplyScalesAndAspects
+(
+    int         count,
+    const Vec3f a0s[],
+    const Vec3f a1s[],          size_t aStride,
+    const float scales[],       size_t scaleStride,
+    const float aspects[],      size_t aspectStride,
+    Vec3f       a0sOut[],
+    Vec3f       a1sOut[]
+)
+{
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF a0x, a0y, a0z;
+        tVF a1x, a1y, a1z;
+
+        Load3(a0s, aStride, i, &a0x, &a0y, &a0z);
+        Load3(a1s, aStride, i, &a1x, &a1y, &a1z);
+
+        tVF s  = LoadF(scales, scaleStride, i);
+        tVF sa = s * LoadF(aspects, aspectStride, i);
+
+        Store3(a0sOut + i, a0x * sa, a0y * sa, a0z * sa);
+        Store3(a1sOut + i, a1x * s,  a1y * s,  a1z * s);
+    }
+
+    return i;
+}
+
+int ApplyVelocityStretch
+(
+    float               psVelocityStretch,
+    const cTransform&   effectToWorld,
+    int                 count,
+    const Vec3f         velocities[],   size_t velocityStride,
+    const Vec3f         a0s[],
+    const Vec3f         a1s[],          size_t aStride,
+    Vec3f               a0Out[],
+    Vec3f               a1Out[]
+)
+{
+    const Mat3f& m = effectToWorld.mRotation;
+
+    tVF m00 = Splat(m[0][0]), m01 = Splat(m[0][1]), m02 = Splat(m[0][2]);
+    tVF m10 = Splat(m[1][0]), m11 = Splat(m[1][1]), m12 = Splat(m[1][2]);
+    tVF m20 = Splat(m[2][0]), m21 = Splat(m[2][1]), m22 = Splat(m[2][2]);
+
+    tVF one     = Splat(1.0f);
+    tVF minNF   = Splat(1e-6f);
+    tVF stretch = Splat(psVelocityStretch);
+
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF vx, vy, vz;
+        Load3(velocities, velocityStride, i, &vx, &vy, &vz);
+
+        tVF wx = vx * m00 + vy * m10 + vz * m20;
+        tVF wy = vx * m01 + vy * m11 + vz * m21;
+        tVF wz = vx * m02 + vy * m12 + vz * m22;
+
+        tVF a0x, a0y, a0z;
+        tVF a1x, a1y, a1z;
+
+        Load3(a0s, aStride, i, &a0x, &a0y, &a0z);
+        Load3(a1s, aStride, i, &a1x, &a1y, &a1z);
+
+        tVF cr = wx * a1x + wy * a1y + wz * a1z;
+        tVF sr = wx * a0x + wy * a0y + wz * a0z;
+
+        tVF nf = Sqrt(cr * cr + sr * sr);
+
+        // Compute both paths, and select per lane.
+        tVF invNF = one / Max(nf, minNF);
+
+        cr = cr * invNF;
+        sr = sr * invNF;
+
+        tVF b0x = cr * a0x - sr * a1x;
+        tVF b0y = cr * a0y - sr * a1y;
+        tVF b0z = cr * a0z - sr * a1z;
+
+        tVF b1x = cr * a1x + sr * a0x;
+        tVF b1y = cr * a1y + sr * a0y;
+        tVF b1z = cr * a1z + sr * a0z;
+
+        tVF s = Select(Greater(nf, stretch), nf / stretch, one);
+
+        tVM rotate = Greater(nf, minNF);
+
+        Store3(a0Out + i, Select(rotate, b0x,     a0x), Select(rotate, b0y,     a0y), Select(rotate, b0z,     a0z));
+        Store3(a1Out + i, Select(rotate, b1x * s, a1x), Select(rotate, b1y * s, a1y), Select(rotate, b1z * s, a1z));
+    }
+
+    return i;
+}
+
+int FindTiles
+(
+    const cParticleTileInfo& psi,
+    int                 count,
+    const uint8_t       startFrames[],  size_t startFrameStride,
+    const tPtAge        ages[],
+    cParticleTile       tiles[]
+)
+{
+    tVF n    = Splat(psi.mCount);
+    tVF invN = Splat(psi.mCount ? 1.0f / psi.mCount : 0.0f);
+    tVI mask0 = SplatI(psi.mMask[0]);
+    tVI mask1 = SplatI(psi.mMask[1]);
+
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF frameT, f0;
+        tVI startFrame;
+
+        FindFrames(psi, startFrames, startFrameStride, ages, i, &frameT, &f0, &startFrame);
+
+        if (psi.mCount)
+            f0 = RemainderF(f0, n, invN);
+
+        tVI frame0 = AddI(ToIntRound(f0), startFrame);
+
+        uint32_t u[kWidth];
+        uint32_t v[kWidth];
+
+        StoreU(u, AndI(frame0, mask0));
+        StoreU(v, AndI(ShrAI(frame0, psi.mShift), mask1));
+
+        for (int j = 0; j < kWidth; j++)
+        {
+            tiles[i + j].mU = u[j];
+            tiles[i + j].mV = v[j];
+        }
+    }
+
+    return i;
+}
+
+int FindTilePairs
+(
+    const cParticleTileInfo& psi,
+    int                 count,
+    const uint8_t       startFrames[],  size_t startFrameStride,
+    const tPtAge        ages[],
+    cParticleTilePair   tiles[]
+)
+{
+    if (psi.mCount == 0)
+        return 0;   // leave to the scalar version
+
+    tVF n    = Splat(psi.mCount);
+    tVF invN = Splat(1.0f / psi.mCount);
+    tVI mask0 = SplatI(psi.mMask[0]);
+    tVI mask1 = SplatI(psi.mMask[1]);
+
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF frameT, f0;
+        tVI startFrame;
+
+        FindFrames(psi, startFrames, startFrameStride, ages, i, &frameT, &f0, &startFrame);
+
+        tVF f1 = f0 + Splat(1.0f);
+
+        tVI frame0 = AddI(ToIntRound(RemainderF(f0, n, invN)), startFrame);
+        tVI frame1 = AddI(ToIntRound(RemainderF(f1, n, invN)), startFrame);
+
+        float    t [kWidth];
+        uint32_t u0[kWidth];
+        uint32_t v0[kWidth];
+        uint32_t u1[kWidth];
+        uint32_t v1[kWidth];
+
+        StoreF(t, frameT);
+        StoreU(u0, AndI(frame0, mask0));
+        StoreU(v0, AndI(ShrAI(frame0, psi.mShift), mask1));
+        StoreU(u1, AndI(frame1, mask0));
+        StoreU(v1, AndI(ShrAI(frame1, psi.mShift), mask1));
+
+        for (int j = 0; j < kWidth; j++)
+        {
+            tiles[i + j].mT  = t [j];
+            tiles[i + j].mU0 = u0[j];
+            tiles[i + j].mV0 = v0[j];
+            tiles[i + j].mU1 = u1[j];
+            tiles[i + j].mV1 = v1[j];
+        }
+    }
+
+    return i;
+}
+
+int WriteQuads
+(
+    int count,
+    const Vec3f positions[],    size_t positionStride,
+    const Vec3f d0s[],
+    const Vec3f d1s[],          size_t dStride,
+    const Vec3f colours[],      size_t colourStride,
+    const float alphas[],       size_t alphaStride,
+    const cParticleTile tiles[],
+    Vec2f tw,
+    cQuadVertex* v
+)
+{
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF px, py, pz;
+        tVF d0x, d0y, d0z;
+        tVF d1x, d1y, d1z;
+        tVF cr, cg, cb;
+
+        Load3(positions, positionStride, i, &px, &py, &pz);
+        Load3(d0s, dStride, i, &d0x, &d0y, &d0z);
+        Load3(d1s, dStride, i, &d1x, &d1y, &d1z);
+        Load3(colours, colourStride, i, &cr, &cg, &cb);
+
+        // Corners are p + d0, p - d1, p - d0, p + d1
+        Vec3f    corners[4][kWidth];
+        uint32_t rgba[kWidth];
+
+        Store3(corners[0], px + d0x, py + d0y, pz + d0z);
+        Store3(corners[1], px - d1x, py - d1y, pz - d1z);
+        Store3(corners[2], px - d0x, py - d0y, pz - d0z);
+        Store3(corners[3], px + d1x, py + d1y, pz + d1z);
+
+        StoreU(rgba, ColourAlphaToRGBA(cr, cg, cb, LoadF(alphas, alphaStride, i)));
+
+        // Write out in order, to keep write-combining happy.
+        if (tiles)
+            for (int j = 0; j < kWidth; j++)
+            {
+                Vec2f tp(tiles[i + j].mU * tw[0], tiles[i + j].mV * tw[1]);
+
+                v[0].mPosition = corners[0][j];
+                v[0].mUV       = Vec2f(tp[0],         tp[1]);
+                v[0].mColour   = rgba[j];
+                v[1].mPosition = corners[1][j];
+                v[1].mUV       = Vec2f(tp[0],         tp[1] + tw[1]);
+                v[1].mColour   = rgba[j];
+                v[2].mPosition = corners[2][j];
+                v[2].mUV       = Vec2f(tp[0] + tw[0], tp[1] + tw[1]);
+                v[2].mColour   = rgba[j];
+                v[3].mPosition = corners[3][j];
+                v[3].mUV       = Vec2f(tp[0] + tw[0], tp[1]);
+                v[3].mColour   = rgba[j];
+                v += 4;
+            }
+        else
+            for (int j = 0; j < kWidth; j++)
+            {
+                v[0].mPosition = corners[0][j];
+                v[0].mUV       = vl_0;
+                v[0].mColour   = rgba[j];
+                v[1].mPosition = corners[1][j];
+                v[1].mUV       = vl_y;
+                v[1].mColour   = rgba[j];
+                v[2].mPosition = corners[2][j];
+                v[2].mUV       = vl_1;
+                v[2].mColour   = rgba[j];
+                v[3].mPosition = corners[3][j];
+                v[3].mUV       = vl_x;
+                v[3].mColour   = rgba[j];
+                v += 4;
+            }
+    }
+
+    return i;
+}
+
+int UpdatePhysicsSimple
+(
+    const cParticlesPhysicsDesc& desc,
+
+    int             count,
+    const float     dts[],          size_t dtStride,
+    Vec3f           positions[],
+    Vec3f           velocities[]
+)
+{
+    tVF fx = Splat(desc.mDirForces[0]);
+    tVF fy = Splat(desc.mDirForces[1]);
+    tVF fz = Splat(desc.mDirForces[2]);
+    tVF drag = Splat(desc.mDrag);
+    tVF one  = Splat(1.0f);
+    tVF half = Splat(0.5f);
+
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+    {
+        tVF px, py, pz;
+        tVF vx, vy, vz;
+
+        Load3(positions  + i, &px, &py, &pz);
+        Load3(velocities + i, &vx, &vy, &vz);
+
+        tVF dt = LoadF(dts, dtStride, i);
+        tVF damping = one - drag * dt;
+
+        tVF v1x = (vx + fx * dt) * damping;
+        tVF v1y = (vy + fy * dt) * damping;
+        tVF v1z = (vz + fz * dt) * damping;
+
+        tVF hdt = half * dt;
+
+        Store3(positions  + i, px + (vx + v1x) * hdt, py + (vy + v1y) * hdt, pz + (vz + v1z) * hdt);
+        Store3(velocities + i, v1x, v1y, v1z);
+    }
+
+    return i;
+}
+
+int UpdateAges
+(
+    tPtAge          da,
+    int             count,
+    const tPtAge    ages[],
+    const tPtAge    ageSteps[],
+    tPtAge          agesOut[]
+)
+{
+    tVI vda = SplatI(da);
+    int i = 0;
+
+    for ( ; i + kWidth <= count; i += kWidth)
+        StoreU(agesOut + i, AddI(LoadU(ages + i), MulI(vda, LoadU(ageSteps + i))));
+
+    return i;
+}
+
+const cParticleKernels kKernels =
+{
+    ApplyRotations,
+    ApplyScalesAndAspects,
+    ApplyVelocityStretch,
+    FindTiles,
+    FindTilePairs,
+    WriteQuads,
+    UpdatePhysicsSimple,
+    UpdateAges
+};
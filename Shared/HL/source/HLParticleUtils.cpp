@@ -10,10 +10,15 @@
 
 #include <HLParticleUtils.h>
 
+#include <HLParticleKernels.h>
+
 #include <IHLRenderer.h>
 
 #include <CLColour.h>
+#include <CLDispatch.h>
+#include <CLLog.h>
 #include <CLMath.h>
+#include <CLRandom.h>
 #include <CLString.h>
 #include <CLValue.h>
 #include <CLVecUtil.h>
@@ -25,6 +30,8 @@ namespace
 {
     const float kDefaultAnimFloat = 1.0f;
     const Vec3f kDefaultAnimVec3f = vl_1;
+
+    const int kCreateBatchSize = 64;    ///< Chunk size for random values generated during particle creation
 }
 
 namespace
@@ -474,42 +481,51 @@ void nHL::CreateParticleBasics
     const cBounds3* codeBounds
 )
 {
-    int finish = start + count;
+    // Random values are generated a field at a time via the batch generators,
+    // so results depend only on the seed and count.
+    float r[kCreateBatchSize];
 
     if (ageStep)
-        for (int i = start; i < finish; i++)
-            ageStep[i] = LifeToAgeStep(RandomRange(desc.mLife, seed));
+        for (int i = start, finish = start + count; i < finish; i += kCreateBatchSize)
+        {
+            int n = Min(finish - i, kCreateBatchSize);
+
+            RandomRange(n, desc.mLife, r, seed);
+
+            for (int j = 0; j < n; j++)
+                ageStep[i + j] = LifeToAgeStep(r[j]);
+        }
 
     const cBounds3* emitBounds = codeBounds ? codeBounds : &desc.mEmitBounds;
 
     if (desc.mEmitTorusRadius > 0.0f)
-        for (int i = start; i < finish; i++)
-            position[i] = RandomTorus    (*emitBounds, desc.mEmitTorusRadius, seed);
+        RandomTorus    (count, *emitBounds, desc.mEmitTorusRadius, position + start, seed);
     else if (desc.mFlags.mEmitEllipsoid)
-        for (int i = start; i < finish; i++)
-            position[i] = RandomEllipsoid(*emitBounds, seed);
+        RandomEllipsoid(count, *emitBounds, position + start, seed);
     else
-        for (int i = start; i < finish; i++)
-            position[i] = RandomRange    (*emitBounds, seed);
+        RandomRange    (count, *emitBounds, position + start, seed);
 
     if (desc.mFlags.mEmitRadial)
-        for (int i = start; i < finish; i++)
-        {
-            Vec3f v = position[i];
-
-            float speed = RandomRange(desc.mEmitSpeed, seed) * createScale.mSpeed;
-            
-            velocity[i] = v * (speed * InvSqrtFast(sqrlen(v)));
-        }
+        for (int i = start, finish = start + count; i < finish; i++)
+            velocity[i] = position[i];
     else
-        for (int i = start; i < finish; i++)
+        RandomRange(count, desc.mEmitDir, velocity + start, seed);
+
+    for (int i = start, finish = start + count; i < finish; i += kCreateBatchSize)
+    {
+        int n = Min(finish - i, kCreateBatchSize);
+
+        RandomRange(n, desc.mEmitSpeed, r, seed);
+
+        for (int j = 0; j < n; j++)
         {
-            Vec3f v = RandomRange(desc.mEmitDir, seed);
+            Vec3f v = velocity[i + j];
 
-            float speed = RandomRange(desc.mEmitSpeed, seed) * createScale.mSpeed;
-            
-            velocity[i] = v * (speed * InvSqrtFast(sqrlen(v)));
+            float speed = r[j] * createScale.mSpeed;
+
+            velocity[i + j] = v * (speed * InvSqrtFast(sqrlen(v)));
         }
+    }
 }
 
 void nHL::CreateParticleAttributes
@@ -532,8 +548,12 @@ void nHL::CreateParticleAttributes
     if (sizes)
     {
         if (desc.mSizeVary != 0.0f)
+        {
+            RandomRangeAbout(count, 1.0f, desc.mSizeVary, sizes + start, seed);
+
             for (int i = start; i < finish; i++)
-                sizes[i] = RandomRangeAbout(1.0f, desc.mSizeVary, seed) * createScale.mSize;
+                sizes[i] *= createScale.mSize;
+        }
         else
             for (int i = start; i < finish; i++)
                 sizes[i] = createScale.mSize;
@@ -542,8 +562,12 @@ void nHL::CreateParticleAttributes
     if (alphas)
     {
         if (desc.mAlphaVary != 0.0f)
+        {
+            RandomRangeAbout(count, 1.0f, desc.mAlphaVary, alphas + start, seed);
+
             for (int i = start; i < finish; i++)
-                alphas[i] = RandomRangeAbout(1.0f, desc.mAlphaVary, seed) * createScale.mAlpha;
+                alphas[i] *= createScale.mAlpha;
+        }
         else
             for (int i = start; i < finish; i++)
                 alphas[i] = createScale.mAlpha;
@@ -554,18 +578,23 @@ void nHL::CreateParticleAttributes
         if (desc.mColourVary != vl_0)
         {
             if (desc.mFlags.mVaryRGB)
+            {
+                RandomSFloat(3 * count, colours[start].Ref(), seed);
+
                 for (int i = start; i < finish; i++)
+                    colours[i] = Vec3f(vl_1) + desc.mColourVary * colours[i];
+            }
+            else
+                for (int i = start; i < finish; i += kCreateBatchSize)
                 {
-                    colours[i] =
-                    {
-                        RandomRangeAbout(1.0f, desc.mColourVary[0], seed),
-                        RandomRangeAbout(1.0f, desc.mColourVary[1], seed),
-                        RandomRangeAbout(1.0f, desc.mColourVary[2], seed)
-                    };
+                    float r[kCreateBatchSize];
+                    int n = Min(finish - i, kCreateBatchSize);
+
+                    RandomSFloat(n, r, seed);
+
+                    for (int j = 0; j < n; j++)
+                        colours[i + j] = Vec3f(vl_1) + desc.mColourVary * r[j];
                 }
-            else
-                for (int i = start; i < finish; i++)
-                    colours[i] = Vec3f(vl_1) + desc.mColourVary * RandomSFloat(seed);
 
             if (createScale.mColour != vl_1)
                 for (int i = start; i < finish; i++)
@@ -579,8 +608,7 @@ void nHL::CreateParticleAttributes
     if (rotations)
     {
         if (desc.mRotateVary != 0.0f)
-            for (int i = start; i < finish; i++)
-                rotations[i] = RandomSFloat(desc.mRotateVary, seed);
+            RandomSFloat(count, desc.mRotateVary, rotations + start, seed);
         else
             for (int i = start; i < finish; i++)
                 rotations[i] = 1.0f;
@@ -589,8 +617,7 @@ void nHL::CreateParticleAttributes
     if (aspects)
     {
         if (desc.mAspectVary != 0.0f)
-            for (int i = start; i < finish; i++)
-                aspects[i] = RandomRangeAbout(1.0f, desc.mAspectVary, seed);
+            RandomRangeAbout(count, 1.0f, desc.mAspectVary, aspects + start, seed);
         else
             for (int i = start; i < finish; i++)
                 aspects[i] = 1.0f;
@@ -610,12 +637,18 @@ void nHL::CreateParticleFrames
 
     if (desc.mFrameRandom > 0)
     {
-        if (desc.mFrameCount > 0)
-            for (int i = start; i < finish; i++)
-                frames[i] = desc.mFrameStart + RandomUInt32(desc.mFrameRandom, seed) * desc.mFrameCount;
-        else
-            for (int i = start; i < finish; i++)
-                frames[i] = desc.mFrameStart + RandomUInt32(desc.mFrameRandom, seed);
+        uint32_t r[kCreateBatchSize];
+        uint32_t frameStep = desc.mFrameCount > 0 ? desc.mFrameCount : 1;
+
+        for (int i = start; i < finish; i += kCreateBatchSize)
+        {
+            int n = Min(finish - i, kCreateBatchSize);
+
+            RandomUInt32(n, desc.mFrameRandom, r, seed);
+
+            for (int j = 0; j < n; j++)
+                frames[i + j] = desc.mFrameStart + r[j] * frameStep;
+        }
     }
     else
         for (int i = start; i < finish; i++)
@@ -873,7 +906,20 @@ void nHL::ApplyRotations
     Vec3f       a1sOut[]
 )
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && IsDenseOrUniform(aStride, sizeof(Vec3f)) && IsDenseOrUniform(rotationStride, sizeof(float)))
+    {
+        i = kernels->mApplyRotations(count, a0s, a1s, aStride, rotations, rotationStride, a0sOut, a1sOut);
+
+        ((uint8_t*&) a0s)        += i * aStride;
+        ((uint8_t*&) a1s)        += i * aStride;
+        ((uint8_t*&) rotations)  += i * rotationStride;
+    }
+
+    for ( ; i < count; i++)
     {
         Vec3f a0(*a0s);
         Vec3f a1(*a1s);
@@ -905,7 +951,21 @@ void nHL::ApplyScalesAndAspects
     Vec3f       a1sOut[]
 )
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && IsDenseOrUniform(aStride, sizeof(Vec3f)) && IsDenseOrUniform(scaleStride, sizeof(float)) && IsDenseOrUniform(aspectStride, sizeof(float)))
+    {
+        i = kernels->mApplyScalesAndAspects(count, a0s, a1s, aStride, scales, scaleStride, aspects, aspectStride, a0sOut, a1sOut);
+
+        ((uint8_t*&) a0s)        += i * aStride;
+        ((uint8_t*&) a1s)        += i * aStride;
+        ((uint8_t*&) scales)     += i * scaleStride;
+        ((uint8_t*&) aspects)    += i * aspectStride;
+    }
+
+    for ( ; i < count; i++)
     {
         Vec3f a0(*a0s);
         Vec3f a1(*a1s);
@@ -1031,7 +1091,22 @@ void nHL::ApplyVelocityStretch
     Vec3f               a1Out[]
 )
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && IsDenseOrUniform(velocityStride, sizeof(Vec3f)) && IsDenseOrUniform(aStride, sizeof(Vec3f)))
+    {
+        i = kernels->mApplyVelocityStretch(psVelocityStretch, effectToWorld, count, velocities, velocityStride, a0s, a1s, aStride, a0Out, a1Out);
+
+        ((uint8_t*&) velocities) += i * velocityStride;
+        ((uint8_t*&) a0s)        += i * aStride;
+        ((uint8_t*&) a1s)        += i * aStride;
+        a0Out += i;
+        a1Out += i;
+    }
+
+    for ( ; i < count; i++)
     {
         // orient-with-direction if velocity stretch is on.
         Vec3f velocity = effectToWorld.TransformDirection(*velocities);
@@ -1079,7 +1154,20 @@ void nHL::FindTiles
     cParticleTile       tiles[]
 )
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && ageStride == sizeof(tPtAge))
+    {
+        i = kernels->mFindTiles(psi, count, startFrames, startFrameStride, ages, tiles);
+
+        ((uint8_t*&) startFrames) += i * startFrameStride;
+        ((uint8_t*&) ages)        += i * ageStride;
+        ((uint8_t*&) ageSteps)    += i * ageStride;
+    }
+
+    for ( ; i < count; i++)
     {
         float    frameT = *ages * psi.mTimeScale;
         float    fti = floorf(frameT);
@@ -1114,7 +1202,20 @@ void nHL::FindTilePairs
     cParticleTilePair tiles[]
 )
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && ageStride == sizeof(tPtAge))
+    {
+        i = kernels->mFindTilePairs(psi, count, startFrames, startFrameStride, ages, tiles);
+
+        ((uint8_t*&) startFrames) += i * startFrameStride;
+        ((uint8_t*&) ages)        += i * ageStride;
+        ((uint8_t*&) ageSteps)    += i * ageStride;
+    }
+
+    for ( ; i < count; i++)
     {
         float    frameT = *ages * psi.mTimeScale;
         float    fti = floorf(frameT);
@@ -1405,12 +1506,332 @@ namespace
         }
     }
 
+    const int kPtBatchSize      = 256;      ///< Particles processed at a time, sized for the stack temporaries
+    const int kQuadChunkSize    = 1024;     ///< Input particles per quad-writing job
+    const int kMaxQuadRanges    = 64;       ///< Ranges queued before they're written
+
+    struct cQuadsContext
+    /// Everything needed to write quads for any sub-range of the input particles.
+    {
+        const cParticlesDispatchDesc* mDesc;
+        const cTransform*     mEffectToWorld;
+        const cDispatchScale* mDispatchScale;
+
+        Vec3f               mAxes[2];       ///< Shared particle axes, in effect space
+        Vec3f               mDiagonals[2];  ///< Same, converted to quad diagonals
+        cParticleTileInfo   mTileInfo;
+        bool                mTiled;
+
+        const tPtAge*   mAges;
+        const tPtAge*   mAgeSteps;      size_t mAgeStride;
+        const Vec3f*    mPositions;     size_t mPositionStride;
+        const Vec3f*    mVelocities;    size_t mVelocityStride;
+        const Vec3f*    mColours;       size_t mColourStride;
+        const float*    mAlphas;        size_t mAlphaStride;
+        const float*    mSizes;         size_t mSizeStride;
+        const float*    mRotations;     size_t mRotationStride;
+        const float*    mAspects;       size_t mAspectStride;
+        const uint8_t*  mFrames;        size_t mFrameStride;
+    };
+
+    struct cQuadRange
+    {
+        int mBegin;     ///< Input particle range
+        int mEnd;
+        int mQuad;      ///< Output quad offset
+    };
+
+    int WriteQuadsForRange(const cQuadsContext& qc, int begin, int end, cQuadVertex* v)
+    /// Writes quads for all live particles in [begin, end) to v, and returns the number written.
+    {
+        const cParticlesDispatchDesc& desc = *qc.mDesc;
+        const cDispatchScale* dispatchScale = qc.mDispatchScale;
+
+        const size_t ageStride      = qc.mAgeStride;
+        const size_t positionStride = qc.mPositionStride;
+        const size_t velocityStride = qc.mVelocityStride;
+        const size_t colourStride   = qc.mColourStride;
+        const size_t alphaStride    = qc.mAlphaStride;
+        const size_t sizeStride     = qc.mSizeStride;
+        const size_t rotationStride = qc.mRotationStride;
+        const size_t aspectStride   = qc.mAspectStride;
+        const size_t frameStride    = qc.mFrameStride;
+
+        const tPtAge*   ages        = (const tPtAge*)   ((const uint8_t*) qc.mAges       + begin * ageStride);
+        const tPtAge*   ageSteps    = (const tPtAge*)   ((const uint8_t*) qc.mAgeSteps   + begin * ageStride);
+        const Vec3f*    positions   = (const Vec3f*)    ((const uint8_t*) qc.mPositions  + begin * positionStride);
+        const Vec3f*    velocities  = (const Vec3f*)    ((const uint8_t*) qc.mVelocities + begin * velocityStride);
+        const Vec3f*    colours     = (const Vec3f*)    ((const uint8_t*) qc.mColours    + begin * colourStride);
+        const float*    alphas      = (const float*)    ((const uint8_t*) qc.mAlphas     + begin * alphaStride);
+        const float*    sizes       = (const float*)    ((const uint8_t*) qc.mSizes      + begin * sizeStride);
+        const float*    rotations   = (const float*)    ((const uint8_t*) qc.mRotations  + begin * rotationStride);
+        const float*    aspects     = (const float*)    ((const uint8_t*) qc.mAspects    + begin * aspectStride);
+        const uint8_t*  frames      = (const uint8_t*)  ((const uint8_t*) qc.mFrames     + begin * frameStride);
+
+        int quadsWritten = 0;
+
+        // intermediate storage
+        Vec3f c         [kPtBatchSize];
+        float a         [kPtBatchSize];
+        Vec3f d0        [kPtBatchSize];
+        Vec3f d1        [kPtBatchSize];
+        float scales    [kPtBatchSize];
+        float r         [kPtBatchSize];
+        float as        [kPtBatchSize];
+        cParticleTile ti[kPtBatchSize];
+
+        for (int i = 0, n = end - begin; i < n; )
+        {
+            int skippedParticles = 0;
+
+            while (IsExpired(*ages))  // skip expired particles at the start
+            {
+                ((uint8_t*&) ages) += ageStride;
+                skippedParticles++;
+
+                if (++i == n)
+                    break;
+            }
+
+            if (i == n)
+                break;
+
+            if (skippedParticles)
+            {
+                ((uint8_t*&) ageSteps)      += skippedParticles * ageStride;
+
+                ((uint8_t*&) positions)     += skippedParticles * positionStride;
+                ((uint8_t*&) velocities)    += skippedParticles * velocityStride;
+
+                ((uint8_t*&) colours)       += skippedParticles * colourStride;
+                ((uint8_t*&) alphas   )     += skippedParticles * alphaStride;
+
+                ((uint8_t*&) sizes    )     += skippedParticles * sizeStride;
+                ((uint8_t*&) rotations)     += skippedParticles * rotationStride;
+                ((uint8_t*&) aspects  )     += skippedParticles * aspectStride;
+
+                ((uint8_t*&) frames   )     += skippedParticles * frameStride;
+            }
+
+            int count = min(n - i, kPtBatchSize);
+            const tPtAge* agesPeek = ages;
+
+            for (int j = 0; j < count; j++)     // find max 'live' span
+            {
+                if (IsExpired(*agesPeek))
+                {
+                    count = j;
+                    break;
+                }
+
+                ((uint8_t*&) agesPeek) += ageStride;
+            }
+
+            const Vec3f* cIn = colours;
+            size_t       cInStride = colourStride;
+            const float* aIn = alphas;
+            size_t       aInStride = alphaStride;
+
+            if (qc.mTiled)
+                FindTiles(qc.mTileInfo, count, frames, frameStride, ages, ageSteps, ageStride, ti);
+
+            const float* sIn = sizes;
+            size_t sInStride = sizeStride;
+
+            if (!desc.mSizeFrames.empty())
+            {
+                ApplyLinearAnim(desc.mSizeFrames.size(), desc.mSizeFrames.data(), count, ages, ageStride, sIn, sInStride, scales);
+                sIn = scales;
+                sInStride = sizeof(scales[0]);
+            }
+
+            if (dispatchScale && dispatchScale->mSize != 1.0f)
+            {
+                ApplyScale(dispatchScale->mSize, count, sIn, sInStride, scales);
+                sIn = scales;
+                sInStride = sizeof(scales[0]);
+            }
+
+            const float* asIn = aspects;
+            size_t asInStride = aspectStride;
+
+            if (!desc.mAspectFrames.empty())
+            {
+                ApplyLinearAnim(desc.mAspectFrames.size(), desc.mAspectFrames.data(), count, ages, ageStride, asIn, asInStride, as);
+
+                asIn = as;
+                asInStride = sizeof(as[0]);
+            }
+
+            const Vec3f* d0In = &qc.mAxes[0];
+            const Vec3f* d1In = &qc.mAxes[1];
+            size_t dInStride = 0;
+
+            const float* rIn = rotations;
+            size_t rInStride = rotationStride;
+
+            if (!desc.mRotateFrames.empty())
+            {
+                ApplyLinearAnim(desc.mRotateFrames.size(), desc.mRotateFrames.data(), count, ages, ageStride, rIn, rInStride, r);
+
+                rIn = r;
+                rInStride = sizeof(r[0]);
+            }
+
+            // TODO: didn't this used to interoperate with mRotateVary, so you could get +- (offset + abs(vary)) ?
+            if (desc.mRotateOffset != 0.0f)
+            {
+                ApplyDelta(desc.mRotateOffset, count, rIn, rInStride, r);
+
+                rIn = r;
+                rInStride = sizeof(r[0]);
+            }
+
+            ///////////////////////////////////////
+
+            if (rIn)
+            {
+                ApplyRotations(count, d0In, d1In, dInStride, rIn, rInStride, d0, d1);
+
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
+
+            if (sIn || asIn)
+            {
+                ApplyScalesAndAspects(count, d0In, d1In, dInStride, sIn ? sIn : &kDefaultAnimFloat, sInStride, asIn ? asIn : &kDefaultAnimFloat, asInStride, d0, d1);
+
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
+
+            ////////////////////////////////////////
+
+            if (!desc.mColourFrames.empty())
+            {
+                ApplyLinearAnim(desc.mColourFrames.size(), desc.mColourFrames.data(), count, ages, ageStride,  cIn, cInStride, c);
+                cIn = c;
+                cInStride = sizeof(c[0]);
+            }
+
+            if (dispatchScale && dispatchScale->mColour != vl_1)
+            {
+                ApplyScale(dispatchScale->mColour, count, cIn, cInStride, c);
+                cIn = c;
+                cInStride = sizeof(c[0]);
+            }
+
+            if (!desc.mAlphaFrames.empty())
+            {
+                ApplyLinearAnim(desc.mAlphaFrames.size(), desc.mAlphaFrames.data(), count, ages, ageStride, aIn, aInStride, a);
+                aIn = a;
+                aInStride = sizeof(a[0]);
+            }
+
+            if (dispatchScale && dispatchScale->mAlpha != 1.0f)
+            {
+                ApplyScale(dispatchScale->mAlpha, count, aIn, aInStride, a);
+                aIn = a;
+                aInStride = sizeof(a[0]);
+            }
+
+            if (velocities && desc.mVelocityStretch != 0.0f)
+            {
+                ApplyVelocityStretch
+                (
+                    desc.mVelocityStretch,
+                    *qc.mEffectToWorld,
+                    count,
+                    velocities, velocityStride,
+                    d0In, d1In, dInStride,
+                    d0, d1
+                );
+
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
+
+            if (d0In == d0)
+                ConvertToDiagonals(count, d0In, d1In, dInStride, d0, d1);
+            else
+            {
+                d0In = &qc.mDiagonals[0];
+                d1In = &qc.mDiagonals[1];
+            }
+
+            int writeCount;
+
+            if (qc.mTiled)
+                writeCount = nHL::WriteQuads
+                (
+                    count,
+                    positions,  positionStride,
+                    d0In, d1In, dInStride,
+                    cIn,        cInStride,
+                    aIn,        aInStride,
+                    ti,         sizeof(ti[0]),
+                    qc.mTileInfo.mDT,
+                    &v
+                );
+            else
+                writeCount = nHL::WriteQuads
+                (
+                    count,
+                    positions,  positionStride,
+                    d0In, d1In, dInStride,
+                    cIn,        cInStride,
+                    aIn,        aInStride,
+                    &v
+                );
+
+            i += count;
+            quadsWritten += writeCount;
+
+            CL_ASSERT(i <= n);
+
+            ((uint8_t*&) ages)          += ageStride * count;
+            ((uint8_t*&) ageSteps)      += ageStride * count;
+
+            ((uint8_t*&) positions)     += positionStride * count;
+            ((uint8_t*&) velocities)    += velocityStride * count;
+
+            ((uint8_t*&) colours)       += colourStride * count;
+            ((uint8_t*&) alphas   )     += alphaStride * count;
+
+            ((uint8_t*&) sizes    )     += sizeStride * count;
+            ((uint8_t*&) rotations)     += rotationStride * count;
+            ((uint8_t*&) aspects  )     += aspectStride * count;
+
+            ((uint8_t*&) frames   )     += frameStride * count;
+        }
+
+        return quadsWritten;
+    }
+
+    void WriteQuadRanges(const cQuadsContext& qc, int numRanges, const cQuadRange ranges[], cQuadVertex* quads, bool parallel)
+    {
+        if (parallel && numRanges > 1)
+            ParallelFor(numRanges, 1,
+                [&qc, ranges, quads](int begin, int end)
+                {
+                    for (int i = begin; i < end; i++)
+                        WriteQuadsForRange(qc, ranges[i].mBegin, ranges[i].mEnd, quads + 4 * ranges[i].mQuad);
+                }
+            );
+        else
+            for (int i = 0; i < numRanges; i++)
+                WriteQuadsForRange(qc, ranges[i].mBegin, ranges[i].mEnd, quads + 4 * ranges[i].mQuad);
+    }
 }
 
-void nHL::DispatchParticles
+int nHL::WriteParticleQuads
 (
-    cIRenderer*         renderer,
-    int                 quadMesh,
+    int                 maxQuads,
+    cQuadVertex         quads[],
+    int*                particlesUsed,
 
     const cParticlesDispatchDesc& desc,
     const cTransform&   sourceToEffect,
@@ -1418,6 +1839,7 @@ void nHL::DispatchParticles
     const cTransform&   cameraToWorld,
 
     const cDispatchScale* dispatchScale,
+    bool                parallel,
 
     int                 particlesCount,
     const tPtAge        ages[],
@@ -1438,22 +1860,11 @@ void nHL::DispatchParticles
     CL_ASSERT(!(rotations == 0  && rotationStride != 0));
     CL_ASSERT(!(aspects == 0    && aspectStride != 0));
 
-    nHL::cQuadVertex* v;
-    int maxQuads = renderer->GetQuadBuffer(quadMesh, particlesCount, (uint8_t**) &v);
-    int quadsWritten = 0;
-    uint8_t startFrame = 0;
-
-    const int kPtBatchSize = 256;
+    cQuadsContext qc;
 
-    // intermediate storage
-    Vec3f c         [kPtBatchSize];
-    float a         [kPtBatchSize];
-    Vec3f d0        [kPtBatchSize];
-    Vec3f d1        [kPtBatchSize];
-    float scales    [kPtBatchSize];
-    float r         [kPtBatchSize];
-    float as        [kPtBatchSize];
-    cParticleTile ti[kPtBatchSize];
+    qc.mDesc            = &desc;
+    qc.mEffectToWorld   = &effectToWorld;
+    qc.mDispatchScale   = dispatchScale;
 
     // Defaults
     if (!alphas)
@@ -1461,252 +1872,614 @@ void nHL::DispatchParticles
     if (!colours)
         colours = &kDefaultAnimVec3f;
 
-    Vec3f axes[2];
-    FindParticleAxes(desc.mAlignment, sourceToEffect, effectToWorld, cameraToWorld, desc.mAlignDir, axes);
-    effectToWorld.Inverse().TransformDirections(CL_SIZE(axes), axes);
+    qc.mAges        = ages;         qc.mAgeSteps = ageSteps; qc.mAgeStride = ageStride;
+    qc.mPositions   = positions;    qc.mPositionStride  = positionStride;
+    qc.mVelocities  = velocities;   qc.mVelocityStride  = velocityStride;
+    qc.mColours     = colours;      qc.mColourStride    = colourStride;
+    qc.mAlphas      = alphas;       qc.mAlphaStride     = alphaStride;
+    qc.mSizes       = sizes;        qc.mSizeStride      = sizeStride;
+    qc.mRotations   = rotations;    qc.mRotationStride  = rotationStride;
+    qc.mAspects     = aspects;      qc.mAspectStride    = aspectStride;
+    qc.mFrames      = frames;       qc.mFrameStride     = frameStride;
+
+    FindParticleAxes(desc.mAlignment, sourceToEffect, effectToWorld, cameraToWorld, desc.mAlignDir, qc.mAxes);
+    effectToWorld.Inverse().TransformDirections(CL_SIZE(qc.mAxes), qc.mAxes);
+
+    qc.mDiagonals[0] = qc.mAxes[1] - qc.mAxes[0];
+    qc.mDiagonals[1] = qc.mAxes[1] + qc.mAxes[0];
+
+    qc.mTiled = InitParticleTileInfo(&qc.mTileInfo, desc.mTilesU, desc.mTilesV, desc.mTilesSpeed, desc.mTilesCount) != 0;
 
-    cParticleTileInfo tileInfo;
-    bool tiledParticles = InitParticleTileInfo(&tileInfo, desc.mTilesU, desc.mTilesV, desc.mTilesSpeed, desc.mTilesCount);
+    parallel = parallel && particlesCount > kQuadChunkSize && NumJobThreads() > 1;
 
-    for (int i = 0, n = particlesCount; ; )
+    // Carve the input into fixed-size chunks, and find where each chunk's
+    // quads start in the output. The chunking doesn't depend on 'parallel',
+    // so the output is identical either way.
+    cQuadRange ranges[kMaxQuadRanges];
+    int numRanges = 0;
+    int quadsWritten = 0;
+    int i = 0;
+
+    while (i < particlesCount && quadsWritten < maxQuads)
     {
-        int skippedParticles = 0;
+        int chunkEnd = min(i + kQuadChunkSize, particlesCount);
+        int available = maxQuads - quadsWritten;
+        int liveCount = 0;
+        int j = i;
+
+        const tPtAge* agesPeek = (const tPtAge*) ((const uint8_t*) ages + i * ageStride);
 
-        while (IsExpired(*ages))  // skip expired particles at the start
+        for ( ; j < chunkEnd; j++)
         {
-            ((uint8_t*&) ages) += ageStride;
-            skippedParticles++;
+            if (!IsExpired(*agesPeek))
+            {
+                if (liveCount == available)     // out of room, end the chunk here
+                    break;
 
-            if (++i == n)
-                break;
+                liveCount++;
+            }
+
+            ((uint8_t*&) agesPeek) += ageStride;
         }
 
-        if (i == n)
-            break;
+        ranges[numRanges].mBegin = i;
+        ranges[numRanges].mEnd   = j;
+        ranges[numRanges].mQuad  = quadsWritten;
+        numRanges++;
 
-        if (skippedParticles)
+        quadsWritten += liveCount;
+        i = j;
+
+        if (numRanges == kMaxQuadRanges)
         {
-            ((uint8_t*&) ageSteps)      += skippedParticles * ageStride;
+            WriteQuadRanges(qc, numRanges, ranges, quads, parallel);
+            numRanges = 0;
+        }
+    }
 
-            ((uint8_t*&) positions)     += skippedParticles * positionStride;
-            ((uint8_t*&) velocities)    += skippedParticles * velocityStride;
+    WriteQuadRanges(qc, numRanges, ranges, quads, parallel);
 
-            ((uint8_t*&) colours)       += skippedParticles * colourStride;
-            ((uint8_t*&) alphas   )     += skippedParticles * alphaStride;
+    *particlesUsed = i;
+    return quadsWritten;
+}
 
-            ((uint8_t*&) sizes    )     += skippedParticles * sizeStride;
-            ((uint8_t*&) rotations)     += skippedParticles * rotationStride;
-            ((uint8_t*&) aspects  )     += skippedParticles * aspectStride;
+void nHL::DispatchParticles
+(
+    cIRenderer*         renderer,
+    int                 quadMesh,
 
-            ((uint8_t*&) frames   )     += skippedParticles * frameStride;
-        }
+    const cParticlesDispatchDesc& desc,
+    const cTransform&   sourceToEffect,
+    const cTransform&   effectToWorld,
+    const cTransform&   cameraToWorld,
+
+    const cDispatchScale* dispatchScale,
+    bool                parallel,
+
+    int                 particlesCount,
+    const tPtAge        ages[],
+    const tPtAge        ageSteps[],     size_t ageStride,
+    const Vec3f         positions[],    size_t positionStride,
+    const Vec3f         velocities[],   size_t velocityStride,
+    const Vec3f         colours[],      size_t colourStride,
+    const float         alphas[],       size_t alphaStride,
+    const float         sizes[],        size_t sizeStride,
+    const float         rotations[],    size_t rotationStride,
+    const float         aspects[],      size_t aspectStride,
+    const uint8_t       frames[],       size_t frameStride
+)
+{
+    // Normally this is a single pass, we only go around again if the system
+    // has more particles than will fit in the quad mesh.
+    while (particlesCount > 0)
+    {
+        nHL::cQuadVertex* v;
+        int maxQuads = renderer->GetQuadBuffer(quadMesh, particlesCount, (uint8_t**) &v);
+        int used = 0;
+
+        int quadsWritten = WriteParticleQuads
+        (
+            maxQuads, v, &used,
+
+            desc,
+            sourceToEffect,
+            effectToWorld,
+            cameraToWorld,
+            dispatchScale,
+            parallel,
+
+            particlesCount,
+            ages, ageSteps,     ageStride,
+            positions,          positionStride,
+            velocities,         velocityStride,
+            colours,            colourStride,
+            alphas,             alphaStride,
+            sizes,              sizeStride,
+            rotations,          rotationStride,
+            aspects,            aspectStride,
+            frames,             frameStride
+        );
+
+        renderer->DispatchAndReleaseBuffer(quadMesh, quadsWritten);
+
+        if (used == 0)
+            break;
+
+        particlesCount -= used;
 
-        int count = min(n - i, maxQuads - quadsWritten);
-        count = min(count, kPtBatchSize);
-        const tPtAge* agesPeek = ages;
+        ((uint8_t*&) ages)          += ageStride * used;
+        ((uint8_t*&) ageSteps)      += ageStride * used;
 
-        for (int j = 0; j < count; j++)     // find max 'live' span
+        ((uint8_t*&) positions)     += positionStride * used;
+        ((uint8_t*&) velocities)    += velocityStride * used;
+
+        ((uint8_t*&) colours)       += colourStride * used;
+        ((uint8_t*&) alphas   )     += alphaStride * used;
+
+        ((uint8_t*&) sizes    )     += sizeStride * used;
+        ((uint8_t*&) rotations)     += rotationStride * used;
+        ((uint8_t*&) aspects  )     += aspectStride * used;
+
+        ((uint8_t*&) frames   )     += frameStride * used;
+    }
+}
+
+namespace
+{
+    // The quad expansion DispatchParticles used before WriteParticleQuads,
+    // writing successive quad buffers contiguously to 'v'. It's kept as a
+    // reference for TestParticleDispatch, with just its two known bugs fixed,
+    // marked "Fix" below.
+    int WriteParticleQuadsReference
+    (
+        int                 quadsPerBuffer,
+        cQuadVertex*        v,
+
+        const cParticlesDispatchDesc& desc,
+        const cTransform&   sourceToEffect,
+        const cTransform&   effectToWorld,
+        const cTransform&   cameraToWorld,
+
+        const cDispatchScale* dispatchScale,
+
+        int                 particlesCount,
+        const tPtAge        ages[],
+        const tPtAge        ageSteps[],     size_t ageStride,
+        const Vec3f         positions[],    size_t positionStride,
+        const Vec3f         velocities[],   size_t velocityStride,
+        const Vec3f         colours[],      size_t colourStride,
+        const float         alphas[],       size_t alphaStride,
+        const float         sizes[],        size_t sizeStride,
+        const float         rotations[],    size_t rotationStride,
+        const float         aspects[],      size_t aspectStride,
+        const uint8_t       frames[],       size_t frameStride
+    )
+    {
+        CL_ASSERT(!(colours == 0    && colourStride != 0));
+        CL_ASSERT(!(alphas == 0     && alphaStride != 0));
+        CL_ASSERT(!(sizes == 0      && sizeStride != 0));
+        CL_ASSERT(!(rotations == 0  && rotationStride != 0));
+        CL_ASSERT(!(aspects == 0    && aspectStride != 0));
+
+        cQuadVertex* vStart = v;
+        int maxQuads = quadsPerBuffer;
+        int quadsWritten = 0;
+
+        const int kPtBatchSize = 256;
+
+        // intermediate storage
+        Vec3f c         [kPtBatchSize];
+        float a         [kPtBatchSize];
+        Vec3f d0        [kPtBatchSize];
+        Vec3f d1        [kPtBatchSize];
+        float scales    [kPtBatchSize];
+        float r         [kPtBatchSize];
+        float as        [kPtBatchSize];
+        cParticleTile ti[kPtBatchSize];
+
+        // Defaults
+        if (!alphas)
+            alphas = &kDefaultAnimFloat;
+        if (!colours)
+            colours = &kDefaultAnimVec3f;
+
+        Vec3f axes[2];
+        FindParticleAxes(desc.mAlignment, sourceToEffect, effectToWorld, cameraToWorld, desc.mAlignDir, axes);
+        effectToWorld.Inverse().TransformDirections(CL_SIZE(axes), axes);
+
+        // Fix 1: convert the shared axes to diagonals once, rather than on every batch
+        Vec3f diagonals[2] = { axes[1] - axes[0], axes[1] + axes[0] };
+
+        cParticleTileInfo tileInfo;
+        bool tiledParticles = InitParticleTileInfo(&tileInfo, desc.mTilesU, desc.mTilesV, desc.mTilesSpeed, desc.mTilesCount);
+
+        for (int i = 0, n = particlesCount; ; )
         {
-            if (IsExpired(*agesPeek))
+            int skippedParticles = 0;
+
+            while (IsExpired(*ages))  // skip expired particles at the start
             {
-                count = j;
+                ((uint8_t*&) ages) += ageStride;
+                skippedParticles++;
+
+                if (++i == n)
+                    break;
+            }
+
+            if (i == n)
                 break;
+
+            if (skippedParticles)
+            {
+                ((uint8_t*&) ageSteps)      += skippedParticles * ageStride;
+
+                ((uint8_t*&) positions)     += skippedParticles * positionStride;
+                ((uint8_t*&) velocities)    += skippedParticles * velocityStride;
+
+                ((uint8_t*&) colours)       += skippedParticles * colourStride;
+                ((uint8_t*&) alphas   )     += skippedParticles * alphaStride;
+
+                ((uint8_t*&) sizes    )     += skippedParticles * sizeStride;
+                ((uint8_t*&) rotations)     += skippedParticles * rotationStride;
+                ((uint8_t*&) aspects  )     += skippedParticles * aspectStride;
+
+                ((uint8_t*&) frames   )     += skippedParticles * frameStride;
             }
 
-            ((uint8_t*&) agesPeek) += ageStride;
-        }
+            int count = min(n - i, maxQuads - quadsWritten);
+            count = min(count, kPtBatchSize);
+            const tPtAge* agesPeek = ages;
 
-        const Vec3f* cIn = colours;
-        size_t       cInStride = colourStride;
-        const float* aIn = alphas;
-        size_t       aInStride = alphaStride;
+            for (int j = 0; j < count; j++)     // find max 'live' span
+            {
+                if (IsExpired(*agesPeek))
+                {
+                    count = j;
+                    break;
+                }
 
-        if (tiledParticles)
-            FindTiles(tileInfo, count, frames, frameStride, ages, ageSteps, ageStride, ti);
+                ((uint8_t*&) agesPeek) += ageStride;
+            }
 
-        const float* sIn = sizes;
-        size_t sInStride = sizeStride;
+            const Vec3f* cIn = colours;
+            size_t       cInStride = colourStride;
+            const float* aIn = alphas;
+            size_t       aInStride = alphaStride;
 
-        if (!desc.mSizeFrames.empty())
-        {
-            ApplyLinearAnim(desc.mSizeFrames.size(), desc.mSizeFrames.data(), count, ages, ageStride, sIn, sInStride, scales);
-            sIn = scales;
-            sInStride = sizeof(scales[0]);
-        }
+            if (tiledParticles)
+                FindTiles(tileInfo, count, frames, frameStride, ages, ageSteps, ageStride, ti);
 
-        if (dispatchScale && dispatchScale->mSize != 1.0f)
-        {
-            ApplyScale(dispatchScale->mSize, count, sIn, sInStride, scales);
-            sIn = scales;
-            sInStride = sizeof(scales[0]);
-        }
+            const float* sIn = sizes;
+            size_t sInStride = sizeStride;
 
-        const float* asIn = aspects;
-        size_t asInStride = aspectStride;
+            if (!desc.mSizeFrames.empty())
+            {
+                ApplyLinearAnim(desc.mSizeFrames.size(), desc.mSizeFrames.data(), count, ages, ageStride, sIn, sInStride, scales);
+                sIn = scales;
+                sInStride = sizeof(scales[0]);
+            }
 
-        if (!desc.mAspectFrames.empty())
-        {
-            ApplyLinearAnim(desc.mAspectFrames.size(), desc.mAspectFrames.data(), count, ages, ageStride, asIn, asInStride, as);
+            if (dispatchScale && dispatchScale->mSize != 1.0f)
+            {
+                ApplyScale(dispatchScale->mSize, count, sIn, sInStride, scales);
+                sIn = scales;
+                sInStride = sizeof(scales[0]);
+            }
 
-            asIn = as;
-            asInStride = sizeof(as[0]);
-        }
+            const float* asIn = aspects;
+            size_t asInStride = aspectStride;
 
-        const Vec3f* d0In = &axes[0];
-        const Vec3f* d1In = &axes[1];
-        size_t dInStride = 0;
+            if (!desc.mAspectFrames.empty())
+            {
+                ApplyLinearAnim(desc.mAspectFrames.size(), desc.mAspectFrames.data(), count, ages, ageStride, asIn, asInStride, as);
 
-        const float* rIn = rotations;
-        size_t rInStride = rotationStride;
+                asIn = as;
+                asInStride = sizeof(as[0]);
+            }
 
-        if (!desc.mRotateFrames.empty())
-        {
-            ApplyLinearAnim(desc.mRotateFrames.size(), desc.mRotateFrames.data(), count, ages, ageStride, rIn, rInStride, r);
+            const Vec3f* d0In = &axes[0];
+            const Vec3f* d1In = &axes[1];
+            size_t dInStride = 0;
 
-            rIn = r;
-            rInStride = sizeof(r[0]);
-        }
+            const float* rIn = rotations;
+            size_t rInStride = rotationStride;
 
-        // TODO: didn't this used to interoperate with mRotateVary, so you could get +- (offset + abs(vary)) ?
-        if (desc.mRotateOffset != 0.0f)
-        {
-            ApplyDelta(desc.mRotateOffset, count, rIn, rInStride, r);
+            if (!desc.mRotateFrames.empty())
+            {
+                ApplyLinearAnim(desc.mRotateFrames.size(), desc.mRotateFrames.data(), count, ages, ageStride, rIn, rInStride, r);
 
-            rIn = r;
-            rInStride = sizeof(r[0]);
-        }
+                rIn = r;
+                rInStride = sizeof(r[0]);
+            }
+
+            // TODO: didn't this used to interoperate with mRotateVary, so you could get +- (offset + abs(vary)) ?
+            if (desc.mRotateOffset != 0.0f)
+            {
+                ApplyDelta(desc.mRotateOffset, count, rIn, rInStride, r);
 
-        ///////////////////////////////////////
+                rIn = r;
+                rInStride = sizeof(r[0]);
+            }
 
-        if (rIn)
-        {
-            ApplyRotations(count, d0In, d1In, dInStride, rIn, rInStride, d0, d1);
+            ///////////////////////////////////////
 
-            d0In = d0;
-            d1In = d1;
-            dInStride = sizeof(d0[0]);
-        }
+            if (rIn)
+            {
+                ApplyRotations(count, d0In, d1In, dInStride, rIn, rInStride, d0, d1);
 
-        if (sIn || asIn)
-        {
-            ApplyScalesAndAspects(count, d0In, d1In, dInStride, sIn ? sIn : &kDefaultAnimFloat, sInStride, asIn ? asIn : &kDefaultAnimFloat, asInStride, d0, d1);
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
 
-            d0In = d0;
-            d1In = d1;
-            dInStride = sizeof(d0[0]);
-        }
+            if (sIn || asIn)
+            {
+                ApplyScalesAndAspects(count, d0In, d1In, dInStride, sIn ? sIn : &kDefaultAnimFloat, sInStride, asIn ? asIn : &kDefaultAnimFloat, asInStride, d0, d1);
 
-        ////////////////////////////////////////
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
 
-        if (!desc.mColourFrames.empty())
-        {
-            ApplyLinearAnim(desc.mColourFrames.size(), desc.mColourFrames.data(), count, ages, ageStride,  cIn, cInStride, c);
-            cIn = c;
-            cInStride = sizeof(c[0]);
-        }
+            ////////////////////////////////////////
 
-        if (dispatchScale && dispatchScale->mColour != vl_1)
-        {
-            ApplyScale(dispatchScale->mColour, count, cIn, cInStride, c);
-            cIn = c;
-            cInStride = sizeof(c[0]);
-        }
+            if (!desc.mColourFrames.empty())
+            {
+                ApplyLinearAnim(desc.mColourFrames.size(), desc.mColourFrames.data(), count, ages, ageStride,  cIn, cInStride, c);
+                cIn = c;
+                cInStride = sizeof(c[0]);
+            }
 
-        if (!desc.mAlphaFrames.empty())
-        {
-            ApplyLinearAnim(desc.mAlphaFrames.size(), desc.mAlphaFrames.data(), count, ages, ageStride, aIn, aInStride, a);
-            aIn = a;
-            aInStride = sizeof(a[0]);
-        }
+            if (dispatchScale && dispatchScale->mColour != vl_1)
+            {
+                ApplyScale(dispatchScale->mColour, count, cIn, cInStride, c);
+                cIn = c;
+                cInStride = sizeof(c[0]);
+            }
 
-        if (dispatchScale && dispatchScale->mAlpha != 1.0f)
-        {
-            ApplyScale(dispatchScale->mAlpha, count, aIn, aInStride, a);
-            aIn = a;
-            aInStride = sizeof(a[0]);
-        }
+            if (!desc.mAlphaFrames.empty())
+            {
+                ApplyLinearAnim(desc.mAlphaFrames.size(), desc.mAlphaFrames.data(), count, ages, ageStride, aIn, aInStride, a);
+                aIn = a;
+                aInStride = sizeof(a[0]);
+            }
 
-        if (velocities && desc.mVelocityStretch != 0.0f)
-        {
-            ApplyVelocityStretch
-            (
-                desc.mVelocityStretch,
-                effectToWorld,
-                count,
-                velocities, velocityStride,
-                d0In, d1In, dInStride,
-                d0, d1
-            );
+            if (dispatchScale && dispatchScale->mAlpha != 1.0f)
+            {
+                ApplyScale(dispatchScale->mAlpha, count, aIn, aInStride, a);
+                aIn = a;
+                aInStride = sizeof(a[0]);
+            }
 
-            d0In = d0;
-            d1In = d1;
-            dInStride = sizeof(d0[0]);
-        }
+            if (velocities && desc.mVelocityStretch != 0.0f)
+            {
+                ApplyVelocityStretch
+                (
+                    desc.mVelocityStretch,
+                    effectToWorld,
+                    count,
+                    velocities, velocityStride,
+                    d0In, d1In, dInStride,
+                    d0, d1
+                );
+
+                d0In = d0;
+                d1In = d1;
+                dInStride = sizeof(d0[0]);
+            }
 
-        if (d0In == d0)
-            ConvertToDiagonals(count, d0In, d1In, dInStride, d0, d1);
-        else
-        {
-            Vec3f t = axes[1] - axes[0];
-            axes[1] = axes[1] + axes[0];
-            axes[0] = t;
+            if (d0In == d0)
+                ConvertToDiagonals(count, d0In, d1In, dInStride, d0, d1);
+            else
+            {
+                d0In = &diagonals[0];
+                d1In = &diagonals[1];
+            }
+
+            int writeCount;
+
+            if (tiledParticles)
+                writeCount = WriteQuads
+                (
+                    count,
+                    positions,  positionStride,
+                    d0In, d1In, dInStride,
+                    cIn,        cInStride,
+                    aIn,        aInStride,
+                    ti,         sizeof(ti[0]),
+                    tileInfo.mDT,
+                    &v
+                );
+            else
+                writeCount = WriteQuads
+                (
+                    count,
+                    positions,  positionStride,
+                    d0In, d1In, dInStride,
+                    cIn,        cInStride,
+                    aIn,        aInStride,
+                    &v
+                );
+
+            i += count;
+            quadsWritten += writeCount;
+
+            CL_ASSERT(i <= n);
+
+            if (i == n)
+                break;
+
+            ((uint8_t*&) ages)          += ageStride * count;
+            ((uint8_t*&) ageSteps)      += ageStride * count;
+
+            ((uint8_t*&) positions)     += positionStride * count;
+            ((uint8_t*&) velocities)    += velocityStride * count;
+
+            ((uint8_t*&) colours)       += colourStride * count;
+            ((uint8_t*&) alphas   )     += alphaStride * count;
+
+            ((uint8_t*&) sizes    )     += sizeStride * count;
+            ((uint8_t*&) rotations)     += rotationStride * count;
+            ((uint8_t*&) aspects  )     += aspectStride * count;
+
+            // Fix 2: advance the frames along with the other attributes
+            ((uint8_t*&) frames   )     += frameStride * count;
+
+            if (quadsWritten == maxQuads)   // the next buffer follows on directly in 'v'
+                quadsWritten = 0;
         }
 
-        int writeCount;
-
-        if (tiledParticles)
-            writeCount = nHL::WriteQuads
-            (
-                count,
-                positions,  positionStride,
-                d0In, d1In, dInStride,
-                cIn,        cInStride,
-                aIn,        aInStride,
-                ti,         sizeof(ti[0]),
-                tileInfo.mDT,
-                &v
-            );
-        else
-            writeCount = nHL::WriteQuads
-            (
-                count,
-                positions,  positionStride,
-                d0In, d1In, dInStride,
-                cIn,        cInStride,
-                aIn,        aInStride,
-                &v
-            );
+        return int(v - vStart) / 4;
+    }
+}
+
+bool nHL::TestParticleDispatch()
+{
+    const int kNumParticles = 20000;
+    const int kMaxQuads     = 4096;     // match the particle quad mesh, so we get multiple passes
+
+    vector<tPtAge>  ages        (kNumParticles);
+    vector<tPtAge>  ageSteps    (kNumParticles);
+    vector<Vec3f>   positions   (kNumParticles);
+    vector<Vec3f>   velocities  (kNumParticles);
+    vector<Vec3f>   colours     (kNumParticles);
+    vector<float>   alphas      (kNumParticles);
+    vector<float>   sizes       (kNumParticles);
+    vector<float>   rotations   (kNumParticles);
+    vector<uint8_t> frames      (kNumParticles);
+
+    tSeed32 seed = kDefaultSeed32;
+
+    for (int i = 0; i < kNumParticles; i++)
+    {
+        // runs of expired particles, plus scattered ones, to exercise chunk splitting
+        bool expired = (i % 5000) < 300 || RandomUFloat(&seed) < 0.1f;
+
+        ages[i]       = expired ? kPtAgeExpired : RandomUInt32(kPtAgeFractionMax - 1, &seed);
+        ageSteps[i]   = LifeToAgeStep(RandomRange(0.1f, 5.0f, &seed));
+        positions[i]  = Vec3f(RandomSFloat(10.0f, &seed), RandomSFloat(10.0f, &seed), RandomSFloat(10.0f, &seed));
+        velocities[i] = Vec3f(RandomSFloat(5.0f, &seed),  RandomSFloat(5.0f, &seed),  RandomSFloat(5.0f, &seed));
+        colours[i]    = Vec3f(RandomUFloat(&seed), RandomUFloat(&seed), RandomUFloat(&seed));
+        alphas[i]     = RandomUFloat(&seed);
+        sizes[i]      = RandomRange(0.1f, 4.0f, &seed);
+        rotations[i]  = RandomSFloat(2.0f, &seed);
+        frames[i]     = RandomUInt32(4, &seed);
+    }
 
-        i += count;
-        quadsWritten += writeCount;
+    cParticlesDispatchDesc desc;
+    desc.mTilesU = 4;
+    desc.mTilesV = 4;
+    desc.mTilesSpeed = 2.0f;
 
-        CL_ASSERT(i <= n);
+    cDispatchScale dispatchScale;
+    dispatchScale.mAlpha = 0.5f;
 
-        if (i == n)
-            break;
+    cTransform sourceToEffect;
+    cTransform effectToWorld;
+    cTransform cameraToWorld;
+    effectToWorld.mTranslation = Vec3f(1.0f, 2.0f, 3.0f);
+    cameraToWorld.mTranslation = Vec3f(0.0f, -20.0f, 5.0f);
+
+    vector<cQuadVertex> quads[3];   // serial, parallel, reference
+    bool match = true;
 
-        ((uint8_t*&) ages)          += ageStride * count;
-        ((uint8_t*&) ageSteps)      += ageStride * count;
+    // The SIMD kernels round the scalar tail of each batch a few ULPs differently,
+    // and batches now break at chunk boundaries, so the byte comparison with the
+    // old expansion uses the scalar code. Serial and parallel must match either way.
+    tParticleSIMD simd = ParticleSIMD();
 
-        ((uint8_t*&) positions)     += positionStride * count;
-        ((uint8_t*&) velocities)    += velocityStride * count;
+    for (int pass = 0; pass < 4; pass++)    // odd passes use the same shared axes for all particles
+    {
+        bool sharedAxes = (pass & 1) != 0;
+        bool scalar     = pass < 2;
+
+        desc.mSizeFrames.clear();
+        desc.mVelocityStretch = 0.0f;
 
-        ((uint8_t*&) colours)       += colourStride * count;
-        ((uint8_t*&) alphas   )     += alphaStride * count;
+        if (!sharedAxes)
+        {
+            desc.mVelocityStretch = 0.5f;
+            desc.mSizeFrames.push_back(1.0f);
+            desc.mSizeFrames.push_back(2.0f);
+        }
+
+        SetParticleSIMD(scalar ? kParticleSIMDNone : simd);
+
+        for (int p = 0; p < 3; p++)
+        {
+            quads[p].clear();
+            quads[p].resize(4 * kNumParticles);
+            memset(quads[p].data(), 0, quads[p].size() * sizeof(cQuadVertex));
+
+            if (p == 2)
+            {
+                if (scalar)
+                    WriteParticleQuadsReference
+                    (
+                        kMaxQuads, quads[p].data(),
+                        desc, sourceToEffect, effectToWorld, cameraToWorld,
+                        sharedAxes ? 0 : &dispatchScale,
+                        kNumParticles,
+                        ages.data(), ageSteps.data(), sizeof(tPtAge),
+                        positions.data(), sizeof(Vec3f),
+                        velocities.data(), sizeof(Vec3f),
+                        colours.data(), sizeof(Vec3f),
+                        alphas.data(), sizeof(float),
+                        sharedAxes ? 0 : sizes.data(),      sharedAxes ? 0 : sizeof(float),
+                        sharedAxes ? 0 : rotations.data(),  sharedAxes ? 0 : sizeof(float),
+                        0, 0,
+                        frames.data(), sizeof(uint8_t)
+                    );
+
+                continue;
+            }
+
+            cQuadVertex* v = quads[p].data();
+            int offset = 0;
+
+            while (offset < kNumParticles)
+            {
+                int used = 0;
+
+                int written = WriteParticleQuads
+                (
+                    kMaxQuads, v, &used,
+                    desc, sourceToEffect, effectToWorld, cameraToWorld,
+                    sharedAxes ? 0 : &dispatchScale,
+                    p == 1,
+                    kNumParticles - offset,
+                    ages.data() + offset, ageSteps.data() + offset, sizeof(tPtAge),
+                    positions.data() + offset, sizeof(Vec3f),
+                    velocities.data() + offset, sizeof(Vec3f),
+                    colours.data() + offset, sizeof(Vec3f),
+                    alphas.data() + offset, sizeof(float),
+                    sharedAxes ? 0 : sizes.data() + offset,     sharedAxes ? 0 : sizeof(float),
+                    sharedAxes ? 0 : rotations.data() + offset, sharedAxes ? 0 : sizeof(float),
+                    0, 0,
+                    frames.data() + offset, sizeof(uint8_t)
+                );
+
+                v += 4 * written;
+                offset += used;
+            }
+        }
 
-        ((uint8_t*&) sizes    )     += sizeStride * count;
-        ((uint8_t*&) rotations)     += rotationStride * count;
-        ((uint8_t*&) aspects  )     += aspectStride * count;
+        if (scalar && memcmp(quads[0].data(), quads[2].data(), quads[0].size() * sizeof(cQuadVertex)) != 0)
+        {
+            CL_LOG("Effects", "Dispatch doesn't match previous expansion in pass %d\n", pass);
+            match = false;
+        }
 
-        if (quadsWritten == maxQuads)
+        if (memcmp(quads[0].data(), quads[1].data(), quads[0].size() * sizeof(cQuadVertex)) != 0)
         {
-            renderer->DispatchAndReleaseBuffer(quadMesh, quadsWritten);
-            quadsWritten = 0;
-            maxQuads = renderer->GetQuadBuffer(quadMesh, n - i, (uint8_t**) &v);
+            CL_LOG("Effects", "Parallel dispatch mismatch in pass %d\n", pass);
+            match = false;
         }
     }
 
-    renderer->DispatchAndReleaseBuffer(quadMesh, quadsWritten);
+    SetParticleSIMD(simd);
+
+    return match;
 }
 
 
@@ -1731,7 +2504,26 @@ int nHL::WriteQuads
     cQuadVertex* v = *vertices;
     int written = 0;
 
-    for (int i = 0; i < count; i++)
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels
+        && IsDenseOrUniform(positionStride, sizeof(Vec3f))
+        && IsDenseOrUniform(dStride,        sizeof(Vec3f))
+        && IsDenseOrUniform(colourStride,   sizeof(Vec3f))
+        && IsDenseOrUniform(alphaStride,    sizeof(float))
+    )
+    {
+        written = kernels->mWriteQuads(count, positions, positionStride, d0s, d1s, dStride, colours, colourStride, alphas, alphaStride, 0, vl_0, v);
+
+        ((uint8_t*&) positions) += written * positionStride;
+        ((uint8_t*&) d0s)       += written * dStride;
+        ((uint8_t*&) d1s)       += written * dStride;
+        ((uint8_t*&) colours)   += written * colourStride;
+        ((uint8_t*&) alphas)    += written * alphaStride;
+        v += 4 * written;
+    }
+
+    for (int i = written; i < count; i++)
     {
         Vec3f p = *positions;
         cRGBA32 c = ColourAlphaToRGBA32(cColourAlpha(*colours, *alphas));
@@ -1787,7 +2579,28 @@ int nHL::WriteQuads
     cQuadVertex* v = *vertices;
     int written = 0;
 
-    for (int i = 0; i < count; i++)
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels
+        && IsDenseOrUniform(positionStride, sizeof(Vec3f))
+        && IsDenseOrUniform(dStride,        sizeof(Vec3f))
+        && IsDenseOrUniform(colourStride,   sizeof(Vec3f))
+        && IsDenseOrUniform(alphaStride,    sizeof(float))
+        && tileStride == sizeof(cParticleTile)
+    )
+    {
+        written = kernels->mWriteQuads(count, positions, positionStride, d0s, d1s, dStride, colours, colourStride, alphas, alphaStride, tiles, tw, v);
+
+        ((uint8_t*&) positions) += written * positionStride;
+        ((uint8_t*&) d0s)       += written * dStride;
+        ((uint8_t*&) d1s)       += written * dStride;
+        ((uint8_t*&) colours)   += written * colourStride;
+        ((uint8_t*&) alphas)    += written * alphaStride;
+        ((uint8_t*&) tiles)     += written * tileStride;
+        v += 4 * written;
+    }
+
+    for (int i = written; i < count; i++)
     {
         Vec3f p = *positions;
         cRGBA32 c = ColourAlphaToRGBA32(cColourAlpha(*colours, *alphas));
@@ -1842,7 +2655,20 @@ void nHL::UpdatePhysicsSimple
 )
 // No numerical integration is needed: the only forces are directional.
 {
-    for (int i = 0; i < count; i++)
+    int i = 0;
+
+    const cParticleKernels* kernels = ParticleKernels();
+
+    if (kernels && IsDenseOrUniform(dtStride, sizeof(float)) && positionStride == sizeof(Vec3f) && velocityStride == sizeof(Vec3f))
+    {
+        i = kernels->mUpdatePhysicsSimple(desc, count, dts, dtStride, positions, velocities);
+
+        ((uint8_t*&) dts)        += i * dtStride;
+        ((uint8_t*&) positions)  += i * positionStride;
+        ((uint8_t*&) velocities) += i * velocityStride;
+    }
+
+    for ( ; i < count; i++)
     {
         Vec3f& p = *positions;
 
@@ -23,11 +23,17 @@
 #include <CLInputState.h>
 #include <CLLog.h>
 #include <CLMatUtil.h>
+#include <CLMath.h>
 #include <CLMemory.h>
 #include <CLFileSpec.h>
 #include <CLString.h>
+#include <CLTimer.h>
 #include <CLValue.h>
 
+#if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+    #include <unistd.h>
+#endif
+
 using namespace nHL;
 using namespace nCL;
 
@@ -66,6 +72,8 @@ namespace
     const tTag kRenderLayerMain            = CL_TAG("main");
     const tTag kRenderLayerForeground      = CL_TAG("foreground");
 
+    const cConfigPath kWireframePath("wireframe");
+
     const cEnumInfo kShaderDataEnum[] =
     {
         "ModelToWorld",     kDataIDModelToWorld,    
@@ -158,16 +166,12 @@ namespace
         };
     }
 
-#ifdef TODO
-    // Still need to do the inverses.
-    kDataIDWorldToModel,
-    kDataIDCameraToWorld,
-    kDataIDClipToCamera,
+    template<tBuiltInShaderDataID T_SOURCE> void UpdateInverse(cIRenderer* renderer, size_t dataSize, void* dataOut)
+    {
+        CL_ASSERT(sizeof(Mat4f) <= dataSize);
 
-    kDataIDCameraToModel,
-    kDataIDClipToModel,
-    kDataIDClipToWorld,
-#endif
+        *reinterpret_cast<Mat4f*>(dataOut) = inv(renderer->ShaderDataT<Mat4f>(T_SOURCE));
+    }
 }
 
 namespace
@@ -918,6 +922,32 @@ bool cRenderer::Init()
         SetShaderDataUpdate(kDataIDModelToClip, UpdateModelToClip, CL_SIZE(deps), deps);
     }
 
+    // Inverses. As updates are done on demand, these cost nothing unless a shader uses them.
+    {
+        tShaderDataRef deps[] = { kDataIDModelToWorld };
+        SetShaderDataUpdate(kDataIDWorldToModel, UpdateInverse<kDataIDModelToWorld>, CL_SIZE(deps), deps);
+    }
+    {
+        tShaderDataRef deps[] = { kDataIDWorldToCamera };
+        SetShaderDataUpdate(kDataIDCameraToWorld, UpdateInverse<kDataIDWorldToCamera>, CL_SIZE(deps), deps);
+    }
+    {
+        tShaderDataRef deps[] = { kDataIDCameraToClip };
+        SetShaderDataUpdate(kDataIDClipToCamera, UpdateInverse<kDataIDCameraToClip>, CL_SIZE(deps), deps);
+    }
+    {
+        tShaderDataRef deps[] = { kDataIDModelToCamera };
+        SetShaderDataUpdate(kDataIDCameraToModel, UpdateInverse<kDataIDModelToCamera>, CL_SIZE(deps), deps);
+    }
+    {
+        tShaderDataRef deps[] = { kDataIDWorldToClip };
+        SetShaderDataUpdate(kDataIDClipToWorld, UpdateInverse<kDataIDWorldToClip>, CL_SIZE(deps), deps);
+    }
+    {
+        tShaderDataRef deps[] = { kDataIDModelToClip };
+        SetShaderDataUpdate(kDataIDClipToModel, UpdateInverse<kDataIDModelToClip>, CL_SIZE(deps), deps);
+    }
+
     {
         tShaderDataRef deps[] = { kDataIDViewSize, kDataIDDeviceOrient };
         SetShaderDataUpdate(kDataIDOrientedViewSize, UpdateOrientedViewSize, CL_SIZE(deps), deps);
@@ -987,6 +1017,15 @@ bool cRenderer::Shutdown()
     mMaterialTagToIndex.clear();
     mMaterials.clear();
 
+    if (mInstanceBuffer)
+    {
+        glDeleteBuffers(1, &mInstanceBuffer);
+        mInstanceBuffer = 0;
+    }
+
+    mInstances.clear();
+    mInstancesUploaded = 0;
+
     return true;
 }
 
@@ -1041,7 +1080,7 @@ void cRenderer::Update(float dt)
         for (int i = 0, n = removedRefs.size(); i < n; i++)
             CL_LOG("Config", "  Removed: %s\n", mDocumentsWatcher.PathForRef(removedRefs[i]));
 
-        set<int> materialsToReload;
+        set<int> materialsToReload;     // the watcher batches up changes, so we can reload straight away
 
         for (int i = 0, n = changedRefs.size(); i < n; i++)
         {
@@ -1050,16 +1089,10 @@ void cRenderer::Update(float dt)
             const auto range = mRefToMaterialIndexMap.equal_range(changedRefs[i]);
 
             for (auto it = range.first; it != range.second; ++it)
-            {
-                mMaterialsToReload.insert(it->second);
-                mMaterialReloadCounter = 10;
-            }
+                materialsToReload.insert(it->second);
         }
-    }
 
-    if (!mMaterialsToReload.empty() && --mMaterialReloadCounter == 0)
-    {
-        for (int i : mMaterialsToReload)
+        for (int i : materialsToReload)
         {
             cMaterial& material = mMaterials[i];
 
@@ -1077,8 +1110,6 @@ void cRenderer::Update(float dt)
                 GetBindingsFromProgram(material.mShaderProgram, &material.mTextureBindings);
             }
         }
-
-        mMaterialsToReload.clear();
     }
 
     mTime += dt;
@@ -1091,6 +1122,45 @@ void cRenderer::Update(float dt)
 
 void cRenderer::Render()
 {
+#if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+    if (mRecordFrame)
+    {
+        mRecordFrame = false;
+
+        // Pass-through, as our cached GL state (bound program etc.) must stay in sync with the driver
+        cGLRecorder recorder;
+        recorder.SetPassThrough(true);
+        recorder.Begin();
+        recorder.BeginFrame();
+
+        Render();
+
+        recorder.EndFrame();
+        recorder.End();
+
+        tString description;
+
+        for (int i = 0, n = recorder.NumCommands(); i < n; i++)
+        {
+            description.clear();
+            recorder.DescribeCommand(i, &description);
+            CL_LOG("GL", "%s\n", description.c_str());
+        }
+
+        description.clear();
+        recorder.DescribeCounters(recorder.FrameCounters(), &description);
+        CL_LOG("GL", "%s", description.c_str());
+        CL_LOG("GL", "shader data: %d uploads, %d skipped, %d updates\n", mShaderDataCounters.mUploads, mShaderDataCounters.mSkipped, mShaderDataCounters.mUpdates);
+        return;
+    }
+#endif
+
+    mLastShaderDataCounters = mShaderDataCounters;
+    mShaderDataCounters = cShaderDataCounters();
+
+    mInstances.clear();
+    mInstancesUploaded = 0;
+
     cRenderLayerState state;
 
     state.mFlags = mRenderFlags;
@@ -1099,7 +1169,7 @@ void cRenderer::Render()
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_CULL_FACE);
 
-    bool wireframe = HL()->mConfigManager->Preferences()->Member("wireframe").AsBool();
+    bool wireframe = kWireframePath.Find(HL()->mConfigManager->Preferences()).AsBool();
 
 #ifndef CL_GLES
     if (wireframe)
@@ -1154,6 +1224,7 @@ void cRenderer::Render()
                 state.mLayerTag = kDefaultLayers[i];
                 state.mLayerFlags = layerInfo->mFlags;
                 layerInfo->mLayer->Dispatch(this, state);
+                FlushDraws();
 
                 PopState("Layer");
             }
@@ -1265,7 +1336,7 @@ void cRenderer::SetRenderFlags(const cObjectValue* flagsV)
 
         auto it = mRenderFlagTags.find(tag);
 
-        if (it != 0)
+        if (it != mRenderFlagTags.end())
         {
             int flagIndex = it->second;
             bool flagValue = flagsV->MemberValue(i).AsBool();
@@ -1340,6 +1411,9 @@ void cRenderer::LoadMaterials(const cObjectValue* config)
         if (!info || MemberIsHidden(name))
             continue;
 
+        if (!mMaterialConfigs.Changed(info))
+            continue;
+
         CL_LOG("Renderer", "\nAdding material " CL_TAG_FMT "\n", tag);
 
         const char* vsName = info->Member("vertexShader").AsString();
@@ -1418,6 +1492,8 @@ void cRenderer::LoadMaterials(const cObjectValue* config)
         material.mRenderStates.clear();
         AddRenderStates(info, &material.mRenderStates);
 
+        material.mInstancedTag = info->Member("instanced").AsTag();
+
         material.mIsValid = true;
 
         // Now set up hotload
@@ -1451,6 +1527,7 @@ bool cRenderer::SetMaterial(int ref)
             return false;
 
         glUseProgram(material.mShaderProgram);
+        mCurrentProgram = material.mShaderProgram;
         GL_CHECK_DETAIL;
 
         if (!material.mRenderStates.empty())
@@ -1805,16 +1882,67 @@ bool cRenderer::SetShaderData(tShaderDataRef ref, size_t dataSize, const void* d
 
     void* dataDest = mShaderDataStore.Data(info.mOffset);
     memcpy(dataDest, data, dataSize);
+    info.mStamp = ++mShaderDataStamp;
+    info.mDirty = false;    // explicitly set data wins until its sources next change
+
+    // Derived data is recomputed when next used, which may well be never, e.g.,
+    // the many model-dependent matrices most shaders don't reference.
+    MarkDependentsDirty(info);
+
+    if (!mLazyShaderDataUpdates)
+        UpdateDependents(info);
+
+    return true;
+}
 
-    for (auto depDataID : info.mUpdateDependents)
+void cRenderer::MarkDependentsDirty(const cShaderDataInfo& info)
+{
+    for (auto depRef : info.mUpdateDependents)
     {
-        CL_INDEX(depDataID, mShaderData.size());
+        CL_INDEX(depRef, mShaderData.size());
+        cShaderDataInfo& depInfo = mShaderData[depRef];
 
-        if (mShaderData[depDataID].mUpdateFunc)
-            mShaderData[depDataID].mUpdateFunc(this, ShaderDataSize(depDataID), ShaderData(depDataID));
+        // If already dirty, so are its dependents.
+        if (depInfo.mUpdateFunc && !depInfo.mDirty)
+        {
+            depInfo.mDirty = true;
+            MarkDependentsDirty(depInfo);
+        }
     }
+}
 
-    return true;
+void cRenderer::UpdateDependents(const cShaderDataInfo& info)
+{
+    for (auto depRef : info.mUpdateDependents)
+    {
+        if (mShaderData[depRef].mDirty)
+        {
+            UpdateShaderData(depRef);
+            UpdateDependents(mShaderData[depRef]);
+        }
+    }
+}
+
+void cRenderer::UpdateShaderData(tShaderDataRef ref)
+{
+    CL_INDEX(ref, mShaderData.size());
+    cShaderDataInfo& info = mShaderData[ref];
+
+    if (!info.mDirty)
+        return;
+
+    info.mDirty = false;    // first, so a dependency cycle can't recurse forever
+
+    // Depth-first through our dependencies gives a topological order, so
+    // everything mUpdateFunc reads is current before it runs.
+    for (auto depRef : info.mUpdateDependencies)
+        if (mShaderData[depRef].mDirty)
+            UpdateShaderData(depRef);
+
+    info.mUpdateFunc(this, info.mSize, ShaderDataStorage(ref));
+    info.mStamp = ++mShaderDataStamp;
+
+    mShaderDataCounters.mUpdates++;
 }
 
 tShaderDataRef cRenderer::ShaderDataRefFromTag(tTag tag) const
@@ -1837,7 +1965,7 @@ tShaderDataRef cRenderer::AddShaderData(tTag tag)
     tShaderDataRef newRef = mShaderData.size();
     mShaderData.push_back();
 
-    mShaderDataTagToIndex.insert(it, { tag, newRef } );
+    mShaderDataTagToIndex.insert( { tag, newRef } );
 
     return newRef;
 }
@@ -1848,10 +1976,11 @@ void cRenderer::SetShaderDataUpdate(tShaderDataRef ref, tShaderDataUpdateFunc up
 
     cShaderDataInfo& info = mShaderData[ref];
 
-    info.mUpdateFunc = updateFunc;
+    for (auto depRef : info.mUpdateDependencies)
+        mShaderData[depRef].mUpdateDependents.erase(ref);
 
-    if (info.mUpdateFunc)
-        info.mUpdateFunc(this, ShaderDataSize(ref), ShaderData(ref));
+    info.mUpdateFunc = updateFunc;
+    info.mUpdateDependencies.assign(deps, deps + numDeps);
 
     for (int i = 0; i < numDeps; i++)
     {
@@ -1859,6 +1988,22 @@ void cRenderer::SetShaderDataUpdate(tShaderDataRef ref, tShaderDataUpdateFunc up
 
         mShaderData[deps[i]].mUpdateDependents.insert(ref);
     }
+
+    info.mDirty = false;
+
+    if (info.mUpdateFunc)
+    {
+        CL_ASSERT(info.mOffset != kNullDataOffset);     // set initial data first, to establish size
+
+        info.mDirty = true;
+        MarkDependentsDirty(info);
+
+        if (!mLazyShaderDataUpdates)
+        {
+            UpdateShaderData(ref);
+            UpdateDependents(info);
+        }
+    }
 }
 
 void cRenderer::SetShaderDataConfig(tShaderDataRef ref, tShaderDataConfigFunc f)
@@ -2345,6 +2490,208 @@ void cRenderer::DrawMesh(const cGLMeshInfo* meshInfo)
     DispatchMesh(meshInfo);
 }
 
+namespace
+{
+    // Draw key layout, from most to least significant bits:
+    //   pass:2 layer:8 translucent:1 material:12 texture:12 depth:29   opaque
+    //   pass:2 layer:8 translucent:1 depth:29 material:12 texture:12   translucent, depth inverted
+    const int kDrawKeyPassShift        = 62;
+    const int kDrawKeyLayerShift       = 54;
+    const int kDrawKeyTranslucentShift = 53;
+    const int kDrawKeyStateBits        = 24;
+    const int kDrawKeyDepthBits        = 29;
+
+    const uint64_t kDrawKeyStateMask = (1ULL << kDrawKeyStateBits) - 1;
+    const uint64_t kDrawKeyDepthMask = (1ULL << kDrawKeyDepthBits) - 1;
+
+    inline bool IsTranslucent(tDrawKey key)
+    {
+        return (key >> kDrawKeyTranslucentShift) & 1;
+    }
+
+    inline uint32_t DrawKeyState(tDrawKey key)
+    {
+        return IsTranslucent(key) ? (key & kDrawKeyStateMask) : ((key >> kDrawKeyDepthBits) & kDrawKeyStateMask);
+    }
+
+    void RadixSortDraws(vector<cQueuedDraw>* draws, vector<cQueuedDraw>* scratch)
+    /// LSD radix sort on the keys, a byte at a time. This is stable, so draws
+    /// with equal keys are issued in submission order.
+    {
+        size_t n = draws->size();
+        uint32_t counts[8][256] = { { 0 } };
+
+        for (const cQueuedDraw& draw : *draws)
+            for (int b = 0; b < 8; b++)
+                counts[b][(draw.mKey >> (8 * b)) & 0xFF]++;
+
+        scratch->resize(n);
+        cQueuedDraw* src = draws->data();
+        cQueuedDraw* dst = scratch->data();
+
+        for (int b = 0; b < 8; b++)
+        {
+            int shift = 8 * b;
+            uint32_t* bucketStart = counts[b];
+
+            // Keys often share whole bytes, e.g., pass and layer, in which case skip.
+            if (bucketStart[(src[0].mKey >> shift) & 0xFF] == n)
+                continue;
+
+            uint32_t sum = 0;
+
+            for (int i = 0; i < 256; i++)
+            {
+                uint32_t count = bucketStart[i];
+                bucketStart[i] = sum;
+                sum += count;
+            }
+
+            for (size_t i = 0; i < n; i++)
+                dst[bucketStart[(src[i].mKey >> shift) & 0xFF]++] = src[i];
+
+            swap(src, dst);
+        }
+
+        if (src != draws->data())
+            draws->swap(*scratch);
+    }
+}
+
+tDrawKey nHL::DrawKey(int pass, int layer, bool translucent, int material, int texture, float depth)
+{
+    CL_ASSERT(pass >= 0 && pass < 4);
+    CL_ASSERT(layer >= -128 && layer < 128);
+    CL_ASSERT(material >= 0 && material < 4096);
+    CL_ASSERT(texture >= -1 && texture < 4095);
+
+    uint64_t state     = (uint64_t(material) << 12) | uint64_t(texture + 1);
+    uint64_t depthBits = OrderedU32(depth) >> (32 - kDrawKeyDepthBits);
+
+    tDrawKey key = (uint64_t(pass) << kDrawKeyPassShift) | (uint64_t(layer + 128) << kDrawKeyLayerShift);
+
+    if (translucent)
+        key |= (1ULL << kDrawKeyTranslucentShift) | ((depthBits ^ kDrawKeyDepthMask) << kDrawKeyStateBits) | state;
+    else
+        key |= (state << kDrawKeyDepthBits) | depthBits;
+
+    return key;
+}
+
+int nHL::DrawKeyMaterial(tDrawKey key)
+{
+    return DrawKeyState(key) >> 12;
+}
+
+int nHL::DrawKeyTexture(tDrawKey key)
+{
+    return int(DrawKeyState(key) & 0xFFF) - 1;
+}
+
+void cRenderer::SubmitDraw(tDrawKey key, cIDrawSource* source, uint32_t item)
+{
+    mDrawQueue.push_back( { key, source, item } );
+}
+
+void cRenderer::FlushDraws()
+{
+    if (mDrawQueue.empty())
+    {
+        mInstances.clear();
+        mInstancesUploaded = 0;
+        return;
+    }
+
+    RadixSortDraws(&mDrawQueue, &mDrawQueueScratch);
+
+    int  material = -1;
+    int  texture = -1;
+    bool drawMaterial = false;
+
+    for (const cQueuedDraw& draw : mDrawQueue)
+    {
+        int drawTexture = DrawKeyTexture(draw.mKey);
+
+        if (DrawKeyMaterial(draw.mKey) != material)
+        {
+            material = DrawKeyMaterial(draw.mKey);
+            drawMaterial = SetMaterial(material);
+            texture = -1;   // materials may bind their own textures
+        }
+
+        if (!drawMaterial)
+            continue;
+
+        if (drawTexture != texture && drawTexture >= 0)
+        {
+            SetTexture(kTextureDiffuseMap, drawTexture);
+            texture = drawTexture;
+        }
+
+        draw.mSource->Draw(this, draw.mItem);
+    }
+
+    mDrawQueue.clear();
+
+    // Instance data only needs to last until the draws that reference it are issued
+    mInstances.clear();
+    mInstancesUploaded = 0;
+
+    // Clear back to invalid material
+    SetMaterial(0);
+}
+
+// Instancing
+
+int cRenderer::InstancedMaterialRef(int materialRef)
+{
+#ifdef CL_GL_INSTANCING
+    if (mInstancingEnabled && materialRef >= 0 && materialRef < mMaterials.size() && mMaterials[materialRef].mInstancedTag)
+    {
+        int ref = MaterialRefFromTag(mMaterials[materialRef].mInstancedTag);
+
+        if (ref > 0 && mMaterials[ref].mIsValid)
+            return ref;
+    }
+#endif
+
+    return 0;
+}
+
+int cRenderer::AddInstances(int count, const cDrawInstance instances[])
+{
+    int first = mInstances.size();
+    mInstances.insert(mInstances.end(), instances, instances + count);
+    return first;
+}
+
+void cRenderer::DrawMeshInstances(const cGLMeshInfo* meshInfo, int firstInstance, int count)
+{
+#ifdef CL_GL_INSTANCING
+    CL_ASSERT(firstInstance >= 0 && firstInstance + count <= int(mInstances.size()));
+
+    // Upload everything added since the last instanced draw in one go, which
+    // is normally just once a frame, as layers add all their instances up front.
+    if (mInstancesUploaded != int(mInstances.size()))
+    {
+        if (mInstanceBuffer == 0)
+        {
+            glGenBuffers(1, &mInstanceBuffer);
+            GL_DEBUG_LABEL(GL_BUFFER_OBJECT_EXT, mInstanceBuffer, "instanceVB");
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, mInstanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, mInstances.size() * sizeof(cDrawInstance), mInstances.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        mInstancesUploaded = mInstances.size();
+    }
+
+    SetStateForDispatch();
+    DispatchMeshInstances(meshInfo, mInstanceBuffer, firstInstance, count);
+#endif
+}
+
 // cRenderer
 
 void cRenderer::LoadRenderBuffers(const cObjectValue* config)
@@ -2611,7 +2958,7 @@ int cRenderer::RenderFlagFromTag(nCL::tTag tag) const
 {
     auto it = mRenderFlagTags.find(tag);
 
-    if (it != 0)
+    if (it != mRenderFlagTags.end())
         return it->second;
 
     return -1;
@@ -2996,6 +3343,7 @@ bool cRenderer::DispatchLayer(tTag layerTag, const cRenderLayerState& state, con
         childState.mLayerFlags = layerInfo->mFlags;
 
         layerInfo->mLayer->Dispatch(this, childState);
+        FlushDraws();
 
         PopState(label);
 
@@ -3013,6 +3361,8 @@ void cRenderer::ResetState()
 
     mCurrentCamera = 0;
     mCameraStack.clear();
+
+    mCurrentProgram = 0;
 }
 
 void cRenderer::PushState(const char* debugTag)
@@ -3037,9 +3387,13 @@ void cRenderer::SetStateForDispatch()
 {
     if (mCurrentMaterial >= 0)
     {
-        const cMaterial& material = mMaterials[mCurrentMaterial];
+        cMaterial& material = mMaterials[mCurrentMaterial];
 
-        glUseProgram(material.mShaderProgram);
+        if (material.mShaderProgram != mCurrentProgram)
+        {
+            glUseProgram(material.mShaderProgram);
+            mCurrentProgram = material.mShaderProgram;
+        }
 
         UploadShaderData(material.mShaderProgram, material.mShaderDataBindings);
         BindTextures(material.mShaderProgram, material.mTextureBindings);
@@ -3098,19 +3452,31 @@ void cRenderer::GetBindingsFromProgram(GLuint program, vector<cShaderDataBinding
     }
 }
 
-void cRenderer::UploadShaderData(GLuint program, const nCL::vector<cShaderDataBinding>& bindings)
+void cRenderer::UploadShaderData(GLuint program, nCL::vector<cShaderDataBinding>& bindings)
 {
     GL_CHECK;
 
     for (int i = 0, n = bindings.size(); i < n; i++)
     {
-        const cShaderDataBinding& binding = bindings[i];
+        cShaderDataBinding& binding = bindings[i];
         const cShaderDataInfo& info = mShaderData[binding.mDataRef];
 
-        // TODO: if stamp in shader data matches that in binding, don't re-upload
+        if (info.mDirty)
+            UpdateShaderData(binding.mDataRef);
+
         if (info.mOffset == kNullDataOffset)
             continue;
 
+        // Uniforms are per-program state, so if this program last saw this version of the data, it still has it.
+        if (mSkipUnchangedShaderData && binding.mStamp == info.mStamp)
+        {
+            mShaderDataCounters.mSkipped++;
+            continue;
+        }
+
+        binding.mStamp = info.mStamp;
+        mShaderDataCounters.mUploads++;
+
         const void* shaderData = mShaderDataStore.Data(info.mOffset);
         int count;
 
@@ -3278,6 +3644,629 @@ void cRenderer::DebugMenu(cUIState* uiState)
 
         uiState->EndSubMenu(id - 1);
     }
+
+    uiState->HandleToggle(id++, "Skip Unchanged Uniforms", &mSkipUnchangedShaderData);
+
+    uiState->HandleToggle(id++, "Lazy Shader Data", &mLazyShaderDataUpdates);
+
+    uiState->HandleToggle(id++, "Instancing", &mInstancingEnabled);
+
+    if (uiState->HandleButton(id++, "Log Uniform Uploads"))
+        CL_LOG("Renderer", "Last frame: %d uniform uploads, %d skipped, %d shader data updates\n", mLastShaderDataCounters.mUploads, mLastShaderDataCounters.mSkipped, mLastShaderDataCounters.mUpdates);
+
+#ifdef HL_GL_SHIM
+    if (uiState->HandleButton(id++, "Record GL Frame"))
+        mRecordFrame = true;
+    if (uiState->HandleButton(id++, "Test GL Recorder"))
+        CL_LOG("GL", "GL recorder test %s\n", TestGLRecorder() ? "passed" : "FAILED");
+    if (uiState->HandleButton(id++, "Test Uniform Skipping"))
+        CL_LOG("GL", "Uniform skipping test %s\n", TestShaderDataUploads(64) ? "passed" : "FAILED");
+    if (uiState->HandleButton(id++, "Bench Shader Data"))
+        BenchShaderDataUpdates(256);
+    if (uiState->HandleButton(id++, "Test Draw Queue"))
+        CL_LOG("GL", "Draw queue test %s\n", TestDrawQueue(512) ? "passed" : "FAILED");
+    if (uiState->HandleButton(id++, "Test Instanced Draws"))
+        CL_LOG("GL", "Instanced draw test %s\n", TestInstancedDraws(1000) ? "passed" : "FAILED");
+#endif
+}
+#endif
+
+#if defined(HL_GL_SHIM) && !defined(CL_RELEASE)
+
+// --- Test --------------------------------------------------------------------
+
+namespace
+{
+    const char* const kUploadTestVS =
+        "uniform mat4 modelToClip;\n"
+        "uniform mat4 modelToWorld;\n"
+        "uniform mat4 worldToClip;\n"
+        "uniform vec2 viewSize;\n"
+        "uniform float time;\n"
+        "attribute vec4 inPosition;\n"
+        "varying vec4 varyColour;\n"
+        "\n"
+        "void main()\n"
+        "{\n"
+        "    gl_Position = modelToClip * inPosition;\n"
+        "    varyColour = worldToClip * modelToWorld * inPosition + vec4(viewSize, time, 1.0);\n"
+        "}\n";
+
+    const char* const kUploadTestFS =
+        "uniform float pulse;\n"
+        "varying vec4 varyColour;\n"
+        "\n"
+        "void main()\n"
+        "{\n"
+        "    gl_FragColor = varyColour * pulse;\n"
+        "}\n";
+
+    const int kUploadTestMaterials = 4;
+    const int kUploadTestFrames    = 8;
+
+    bool WriteUploadTestFile(const char* path, const char* contents)
+    {
+        FILE* file = fopen(path, "w");
+
+        if (!file)
+            return false;
+
+        fputs(contents, file);
+        fclose(file);
+
+        return true;
+    }
+
+    bool CreateUploadTestShaders(tString* dir)
+    {
+        GetTempPath(dir);
+        *dir += "/uniformskip-XXXXXX";
+
+        if (!mkdtemp(&(*dir)[0]))
+            return false;
+
+        return WriteUploadTestFile((*dir + "/test.vsh").c_str(), kUploadTestVS)
+            && WriteUploadTestFile((*dir + "/test.fsh").c_str(), kUploadTestFS);
+    }
+
+    void RemoveUploadTestShaders(const tString& dir)
+    {
+        unlink((dir + "/test.vsh").c_str());
+        unlink((dir + "/test.fsh").c_str());
+        rmdir(dir.c_str());
+    }
+
+    struct cUniformShadow
+    /// Tracks the uniform values each program has been sent, from the recorder's log.
+    {
+        nCL::map<uint32_t, nCL::vector<uint8_t>> mValues;   ///< (program << 16) | location -> last value
+        GLuint mProgram = 0;
+        int    mScanned = 0;
+
+        void Scan(const cGLRecorder& recorder)
+        {
+            for (int n = recorder.NumCommands(); mScanned < n; mScanned++)
+            {
+                const cGLCommand& command = recorder.Command(mScanned);
+
+                if (command.mFunction == kGLFnUseProgram)
+                    mProgram = GLuint(recorder.CommandArg(mScanned, 0));
+                else if (GLFunctionKind(command.mFunction) == kGLCallUniform)
+                {
+                    size_t dataSize;
+                    const uint8_t* data = recorder.CommandData(mScanned, &dataSize);
+                    uint32_t key = (mProgram << 16) | uint32_t(recorder.CommandArg(mScanned, 0));
+
+                    mValues[key].assign(data, data + dataSize);
+                }
+            }
+        }
+
+        bool Matches(GLuint program, GLuint location, size_t dataSize, const void* data) const
+        {
+            auto it = mValues.find((program << 16) | location);
+
+            return it != mValues.end() && it->second.size() == dataSize && memcmp(it->second.data(), data, dataSize) == 0;
+        }
+    };
+}
+
+int cRenderer::AddTestMaterials(const char* dir, int count)
+{
+    tString vsPath(dir);
+    tString fsPath(dir);
+    vsPath += "/test.vsh";
+    fsPath += "/test.fsh";
+
+    int firstMaterial = mMaterials.size();
+
+    for (int i = 0; i < count; i++)
+    {
+        mMaterials.push_back();
+        cMaterial& material = mMaterials.back();
+
+        material.mShaderProgram = LoadShaders(vsPath.c_str(), fsPath.c_str(), 0, "test");
+
+        if (material.mShaderProgram == 0)
+            return -1;
+
+        GetBindingsFromProgram(material.mShaderProgram, &material.mShaderDataBindings);
+    }
+
+    return firstMaterial;
+}
+
+bool cRenderer::TestShaderDataUploads(int numModels)
+{
+    tString tempPath;
+
+    if (!CreateUploadTestShaders(&tempPath))
+    {
+        printf("Uniform skipping test: couldn't write shaders to %s\n", tempPath.c_str());
+        return false;
+    }
+
+    bool success = true;
+
+    cGLRecorder recorder;
+    recorder.Begin();
+
+    cRenderer renderer;
+    renderer.Init();
+
+    int firstMaterial = renderer.AddTestMaterials(tempPath.c_str(), kUploadTestMaterials);
+
+    if (firstMaterial < 0)
+    {
+        printf("Uniform skipping test: couldn't load shaders\n");
+        recorder.End();
+        RemoveUploadTestShaders(tempPath);
+        return false;
+    }
+
+    for (int i = firstMaterial, n = renderer.mMaterials.size(); i < n; i++)
+        success &= renderer.mMaterials[i].mShaderDataBindings.size() == 6;
+
+    renderer.SetShaderDataT<Vec2f>(kDataIDViewSize, Vec2f(1024, 768));
+    renderer.SetShaderDataT<float>(kDataIDPulse, 0.5f);
+
+    // Draw the same scene with and without skipping. Models are interleaved
+    // across materials, so every program switch is a chance to skip.
+    int uniformCalls[2] = { 0 };
+    cShaderDataCounters counters[2];
+
+    for (int skip = 0; skip < 2; skip++)
+    {
+        renderer.mSkipUnchangedShaderData = (skip != 0);
+        renderer.mShaderDataCounters = cShaderDataCounters();
+
+        for (int i = firstMaterial, n = renderer.mMaterials.size(); i < n; i++)
+            for (cShaderDataBinding& binding : renderer.mMaterials[i].mShaderDataBindings)
+                binding.mStamp = 0;     // as if freshly linked
+
+        cUniformShadow shadow;
+
+        for (int frame = 0; frame < kUploadTestFrames; frame++)
+        {
+            recorder.BeginFrame();
+            shadow.mScanned = 0;
+
+            Mat4f worldToCamera = vl_I;
+            worldToCamera(3, 2) = -10.0f - frame;
+
+            renderer.SetShaderDataT<Mat4f>(kDataIDWorldToCamera, worldToCamera);
+            renderer.SetShaderDataT<Mat4f>(kDataIDCameraToClip, Mat4f(vl_I));
+            renderer.SetShaderDataT<float>(kDataIDTime, frame / 60.0f);
+
+            for (int i = 0; i < numModels; i++)
+            {
+                Mat4f modelToWorld = vl_I;
+                modelToWorld(3, 0) = float(i);
+
+                renderer.SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
+                renderer.SetMaterial(firstMaterial + i % kUploadTestMaterials);
+                renderer.SetStateForDispatch();
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+
+                // Whatever was skipped, the program must hold the current data
+                const cMaterial& material = renderer.mMaterials[renderer.mCurrentMaterial];
+                shadow.Scan(recorder);
+
+                for (const cShaderDataBinding& binding : material.mShaderDataBindings)
+                    if (!shadow.Matches(material.mShaderProgram, binding.mLocation, renderer.ShaderDataSize(binding.mDataRef), renderer.ShaderData(binding.mDataRef)))
+                    {
+                        printf("Uniform skipping test: stale uniform %d in program %d, model %d, frame %d\n", binding.mLocation, material.mShaderProgram, i, frame);
+                        success = false;
+                    }
+            }
+
+            recorder.EndFrame();
+            uniformCalls[skip] += recorder.FrameCounters().mCallsOfKind[kGLCallUniform];
+        }
+
+        counters[skip] = renderer.mShaderDataCounters;
+    }
+
+    // Per-model matrices go up on every draw, per-frame data once per program
+    // per frame, and constant data once per program.
+    const int F = kUploadTestFrames;
+    const int M = kUploadTestMaterials;
+    const int N = numModels;
+
+    success &= uniformCalls[0] == F * N * 6 && counters[0].mUploads == uniformCalls[0] && counters[0].mSkipped == 0;
+    success &= uniformCalls[1] == F * N * 2 + F * M * 2 + M * 2 && counters[1].mUploads == uniformCalls[1];
+    success &= counters[1].mUploads + counters[1].mSkipped == uniformCalls[0];
+
+    // Only the derived data the shaders bind should be computed: modelToClip per draw, worldToClip per frame.
+    success &= counters[0].mUpdates == F * N + F && counters[1].mUpdates == F * N + F;
+
+    printf("%d models x %d frames: %d uniform calls without skipping, %d with (%d skipped, %.0f%% fewer)\n",
+        N, F, uniformCalls[0], uniformCalls[1], counters[1].mSkipped,
+        100.0f * (uniformCalls[0] - uniformCalls[1]) / max(uniformCalls[0], 1));
+
+    renderer.Shutdown();
+    recorder.End();
+
+    RemoveUploadTestShaders(tempPath);
+
+    return success;
+}
+
+void cRenderer::BenchShaderDataUpdates(int numModels)
+{
+    const int kBenchFrames = 100;
+
+    // Runs eager updates both without and with the inverse matrices, as the
+    // former is the derived set from before lazy updates were added.
+    const tShaderDataRef kInverseIDs[] =
+    {
+        kDataIDWorldToModel, kDataIDCameraToWorld, kDataIDClipToCamera,
+        kDataIDCameraToModel, kDataIDClipToWorld, kDataIDClipToModel
+    };
+
+    const int kNumBenchModes = 3;
+    const char* const kBenchModeNames[kNumBenchModes] = { "Eager (no inverses)", "Eager", "Lazy" };
+
+    tString tempPath;
+
+    if (!CreateUploadTestShaders(&tempPath))
+        return;
+
+    cGLRecorder recorder;
+    recorder.SetRecordCommands(false);
+    recorder.Begin();
+
+    for (int mode = 0; mode < kNumBenchModes; mode++)
+    {
+        cRenderer renderer;
+        renderer.Init();
+
+        renderer.mLazyShaderDataUpdates = (mode == 2);
+
+        if (mode == 0)
+            for (tShaderDataRef ref : kInverseIDs)
+                renderer.SetShaderDataUpdate(ref, 0, 0, 0);
+
+        int firstMaterial = renderer.AddTestMaterials(tempPath.c_str(), kUploadTestMaterials);
+
+        if (firstMaterial < 0)
+        {
+            renderer.Shutdown();
+            break;
+        }
+
+        uint64_t t0 = 0;
+
+        for (int frame = -1; frame < kBenchFrames; frame++)     // first frame is warm-up
+        {
+            if (frame == 0)
+            {
+                renderer.mShaderDataCounters = cShaderDataCounters();
+                t0 = AbsoluteTicks();
+            }
+
+            Mat4f worldToCamera = vl_I;
+            worldToCamera(3, 2) = -10.0f - frame;
+
+            renderer.SetShaderDataT<Mat4f>(kDataIDWorldToCamera, worldToCamera);
+            renderer.SetShaderDataT<float>(kDataIDTime, frame / 60.0f);
+
+            for (int i = 0; i < numModels; i++)
+            {
+                Mat4f modelToWorld = vl_I;
+                modelToWorld(3, 0) = float(i);
+
+                renderer.SetShaderDataT<Mat4f>(kDataIDModelToWorld, modelToWorld);
+                renderer.SetMaterial(firstMaterial + i % kUploadTestMaterials);
+                renderer.SetStateForDispatch();
+                glDrawArrays(GL_TRIANGLES, 0, 36);
+            }
+        }
+
+        uint64_t t1 = AbsoluteTicks();
+        int numDraws = kBenchFrames * numModels;
+
+        CL_LOG("Renderer", "%-19s shader data: %.1f ns per draw, %.2f updates per draw (%d models)\n",
+            kBenchModeNames[mode],
+            double(t1 - t0) / numDraws,
+            double(renderer.mShaderDataCounters.mUpdates) / numDraws,
+            numModels
+        );
+
+        renderer.Shutdown();
+    }
+
+    recorder.End();
+
+    RemoveUploadTestShaders(tempPath);
+}
+
+namespace
+{
+    struct cTestDrawSource : public cIDrawSource
+    {
+        nCL::vector<uint32_t> mDrawn;
+
+        void Draw(cIRenderer* renderer, uint32_t item) override
+        {
+            mDrawn.push_back(item);
+
+            static_cast<cRenderer*>(renderer)->SetStateForDispatch();
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+    };
+}
+
+bool cRenderer::TestDrawQueue(int numDraws)
+{
+    const int kNumTextures = 8;
+
+    tString tempPath;
+
+    if (!CreateUploadTestShaders(&tempPath))
+    {
+        printf("Draw queue test: couldn't write shaders to %s\n", tempPath.c_str());
+        return false;
+    }
+
+    bool success = true;
+
+    cGLRecorder recorder;
+    recorder.Begin();
+
+    cRenderer renderer;
+    renderer.Init();
+
+    int firstMaterial = renderer.AddTestMaterials(tempPath.c_str(), kUploadTestMaterials);
+
+    if (firstMaterial < 0)
+    {
+        printf("Draw queue test: couldn't load shaders\n");
+        recorder.End();
+        RemoveUploadTestShaders(tempPath);
+        return false;
+    }
+
+    // A mix of opaque and translucent draws, in the kind of arbitrary order layers find them in.
+    nCL::vector<tDrawKey> keys(numDraws);
+    nCL::vector<int> materials(numDraws);
+    nCL::vector<int> textures(numDraws);
+
+    for (int i = 0; i < numDraws; i++)
+    {
+        materials[i] = firstMaterial + i % kUploadTestMaterials;
+        textures [i] = 1 + (i / kUploadTestMaterials) % kNumTextures;
+
+        keys[i] = DrawKey(0, 0, i % 5 == 0, materials[i], textures[i], float((i * 37) % 101));
+
+        success &= DrawKeyMaterial(keys[i]) == materials[i] && DrawKeyTexture(keys[i]) == textures[i];
+    }
+
+    if (!success)
+        printf("Draw queue test: key fields don't round trip\n");
+
+    cTestDrawSource source;
+    cGLCounters counters[2];
+
+    for (int queued = 0; queued < 2; queued++)
+    {
+        recorder.BeginFrame();
+        renderer.ResetState();
+        source.mDrawn.clear();
+
+        if (queued)
+        {
+            for (int i = 0; i < numDraws; i++)
+                renderer.SubmitDraw(keys[i], &source, i);
+
+            renderer.FlushDraws();
+        }
+        else
+        {
+            // What layers used to do
+            for (int i = 0; i < numDraws; i++)
+                if (renderer.SetMaterial(materials[i]))
+                {
+                    renderer.SetTexture(kTextureDiffuseMap, textures[i]);
+                    source.Draw(&renderer, i);
+                }
+
+            renderer.SetMaterial(0);
+        }
+
+        recorder.EndFrame();
+        counters[queued] = recorder.FrameCounters();
+
+        success &= source.mDrawn.size() == numDraws && counters[queued].mDraws == numDraws;
+    }
+
+    // Queued draws must come out in key order, with ties in submission order
+    for (int i = 1; i < source.mDrawn.size(); i++)
+    {
+        uint32_t a = source.mDrawn[i - 1];
+        uint32_t b = source.mDrawn[i];
+
+        if (keys[a] > keys[b] || (keys[a] == keys[b] && a > b))
+        {
+            printf("Draw queue test: draw %d (key 0x%016llx) issued before %d (key 0x%016llx)\n", a, (unsigned long long) keys[a], b, (unsigned long long) keys[b]);
+            success = false;
+            break;
+        }
+    }
+
+    // Translucent draws go last, back to front
+    for (int i = 1, translucentSeen = 0; i < source.mDrawn.size(); i++)
+    {
+        uint32_t a = source.mDrawn[i - 1];
+        uint32_t b = source.mDrawn[i];
+
+        translucentSeen |= (a % 5 == 0);
+
+        if ((translucentSeen && b % 5 != 0) || (a % 5 == 0 && (a * 37) % 101 < (b * 37) % 101))
+        {
+            printf("Draw queue test: translucent draws out of order at %d\n", i);
+            success = false;
+            break;
+        }
+    }
+
+    int programCalls[2] = { counters[0].mCallsOfKind[kGLCallProgram], counters[1].mCallsOfKind[kGLCallProgram] };
+    int textureCalls[2] = { counters[0].mCallsOfKind[kGLCallTexture], counters[1].mCallsOfKind[kGLCallTexture] };
+
+    success &= programCalls[1] < programCalls[0] && textureCalls[1] < textureCalls[0];
+
+    printf("%d draws: program binds %d -> %d, texture calls %d -> %d, state changes %d -> %d\n",
+        numDraws,
+        programCalls[0], programCalls[1],
+        textureCalls[0], textureCalls[1],
+        counters[0].mStateChanges, counters[1].mStateChanges
+    );
+
+    renderer.Shutdown();
+    recorder.End();
+
+    RemoveUploadTestShaders(tempPath);
+
+    return success;
+}
+
+bool cRenderer::TestInstancedDraws(int numInstances)
+{
+    tString tempPath;
+
+    if (!CreateUploadTestShaders(&tempPath))
+    {
+        printf("Instanced draw test: couldn't write shaders to %s\n", tempPath.c_str());
+        return false;
+    }
+
+    bool success = true;
+
+    cGLRecorder recorder;
+    recorder.Begin();
+
+    cRenderer renderer;
+    renderer.Init();
+
+    int material = renderer.AddTestMaterials(tempPath.c_str(), 1);
+
+    if (material < 0)
+    {
+        printf("Instanced draw test: couldn't load shaders\n");
+        recorder.End();
+        RemoveUploadTestShaders(tempPath);
+        return false;
+    }
+
+    // Test materials have no instanced variant, so callers must draw them one by one
+    success &= renderer.InstancedMaterialRef(material) == 0;
+
+    cGLMeshInfo mesh;
+    glGenVertexArrays(1, &mesh.mMesh);
+    mesh.mNumElts = 36;
+    mesh.mEltType = GL_UNSIGNED_SHORT;
+
+    nCL::vector<cDrawInstance> instances(numInstances);
+    nCL::vector<Mat4f> modelToWorlds(numInstances);
+
+    for (int i = 0; i < numInstances; i++)
+    {
+        cTransform xform(1.0f + 0.01f * i, Vec3f(float(i % 10), float(i / 10 % 10), float(i / 100)));
+        xform.MakeMat4(&modelToWorlds[i]);
+
+        const Mat4f& m = modelToWorlds[i];
+
+        for (int j = 0; j < 3; j++)
+            instances[i].mModelToWorld[j] = Vec4f(m[0][j], m[1][j], m[2][j], m[3][j]);
+
+        // Instance rows must transform points the same way the matrix does
+        Vec4f p(1.0f, 2.0f, 3.0f, 1.0f);
+        Vec4f pm = p * m;
+
+        for (int j = 0; j < 3; j++)
+            success &= fabsf(dot(instances[i].mModelToWorld[j], p) - pm[j]) < 1e-3f;
+    }
+
+    if (!success)
+        printf("Instanced draw test: instance data doesn't match transforms\n");
+
+    cGLCounters counters[2];
+
+    for (int instanced = 0; instanced < 2; instanced++)
+    {
+        recorder.BeginFrame();
+        renderer.ResetState();
+
+        if (instanced)
+        {
+            int first = renderer.AddInstances(numInstances, instances.data());
+            success &= (first == 0);
+
+            if (renderer.SetMaterial(material))
+                renderer.DrawMeshInstances(&mesh, first, numInstances);
+
+            renderer.FlushDraws();
+
+            // Instances only live until the flush
+            success &= renderer.AddInstances(0, instances.data()) == 0;
+        }
+        else if (renderer.SetMaterial(material))
+        {
+            for (int i = 0; i < numInstances; i++)
+            {
+                renderer.SetShaderDataT(kDataIDModelToWorld, modelToWorlds[i]);
+                renderer.DrawMesh(&mesh);
+            }
+        }
+
+        renderer.SetMaterial(0);
+
+        recorder.EndFrame();
+        counters[instanced] = recorder.FrameCounters();
+    }
+
+#ifdef CL_GL_INSTANCING
+    success &= counters[0].mDraws == numInstances && counters[1].mDraws == 1;
+    success &= counters[0].mDrawElements == counters[1].mDrawElements;
+    success &= counters[1].mBufferBytes == numInstances * sizeof(cDrawInstance);
+#endif
+
+    printf("%d instances: draws %d -> %d, elements %d -> %d, uniform calls %d -> %d, buffer bytes %zu -> %zu\n",
+        numInstances,
+        counters[0].mDraws, counters[1].mDraws,
+        counters[0].mDrawElements, counters[1].mDrawElements,
+        counters[0].mCallsOfKind[kGLCallUniform], counters[1].mCallsOfKind[kGLCallUniform],
+        counters[0].mBufferBytes, counters[1].mBufferBytes
+    );
+
+    glDeleteVertexArrays(1, &mesh.mMesh);
+
+    renderer.Shutdown();
+    recorder.End();
+
+    RemoveUploadTestShaders(tempPath);
+
+    return success;
 }
 #endif
 
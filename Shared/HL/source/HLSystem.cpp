@@ -21,11 +21,14 @@
 #include <HLServices.h>
 
 #include <CLDirectories.h>
+#include <CLDispatch.h>
 #include <CLFileSpec.h>
 #include <CLImage.h>
 #include <CLLog.h>
 #include <CLMemory.h>
+#include <CLProfile.h>
 #include <CLSystemInfo.h>
+#include <CLTimer.h>
 
 #ifdef HL_LIB_UV
     #include "../../../External/LibUV/uv.h"
@@ -141,6 +144,8 @@ bool cSystem::Init()
 
     services->mConfigManager = mConfigManager;
 
+    InitJobs(alloc, mConfigManager->Config()->Member("jobThreads").AsInt(-1));
+
     //////////
 
 #ifndef CL_RELEASE
@@ -253,6 +258,8 @@ bool cSystem::Shutdown()
 
     ShutdownImageSystem();
 
+    ShutdownJobs();
+
     services->mConfigManager = 0;
     mConfigManager->Shutdown();
     mConfigManager = 0;
@@ -266,6 +273,8 @@ bool cSystem::Shutdown()
 
 void cSystem::Update(float dt, float gameDT)
 {
+    CL_PROFILE_SCOPE("System Update");
+
 #ifndef CL_RELEASE
     mDebugDraw->Clear();    // Prepare for a new tick.
 #endif
@@ -275,6 +284,8 @@ void cSystem::Update(float dt, float gameDT)
     uv_run(uv_default_loop(), UV_RUN_NOWAIT);
 #endif
     
+    RunMainThreadJobs();
+
     mConfigManager->Update();
 
     if (mConfigManager->ConfigModified())
@@ -312,6 +323,11 @@ void cSystem::Update(float dt, float gameDT)
 
 void cSystem::UpdateFromConfig()
 {
+    CL_PROFILE_SCOPE("Apply Config");
+
+    cWallClockTimer timer;
+    timer.Start();
+
 #ifdef CL_IOS
     const char* platformTag = CL_HIDDEN_VALUE_TAG("iOS");
 #elif defined(CL_OSX)
@@ -385,6 +401,8 @@ void cSystem::UpdateFromConfig()
         HL()->mAudioManager->LoadSounds(audioConfig);
         CL_LOG_I("Memory", "After audio load: %4.1f MB\n", UsedMemoryInMB());
     }
+
+    CL_LOG("Config", "Applied config in %.2f ms\n", timer.GetTime() * 1000.0f);
 }
 
 cISystem* nHL::CreateSystem(nCL::cIAllocator* alloc)